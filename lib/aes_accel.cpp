@@ -0,0 +1,287 @@
+/// \file aes_accel.cpp
+/// Hardware accelerated AES-128, using AES-NI on x86 or the cryptography extensions on ARMv8.
+/// The instructions are enabled per function, so the library runs on CPUs without them as well;
+/// available() tells whether they may be used. Independent blocks (CTR, CBC decryption) are
+/// processed AES_ACCEL_PIPELINE at a time, so the rounds of several blocks overlap in the CPU.
+
+#include "aes_accel.h"
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define AES_ACCEL_X86
+#include <cpuid.h>
+#include <emmintrin.h>
+#include <wmmintrin.h>
+#define ACCEL_TARGET __attribute__((target("aes,sse2")))
+#elif defined(__aarch64__)
+#define AES_ACCEL_ARM
+#include <arm_neon.h>
+#include <sys/auxv.h>
+#ifndef HWCAP_AES
+#define HWCAP_AES (1 << 3)
+#endif
+#define ACCEL_TARGET __attribute__((target("+crypto")))
+#endif
+
+#define AES_ACCEL_PIPELINE 8 // Blocks encrypted or decrypted at the same time
+
+namespace Encryption{
+  namespace Accel{
+
+#ifdef AES_ACCEL_X86
+    static bool detect(){
+      unsigned int a, b, c, d;
+      if (!__get_cpuid(1, &a, &b, &c, &d)){return false;}
+      return (c & bit_AES) && (d & bit_SSE2);
+    }
+
+    ACCEL_TARGET static inline __m128i keyStep(__m128i key, __m128i gen){
+      gen = _mm_shuffle_epi32(gen, 0xff);
+      key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+      key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+      key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+      return _mm_xor_si128(key, gen);
+    }
+
+    ACCEL_TARGET static void hwExpand(const char *key, char *encKeys, char *decKeys){
+      __m128i k[11];
+      k[0] = _mm_loadu_si128((const __m128i *)key);
+#define AES_EXPAND(i, rcon) k[i] = keyStep(k[i - 1], _mm_aeskeygenassist_si128(k[i - 1], rcon))
+      AES_EXPAND(1, 0x01);
+      AES_EXPAND(2, 0x02);
+      AES_EXPAND(3, 0x04);
+      AES_EXPAND(4, 0x08);
+      AES_EXPAND(5, 0x10);
+      AES_EXPAND(6, 0x20);
+      AES_EXPAND(7, 0x40);
+      AES_EXPAND(8, 0x80);
+      AES_EXPAND(9, 0x1b);
+      AES_EXPAND(10, 0x36);
+#undef AES_EXPAND
+      for (size_t i = 0; i < 11; ++i){_mm_storeu_si128((__m128i *)(encKeys + 16 * i), k[i]);}
+      // Equivalent inverse cipher: reversed order, with InvMixColumns applied to the inner keys
+      _mm_storeu_si128((__m128i *)decKeys, k[10]);
+      for (size_t i = 1; i < 10; ++i){
+        _mm_storeu_si128((__m128i *)(decKeys + 16 * i), _mm_aesimc_si128(k[10 - i]));
+      }
+      _mm_storeu_si128((__m128i *)(decKeys + 160), k[0]);
+    }
+
+#define AES_LOAD8(src)                                                                             \
+  b0 = _mm_loadu_si128((const __m128i *)(src));                                                    \
+  b1 = _mm_loadu_si128((const __m128i *)(src) + 1);                                                \
+  b2 = _mm_loadu_si128((const __m128i *)(src) + 2);                                                \
+  b3 = _mm_loadu_si128((const __m128i *)(src) + 3);                                                \
+  b4 = _mm_loadu_si128((const __m128i *)(src) + 4);                                                \
+  b5 = _mm_loadu_si128((const __m128i *)(src) + 5);                                                \
+  b6 = _mm_loadu_si128((const __m128i *)(src) + 6);                                                \
+  b7 = _mm_loadu_si128((const __m128i *)(src) + 7);
+#define AES_ROUND8(op, key)                                                                        \
+  b0 = op(b0, key);                                                                                \
+  b1 = op(b1, key);                                                                                \
+  b2 = op(b2, key);                                                                                \
+  b3 = op(b3, key);                                                                                \
+  b4 = op(b4, key);                                                                                \
+  b5 = op(b5, key);                                                                                \
+  b6 = op(b6, key);                                                                                \
+  b7 = op(b7, key);
+#define AES_STORE8(dest)                                                                           \
+  _mm_storeu_si128((__m128i *)(dest), b0);                                                         \
+  _mm_storeu_si128((__m128i *)(dest) + 1, b1);                                                     \
+  _mm_storeu_si128((__m128i *)(dest) + 2, b2);                                                     \
+  _mm_storeu_si128((__m128i *)(dest) + 3, b3);                                                     \
+  _mm_storeu_si128((__m128i *)(dest) + 4, b4);                                                     \
+  _mm_storeu_si128((__m128i *)(dest) + 5, b5);                                                     \
+  _mm_storeu_si128((__m128i *)(dest) + 6, b6);                                                     \
+  _mm_storeu_si128((__m128i *)(dest) + 7, b7);
+
+    /// Runs the rounds of the given keys over independent blocks, encrypting or decrypting.
+    /// Decryption needs the keys of the equivalent inverse cipher.
+    ACCEL_TARGET static void hwBlocks(const char *keys, const char *src, char *dest, size_t blocks, bool decrypt){
+      __m128i k[11];
+      for (size_t i = 0; i < 11; ++i){k[i] = _mm_loadu_si128((const __m128i *)(keys + 16 * i));}
+      __m128i b0, b1, b2, b3, b4, b5, b6, b7;
+      while (blocks >= AES_ACCEL_PIPELINE){
+        AES_LOAD8(src);
+        AES_ROUND8(_mm_xor_si128, k[0]);
+        if (decrypt){
+          for (size_t r = 1; r < 10; ++r){AES_ROUND8(_mm_aesdec_si128, k[r]);}
+          AES_ROUND8(_mm_aesdeclast_si128, k[10]);
+        }else{
+          for (size_t r = 1; r < 10; ++r){AES_ROUND8(_mm_aesenc_si128, k[r]);}
+          AES_ROUND8(_mm_aesenclast_si128, k[10]);
+        }
+        AES_STORE8(dest);
+        src += 16 * AES_ACCEL_PIPELINE;
+        dest += 16 * AES_ACCEL_PIPELINE;
+        blocks -= AES_ACCEL_PIPELINE;
+      }
+      for (; blocks; --blocks, src += 16, dest += 16){
+        b0 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)src), k[0]);
+        if (decrypt){
+          for (size_t r = 1; r < 10; ++r){b0 = _mm_aesdec_si128(b0, k[r]);}
+          b0 = _mm_aesdeclast_si128(b0, k[10]);
+        }else{
+          for (size_t r = 1; r < 10; ++r){b0 = _mm_aesenc_si128(b0, k[r]);}
+          b0 = _mm_aesenclast_si128(b0, k[10]);
+        }
+        _mm_storeu_si128((__m128i *)dest, b0);
+      }
+    }
+#undef AES_LOAD8
+#undef AES_ROUND8
+#undef AES_STORE8
+
+    const char *name(){return available() ? "AES-NI" : "none";}
+#endif
+
+#ifdef AES_ACCEL_ARM
+    static bool detect(){return getauxval(AT_HWCAP) & HWCAP_AES;}
+
+    /// Applies the AES S-box to every byte of w. With all columns equal, ShiftRows changes
+    /// nothing, so a single AESE round with a zero key does exactly that.
+    ACCEL_TARGET static uint32_t subWord(uint32_t w){
+      uint8x16_t b = vaeseq_u8(vreinterpretq_u8_u32(vdupq_n_u32(w)), vdupq_n_u8(0));
+      return vgetq_lane_u32(vreinterpretq_u32_u8(b), 0);
+    }
+
+    ACCEL_TARGET static void hwExpand(const char *key, char *encKeys, char *decKeys){
+      static const uint8_t rcon[10] ={0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36};
+      uint32_t w[44];
+      memcpy(w, key, 16);
+      for (size_t i = 4; i < 44; ++i){
+        uint32_t t = w[i - 1];
+        if (!(i % 4)){t = subWord((t >> 8) | (t << 24)) ^ rcon[i / 4 - 1];}
+        w[i] = w[i - 4] ^ t;
+      }
+      memcpy(encKeys, w, AES_ACCEL_KEYS);
+      // Equivalent inverse cipher: reversed order, with InvMixColumns applied to the inner keys
+      memcpy(decKeys, encKeys + 160, 16);
+      for (size_t i = 1; i < 10; ++i){
+        vst1q_u8((uint8_t *)decKeys + 16 * i, vaesimcq_u8(vld1q_u8((const uint8_t *)encKeys + 16 * (10 - i))));
+      }
+      memcpy(decKeys + 160, encKeys, 16);
+    }
+
+    /// Runs the rounds of the given keys over independent blocks, encrypting or decrypting.
+    /// Decryption needs the keys of the equivalent inverse cipher.
+    ACCEL_TARGET static void hwBlocks(const char *keys, const char *src, char *dest, size_t blocks, bool decrypt){
+      uint8x16_t k[11];
+      for (size_t i = 0; i < 11; ++i){k[i] = vld1q_u8((const uint8_t *)keys + 16 * i);}
+      while (blocks){
+        size_t n = blocks < AES_ACCEL_PIPELINE ? blocks : AES_ACCEL_PIPELINE;
+        uint8x16_t b[AES_ACCEL_PIPELINE];
+        for (size_t j = 0; j < n; ++j){b[j] = vld1q_u8((const uint8_t *)src + 16 * j);}
+        for (size_t r = 0; r < 9; ++r){
+          if (decrypt){
+            for (size_t j = 0; j < n; ++j){b[j] = vaesimcq_u8(vaesdq_u8(b[j], k[r]));}
+          }else{
+            for (size_t j = 0; j < n; ++j){b[j] = vaesmcq_u8(vaeseq_u8(b[j], k[r]));}
+          }
+        }
+        for (size_t j = 0; j < n; ++j){
+          b[j] = veorq_u8(decrypt ? vaesdq_u8(b[j], k[9]) : vaeseq_u8(b[j], k[9]), k[10]);
+          vst1q_u8((uint8_t *)dest + 16 * j, b[j]);
+        }
+        src += 16 * n;
+        dest += 16 * n;
+        blocks -= n;
+      }
+    }
+
+    const char *name(){return available() ? "ARMv8-CE" : "none";}
+#endif
+
+#if !defined(AES_ACCEL_X86) && !defined(AES_ACCEL_ARM)
+    static bool detect(){return false;}
+    static void hwExpand(const char *key, char *encKeys, char *decKeys){}
+    static void hwBlocks(const char *keys, const char *src, char *dest, size_t blocks, bool decrypt){}
+    const char *name(){return "none";}
+#endif
+
+    /// Returns true if this CPU supports the accelerated AES instructions.
+    bool available(){
+      static int avail = -1;
+      if (avail == -1){avail = detect() ? 1 : 0;}
+      return avail;
+    }
+
+    /// Expands a 16 byte key into AES_ACCEL_KEYS bytes of encryption and decryption round keys.
+    void expandKey(const char *key, char *encKeys, char *decKeys){hwExpand(key, encKeys, decKeys);}
+
+    /// Sets dest to a XOR b, for len bytes.
+    static inline void xorBytes(char *dest, const char *a, const char *b, size_t len){
+      while (len >= 8){
+        uint64_t x, y;
+        memcpy(&x, a, 8);
+        memcpy(&y, b, 8);
+        x ^= y;
+        memcpy(dest, &x, 8);
+        dest += 8;
+        a += 8;
+        b += 8;
+        len -= 8;
+      }
+      while (len--){*(dest++) = *(a++) ^ *(b++);}
+    }
+
+    /// Increases a 16 byte big-endian counter by one.
+    static inline void increaseCounter(char *counter){
+      for (int i = 15; i >= 0; --i){
+        if (++((uint8_t *)counter)[i]){return;}
+      }
+    }
+
+    /// Encrypts or decrypts len bytes in counter mode, starting at the given counter block.
+    /// The counter is left at the block after the last one used.
+    void cryptCTR(const char *encKeys, char *counter, const char *src, char *dest, size_t len){
+      char stream[16 * AES_ACCEL_PIPELINE];
+      while (len){
+        size_t blocks = (len + 15) / 16;
+        if (blocks > AES_ACCEL_PIPELINE){blocks = AES_ACCEL_PIPELINE;}
+        for (size_t i = 0; i < blocks; ++i){
+          memcpy(stream + 16 * i, counter, 16);
+          increaseCounter(counter);
+        }
+        hwBlocks(encKeys, stream, stream, blocks, false);
+        size_t bytes = len < 16 * blocks ? len : 16 * blocks;
+        xorBytes(dest, src, stream, bytes);
+        src += bytes;
+        dest += bytes;
+        len -= bytes;
+      }
+    }
+
+    /// Encrypts len bytes, a multiple of 16, in CBC mode. The ivec is left at the last encrypted
+    /// block, so the next call continues the chain.
+    void encryptCBC(const char *encKeys, char *ivec, const char *src, char *dest, size_t len){
+      char block[16];
+      for (; len >= 16; len -= 16, src += 16, dest += 16){
+        xorBytes(block, src, ivec, 16);
+        hwBlocks(encKeys, block, dest, 1, false);
+        memcpy(ivec, dest, 16);
+      }
+    }
+
+    /// Decrypts len bytes, a multiple of 16, in CBC mode. The ivec is left at the last decrypted
+    /// block, so the next call continues the chain. Decrypting in place is allowed.
+    void decryptCBC(const char *decKeys, char *ivec, const char *src, char *dest, size_t len){
+      char cipher[16 * AES_ACCEL_PIPELINE];
+      char plain[16 * AES_ACCEL_PIPELINE];
+      while (len >= 16){
+        size_t blocks = len / 16;
+        if (blocks > AES_ACCEL_PIPELINE){blocks = AES_ACCEL_PIPELINE;}
+        // Keep the ciphertext, the source may be overwritten
+        memcpy(cipher, src, 16 * blocks);
+        hwBlocks(decKeys, cipher, plain, blocks, true);
+        xorBytes(dest, plain, ivec, 16);
+        xorBytes(dest + 16, plain + 16, cipher, 16 * (blocks - 1));
+        memcpy(ivec, cipher + 16 * (blocks - 1), 16);
+        src += 16 * blocks;
+        dest += 16 * blocks;
+        len -= 16 * blocks;
+      }
+    }
+
+  }// namespace Accel
+}// namespace Encryption
@@ -0,0 +1,19 @@
+/// \file aes_accel.h
+/// Hardware accelerated AES-128, using AES-NI on x86 or the cryptography extensions on ARMv8.
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#define AES_ACCEL_KEYS 176 // Bytes of an expanded AES-128 key: 11 round keys of 16 bytes
+
+namespace Encryption{
+  namespace Accel{
+    const char *name();
+    bool available();
+    void expandKey(const char *key, char *encKeys, char *decKeys);
+    void cryptCTR(const char *encKeys, char *counter, const char *src, char *dest, size_t len);
+    void encryptCBC(const char *encKeys, char *ivec, const char *src, char *dest, size_t len);
+    void decryptCBC(const char *decKeys, char *ivec, const char *src, char *dest, size_t len);
+  }// namespace Accel
+}// namespace Encryption
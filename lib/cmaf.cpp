@@ -127,7 +127,7 @@ namespace CMAF{
     header.write(moovBox.asBox(), moovBox.boxedSize());
 
     if (M.getVod()){
-      DTSC::Fragments fragments(M.fragments(track));
+      DTSC::Fragments fragments(M.getFragments(track));
       DTSC::Keys keys(M.keys(track));
       DTSC::Parts parts(M.parts(track));
 
@@ -173,7 +173,7 @@ namespace CMAF{
   size_t keyHeaderSize(const DTSC::Meta &M, size_t track, size_t fragment){
     uint64_t tmpRes = 8 + 16 + 32 + 20;
 
-    DTSC::Fragments fragments(M.fragments(track));
+    DTSC::Fragments fragments(M.getFragments(track));
     DTSC::Keys keys(M.keys(track));
     DTSC::Parts parts(M.parts(track));
 
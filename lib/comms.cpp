@@ -6,6 +6,7 @@
 #include "timing.h"
 #include <fcntl.h>
 #include <string.h>
+#include <sys/file.h>
 #include <sstream>
 #include "config.h"
 
@@ -76,7 +77,16 @@ namespace Comms{
 
   size_t Comms::recordCount() const{
     if (!master){return index + 1;}
-    return dataAccX.getRCount();
+    size_t count = dataAccX.getRCount();
+    // Never go past the end of the mapped page, whatever its header claims
+    if (dataPage.mapped && dataAccX.getRSize() && dataPage.len > dataAccX.getOffset()){
+      size_t fit = (dataPage.len - dataAccX.getOffset()) / dataAccX.getRSize();
+      if (count > fit){count = fit;}
+    }
+    // Records are claimed from the start of the page onwards, so none past the last claimed one are in use
+    uint64_t endPos = dataAccX.getEndPos();
+    if (endPos && endPos < count){return endPos;}
+    return count;
   }
 
   uint8_t Comms::getStatus() const{return status.uint(index);}
@@ -114,6 +124,26 @@ namespace Comms{
     }while (keepGoing && ++c < 8);
   }
 
+  /// \brief Claims a free record the way non-master users do when reloading, but on a page opened in
+  /// master mode, for processes that keep records on behalf of others (such as MistSession).
+  /// Returns the index of the claimed record, or INVALID_RECORD_INDEX if none are free.
+  size_t Comms::claimRecord(){
+    if (!master || !dataPage){return INVALID_RECORD_INDEX;}
+    size_t reqCount = dataAccX.getRCount();
+    for (size_t i = 0; i < reqCount; ++i){
+      if (getStatus(i) != COMM_STATUS_INVALID){continue;}
+      IPC::semGuard G(&sem);
+      if (getStatus(i) != COMM_STATUS_INVALID){continue;}
+      index = i;
+      nullFields();
+      setStatus(COMM_STATUS_ACTIVE | defaultCommFlags);
+      if (dataAccX.getEndPos() <= i){dataAccX.setEndPos(i + 1);}
+      index = INVALID_RECORD_INDEX;
+      return i;
+    }
+    return INVALID_RECORD_INDEX;
+  }
+
   Comms::operator bool() const{
     if (master){return dataPage;}
     return dataPage && (getStatus() != COMM_STATUS_INVALID) && !(getStatus() & COMM_STATUS_DISCONNECT);
@@ -166,6 +196,7 @@ namespace Comms{
           if (getStatus() != COMM_STATUS_INVALID){continue;}
           nullFields();
           setStatus(COMM_STATUS_ACTIVE | defaultCommFlags);
+          if (dataAccX.getEndPos() <= index){dataAccX.setEndPos(index + 1);}
           break;
         }
       }
@@ -228,6 +259,111 @@ namespace Comms{
     tags.set(_sid, idx);
   }
 
+  SessionRequests::SessionRequests() : Comms(){sem.open(SEM_SESSTRACKER, O_CREAT | O_RDWR, ACCESSPERMS, 1);}
+
+  void SessionRequests::reload(bool _master, bool reIssue){
+    Comms::reload(COMMS_SESSTRACKER, COMMS_SESSTRACKER_INITSIZE, _master, reIssue);
+  }
+
+  /// \brief Opens the page without claiming a record. Returns false, without waiting for the page to
+  /// appear, if there is no page or no session tracker holding it.
+  bool SessionRequests::open(){
+    dataPage.init(COMMS_SESSTRACKER, 0, false, false);
+    if (!dataPage){return false;}
+    if (!isLocked()){
+      dataPage.close();
+      return false;
+    }
+    dataAccX = Util::RelAccX(dataPage.mapped);
+    if (!dataAccX.isReady()){
+      dataPage.close();
+      return false;
+    }
+    fieldAccess();
+    return true;
+  }
+
+  /// \brief Asks the session tracker to start keeping the given session.
+  /// Returns false if no session tracker is accepting requests, in which case the caller should start
+  /// a MistSession process for it instead.
+  bool SessionRequests::submit(const std::string &_sessId, const std::string &_stream, const std::string &_host,
+                               const std::string &_tkn, const std::string &_connector, const std::string &_reqUrl){
+    if (!open() || getExit()){return false;}
+    reload();
+    if (!*this){return false;}
+    stream.set(_stream, index);
+    host.set(_host, index);
+    tkn.set(_tkn, index);
+    connector.set(_connector, index);
+    reqUrl.set(_reqUrl, index);
+    sessId.set(_sessId, index);
+    // Disconnecting hands the request to the tracker, which frees the record after reading it
+    setStatus(COMM_STATUS_DISCONNECT | getStatus());
+    index = INVALID_RECORD_INDEX;
+    return true;
+  }
+
+  /// \brief Takes the lock that marks the session tracker as running, which it keeps until it exits.
+  /// Fails if another session tracker holds it already.
+  bool SessionRequests::lock(){
+    if (!dataPage){return false;}
+    return !flock(dataPage.handle, LOCK_EX | LOCK_NB);
+  }
+
+  /// \brief Returns true if a session tracker holds the lock on the page.
+  bool SessionRequests::isLocked(){
+    if (!dataPage){return false;}
+    if (flock(dataPage.handle, LOCK_SH | LOCK_NB)){return true;}
+    flock(dataPage.handle, LOCK_UN);
+    return false;
+  }
+
+  /// \brief Marks the page as no longer accepting requests, which makes the session tracker exit
+  /// once all its sessions have ended.
+  void SessionRequests::setExit(){
+    if (!dataPage){return;}
+    dataAccX.setExit();
+  }
+
+  bool SessionRequests::getExit(){return dataAccX.isExit();}
+
+  void SessionRequests::addFields(){
+    Comms::addFields();
+    dataAccX.addField("sessid", RAX_STRING, 80);
+    dataAccX.addField("stream", RAX_STRING, 100);
+    dataAccX.addField("host", RAX_STRING, 64);
+    dataAccX.addField("tkn", RAX_STRING, 256);
+    dataAccX.addField("connector", RAX_STRING, 64);
+    dataAccX.addField("requrl", RAX_STRING, 4096);
+  }
+
+  void SessionRequests::nullFields(){
+    Comms::nullFields();
+    sessId.set("", index);
+    stream.set("", index);
+    host.set("", index);
+    tkn.set("", index);
+    connector.set("", index);
+    reqUrl.set("", index);
+  }
+
+  void SessionRequests::fieldAccess(){
+    Comms::fieldAccess();
+    sessId = dataAccX.getFieldAccX("sessid");
+    stream = dataAccX.getFieldAccX("stream");
+    host = dataAccX.getFieldAccX("host");
+    tkn = dataAccX.getFieldAccX("tkn");
+    connector = dataAccX.getFieldAccX("connector");
+    reqUrl = dataAccX.getFieldAccX("requrl");
+  }
+
+  std::string SessionRequests::getSessId(size_t idx) const{return (master ? sessId.string(idx) : "");}
+  std::string SessionRequests::getStream(size_t idx) const{return (master ? stream.string(idx) : "");}
+  std::string SessionRequests::getHost(size_t idx) const{return (master ? host.string(idx) : "");}
+  std::string SessionRequests::getTkn(size_t idx) const{return (master ? tkn.string(idx) : "");}
+  std::string SessionRequests::getConnector(size_t idx) const{return (master ? connector.string(idx) : "");}
+  std::string SessionRequests::getReqUrl(size_t idx) const{return (master ? reqUrl.string(idx) : "");}
+
   Users::Users() : Comms(){}
 
   Users::Users(const Users &rhs) : Comms(){
@@ -298,6 +434,8 @@ namespace Comms{
 
 
 
+  Connections::Connections() : Comms(){trackerRequest = 0;}
+
   void Connections::reload(const std::string & sessId, bool _master, bool reIssue){
     // Open SEM_SESSION
     if(!sem){
@@ -312,8 +450,9 @@ namespace Comms{
   }
 
   /// \brief Claims a spot on the connections page for the input/output which calls this function
-  ///        Starts the MistSession binary for each session, which handles the statistics
-  ///         and the USER_NEW and USER_END triggers
+  ///        Hands each new session to the session tracker if one is running, or starts the
+  ///         MistSession binary for it otherwise. These handle the statistics and the USER_NEW
+  ///         and USER_END triggers
   /// \param streamName: Name of the stream the input is providing or an output is making available to viewers
   /// \param ip: IP address of the viewer which wants to access streamName. For inputs this value can be set to any value
   /// \param tkn: Session token given by the player or randomly generated
@@ -356,9 +495,27 @@ namespace Comms{
     // Check if the page exists, if not, spawn new session process
     if (!_master){
       dataPage.init(userPageName, 0, false, false);
-      if (!dataPage){
-        std::string host;
+      std::string host;
+      bool tracked = false;
+      if (dataPage){
+        trackerRequest = 0;
+      }else{
         Socket::hostBytesToStr(ip.data(), ip.size(), host);
+        uint64_t bootMs = Util::bootMS();
+        if (!trackerRequest){
+          SessionRequests req;
+          if (req.submit(sessionId, streamName, host, tkn, protocol, reqUrl)){
+            trackerRequest = bootMs;
+            tracked = true;
+          }
+        }else if (bootMs - trackerRequest < SESS_TRACKER_TIMEOUT * 1000){
+          // Still waiting for the session tracker to pick up the session
+          tracked = true;
+        }else{
+          WARN_MSG("Session tracker did not start session %s in time, starting MistSession instead", sessionId.c_str());
+        }
+      }
+      if (!dataPage && !tracked){
         pid_t thisPid;
         std::deque<std::string> args;
         args.push_back(Util::getMyPath() + "MistSession");
@@ -52,6 +52,7 @@ namespace Comms{
     void setPid(uint32_t _pid);
     void setPid(uint32_t _pid, size_t idx);
     void finishAll();
+    size_t claimRecord();
     void setMaster(bool _master);
     const std::string &pageName() const{return dataPage.name;}
 
@@ -68,6 +69,7 @@ namespace Comms{
 
   class Connections : public Comms{
   public:
+    Connections();
     void reload(const std::string & streamName, const std::string & ip, const std::string & tkn, const std::string & protocol, const std::string & reqUrl, bool _master = false, bool reIssue = false);
     void reload(const std::string & sessId, bool _master = false, bool reIssue = false);
     void unload();
@@ -155,6 +157,9 @@ namespace Comms{
     Util::FieldAccX pktcount;
     Util::FieldAccX pktloss;
     Util::FieldAccX pktretrans;
+
+  private:
+    uint64_t trackerRequest;
   };
 
   class Users : public Comms{
@@ -204,4 +209,38 @@ namespace Comms{
       void setTags(std::string _sid);
       void setTags(std::string _sid, size_t idx);
   };
+
+  /// Requests from inputs and outputs to the shared session tracker (MistSession --tracker) to start
+  /// keeping a session, instead of starting a MistSession process for it.
+  /// The tracker holds an exclusive lock on the page for as long as it accepts requests.
+  class SessionRequests : public Comms{
+    public:
+      SessionRequests();
+      void reload(bool _master = false, bool reIssue = false);
+      bool open();
+      bool submit(const std::string &_sessId, const std::string &_stream, const std::string &_host,
+                  const std::string &_tkn, const std::string &_connector, const std::string &_reqUrl);
+      bool lock();
+      bool isLocked();
+      void setExit();
+      bool getExit();
+      virtual void addFields();
+      virtual void nullFields();
+      virtual void fieldAccess();
+
+      std::string getSessId(size_t idx) const;
+      std::string getStream(size_t idx) const;
+      std::string getHost(size_t idx) const;
+      std::string getTkn(size_t idx) const;
+      std::string getConnector(size_t idx) const;
+      std::string getReqUrl(size_t idx) const;
+
+    private:
+      Util::FieldAccX sessId;
+      Util::FieldAccX stream;
+      Util::FieldAccX host;
+      Util::FieldAccX tkn;
+      Util::FieldAccX connector;
+      Util::FieldAccX reqUrl;
+  };
 }// namespace Comms
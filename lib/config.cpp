@@ -563,6 +563,80 @@ int Util::Config::serveForkedSocket(int (*callback)(Socket::Connection &S)){
   return r;
 }
 
+/// Serves the listening socket from a fixed pool of pre-forked worker processes.
+/// Each worker receives the (non-blocking) server socket and is expected to accept and handle any
+/// number of connections on its own, returning only when it is done.
+/// Workers that exit while the config is still active are restarted.
+/// \param workers Amount of worker processes to run. Zero means one worker per CPU core.
+/// \param worker Function each worker process runs.
+/// \param unixPath If non-empty, listens on this Unix socket path instead of the configured port.
+int Util::Config::serveWorkerSocket(size_t workers, int (*worker)(Socket::Server &S), const std::string &unixPath){
+  Socket::Server server_socket;
+  if (unixPath.size()){
+    server_socket = Socket::Server(unixPath, true);
+  }else if (Socket::checkTrueSocket(0)){
+    server_socket = Socket::Server(0);
+  }else if (vals.isMember("socket")){
+    server_socket = Socket::Server(Util::getTmpFolder() + getString("socket"));
+  }else if (vals.isMember("port") && vals.isMember("interface")){
+    server_socket = Socket::Server(getInteger("port"), getString("interface"), false);
+  }
+  if (!server_socket.connected()){
+    DEVEL_MSG("Failure to open socket");
+    return 1;
+  }
+  Socket::getSocketName(server_socket.getSocket(), Util::listenInterface, Util::listenPort);
+  serv_sock_pointer = &server_socket;
+  activate();
+  if (server_socket.getSocket() && !unixPath.size()){
+    int oldSock = server_socket.getSocket();
+    if (!dup2(oldSock, 0)){
+      server_socket = Socket::Server(0);
+      close(oldSock);
+    }
+  }
+  server_socket.setBlocking(false);
+  if (!workers){
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    workers = (cores > 0) ? cores : 1;
+  }
+  Util::Procs::socketList.insert(server_socket.getSocket());
+  std::set<pid_t> pool;
+  while (is_active && server_socket.connected()){
+    // Forget about any workers that are no longer running
+    for (std::set<pid_t>::iterator it = pool.begin(); it != pool.end();){
+      if (kill(*it, 0) && errno == ESRCH){
+        WARN_MSG("Worker process %d exited", (int)*it);
+        pool.erase(it++);
+      }else{
+        ++it;
+      }
+    }
+    while (pool.size() < workers && is_active){
+      pid_t myid = fork();
+      if (myid == 0){
+        serv_sock_pointer = 0;
+        int r = worker(server_socket);
+        server_socket.drop();
+        return r;
+      }
+      if (myid < 0){
+        FAIL_MSG("Could not fork worker process: %s", strerror(errno));
+        break;
+      }
+      HIGH_MSG("Forked worker process %i for socket %i", (int)myid, server_socket.getSocket());
+      pool.insert(myid);
+    }
+    Util::sleep(500);
+  }
+  for (std::set<pid_t>::iterator it = pool.begin(); it != pool.end(); ++it){kill(*it, SIGTERM);}
+  Util::Procs::socketList.erase(server_socket.getSocket());
+  if (!is_restarting){server_socket.close();}
+  if (unixPath.size()){unlink(unixPath.c_str());}
+  serv_sock_pointer = 0;
+  return 0;
+}
+
 /// Activated the stored config. This will:
 /// - Drop permissions to the stored "username", if any.
 /// - Set is_active to true.
@@ -58,6 +58,7 @@ namespace Util{
     int forkServer(Socket::Server &server_socket, int (*callback)(Socket::Connection &S));
     int serveThreadedSocket(int (*callback)(Socket::Connection &S));
     int serveForkedSocket(int (*callback)(Socket::Connection &S));
+    int serveWorkerSocket(size_t workers, int (*worker)(Socket::Server &S), const std::string &unixPath = "");
     int servePlainSocket(int (*callback)(Socket::Connection &S));
     void addOptionsFromCapabilities(const JSON::Value &capabilities);
     void addBasicConnectorOptions(JSON::Value &capabilities);
@@ -207,6 +207,9 @@ static inline void show_stackframe(){}
 #define COMMS_SESSIONS "/MstSession%s"
 #define COMMS_SESSIONS_INITSIZE 8 * 1024 * 1024
 
+#define COMMS_SESSTRACKER "/MstSessTracker"
+#define COMMS_SESSTRACKER_INITSIZE 4 * 1024 * 1024
+
 #define CUSTOM_VARIABLES_INITSIZE 64 * 1024
 
 #define EXTWRITERS "/MstExtWriters"
@@ -235,12 +238,27 @@ static inline void show_stackframe(){}
 #define STRMSTAT_INVALID 255
 
 #define SHM_TRIGGER "/MstTRGR%s" //%s trigger name
+#define SHM_TRIGGER_CACHE "/MstTrigCache"
+#define SHM_TRIGGER_CACHE_SIZE 8 * 1024 * 1024
+#define SEM_TRIGGER_CACHE "/MstTrigCacheLock"
+#define TRIGGER_CACHE_PROBE 8 // Records searched for a cached trigger response
+#define TRIGGER_ASYNC_QUEUE 1000 // Asynchronous triggers queued per process before sending them directly
+#define TRIGGER_ASYNC_ATTEMPTS 5 // Attempts to deliver an asynchronous trigger before giving up
+#define TRIGGER_ASYNC_BATCH 64 // Asynchronous triggers sent over a connection before reading the responses
+#define SHM_SEGCACHE "/MstSegC%s" //%s stream name
+#define SHM_SEGCACHE_DATA "/MstSegD%s@%zu_%" PRIu64 //%s stream name, %zu entry, %PRIu64 generation
+#define SEM_SEGCACHE "/MstSegCLock%s" //%s stream name
+#define SEGCACHE_ENTRIES 64 // Segments kept in the shared segment cache per stream
+#define SEGCACHE_HEADER 32 // Bytes of counters in front of the shared segment cache entries
 #define SEM_LIVE "/MstLIVE%s"   //%s stream name
 #define SEM_INPUT "/MstInpt%s"  //%s stream name
 #define SEM_TRACKLIST "/MstTRKS%s"  //%s stream name
 #define SEM_SESSION "/MstSess%s"
 #define SEM_SESSCACHE "/MstSessCacheLock"
+#define SEM_SESSTRACKER "/MstSessTrackerLock"
 #define SESS_TIMEOUT 600 // Session timeout in seconds
+#define SESS_TRACKER_TIMEOUT 5 // Seconds to wait for the session tracker before starting MistSession instead
+#define MULTI_SEND_TIMEOUT 30 // Seconds a multiplexed worker waits for a connection to accept data before dropping it
 #define SHM_CAPA "/MstCapa"
 #define SHM_PROTO "/MstProt"
 #define SHM_PROXY "/MstProx"
@@ -286,6 +304,7 @@ static inline void show_stackframe(){}
 #define COMM_STATUS_DISCONNECT 0x20
 #define COMM_STATUS_REQDISCONNECT 0x10
 #define COMM_STATUS_NOKILL 0x8
+#define COMM_STATUS_REQINVALIDATE 0x4
 #define COMM_STATUS_ACTIVE 0x1
 #define COMM_STATUS_INVALID 0x0
 #define SESS_BUNDLE_DEFAULT_VIEWER 14
@@ -10,6 +10,7 @@ namespace HTTP{
     connectedPort = 0;
     dataTimeout = 5;
     retryCount = 5;
+    isComplete = false;
     ssl = false;
     proxied = false;
     sPtr = 0;
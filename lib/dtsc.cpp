@@ -37,6 +37,7 @@ namespace DTSC{
     master = false;
     version = DTSC_INVALID;
     prevNalSize = 0;
+    indexed = false;
   }
 
   /// Copy constructor for packets, copies an existing packet with same noCopy flag as original.
@@ -44,6 +45,7 @@ namespace DTSC{
     master = false;
     bufferLen = 0;
     data = NULL;
+    indexed = false;
     if (rhs.data && rhs.dataLen){
       reInit(rhs.data, rhs.dataLen);
       if (idx != INVALID_TRACK_ID){Bit::htobl(data + 8, idx);}
@@ -57,6 +59,7 @@ namespace DTSC{
     master = false;
     bufferLen = 0;
     data = NULL;
+    indexed = false;
     reInit(data_, len, noCopy);
   }
 
@@ -112,6 +115,7 @@ namespace DTSC{
     bufferLen = 0;
     dataLen = 0;
     version = DTSC_INVALID;
+    indexed = false;
   }
 
   /// Internally used resize function for when operating in copy mode and the internal buffer is too
@@ -132,25 +136,26 @@ namespace DTSC{
   void Packet::reInit(Socket::Connection &src){
     int sleepCount = 0;
     null();
-    Util::ResizeablePointer ptr;
+    Socket::Buffer &buf = src.Received();
     while (src.connected()){
-      if (!ptr.rsize() && src.Received().available(8)){
-        if (src.Received().copy(2) != "DT"){
+      const char *head = buf.peek(8);
+      if (head){
+        if (head[0] != 'D' || head[1] != 'T'){
           WARN_MSG("Invalid DTSC Packet header encountered (%s)",
-                   Encodings::Hex::encode(src.Received().copy(4)).c_str());
+                   Encodings::Hex::encode(std::string(head, 4)).c_str());
           break;
         }
-        ptr.allocate(Bit::btohl(src.Received().copy(8).data() + 4) + 8);
-      }
-      unsigned int readable = src.Received().bytes(ptr.rsize() - ptr.size());
-      if (ptr.rsize() && readable){
-        src.Received().remove(ptr, readable);
-        if (ptr.size() == ptr.rsize()){
-          reInit(ptr, ptr.size());
+        // Copy the packet straight out of the receive buffer once it is complete
+        size_t len = Bit::btohl(head + 4) + 8;
+        const char *pkt = buf.peek(len);
+        if (pkt){
+          reInit(pkt, len);
+          buf.consume(len);
           return;
         }
       }
-      if (!src.spool()){
+      // Strict mode, since a large packet may need more data than is normally buffered
+      if (!src.spool(true)){
         if (sleepCount++ > 750){
           WARN_MSG("Waiting for packet on connection timed out");
           return;
@@ -198,6 +203,7 @@ namespace DTSC{
     // check header type and store packet length
     dataLen = len;
     version = DTSC_INVALID;
+    indexed = false;
     if (len < 4){
       FAIL_MSG("ReInit received a packet with size < 4");
       return;
@@ -275,6 +281,7 @@ namespace DTSC{
     if (data[offset] == 'k' || data[offset] == 'K'){
       data[offset] = (kf ? 'k' : 'K');
       data[offset + 16] = (kf ? 1 : 0);
+      indexed = false;
     }else{
       ERROR_MSG("Could not set keyframe - field not found!");
     }
@@ -285,6 +292,7 @@ namespace DTSC{
     memcpy(data + dataLen - 3, appendData, appendLen);
     memcpy(data + dataLen - 3 + appendLen, "\000\000\356", 3); // end container
     dataLen += appendLen;
+    indexed = false;
     Bit::htobl(data + 4, Bit::btohl(data + 4) + appendLen);
     uint32_t offset = getDataStringLenOffset();
     Bit::htobl(data + offset, Bit::btohl(data + offset) + appendLen);
@@ -298,6 +306,7 @@ namespace DTSC{
     memcpy(data + dataLen - 3 + 4, appendData, appendLen);
     memcpy(data + dataLen - 3 + 4 + appendLen, "\000\000\356", 3); // end container
     dataLen += appendLen + 4;
+    indexed = false;
     Bit::htobl(data + 4, Bit::btohl(data + 4) + appendLen + 4);
     uint32_t offset = getDataStringLenOffset();
     Bit::htobl(data + offset, Bit::btohl(data + offset) + appendLen + 4);
@@ -318,6 +327,7 @@ namespace DTSC{
     memcpy(data + dataLen - 3, appendData, appendLen);
     memcpy(data + dataLen - 3 + appendLen, "\000\000\356", 3); // end container
     dataLen += appendLen;
+    indexed = false;
     Bit::htobl(data + 4, Bit::btohl(data + 4) + appendLen);
     uint32_t offset = getDataStringLenOffset();
     Bit::htobl(data + offset, Bit::btohl(data + offset) + appendLen);
@@ -382,26 +392,76 @@ namespace DTSC{
     return 0; // out of packet! 1 == error
   }
 
+  /// Returns the index of the given member name in Packet::fieldPos, or -1 if it is not indexed.
+  static inline int indexedField(const char *name, size_t len){
+    switch (len){
+    case 4:
+      if (!memcmp(name, "data", 4)){return 0;}
+      if (!memcmp(name, "bpos", 4)){return 2;}
+      return -1;
+    case 6: return memcmp(name, "offset", 6) ? -1 : 1;
+    case 8: return memcmp(name, "keyframe", 8) ? -1 : 3;
+    default: return -1;
+    }
+  }
+
+  /// Finds the values of all indexed members in one pass over the packet contents.
+  /// Follows the same rules as Scan::getMember, so the first occurrence of a member wins.
+  void Packet::indexFields() const{
+    indexed = true;
+    memset(fieldPos, 0, sizeof(fieldPos));
+    Scan s = getScan();
+    if (s.getType() != DTSC_OBJ && s.getType() != DTSC_CON){return;}
+    char *max = data + dataLen;
+    char *i = data + (dataLen - getPayloadLen()) + 1;
+    while (i + 2 < max && (i[0] || i[1])){
+      uint16_t nameLen = Bit::btohs(i);
+      char *name = i + 2;
+      i = name + nameLen;
+      if (i >= max){return;}
+      int f = indexedField(name, nameLen);
+      if (f >= 0 && !fieldPos[f]){fieldPos[f] = i - data;}
+      i = skipDTSC(i, max);
+      if (!i){return;}
+    }
+  }
+
+  /// Returns a DTSC::Scan of the given member of this packet, or an invalid instance if it is absent.
+  /// Indexed members are found without scanning the packet, others through Scan::getMember.
+  Scan Packet::getField(const char *identifier) const{
+    int f = -1;
+    switch (identifier[0]){
+    case 'd': f = strcmp(identifier, "data") ? -1 : 0; break;
+    case 'o': f = strcmp(identifier, "offset") ? -1 : 1; break;
+    case 'b': f = strcmp(identifier, "bpos") ? -1 : 2; break;
+    case 'k': f = strcmp(identifier, "keyframe") ? -1 : 3; break;
+    }
+    if (f < 0){return getScan().getMember(identifier);}
+    if (!indexed){indexFields();}
+    if (!fieldPos[f]){return Scan();}
+    return Scan(data + fieldPos[f], dataLen - fieldPos[f]);
+  }
+
   ///\brief Retrieves a single parameter as a string
   ///\param identifier The name of the parameter
   ///\param result A location on which the string will be returned
   ///\param len An integer in which the length of the string will be returned
   void Packet::getString(const char *identifier, char *&result, size_t &len) const{
-    getScan().getMember(identifier).getString(result, len);
+    getField(identifier).getString(result, len);
   }
 
   ///\brief Retrieves a single parameter as a string
   ///\param identifier The name of the parameter
   ///\param result The string in which to store the result
   void Packet::getString(const char *identifier, std::string &result) const{
-    result = getScan().getMember(identifier).asString();
+    result = getField(identifier).asString();
   }
 
   ///\brief Retrieves a single parameter as an integer
   ///\param identifier The name of the parameter
   ///\param result The result is stored in this integer
   void Packet::getInt(const char *identifier, uint64_t &result) const{
-    result = getScan().getMember(identifier).asInt();
+    result = getField(identifier).asInt();
   }
 
   ///\brief Retrieves a single parameter as an integer
@@ -435,7 +495,7 @@ namespace DTSC{
   ///\param identifier The name of the parameter
   ///\result Whether the parameter exists or not
   bool Packet::hasMember(const char *identifier) const{
-    return getScan().getMember(identifier).getType() > 0;
+    return getField(identifier).getType() > 0;
   }
 
   ///\brief Returns the timestamp of the packet.
@@ -462,6 +522,7 @@ namespace DTSC{
       return;
     }
     getScan().nullMember(memb);
+    indexed = false;
   }
 
   ///\brief Returns the track id of the packet.
@@ -1310,11 +1371,13 @@ namespace DTSC{
       return;
     }
     trackList = Util::RelAccX(stream.getPointer("tracks"), false);
+    trackValidField = trackList.getFieldData("valid");
+    trackPageField = trackList.getFieldData("page");
     for (size_t i = 0; i < trackList.getPresent(); i++){
-      if (trackList.getInt("valid", i) == 0){continue;}
+      if (trackList.getInt(trackValidField, i) == 0){continue;}
       if (tracks.count(i)){continue;}
       IPC::sharedPage &p = tM[i];
-      p.init(trackList.getPointer("page", i), SHM_STREAM_TRACK_LEN, false, false);
+      p.init(trackList.getPointer(trackPageField, i), SHM_STREAM_TRACK_LEN, false, false);
 
       Track &t = tracks[i];
       t.track = Util::RelAccX(p.mapped, true);
@@ -1371,6 +1434,14 @@ namespace DTSC{
         t.fragmentKeysField = t.fragments.getFieldData("keys");
         t.fragmentFirstKeyField = t.fragments.getFieldData("firstkey");
         t.fragmentSizeField = t.fragments.getFieldData("size");
+
+        t.pageFirstKeyField = t.pages.getFieldData("firstkey");
+        t.pageKeyCountField = t.pages.getFieldData("keycount");
+        t.pagePartsField = t.pages.getFieldData("parts");
+        t.pageSizeField = t.pages.getFieldData("size");
+        t.pageAvailField = t.pages.getFieldData("avail");
+        t.pageFirstTimeField = t.pages.getFieldData("firsttime");
+        t.pageLastKeyTimeField = t.pages.getFieldData("lastkeytime");
       }
     }
   }
@@ -1405,20 +1476,20 @@ namespace DTSC{
 
     bool ret = false;
     for (size_t i = 0; i < trackList.getPresent(); i++){
-      if (trackList.getInt("valid", i) == 0){continue;}
+      if (trackList.getInt(trackValidField, i) == 0){continue;}
       bool always_load = !tracks.count(i);
       if (always_load || tracks[i].track.isReload()){
         ret = true;
         Track &t = tracks[i];
         if (always_load){
-          VERYHIGH_MSG("Loading track: %s", trackList.getPointer("page", i));
+          VERYHIGH_MSG("Loading track: %s", trackList.getPointer(trackPageField, i));
         }else{
-          VERYHIGH_MSG("Reloading track: %s", trackList.getPointer("page", i));
+          VERYHIGH_MSG("Reloading track: %s", trackList.getPointer(trackPageField, i));
         }
         IPC::sharedPage &p = tM[i];
-        p.init(trackList.getPointer("page", i), SHM_STREAM_TRACK_LEN, false, false);
+        p.init(trackList.getPointer(trackPageField, i), SHM_STREAM_TRACK_LEN, false, false);
         if (!p.mapped){
-          WARN_MSG("Failed to load page %s, retrying later", trackList.getPointer("page", i));
+          WARN_MSG("Failed to load page %s, retrying later", trackList.getPointer(trackPageField, i));
           tM.erase(i);
           tracks.erase(i);
           continue;
@@ -1478,6 +1549,14 @@ namespace DTSC{
           t.fragmentKeysField = t.fragments.getFieldData("keys");
           t.fragmentFirstKeyField = t.fragments.getFieldData("firstkey");
           t.fragmentSizeField = t.fragments.getFieldData("size");
+
+          t.pageFirstKeyField = t.pages.getFieldData("firstkey");
+          t.pageKeyCountField = t.pages.getFieldData("keycount");
+          t.pagePartsField = t.pages.getFieldData("parts");
+          t.pageSizeField = t.pages.getFieldData("size");
+          t.pageAvailField = t.pages.getFieldData("avail");
+          t.pageFirstTimeField = t.pages.getFieldData("firsttime");
+          t.pageLastKeyTimeField = t.pages.getFieldData("lastkeytime");
         }
 
       }
@@ -1563,7 +1642,9 @@ namespace DTSC{
     }
     size_t tNumber = trackList.getPresent();
 
+    // The copy has the same layout as the source, so it can reuse its field handles
     Track &t = tracks[tNumber];
+    t = tracks[sourceTrack];
 
     char pageName[NAME_BUFFER_SIZE];
     snprintf(pageName, NAME_BUFFER_SIZE, SHM_STREAM_TM, streamName.c_str(), getpid(), tNumber);
@@ -1574,10 +1655,20 @@ namespace DTSC{
     memcpy(tM[tNumber].mapped, tM[sourceTrack].mapped, tM[sourceTrack].len);
     t.track = Util::RelAccX(tM[tNumber].mapped, true);
 
-    t.parts = Util::RelAccX(t.track.getPointer("parts"), true);
-    t.keys = Util::RelAccX(t.track.getPointer("keys"), true);
-    t.fragments = Util::RelAccX(t.track.getPointer("fragments"), true);
-    t.pages = Util::RelAccX(t.track.getPointer("pages"), true);
+    // Point every accessor into the new page, not the page of the source track
+    if (t.track.hasField("frames")){
+      t.parts = Util::RelAccX();
+      t.keys = Util::RelAccX();
+      t.fragments = Util::RelAccX();
+      t.pages = Util::RelAccX();
+      t.frames = Util::RelAccX(t.track.getPointer("frames"), true);
+    }else{
+      t.frames = Util::RelAccX();
+      t.parts = Util::RelAccX(t.track.getPointer("parts"), true);
+      t.keys = Util::RelAccX(t.track.getPointer("keys"), true);
+      t.fragments = Util::RelAccX(t.track.getPointer("fragments"), true);
+      t.pages = Util::RelAccX(t.track.getPointer("pages"), true);
+    }
 
     trackList.setString(trackPageField, pageName, tNumber);
     trackList.setInt(trackPidField, getpid(), tNumber);
@@ -2058,6 +2149,13 @@ namespace DTSC{
     t.pages.addField("lastkeytime", RAX_64UINT);
     t.pages.setRCount(pageCount);
     t.pages.setReady();
+    t.pageFirstKeyField = t.pages.getFieldData("firstkey");
+    t.pageKeyCountField = t.pages.getFieldData("keycount");
+    t.pagePartsField = t.pages.getFieldData("parts");
+    t.pageSizeField = t.pages.getFieldData("size");
+    t.pageAvailField = t.pages.getFieldData("avail");
+    t.pageFirstTimeField = t.pages.getFieldData("firsttime");
+    t.pageLastKeyTimeField = t.pages.getFieldData("lastkeytime");
   }
 
   /// Sets the given track's init data.
@@ -2441,10 +2539,10 @@ namespace DTSC{
     Track &t = tracks[trackIdx];
     if (t.pages.isReady()){
       for (uint64_t i = t.pages.getDeleted(); i < t.pages.getEndPos(); i++){
-        if (t.pages.getInt("avail", i) == 0){continue;}
+        if (t.pages.getInt(t.pageAvailField, i) == 0){continue;}
         char thisPageName[NAME_BUFFER_SIZE];
         snprintf(thisPageName, NAME_BUFFER_SIZE, SHM_TRACK_DATA, streamName.c_str(), trackIdx,
-                 (uint32_t)t.pages.getInt("firstkey", i));
+                 (uint32_t)t.pages.getInt(t.pageFirstKeyField, i));
         IPC::sharedPage p(thisPageName, 20971520);
         p.master = true;
       }
@@ -2490,13 +2588,13 @@ namespace DTSC{
     setFirstms(trackIdx, t.keys.getInt(t.keyTimeField, t.keys.getDeleted()));
 
     // Update page info
-    Util::RelAccX &tPages = pages(trackIdx);
+    Util::RelAccX &tPages = t.pages;
     uint32_t firstPage = tPages.getDeleted();
-    uint32_t keyCount = tPages.getInt("keycount", firstPage);
-    uint32_t firstKey = tPages.getInt("firstkey", firstPage);
+    uint32_t keyCount = tPages.getInt(t.pageKeyCountField, firstPage);
+    uint32_t firstKey = tPages.getInt(t.pageFirstKeyField, firstPage);
     // Delete the page if this was the last key
     if (firstKey + keyCount <= deletedKeyNum + 1){
-      if (tPages.getInt("avail", firstPage)){
+      if (tPages.getInt(t.pageAvailField, firstPage)){
         // Open the correct page
         char pageId[NAME_BUFFER_SIZE];
         snprintf(pageId, NAME_BUFFER_SIZE, SHM_TRACK_DATA, streamName.c_str(), trackIdx, firstKey);
@@ -2507,10 +2605,10 @@ namespace DTSC{
         toErase.master = true;
       }
       tPages.deleteRecords(1);
-    } else if (tPages.getInt("avail", firstPage) == 0){
-      tPages.setInt("keycount", keyCount - 1, firstPage);
-      tPages.setInt("parts", tPages.getInt("parts", firstPage) - deletedPartCount, firstPage);
-      tPages.setInt("firstkey", deletedKeyNum + 1, firstPage);
+    } else if (tPages.getInt(t.pageAvailField, firstPage) == 0){
+      tPages.setInt(t.pageKeyCountField, keyCount - 1, firstPage);
+      tPages.setInt(t.pagePartsField, tPages.getInt(t.pagePartsField, firstPage) - deletedPartCount, firstPage);
+      tPages.setInt(t.pageFirstKeyField, deletedKeyNum + 1, firstPage);
     }
 
     if (resizeLock){resizeLock.unlink();}
@@ -2806,17 +2904,22 @@ namespace DTSC{
 
   const Keys Meta::getKeys(size_t trackIdx) const{
     const Track & t = tracks.at(trackIdx);
-    if (t.frames.isReady()){
-      DTSC::Keys k(t.frames);
-      if (isLimited){k.applyLimiter(limitMin, limitMax);}
-      return k;
-    }else{
-      DTSC::Keys k(t.keys);
-      if (isLimited){k.applyLimiter(limitMin, limitMax, DTSC::Parts(t.parts));}
-      return k;
+    DTSC::Keys k(t);
+    if (isLimited){
+      if (t.frames.isReady()){
+        k.applyLimiter(limitMin, limitMax);
+      }else{
+        k.applyLimiter(limitMin, limitMax, DTSC::Parts(t));
+      }
     }
+    return k;
   }
 
+  const Fragments Meta::getFragments(size_t trackIdx) const{return Fragments(tracks.at(trackIdx));}
+
+  Pages Meta::getPages(size_t trackIdx){return Pages(tracks.at(trackIdx));}
+  const Pages Meta::getPages(size_t trackIdx) const{return Pages(tracks.at(trackIdx));}
+
 
   void Meta::storeFrame(size_t trackIdx, uint64_t time, const char * data, size_t dataSize){
     Track & t = tracks.at(trackIdx);
@@ -2966,7 +3069,7 @@ namespace DTSC{
           dataLen += ((it->second.keys.getPresent() * 4) + 15);
           dataLen += ((it->second.parts.getPresent() * DTSH_PART_SIZE) + 12);
           //          dataLen += ivecs.size() * 8 + 12; /*LTS*/
-          if (it->second.track.getInt("missedFrags")){dataLen += 23;}
+          if (it->second.track.getInt(it->second.trackMissedFragsField)){dataLen += 23;}
         }
         std::string lang = getLang(it->first);
         if (lang.size() && lang != "und"){dataLen += 11 + lang.size();}
@@ -3127,10 +3230,11 @@ namespace DTSC{
       conn.SendNow(tmp.data(), tmp.size());
       conn.SendNow("\340", 1); // Begin track object
 
+      const Track &t = tracks.at(*it);
       if (!skipDynamic){
-        const Util::RelAccX &fragments = tracks.at(*it).fragments;
-        const Util::RelAccX &keys = tracks.at(*it).keys;
-        const Util::RelAccX &parts = tracks.at(*it).parts;
+        const Util::RelAccX &fragments = t.fragments;
+        const Util::RelAccX &keys = t.keys;
+        const Util::RelAccX &parts = t.parts;
 
         size_t fragBegin = fragments.getStartPos();
         size_t fragCount = fragments.getPresent();
@@ -3142,60 +3246,60 @@ namespace DTSC{
         conn.SendNow("\000\011fragments\002", 12);
         conn.SendNow(c32(fragCount * DTSH_FRAGMENT_SIZE), 4);
         for (size_t i = 0; i < fragCount; i++){
-          conn.SendNow(c32(fragments.getInt("duration", i + fragBegin)), 4);
-          conn.SendNow(std::string(1, (char)fragments.getInt("keys", i + fragBegin)));
+          conn.SendNow(c32(fragments.getInt(t.fragmentDurationField, i + fragBegin)), 4);
+          conn.SendNow(std::string(1, (char)fragments.getInt(t.fragmentKeysField, i + fragBegin)));
 
-          conn.SendNow(c32(fragments.getInt("firstkey", i + fragBegin) + 1), 4);
-          conn.SendNow(c32(fragments.getInt("size", i + fragBegin)), 4);
+          conn.SendNow(c32(fragments.getInt(t.fragmentFirstKeyField, i + fragBegin) + 1), 4);
+          conn.SendNow(c32(fragments.getInt(t.fragmentSizeField, i + fragBegin)), 4);
         }
 
         conn.SendNow("\000\004keys\002", 7);
         conn.SendNow(c32(keyCount * DTSH_KEY_SIZE), 4);
         for (size_t i = 0; i < keyCount; i++){
-          conn.SendNow(c64(keys.getInt("bpos", i + fragBegin)), 8);
-          conn.SendNow(c24(keys.getInt("duration", i + keyBegin)), 3);
-          conn.SendNow(c32(keys.getInt("number", i + keyBegin)), 4);
-          conn.SendNow(c16(keys.getInt("parts", i + keyBegin)), 2);
-          conn.SendNow(c64(keys.getInt("time", i + keyBegin)), 8);
+          conn.SendNow(c64(keys.getInt(t.keyBposField, i + fragBegin)), 8);
+          conn.SendNow(c24(keys.getInt(t.keyDurationField, i + keyBegin)), 3);
+          conn.SendNow(c32(keys.getInt(t.keyNumberField, i + keyBegin)), 4);
+          conn.SendNow(c16(keys.getInt(t.keyPartsField, i + keyBegin)), 2);
+          conn.SendNow(c64(keys.getInt(t.keyTimeField, i + keyBegin)), 8);
         }
         conn.SendNow("\000\010keysizes\002,", 11);
         conn.SendNow(c32(keyCount * 4), 4);
         for (size_t i = 0; i < keyCount; i++){
-          conn.SendNow(c32(keys.getInt("size", i + keyBegin)), 4);
+          conn.SendNow(c32(keys.getInt(t.keySizeField, i + keyBegin)), 4);
         }
 
         conn.SendNow("\000\005parts\002", 8);
         conn.SendNow(c32(partCount * DTSH_PART_SIZE), 4);
         for (size_t i = 0; i < partCount; i++){
-          conn.SendNow(c24(parts.getInt("size", i + partBegin)), 3);
-          conn.SendNow(c24(parts.getInt("duration", i + partBegin)), 3);
-          conn.SendNow(c24(parts.getInt("offset", i + partBegin)), 3);
+          conn.SendNow(c24(parts.getInt(t.partSizeField, i + partBegin)), 3);
+          conn.SendNow(c24(parts.getInt(t.partDurationField, i + partBegin)), 3);
+          conn.SendNow(c24(parts.getInt(t.partOffsetField, i + partBegin)), 3);
         }
       }
 
-      const Util::RelAccX &track = tracks.at(*it).track;
+      const Util::RelAccX &track = t.track;
       conn.SendNow("\000\007trackid\001", 10);
       if (reID){
         conn.SendNow(c64((*it) + 1), 8);
       }else{
-        conn.SendNow(c64(track.getInt("id")), 8);
+        conn.SendNow(c64(track.getInt(t.trackIdField)), 8);
       }
 
-      if (!skipDynamic && track.getInt("missedFrags")){
+      if (!skipDynamic && track.getInt(t.trackMissedFragsField)){
         conn.SendNow("\000\014missed_frags\001", 15);
-        conn.SendNow(c64(track.getInt("missedFrags")), 8);
+        conn.SendNow(c64(track.getInt(t.trackMissedFragsField)), 8);
       }
 
       conn.SendNow("\000\007firstms\001", 10);
-      conn.SendNow(c64(track.getInt("firstms")), 8);
+      conn.SendNow(c64(track.getInt(t.trackFirstmsField)), 8);
       conn.SendNow("\000\006lastms\001", 9);
-      conn.SendNow(c64(track.getInt("lastms")), 8);
+      conn.SendNow(c64(track.getInt(t.trackLastmsField)), 8);
 
       conn.SendNow("\000\003bps\001", 6);
-      conn.SendNow(c64(track.getInt("bps")), 8);
+      conn.SendNow(c64(track.getInt(t.trackBpsField)), 8);
 
       conn.SendNow("\000\006maxbps\001", 9);
-      conn.SendNow(c64(track.getInt("maxbps")), 8);
+      conn.SendNow(c64(track.getInt(t.trackMaxbpsField)), 8);
 
       tmp = getInit(*it);
       conn.SendNow("\000\004init\002", 7);
@@ -3221,18 +3325,18 @@ namespace DTSC{
 
       if (tmp == "audio"){
         conn.SendNow("\000\004rate\001", 7);
-        conn.SendNow(c64(track.getInt("rate")), 8);
+        conn.SendNow(c64(track.getInt(t.trackRateField)), 8);
         conn.SendNow("\000\004size\001", 7);
-        conn.SendNow(c64(track.getInt("size")), 8);
+        conn.SendNow(c64(track.getInt(t.trackSizeField)), 8);
         conn.SendNow("\000\010channels\001", 11);
-        conn.SendNow(c64(track.getInt("channels")), 8);
+        conn.SendNow(c64(track.getInt(t.trackChannelsField)), 8);
       }else if (tmp == "video"){
         conn.SendNow("\000\005width\001", 8);
-        conn.SendNow(c64(track.getInt("width")), 8);
+        conn.SendNow(c64(track.getInt(t.trackWidthField)), 8);
         conn.SendNow("\000\006height\001", 9);
-        conn.SendNow(c64(track.getInt("height")), 8);
+        conn.SendNow(c64(track.getInt(t.trackHeightField)), 8);
         conn.SendNow("\000\004fpks\001", 7);
-        conn.SendNow(c64(track.getInt("fpks")), 8);
+        conn.SendNow(c64(track.getInt(t.trackFpksField)), 8);
       }
       conn.SendNow("\000\000\356", 3); // End this track Object
     }
@@ -3327,17 +3431,82 @@ namespace DTSC{
     return true;
   }
 
+  /// Returns the first index in [lo, hi) for which pred is true, or hi if there is none.
+  /// Requires pred to be false up to some index and true from there on, which holds for lookups
+  /// by time since all track records are sorted by time. Indices are absolute record numbers, so
+  /// this works unchanged for ring buffers that have wrapped around.
+  /// If cursor is given, the index it holds and the one after it are tried first, so that lookups
+  /// for increasing times are constant time. Otherwise, a binary search is done. Either way, the
+  /// result is stored in the cursor.
+  template <typename P> static size_t findFirst(size_t lo, size_t hi, const P &pred, size_t *cursor = 0){
+    if (cursor && *cursor >= lo && *cursor <= hi){
+      for (size_t i = *cursor; i <= hi && i <= *cursor + 1; ++i){
+        if ((i == lo || !pred(i - 1)) && (i == hi || pred(i))){
+          *cursor = i;
+          return i;
+        }
+      }
+    }
+    while (lo < hi){
+      size_t mid = lo + (hi - lo) / 2;
+      if (pred(mid)){
+        hi = mid;
+      }else{
+        lo = mid + 1;
+      }
+    }
+    if (cursor){*cursor = lo;}
+    return lo;
+  }
+
+  /// True for keys that start at or end after a given time
+  struct keyReaches{
+    const Keys &keys;
+    uint64_t time;
+    keyReaches(const Keys &k, uint64_t t) : keys(k), time(t){}
+    bool operator()(size_t i) const{
+      uint64_t t = keys.getTime(i);
+      return t >= time || t + keys.getDuration(i) > time;
+    }
+  };
+
+  /// True for keys that end after a given time
+  struct keyEndsAfter{
+    const Keys &keys;
+    uint64_t time;
+    keyEndsAfter(const Keys &k, uint64_t t) : keys(k), time(t){}
+    bool operator()(size_t i) const{return keys.getTime(i) + keys.getDuration(i) > time;}
+  };
+
+  /// True for fragments that end after a given time
+  struct fragmentEndsAfter{
+    const Fragments &fragments;
+    const Keys &keys;
+    uint64_t time;
+    fragmentEndsAfter(const Fragments &f, const Keys &k, uint64_t t) : fragments(f), keys(k), time(t){}
+    bool operator()(size_t i) const{
+      return time < keys.getTime(fragments.getFirstKey(i)) + fragments.getDuration(i);
+    }
+  };
+
+  /// True for records of which an integer field is larger than a given value
+  struct fieldAbove{
+    const Util::RelAccX &rax;
+    const Util::RelAccXFieldData &field;
+    uint64_t val;
+    fieldAbove(const Util::RelAccX &r, const Util::RelAccXFieldData &f, uint64_t v) : rax(r), field(f), val(v){}
+    bool operator()(size_t i) const{return rax.getInt(field, i) > val;}
+  };
+
   /// Gets indice of the fragment containing timestamp, or last fragment if nowhere.
   uint32_t Meta::getFragmentIndexForTime(uint32_t idx, uint64_t timestamp) const{
-    DTSC::Fragments fragments(tracks.at(idx).fragments);
+    const Track &t = tracks.at(idx);
+    DTSC::Fragments fragments(t);
     DTSC::Keys keys(getKeys(idx));
     uint32_t firstFragment = fragments.getFirstValid();
     uint32_t endFragment = fragments.getEndValid();
-    for (size_t i = firstFragment; i < endFragment; i++){
-      uint32_t keyNumber = fragments.getFirstKey(i);
-      uint32_t duration = fragments.getDuration(i);
-      if (timestamp < keys.getTime(keyNumber) + duration){return i;}
-    }
+    size_t i = findFirst(firstFragment, endFragment, fragmentEndsAfter(fragments, keys, timestamp), &t.fragmentCursor);
+    if (i < endFragment){return i;}
     if (endFragment > firstFragment){
       if (timestamp < getLastms(idx)){return endFragment - 1;}
     }
@@ -3352,18 +3521,13 @@ namespace DTSC{
   /// Returns indice of the key containing timestamp, or last key if nowhere.
   uint32_t Meta::getKeyIndexForTime(uint32_t idx, uint64_t timestamp) const{
     DTSC::Keys keys(getKeys(idx));
-    uint32_t firstKey = keys.getFirstValid();
-    uint32_t endKey = keys.getEndValid();
-
-    for (size_t i = firstKey; i < endKey; i++){
-      if (keys.getTime(i) + keys.getDuration(i) > timestamp){return i;}
-    }
-    return endKey;
+    return findFirst(keys.getFirstValid(), keys.getEndValid(), keyEndsAfter(keys, timestamp),
+                     &tracks.at(idx).keyCursor);
   }
 
   /// Returns the tiestamp for the given fragment index in the given track index.
   uint64_t Meta::getTimeForFragmentIndex(uint32_t idx, uint32_t fragmentIdx) const{
-    DTSC::Fragments fragments(tracks.at(idx).fragments);
+    DTSC::Fragments fragments(tracks.at(idx));
     return getKeys(idx).getTime(fragments.getFirstKey(fragmentIdx));
   }
 
@@ -3417,41 +3581,51 @@ namespace DTSC{
 
   /// Given the current page, check if the next page is available. Returns true if it is.
   bool Meta::nextPageAvailable(uint32_t idx, size_t currentPage) const{
-    const Util::RelAccX &pages = tracks.at(idx).pages;
+    const Track &t = tracks.at(idx);
+    const Util::RelAccX &pages = t.pages;
     for (size_t i = pages.getStartPos(); i + 1 < pages.getEndPos(); ++i){
-      if (pages.getInt("firstkey", i) == currentPage){return pages.getInt("avail", i + 1);}
+      if (pages.getInt(t.pageFirstKeyField, i) == currentPage){return pages.getInt(t.pageAvailField, i + 1);}
     }
     return false;
   }
 
+  /// Returns the last available page whose field does not exceed the given value, or the first
+  /// page if there is none. Pages that are not available do not count, whatever their values.
+  static size_t findPage(const Util::RelAccX &pages, const Util::RelAccXFieldData &avail,
+                         const Util::RelAccXFieldData &field, uint64_t val, size_t *cursor){
+    size_t start = pages.getStartPos();
+    size_t end = pages.getEndPos();
+    size_t next = findFirst(start, end, fieldAbove(pages, field, val), cursor);
+    // The search relies on ordered values, which only holds for available pages: if it ended up
+    // next to a page that is not available, scan the pages instead, like before.
+    if ((next < end && !pages.getInt(avail, next)) || (next > start && !pages.getInt(avail, next - 1))){
+      size_t res = start;
+      for (size_t i = start; i < end; ++i){
+        if (pages.getInt(avail, i) == 0){continue;}
+        if (pages.getInt(field, i) > val){break;}
+        res = i;
+      }
+      return res;
+    }
+    return (next > start) ? next - 1 : start;
+  }
+
   /// Given a timestamp, returns the page number that timestamp can be found on.
   /// If the timestamp is not available, returns the closest page number that is.
   size_t Meta::getPageNumberForTime(uint32_t idx, uint64_t time) const{
-    const Util::RelAccX &pages = tracks.at(idx).pages;
-    Util::RelAccXFieldData avail = pages.getFieldData("avail");
-    Util::RelAccXFieldData firsttime = pages.getFieldData("firsttime");
-    uint32_t res = pages.getStartPos();
-    uint64_t endPos = pages.getEndPos();
-    for (uint64_t i = res; i < endPos; ++i){
-      if (pages.getInt(avail, i) == 0){continue;}
-      if (pages.getInt(firsttime, i) > time){break;}
-      res = i;
-    }
-    DONTEVEN_MSG("Page number for time %" PRIu64 " on track %" PRIu32 " can be found on page %" PRIu64, time, idx, pages.getInt("firstkey", res));
-    return pages.getInt("firstkey", res);
+    const Track &t = tracks.at(idx);
+    const Util::RelAccX &pages = t.pages;
+    size_t res = findPage(pages, t.pageAvailField, t.pageFirstTimeField, time, &t.pageCursor);
+    DONTEVEN_MSG("Page number for time %" PRIu64 " on track %" PRIu32 " can be found on page %" PRIu64, time, idx, pages.getInt(t.pageFirstKeyField, res));
+    return pages.getInt(t.pageFirstKeyField, res);
   }
 
   /// Given a key, returns the page number it can be found on.
   /// If the key is not available, returns the closest page that is.
   size_t Meta::getPageNumberForKey(uint32_t idx, uint64_t keyNum) const{
-    const Util::RelAccX &pages = tracks.at(idx).pages;
-    size_t res = pages.getStartPos();
-    for (size_t i = pages.getStartPos(); i < pages.getEndPos(); ++i){
-      if (pages.getInt("avail", i) == 0){continue;}
-      if (pages.getInt("firstkey", i) > keyNum){break;}
-      res = i;
-    }
-    return pages.getInt("firstkey", res);
+    const Track &t = tracks.at(idx);
+    const Util::RelAccX &pages = t.pages;
+    return pages.getInt(t.pageFirstKeyField, findPage(pages, t.pageAvailField, t.pageFirstKeyField, keyNum, &t.pageCursor));
   }
 
   /// Returns the key number containing a given time.
@@ -3462,33 +3636,28 @@ namespace DTSC{
     const Track &trk = tracks.at(idx);
     if (trk.frames.isReady()){
       if (!trk.frames.getEndPos()){return INVALID_KEY_NUM;}
-      size_t res = trk.frames.getDeleted();
-      for (size_t i = res; i < trk.frames.getEndPos(); i++){
-        if (trk.frames.getInt(trk.framesTimeField, i) > time){
-          return res;
-        }
-        res = i;
-      }
-      return res;
+      size_t first = trk.frames.getDeleted();
+      size_t next = findFirst(first, trk.frames.getEndPos(), fieldAbove(trk.frames, trk.framesTimeField, time), &trk.keyCursor);
+      return next > first ? next - 1 : first;
     }
     const Util::RelAccX &keys = trk.keys;
     const Util::RelAccX &parts = trk.parts;
     if (!keys.getEndPos()){return INVALID_KEY_NUM;}
-    size_t res = keys.getDeleted();
-    for (size_t i = res; i < keys.getEndPos(); i++){
-      if (keys.getInt(trk.keyTimeField, i) > time){
-        //It's possible we overshot our timestamp, but the previous key does not contain it.
-        //This happens when seeking to a timestamp past the last part of the previous key, but
-        //before the first part of the next key.
-        //In this case, we should _not_ return the previous key, but the current key.
-        //That prevents getting stuck at the end of the page, waiting for a part to show up that never will.
-        if (keys.getInt(trk.keyFirstPartField, i) > parts.getStartPos()){
-          uint64_t dur = parts.getInt(trk.partDurationField, keys.getInt(trk.keyFirstPartField, i)-1);
-          if (keys.getInt(trk.keyTimeField, i) - dur < time){res = i;}
-        }
-        continue;
+    size_t first = keys.getDeleted();
+    size_t end = keys.getEndPos();
+    // The first key that starts after the given time
+    size_t next = findFirst(first, end, fieldAbove(keys, trk.keyTimeField, time), &trk.keyCursor);
+    size_t res = next > first ? next - 1 : first;
+    if (next < end){
+      //It's possible we overshot our timestamp, but the previous key does not contain it.
+      //This happens when seeking to a timestamp past the last part of the previous key, but
+      //before the first part of the next key.
+      //In this case, we should _not_ return the previous key, but the next key.
+      //That prevents getting stuck at the end of the page, waiting for a part to show up that never will.
+      if (keys.getInt(trk.keyFirstPartField, next) > parts.getStartPos()){
+        uint64_t dur = parts.getInt(trk.partDurationField, keys.getInt(trk.keyFirstPartField, next)-1);
+        if (keys.getInt(trk.keyTimeField, next) - dur < time){res = next;}
       }
-      res = i;
     }
     DONTEVEN_MSG("Key number for time %" PRIu64 " on track %" PRIu32 " is %zu", time, idx, res);
     return res;
@@ -3641,6 +3810,12 @@ namespace DTSC{
     offsetField = parts.getFieldData("offset");
   }
 
+  Parts::Parts(const Track &t) : parts(t.parts){
+    sizeField = t.partSizeField;
+    durationField = t.partDurationField;
+    offsetField = t.partOffsetField;
+  }
+
   size_t Parts::getFirstValid() const{return parts.getDeleted();}
   size_t Parts::getEndValid() const{return parts.getEndPos();}
   size_t Parts::getValidCount() const{return getEndValid() - getFirstValid();}
@@ -3684,6 +3859,26 @@ namespace DTSC{
     isLimited = false;
   }
 
+  /// Uses the field handles of the given track, either for its keys or for its frames.
+  Keys::Keys(const Track &t)
+      : isConst(true), keys(empty), cKeys(t.frames.isReady() ? t.frames : t.keys){
+    if (t.frames.isReady()){
+      isFrames = true;
+      timeField = t.framesTimeField;
+      sizeField = t.framesDataField;
+    }else{
+      isFrames = false;
+      firstPartField = t.keyFirstPartField;
+      bposField = t.keyBposField;
+      durationField = t.keyDurationField;
+      numberField = t.keyNumberField;
+      partsField = t.keyPartsField;
+      timeField = t.keyTimeField;
+      sizeField = t.keySizeField;
+    }
+    isLimited = false;
+  }
+
   size_t Keys::getFirstValid() const{
     return isLimited ? limMin : cKeys.getDeleted();
   }
@@ -3739,14 +3934,7 @@ namespace DTSC{
   }
   
   uint32_t Keys::getIndexForTime(uint64_t timestamp){
-    uint32_t firstKey = getFirstValid();
-    uint32_t endKey = getEndValid();
-
-    for (size_t i = firstKey; i < endKey; i++){
-      const uint64_t t = getTime(i);
-      if (t >= timestamp || t + getDuration(i) > timestamp){return i;}
-    }
-    return endKey;
+    return findFirst(getFirstValid(), getEndValid(), keyReaches(*this, timestamp));
   }
 
   void Keys::applyLimiter(uint64_t _min, uint64_t _max, DTSC::Parts _p){
@@ -3850,12 +4038,88 @@ namespace DTSC{
     isLimited = true;
   }
 
-  Fragments::Fragments(const Util::RelAccX &_fragments) : fragments(_fragments){}
+  Fragments::Fragments(const Util::RelAccX &_fragments) : fragments(_fragments){
+    durationField = fragments.getFieldData("duration");
+    keysField = fragments.getFieldData("keys");
+    firstKeyField = fragments.getFieldData("firstkey");
+    sizeField = fragments.getFieldData("size");
+  }
+  Fragments::Fragments(const Track &t) : fragments(t.fragments){
+    durationField = t.fragmentDurationField;
+    keysField = t.fragmentKeysField;
+    firstKeyField = t.fragmentFirstKeyField;
+    sizeField = t.fragmentSizeField;
+  }
   size_t Fragments::getFirstValid() const{return fragments.getDeleted();}
   size_t Fragments::getEndValid() const{return fragments.getEndPos();}
   size_t Fragments::getValidCount() const{return getEndValid() - getFirstValid();}
-  uint64_t Fragments::getDuration(size_t idx) const{return fragments.getInt("duration", idx);}
-  size_t Fragments::getKeycount(size_t idx) const{return fragments.getInt("keys", idx);}
-  size_t Fragments::getFirstKey(size_t idx) const{return fragments.getInt("firstkey", idx);}
-  size_t Fragments::getSize(size_t idx) const{return fragments.getInt("size", idx);}
+  uint64_t Fragments::getDuration(size_t idx) const{return fragments.getInt(durationField, idx);}
+  size_t Fragments::getKeycount(size_t idx) const{return fragments.getInt(keysField, idx);}
+  size_t Fragments::getFirstKey(size_t idx) const{return fragments.getInt(firstKeyField, idx);}
+  size_t Fragments::getSize(size_t idx) const{return fragments.getInt(sizeField, idx);}
+
+  Pages::Pages(Util::RelAccX &_pages) : isConst(false), pages(_pages), cPages(_pages){
+    setFields(cPages);
+  }
+  Pages::Pages(const Util::RelAccX &_pages) : isConst(true), pages(empty), cPages(_pages){
+    setFields(cPages);
+  }
+  Pages::Pages(Track &t) : isConst(false), pages(t.pages), cPages(t.pages){
+    firstKeyField = t.pageFirstKeyField;
+    keyCountField = t.pageKeyCountField;
+    partsField = t.pagePartsField;
+    sizeField = t.pageSizeField;
+    availField = t.pageAvailField;
+    firstTimeField = t.pageFirstTimeField;
+    lastKeyTimeField = t.pageLastKeyTimeField;
+  }
+  Pages::Pages(const Track &t) : isConst(true), pages(empty), cPages(t.pages){
+    firstKeyField = t.pageFirstKeyField;
+    keyCountField = t.pageKeyCountField;
+    partsField = t.pagePartsField;
+    sizeField = t.pageSizeField;
+    availField = t.pageAvailField;
+    firstTimeField = t.pageFirstTimeField;
+    lastKeyTimeField = t.pageLastKeyTimeField;
+  }
+  void Pages::setFields(const Util::RelAccX &src){
+    firstKeyField = src.getFieldData("firstkey");
+    keyCountField = src.getFieldData("keycount");
+    partsField = src.getFieldData("parts");
+    sizeField = src.getFieldData("size");
+    availField = src.getFieldData("avail");
+    firstTimeField = src.getFieldData("firsttime");
+    lastKeyTimeField = src.getFieldData("lastkeytime");
+  }
+  size_t Pages::getFirstValid() const{return cPages.getDeleted();}
+  size_t Pages::getEndValid() const{return cPages.getEndPos();}
+  size_t Pages::getValidCount() const{return getEndValid() - getFirstValid();}
+  size_t Pages::getFirstKey(size_t idx) const{return cPages.getInt(firstKeyField, idx);}
+  size_t Pages::getKeycount(size_t idx) const{return cPages.getInt(keyCountField, idx);}
+  size_t Pages::getParts(size_t idx) const{return cPages.getInt(partsField, idx);}
+  size_t Pages::getSize(size_t idx) const{return cPages.getInt(sizeField, idx);}
+  size_t Pages::getAvail(size_t idx) const{return cPages.getInt(availField, idx);}
+  uint64_t Pages::getFirstTime(size_t idx) const{return cPages.getInt(firstTimeField, idx);}
+  uint64_t Pages::getLastKeyTime(size_t idx) const{return cPages.getInt(lastKeyTimeField, idx);}
+  void Pages::setFirstKey(size_t idx, size_t val){
+    if (!isConst){pages.setInt(firstKeyField, val, idx);}
+  }
+  void Pages::setKeycount(size_t idx, size_t val){
+    if (!isConst){pages.setInt(keyCountField, val, idx);}
+  }
+  void Pages::setParts(size_t idx, size_t val){
+    if (!isConst){pages.setInt(partsField, val, idx);}
+  }
+  void Pages::setSize(size_t idx, size_t val){
+    if (!isConst){pages.setInt(sizeField, val, idx);}
+  }
+  void Pages::setAvail(size_t idx, size_t val){
+    if (!isConst){pages.setInt(availField, val, idx);}
+  }
+  void Pages::setFirstTime(size_t idx, uint64_t val){
+    if (!isConst){pages.setInt(firstTimeField, val, idx);}
+  }
+  void Pages::setLastKeyTime(size_t idx, uint64_t val){
+    if (!isConst){pages.setInt(lastKeyTimeField, val, idx);}
+  }
 }// namespace DTSC
@@ -20,6 +20,8 @@
 #define DTSC_ARR 0x0A
 #define DTSC_CON 0xFF
 
+#define PACKET_INDEXED_FIELDS 4 // data, offset, bpos and keyframe
+
 #define TRACK_VALID_EXT_HUMAN 1 //(assumed) humans connecting externally
 #define TRACK_VALID_EXT_PUSH 2 //(assumed) humans connecting externally
 #define TRACK_VALID_INT_PROCESS 4 //internal processes
@@ -91,6 +93,9 @@ namespace DTSC{
   /// DTSC_V1 packets are "DTPD", followed by 4 bytes len and packed content.
   /// DTSC_V2 packets are "DTP2", followed by 4 bytes len, 4 bytes trackID, 8 bytes time, and packed
   /// content. The len is always without the first 8 bytes counted.
+  /// The positions of the members every media packet has (data, offset, bpos and keyframe) are
+  /// found in a single pass the first time any of them is requested, and kept until the packet
+  /// changes. Other members are looked up by scanning the packet contents every time.
   class Packet{
   public:
     Packet();
@@ -133,11 +138,15 @@ namespace DTSC{
     bool master;
     packType version;
     void resize(size_t size);
+    Scan getField(const char *identifier) const;
+    void indexFields() const;
     char *data;
     uint32_t bufferLen;
     uint32_t dataLen;
 
     uint64_t prevNalSize;
+    mutable bool indexed; ///< True if fieldPos is valid for the current contents
+    mutable uint32_t fieldPos[PACKET_INDEXED_FIELDS]; ///< Offset of each indexed member's value, or 0
   };
 
   /// A child class of DTSC::Packet, which allows overriding the packet time efficiently.
@@ -156,9 +165,12 @@ namespace DTSC{
     uint64_t timeOverride;
   };
 
+  class Track;
+
   class Parts{
   public:
     Parts(const Util::RelAccX &_parts);
+    Parts(const Track &t);
     size_t getFirstValid() const;
     size_t getEndValid() const;
     size_t getValidCount() const;
@@ -177,6 +189,7 @@ namespace DTSC{
   public:
     Keys(Util::RelAccX &_keys);
     Keys(const Util::RelAccX &_keys);
+    Keys(const Track &t);
     size_t getFirstValid() const;
     size_t getEndValid() const;
     size_t getValidCount() const;
@@ -229,6 +242,7 @@ namespace DTSC{
   class Fragments{
   public:
     Fragments(const Util::RelAccX &_fragments);
+    Fragments(const Track &t);
     size_t getFirstValid() const;
     size_t getEndValid() const;
     size_t getValidCount() const;
@@ -239,6 +253,10 @@ namespace DTSC{
 
   private:
     const Util::RelAccX &fragments;
+    Util::RelAccXFieldData durationField;
+    Util::RelAccXFieldData keysField;
+    Util::RelAccXFieldData firstKeyField;
+    Util::RelAccXFieldData sizeField;
   };
 
   class Track{
@@ -288,6 +306,63 @@ namespace DTSC{
 
     Util::RelAccXFieldData framesTimeField;
     Util::RelAccXFieldData framesDataField;
+
+    Util::RelAccXFieldData pageFirstKeyField;
+    Util::RelAccXFieldData pageKeyCountField;
+    Util::RelAccXFieldData pagePartsField;
+    Util::RelAccXFieldData pageSizeField;
+    Util::RelAccXFieldData pageAvailField;
+    Util::RelAccXFieldData pageFirstTimeField;
+    Util::RelAccXFieldData pageLastKeyTimeField;
+
+    // Results of the last time lookups on this track, tried first by the next lookup
+    mutable size_t keyCursor;
+    mutable size_t fragmentCursor;
+    mutable size_t pageCursor;
+
+    Track() : keyCursor(0), fragmentCursor(0), pageCursor(0){}
+  };
+
+  /// Accessor for the page table of a track.
+  /// When created from a Track, uses the field handles that were looked up when the track was
+  /// opened, so reading and writing entries never needs to look up fields by name.
+  class Pages{
+  public:
+    Pages(Util::RelAccX &_pages);
+    Pages(const Util::RelAccX &_pages);
+    Pages(Track &t);
+    Pages(const Track &t);
+    size_t getFirstValid() const;
+    size_t getEndValid() const;
+    size_t getValidCount() const;
+    size_t getFirstKey(size_t idx) const;
+    size_t getKeycount(size_t idx) const;
+    size_t getParts(size_t idx) const;
+    size_t getSize(size_t idx) const;
+    size_t getAvail(size_t idx) const;
+    uint64_t getFirstTime(size_t idx) const;
+    uint64_t getLastKeyTime(size_t idx) const;
+    void setFirstKey(size_t idx, size_t val);
+    void setKeycount(size_t idx, size_t val);
+    void setParts(size_t idx, size_t val);
+    void setSize(size_t idx, size_t val);
+    void setAvail(size_t idx, size_t val);
+    void setFirstTime(size_t idx, uint64_t val);
+    void setLastKeyTime(size_t idx, uint64_t val);
+
+  private:
+    void setFields(const Util::RelAccX &src);
+    bool isConst;
+    Util::RelAccX empty;
+    Util::RelAccX &pages;
+    const Util::RelAccX &cPages;
+    Util::RelAccXFieldData firstKeyField;
+    Util::RelAccXFieldData keyCountField;
+    Util::RelAccXFieldData partsField;
+    Util::RelAccXFieldData sizeField;
+    Util::RelAccXFieldData availField;
+    Util::RelAccXFieldData firstTimeField;
+    Util::RelAccXFieldData lastKeyTimeField;
   };
 
 
@@ -504,6 +579,9 @@ namespace DTSC{
     const Util::RelAccX &pages(size_t idx) const;
 
     const Keys getKeys(size_t trackIdx) const;
+    const Fragments getFragments(size_t trackIdx) const;
+    Pages getPages(size_t trackIdx);
+    const Pages getPages(size_t trackIdx) const;
 
     void storeFrame(size_t trackIdx, uint64_t time, const char * data, size_t dataSize);
 
@@ -4,15 +4,20 @@
 #include "h264.h"
 
 namespace Encryption{
-  AES::AES(){mbedtls_aes_init(&ctx);}
+  AES::AES(){
+    mbedtls_aes_init(&ctx);
+    accel = Accel::available();
+  }
 
   AES::~AES(){mbedtls_aes_free(&ctx);}
 
   void AES::setEncryptKey(const char *key){
     mbedtls_aes_setkey_enc(&ctx, (const unsigned char *)key, 128);
+    if (accel){Accel::expandKey(key, encKeys, decKeys);}
   }
   void AES::setDecryptKey(const char *key){
     mbedtls_aes_setkey_dec(&ctx, (const unsigned char *)key, 128);
+    if (accel){Accel::expandKey(key, encKeys, decKeys);}
   }
 
   DTSC::Packet AES::encryptPacketCTR(const DTSC::Meta &M, const DTSC::Packet &src, uint64_t ivec, size_t newTrack){
@@ -66,6 +71,10 @@ namespace Encryption{
     unsigned char nonceCtr[] ={0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
     Bit::htobll((char *)nonceCtr, ivec);
 
+    if (accel){
+      Accel::cryptCTR(encKeys, (char *)nonceCtr, src, dest, dataLen);
+      return true;
+    }
     return mbedtls_aes_crypt_ctr(&ctx, dataLen, &ncOff, nonceCtr, streamBlock,
                                  (const unsigned char *)src, (unsigned char *)dest) == 0;
   }
@@ -164,7 +173,24 @@ namespace Encryption{
 
   bool AES::encryptBlockCBC(char *ivec, const char *src, char *dest, size_t dataLen){
     if (dataLen % 16){WARN_MSG("Encrypting a non-multiple of 16 bytes: %zu", dataLen);}
+    if (accel){
+      if (dataLen % 16){return false;}
+      Accel::encryptCBC(encKeys, ivec, src, dest, dataLen);
+      return true;
+    }
     return mbedtls_aes_crypt_cbc(&ctx, MBEDTLS_AES_ENCRYPT, dataLen, (unsigned char *)ivec,
                                  (const unsigned char *)src, (unsigned char *)dest) == 0;
   }
+
+  /// Decrypts dataLen bytes, a multiple of 16, in CBC mode. Updates ivec to continue the chain.
+  bool AES::decryptBlockCBC(char *ivec, const char *src, char *dest, size_t dataLen){
+    if (dataLen % 16){WARN_MSG("Decrypting a non-multiple of 16 bytes: %zu", dataLen);}
+    if (accel){
+      if (dataLen % 16){return false;}
+      Accel::decryptCBC(decKeys, ivec, src, dest, dataLen);
+      return true;
+    }
+    return mbedtls_aes_crypt_cbc(&ctx, MBEDTLS_AES_DECRYPT, dataLen, (unsigned char *)ivec,
+                                 (const unsigned char *)src, (unsigned char *)dest) == 0;
+  }
 }// namespace Encryption
@@ -1,9 +1,12 @@
 #pragma once
+#include "aes_accel.h"
 #include "dtsc.h"
 #include <mbedtls/aes.h>
 #include <string>
 
 namespace Encryption{
+  /// AES-128 in CTR and CBC mode. Uses AES-NI or the ARMv8 cryptography extensions when the CPU
+  /// supports them, and mbedtls otherwise.
   class AES{
   public:
     AES();
@@ -21,8 +24,12 @@ namespace Encryption{
     DTSC::Packet encryptPacketCBC(const DTSC::Meta &M, const DTSC::Packet &src, char *ivec, size_t newTrack);
     std::string encryptBlockCBC(char *ivec, const std::string &inp);
     bool encryptBlockCBC(char *ivec, const char *src, char *dest, size_t dataLen);
+    bool decryptBlockCBC(char *ivec, const char *src, char *dest, size_t dataLen);
 
   protected:
     mbedtls_aes_context ctx;
+    bool accel; ///< True if the Accel round keys below are used instead of ctx
+    char encKeys[AES_ACCEL_KEYS];
+    char decKeys[AES_ACCEL_KEYS];
   };
 }// namespace Encryption
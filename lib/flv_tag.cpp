@@ -2,18 +2,23 @@
 /// Holds all code for the FLV namespace.
 
 #include "adts.h"
+#include "bitfields.h"
 #include "defines.h"
 #include "flv_tag.h"
 #include "mp4_generic.h"
 #include "rtmpchunks.h"
 #include "timing.h"
+#include "tinythread.h"
 #include "util.h"
 #include "adts.h"
+#include <deque>
 #include <fcntl.h> //for Tag::FileLoader
 #include <sstream>
 #include <stdio.h>  //for Tag::FileLoader
 #include <stdlib.h> //malloc
 #include <string.h> //memcpy
+#include <sys/mman.h> //for scanHeader
+#include <sys/stat.h> //for scanHeader
 #include <unistd.h> //for Tag::FileLoader
 
 #include "h264.h" //Needed for init data parsing in case of invalid values from FLV init
@@ -325,7 +330,10 @@ FLV::Tag &FLV::Tag::operator=(const FLV::Tag &O){
   return *this;
 }// assignment operator
 
-bool FLV::Tag::DTSCLoader(DTSC::Packet &packData, const DTSC::Meta &M, size_t idx){
+/// Loads the given DTSC packet into this tag.
+/// If copyPayload is false, the packet payload is not copied into the tag: the caller is expected
+/// to send it from the packet itself, between the tag header and the 4-byte tag size at the end.
+bool FLV::Tag::DTSCLoader(DTSC::Packet &packData, const DTSC::Meta &M, size_t idx, bool copyPayload){
   std::string meta_str;
   len = 0;
   if (idx == INVALID_TRACK_ID){
@@ -342,11 +350,11 @@ bool FLV::Tag::DTSCLoader(DTSC::Packet &packData, const DTSC::Meta &M, size_t id
     if (codec == "H264"){len += 4;}
     if (!checkBufferSize()){return false;}
     if (codec == "H264"){
-      memcpy(data + 16, tmpData, len - 20);
+      if (copyPayload){memcpy(data + 16, tmpData, len - 20);}
       data[12] = 1;
       offset(packData.getInt("offset"));
     }else{
-      memcpy(data + 12, tmpData, len - 16);
+      if (copyPayload){memcpy(data + 12, tmpData, len - 16);}
     }
     data[11] = 0;
     if (codec == "H264"){data[11] |= 7;}
@@ -371,10 +379,10 @@ bool FLV::Tag::DTSCLoader(DTSC::Packet &packData, const DTSC::Meta &M, size_t id
     if (codec == "AAC"){len++;}
     if (!checkBufferSize()){return false;}
     if (codec == "AAC"){
-      memcpy(data + 13, tmpData, len - 17);
+      if (copyPayload){memcpy(data + 13, tmpData, len - 17);}
       data[12] = 1; // raw AAC data, not sequence header
     }else{
-      memcpy(data + 12, tmpData, len - 16);
+      if (copyPayload){memcpy(data + 12, tmpData, len - 16);}
     }
     unsigned int datarate = M.getRate(idx);
     data[11] = 0;
@@ -955,3 +963,200 @@ bool FLV::Tag::checkBufferSize(){
   }
   return true;
 }
+
+/// Returns the position after the tag at pos, or 0 if no valid audio, video or script tag starts
+/// there, judging by its type, stream ID, and the previous tag size field that follows it.
+static uint64_t tagEnd(const char *base, uint64_t size, uint64_t pos){
+  if (pos + 15 > size){return 0;}
+  const char *p = base + pos;
+  if (p[0] != 0x08 && p[0] != 0x09 && p[0] != 0x12){return 0;}
+  if (p[8] || p[9] || p[10]){return 0;}
+  uint32_t dataLen = Bit::btoh24(p + 1);
+  if (pos + 15 + dataLen > size){return 0;}
+  if (Bit::btohl(p + 11 + dataLen) != dataLen + 11){return 0;}
+  return pos + 15 + dataLen;
+}
+
+namespace FLV{
+  /// Metadata of a single tag found by a ChunkScan.
+  struct ScanRecord{
+    uint64_t time;
+    int64_t offset;
+    uint64_t bpos;
+    size_t dataLen;
+    unsigned int trackID;
+    bool keyframe;
+    bool needsMeta; ///< Tag must be passed to Tag::toMeta while merging
+    bool isMedia;   ///< Tag is a media packet, not init data or empty
+  };
+
+  /// Reads the tags starting in one byte range of a memory mapped FLV file on a thread of its own,
+  /// for scanHeader. Only tags that may change the track metadata are marked to be parsed again
+  /// while merging: script tags, init data, and the first tag of each type or audio codec.
+  class ChunkScan{
+  public:
+    ChunkScan(const char *b, uint64_t s, uint64_t e, uint64_t sz) : base(b), start(s), end(e), size(sz){
+      pos = start;
+      finished = false;
+      errorPos = 0;
+    }
+
+    static void run(void *arg){
+      ChunkScan *S = (ChunkScan *)arg;
+      S->scan();
+      S->finished = true;
+    }
+
+    void scan(){
+      Tag T;
+      bool seenAudio = false, seenVideo = false;
+      std::string audioCodec;
+      while (pos < end){
+        unsigned int P = 0;
+        unsigned int avail = (size - pos > 0x2000000) ? 0x2000000 : size - pos;
+        bool loaded = false;
+        while (!loaded && P < avail){
+          unsigned int preP = P;
+          loaded = T.MemLoader(base + pos, avail, P);
+          if (!loaded && P == preP){break;}
+        }
+        if (!loaded){
+          // A tag cut off by the end of the file ends it, like when reading it in order
+          if (pos + P >= size){return;}
+          errorPos = pos;
+          return;
+        }
+        ScanRecord R;
+        R.bpos = pos;
+        R.time = T.tagTime();
+        R.offset = T.offset();
+        R.dataLen = T.getDataLen();
+        R.trackID = T.getTrackID();
+        R.keyframe = T.isKeyframe;
+        bool init = T.needsInitData() && T.isInitData();
+        R.isMedia = R.dataLen && !init;
+        R.needsMeta = (T.data[0] == 0x12) || init;
+        if (T.data[0] == 0x08){
+          if (!seenAudio || audioCodec != T.getAudioCodec()){R.needsMeta = true;}
+          seenAudio = true;
+          audioCodec = T.getAudioCodec();
+        }
+        if (T.data[0] == 0x09 && !seenVideo){
+          R.needsMeta = true;
+          seenVideo = true;
+        }
+        records.push_back(R);
+        pos += P;
+      }
+    }
+
+    const char *base;
+    uint64_t start; ///< Position of the first tag in the range
+    uint64_t end;   ///< Byte after the range
+    uint64_t size;
+    volatile uint64_t pos; ///< Current read position, for progress reporting
+    volatile bool finished;
+    uint64_t errorPos; ///< Position of a tag that could not be read, if not 0
+    std::deque<ScanRecord> records;
+  };
+}// namespace FLV
+
+/// Fills meta with the tracks and tags of the given FLV file, by splitting the file into the
+/// given amount of byte ranges and reading them in parallel, one thread per range.
+/// If progress is set, it is updated with the fraction of the file read, 0 through 255.
+/// Like reading the file in order, stops at the first tag that cannot be read.
+/// If indexed is set, reading starts at the tag it points to, if any, and it receives the
+/// position after the last tag read: this resumes indexing a file that grew since.
+/// Returns false if the file cannot be memory mapped, in which case meta is not touched.
+bool FLV::scanHeader(const std::string &file, DTSC::Meta &meta, size_t chunks, uint8_t *progress, uint64_t *indexed){
+  int fd = open(file.c_str(), O_RDONLY);
+  if (fd == -1){return false;}
+  struct stat st;
+  if (fstat(fd, &st) || st.st_size < 13){
+    close(fd);
+    return false;
+  }
+  uint64_t size = st.st_size;
+  uint64_t from = (indexed && *indexed) ? *indexed : 13;
+  if (from > size){
+    close(fd);
+    return false;
+  }
+  char *base = (char *)mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED){return false;}
+  if (!chunks){chunks = 1;}
+
+  // Split the file, starting every range but the first at the first valid tag within it
+  std::deque<ChunkScan *> scans;
+  for (size_t i = 0; i < chunks; ++i){
+    uint64_t s = from + (size - from) * i / chunks;
+    uint64_t e = (i + 1 == chunks) ? size : from + (size - from) * (i + 1) / chunks;
+    while (i && s < e){
+      uint64_t next = tagEnd(base, size, s);
+      if (next && (next == size || tagEnd(base, size, next))){break;}
+      ++s;
+    }
+    scans.push_back(new ChunkScan(base, s, e, size));
+  }
+  std::deque<tthread::thread *> threads;
+  for (size_t i = 0; i < chunks; ++i){threads.push_back(new tthread::thread(ChunkScan::run, scans[i]));}
+  bool finished = false;
+  while (!finished){
+    finished = true;
+    uint64_t done = 0;
+    for (size_t i = 0; i < chunks; ++i){
+      uint64_t p = scans[i]->pos;
+      done += (p < scans[i]->end ? p : scans[i]->end) - scans[i]->start;
+      if (!scans[i]->finished){finished = false;}
+    }
+    if (progress && size > from){*progress = (255 * done) / (size - from);}
+    if (!finished){Util::sleep(100);}
+  }
+  for (size_t i = 0; i < chunks; ++i){
+    threads[i]->join();
+    delete threads[i];
+  }
+  // Errors are handled below, per range
+  FLV::Parse_Error = false;
+
+  // Every range must start where the tags of the previous one ended, or a range started in the
+  // middle of a tag that merely looked like a valid tag
+  for (size_t i = 1; i < chunks && !scans[i - 1]->errorPos; ++i){
+    if (scans[i - 1]->pos != scans[i]->start){
+      WARN_MSG("Could not split %s into ranges of whole tags", file.c_str());
+      for (size_t j = 0; j < chunks; ++j){delete scans[j];}
+      munmap(base, size);
+      return false;
+    }
+  }
+
+  // Merge the ranges in order, passing only the tags that may change the metadata to toMeta
+  AMF::Object amf_storage;
+  Tag T;
+  for (size_t i = 0; i < chunks; ++i){
+    ChunkScan &S = *scans[i];
+    for (std::deque<ScanRecord>::iterator it = S.records.begin(); it != S.records.end(); ++it){
+      if (it->needsMeta){
+        unsigned int P = 0;
+        unsigned int avail = (size - it->bpos > 0x2000000) ? 0x2000000 : size - it->bpos;
+        while (P < avail && !T.MemLoader(base + it->bpos, avail, P)){}
+        T.toMeta(meta, amf_storage);
+      }
+      if (!it->isMedia){continue;}
+      size_t idx = meta.trackIDToIndex(it->trackID, getpid());
+      if (idx != INVALID_TRACK_ID){
+        meta.update(it->time, it->offset, idx, it->dataLen, it->bpos, it->keyframe);
+      }
+    }
+    if (indexed){*indexed = S.errorPos ? S.errorPos : S.pos;}
+    if (S.errorPos){
+      ERROR_MSG("Stopping at FLV parse error @%" PRIu64, S.errorPos);
+      break;
+    }
+  }
+  if (progress){*progress = 255;}
+  for (size_t i = 0; i < chunks; ++i){delete scans[i];}
+  munmap(base, size);
+  return true;
+}
@@ -27,6 +27,10 @@ namespace FLV{
   /// Helper function that can quickly skip through a file looking for a particular tag type
   bool seekToTagType(FILE *f, uint8_t type);
 
+  /// Reads the header of a FLV file in parallel byte ranges
+  bool scanHeader(const std::string &file, DTSC::Meta &meta, size_t chunks, uint8_t *progress = 0,
+                  uint64_t *indexed = 0);
+
   /// This class is used to hold, work with and get information about a single FLV tag.
   class Tag{
   public:
@@ -49,7 +53,7 @@ namespace FLV{
     ~Tag();                          ///< Generic destructor.
     // loader functions
     bool ChunkLoader(const RTMPStream::Chunk &O);
-    bool DTSCLoader(DTSC::Packet &packData, const DTSC::Meta &M, size_t idx);
+    bool DTSCLoader(DTSC::Packet &packData, const DTSC::Meta &M, size_t idx, bool copyPayload = true);
     bool DTSCVideoInit(DTSC::Meta &meta, uint32_t vTrack);
     bool DTSCAudioInit(const std::string & codec, unsigned int sampleRate, unsigned int sampleSize, unsigned int channels, const std::string & initData);
     bool DTSCMetaInit(const DTSC::Meta &M, std::set<size_t> &selTracks);
@@ -1,6 +1,7 @@
 #include "hls_support.h"
 #include "langcodes.h" /*LTS*/
 #include "stream.h"
+#include "timing.h"
 #include <cstdlib>
 #include <sstream>
 #include <iomanip>
@@ -54,6 +55,63 @@ namespace HLS{
     return std::min(M.getLastms(trackIdx), Util::unixMS() - streamStartTime - minKeepAway);
   }
 
+  /// Returns a number that changes whenever playlists timed by the given track change: when a
+  /// fragment is added or removed, when a partial fragment completes at the live edge, or when the
+  /// stream stops being live (so the playlist gets its ending tags).
+  /// \param lastMs The live edge of the track, as used for generating the playlist.
+  uint64_t playlistVersion(const DTSC::Meta &M, size_t tid, uint64_t lastMs){
+    DTSC::Fragments fragments(M.getFragments(tid));
+    uint64_t firstFrag = fragments.getFirstValid();
+    uint64_t endFrag = fragments.getEndValid();
+    // Zero until the last fragment has started, then one more than its amount of complete parts
+    uint64_t parts = 0;
+    if (endFrag > firstFrag){
+      DTSC::Keys keys(M.getKeys(tid));
+      uint64_t lastStart = keys.getTime(fragments.getFirstKey(endFrag - 1));
+      if (lastMs > lastStart){parts = (lastMs - lastStart) / partDurationMaxMs + 1;}
+    }
+    uint64_t version = firstFrag;
+    version = version * 1000003 + endFrag;
+    version = version * 1000003 + parts;
+    version = version * 1000003 + M.getFirstms(tid);
+    version = version * 1000003 + (M.getLive() ? 1 : 0);
+    return version;
+  }
+
+  /// Returns the version of the media playlist described by trackData.
+  uint64_t playlistVersion(const DTSC::Meta &M, const std::map<size_t, Comms::Users> &userSelect,
+                           const TrackData &trackData){
+    uint64_t lastMs = std::min(
+        getLastms(M, userSelect, trackData.requestTrackId, trackData.systemBoot + trackData.bootMsOffset),
+        getLastms(M, userSelect, trackData.timingTrackId, trackData.systemBoot + trackData.bootMsOffset));
+    return playlistVersion(M, trackData.timingTrackId, lastMs);
+  }
+
+  /// Retrieves the manifest stored under key, if it was stored for the given version.
+  bool ManifestCache::get(const std::string &key, uint64_t version, std::string &manifest){
+    std::map<std::string, Entry>::iterator it = entries.find(key);
+    if (it == entries.end() || it->second.version != version){return false;}
+    it->second.lastUse = Util::bootMS();
+    manifest = it->second.manifest;
+    return true;
+  }
+
+  /// Stores a manifest under key for the given version, replacing any older version.
+  /// Makes room by dropping the least recently used manifest when full.
+  void ManifestCache::set(const std::string &key, uint64_t version, const std::string &manifest){
+    if (!entries.count(key) && entries.size() >= 64){
+      std::map<std::string, Entry>::iterator oldest = entries.begin();
+      for (std::map<std::string, Entry>::iterator it = entries.begin(); it != entries.end(); ++it){
+        if (it->second.lastUse < oldest->second.lastUse){oldest = it;}
+      }
+      entries.erase(oldest);
+    }
+    Entry &E = entries[key];
+    E.version = version;
+    E.lastUse = Util::bootMS();
+    E.manifest = manifest;
+  }
+
   /// Calculate HLS media playlist version compatibility
   /// \return version number
   uint16_t calcManifestVersion(const std::string &hlsSkip){
@@ -417,7 +475,7 @@ namespace HLS{
   void addAltRenditionReports(std::stringstream &result, const DTSC::Meta &M,
                               const std::map<size_t, Comms::Users> &userSelect,
                               const FragmentData &fragData, const TrackData &trackData){
-    DTSC::Fragments fragments(M.fragments(trackData.timingTrackId));
+    DTSC::Fragments fragments(M.getFragments(trackData.timingTrackId));
     std::ldiv_t altPart =
         std::ldiv(fragments.getDuration(fragData.currentFrag - 2), partDurationMaxMs);
     std::map<size_t, Comms::Users>::const_iterator it = userSelect.end();
@@ -698,7 +756,7 @@ namespace HLS{
   /// Get the first fragment number to be printed in the playlist
   u_int64_t getInitFragment(const DTSC::Meta &M, const MasterData &masterData){
     if (M.getLive()){
-      DTSC::Fragments fragments(M.fragments(masterData.mainTrack));
+      DTSC::Fragments fragments(M.getFragments(masterData.mainTrack));
       DTSC::Keys keys(M.getKeys(masterData.mainTrack));
       u_int64_t iFrag = std::max(fragments.getEndValid() -
                                      (masterData.noLLHLS ? 10 : getLiveLengthLimit(masterData)),
@@ -747,7 +805,7 @@ namespace HLS{
   /// returns 0 for a hinted part which never got created
   uint64_t getPartTargetTime(const DTSC::Meta &M, const uint32_t idx, const uint32_t mTrack,
                              const uint64_t startTime, const uint64_t msn, const uint32_t part){
-    DTSC::Fragments fragments(M.fragments(mTrack));
+    DTSC::Fragments fragments(M.getFragments(mTrack));
 
     // Estimate the target end time for a given part
     // 50 ms is margin of safety to accommodate inconsistencies
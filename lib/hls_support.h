@@ -55,6 +55,27 @@ namespace HLS{
     int64_t bootMsOffset;  ///< time diff between systemBoot & stream's 0 time in ms
   };
 
+  /// Media playlists and other manifests generated by this process, kept for as long as the
+  /// version they were generated for is current. Multiplexed workers share them between all
+  /// viewers they handle, other outputs between repeated requests of the same viewer.
+  class ManifestCache{
+  public:
+    bool get(const std::string &key, uint64_t version, std::string &manifest);
+    void set(const std::string &key, uint64_t version, const std::string &manifest);
+
+  private:
+    struct Entry{
+      uint64_t version;
+      uint64_t lastUse;
+      std::string manifest;
+    };
+    std::map<std::string, Entry> entries;
+  };
+
+  uint64_t playlistVersion(const DTSC::Meta &M, size_t tid, uint64_t lastMs);
+  uint64_t playlistVersion(const DTSC::Meta &M, const std::map<size_t, Comms::Users> &userSelect,
+                           const TrackData &trackData);
+
   uint32_t blockPlaylistReload(const DTSC::Meta &M, const std::map<size_t, Comms::Users> &userSelect, const TrackData &trackData,
                                const HlsSpecData &hlsSpecData, const DTSC::Fragments &fragments,
                                const DTSC::Keys &keys);
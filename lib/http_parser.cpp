@@ -257,17 +257,21 @@ void HTTP::Parser::SendResponse(std::string code, std::string message, Socket::C
   std::map<std::string, std::string>::iterator it;
   if (protocol.size() < 5 || protocol[4] != '/'){protocol = "HTTP/1.0";}
   builder = protocol + " " + code + " " + message + "\r\n";
-  conn.SendNow(builder);
   for (it = headers.begin(); it != headers.end(); it++){
     if ((*it).first != "" && (*it).second != ""){
       if ((*it).first != "Content-Length" || (*it).second != "0"){
-        builder = (*it).first + ": " + (*it).second + "\r\n";
-        conn.SendNow(builder);
+        builder += (*it).first + ": " + (*it).second + "\r\n";
       }
     }
   }
-  conn.SendNow("\r\n", 2);
-  conn.SendNow(body);
+  builder += "\r\n";
+  // send the headers and body in one go
+  struct iovec parts[2];
+  parts[0].iov_base = (void *)builder.data();
+  parts[0].iov_len = builder.size();
+  parts[1].iov_base = (void *)body.data();
+  parts[1].iov_len = body.size();
+  conn.SendNow(parts, 2);
 }
 
 /// Creates and sends a valid HTTP 1.0 or 1.1 response, based on the given request.
@@ -512,31 +516,23 @@ void HTTP::Parser::SetVar(std::string i, std::string v){
 /// returned. If not, as much as can be interpreted is removed and false returned. \param conn The
 /// socket to read from. \return True if a whole request or response was read, false otherwise.
 bool HTTP::Parser::Read(Socket::Connection &conn, Util::DataCallback &cb){
+  // Parse straight from the receive buffer, removing only what was interpreted
+  Socket::Buffer &buf = conn.Received();
+  size_t len = buf.length();
   // In this case, we might have a broken connection and need to check if we're done
-  if (!conn.Received().size()){
-    return (parse(conn.Received().get(), cb) && (!possiblyComplete || !conn || !JSON::Value(url).asInt()));
+  if (!len){
+    size_t pos = 0;
+    return (parse(0, 0, pos, cb) && (!possiblyComplete || !conn || !JSON::Value(url).asInt()));
   }
-  while (conn.Received().size()){
-    // Make sure the received data ends in a newline (\n).
-    while ((!seenHeaders || (getChunks && !doingChunk)) && conn.Received().get().size() &&
-           *(conn.Received().get().rbegin()) != '\n'){
-      if (conn.Received().size() > 1){
-        // make a copy of the first part
-        std::string tmp = conn.Received().get();
-        // clear the first part, wiping it from the partlist
-        conn.Received().get().clear();
-        conn.Received().size();
-        // take the now first (was second) part, insert the stored part in front of it
-        conn.Received().get().insert(0, tmp);
-      }else{
-        return false;
-      }
-    }
-
+  while (len){
+    size_t pos = 0;
+    bool ret = parse(buf.peek(len), len, pos, cb);
+    buf.consume(pos);
     // return true if a parse succeeds, and is not a request
-    if (parse(conn.Received().get(), cb) && (!possiblyComplete || !conn || !JSON::Value(url).asInt())){
-      return true;
-    }
+    if (ret && (!possiblyComplete || !conn || !JSON::Value(url).asInt())){return true;}
+    // stop if nothing could be interpreted; we need more data first
+    if (!pos){return false;}
+    len = buf.length();
   }
   return false;
 }// HTTPReader::Read
@@ -562,20 +558,28 @@ uint8_t HTTP::Parser::getPercentage() const{
 /// \param HTTPbuffer The data buffer to read from.
 /// \return True on success, false otherwise.
 bool HTTP::Parser::parse(std::string &HTTPbuffer, Util::DataCallback &cb){
-  size_t f;
+  size_t pos = 0;
+  bool ret = parse(HTTPbuffer.data(), HTTPbuffer.size(), pos, cb);
+  if (pos){HTTPbuffer.erase(0, pos);}
+  return ret;
+}
+
+/// Attempt to read a whole HTTP response or request from a data buffer, without copying it.
+/// If succesful, fills its own fields with the proper data.
+/// \param data The data buffer to read from.
+/// \param len The amount of bytes in the data buffer.
+/// \param pos Offset in the data buffer to start reading from; set to the offset of the first
+/// byte that was not interpreted when returning.
+/// \return True on success, false otherwise.
+bool HTTP::Parser::parse(const char *data, size_t len, size_t &pos, Util::DataCallback &cb){
   std::string tmpA, tmpB, tmpC;
-  /// \todo Make this not resize HTTPbuffer in parts, but read all at once and then remove the
-  /// entire request, like doxygen claims it does?
-  while (!HTTPbuffer.empty()){
+  while (pos < len){
     if (!seenHeaders){
-      f = HTTPbuffer.find('\n');
-      if (f == std::string::npos) return false;
-      tmpA = HTTPbuffer.substr(0, f);
-      if (f + 1 == HTTPbuffer.size()){
-        HTTPbuffer.clear();
-      }else{
-        HTTPbuffer.erase(0, f + 1);
-      }
+      const char *lf = (const char *)memchr(data + pos, '\n', len - pos);
+      if (!lf) return false;
+      tmpA.assign(data + pos, lf - data - pos);
+      pos = lf - data + 1;
+      size_t f;
       while (tmpA.find('\r') != std::string::npos){tmpA.erase(tmpA.find('\r'));}
       if (!seenReq){
         seenReq = true;
@@ -654,26 +658,26 @@ bool HTTP::Parser::parse(std::string &HTTPbuffer, Util::DataCallback &cb){
 
         // limit the amount of bytes that will be appended to the amount there
         // is available
-        if (toappend > HTTPbuffer.size()){toappend = HTTPbuffer.size();}
+        if (toappend > len - pos){toappend = len - pos;}
 
         if (toappend > 0){
           bool shouldAppend = true;
           // check if pointer callback function is set and run callback. remove partial data from buffer
           if (bodyCallback){
-            bodyCallback(HTTPbuffer.data(), toappend);
+            bodyCallback(data + pos, toappend);
             length -= toappend;
             shouldAppend = false;
           }
 
           // check if reference callback function is set and run callback. remove partial data from buffer
           if (&cb != &Util::defaultDataCallback){
-            cb.dataCallback(HTTPbuffer.data(), toappend);
+            cb.dataCallback(data + pos, toappend);
             length -= toappend;
             shouldAppend = false;
           }
 
-          if (shouldAppend){body.append(HTTPbuffer, 0, toappend);}
-          HTTPbuffer.erase(0, toappend);
+          if (shouldAppend){body.append(data + pos, toappend);}
+          pos += toappend;
           currentLength += toappend;
         }
         if (length == body.length()){
@@ -685,29 +689,29 @@ bool HTTP::Parser::parse(std::string &HTTPbuffer, Util::DataCallback &cb){
         }
       }else{
         if (getChunks){
-          currentLength += HTTPbuffer.size();
+          currentLength += len - pos;
           if (doingChunk){
-            unsigned int toappend = HTTPbuffer.size();
+            unsigned int toappend = len - pos;
             if (toappend > doingChunk){toappend = doingChunk;}
 
             bool shouldAppend = true;
             if (bodyCallback){
-              bodyCallback(HTTPbuffer.data(), toappend);
+              bodyCallback(data + pos, toappend);
               shouldAppend = false;
             }
 
             if (&cb != &Util::defaultDataCallback){
-              cb.dataCallback(HTTPbuffer.data(), toappend);
+              cb.dataCallback(data + pos, toappend);
               shouldAppend = false;
             }
 
-            if (shouldAppend){body.append(HTTPbuffer, 0, toappend);}
-            HTTPbuffer.erase(0, toappend);
+            if (shouldAppend){body.append(data + pos, toappend);}
+            pos += toappend;
             doingChunk -= toappend;
           }else{
-            f = HTTPbuffer.find('\n');
-            if (f == std::string::npos){return false;}
-            tmpA = HTTPbuffer.substr(0, f);
+            const char *lf = (const char *)memchr(data + pos, '\n', len - pos);
+            if (!lf){return false;}
+            tmpA.assign(data + pos, lf - data - pos);
             while (tmpA.find('\r') != std::string::npos){tmpA.erase(tmpA.find('\r'));}
             unsigned int chunkLen = 0;
             if (!tmpA.empty()){
@@ -720,29 +724,25 @@ bool HTTP::Parser::parse(std::string &HTTPbuffer, Util::DataCallback &cb){
               }
               doingChunk = chunkLen;
             }
-            if (f + 1 == HTTPbuffer.size()){
-              HTTPbuffer.clear();
-            }else{
-              HTTPbuffer.erase(0, f + 1);
-            }
+            pos = lf - data + 1;
           }
           return false;
         }else{
           if (protocol.substr(0, 4) == "RTSP" || method.substr(0, 4) == "RTSP"){return true;}
-          unsigned int toappend = HTTPbuffer.size();
+          unsigned int toappend = len - pos;
           bool shouldAppend = true;
           if (bodyCallback){
-            bodyCallback(HTTPbuffer.data(), toappend);
+            bodyCallback(data + pos, toappend);
             shouldAppend = false;
           }
 
           if (&cb != &Util::defaultDataCallback){
-            cb.dataCallback(HTTPbuffer.data(), toappend);
+            cb.dataCallback(data + pos, toappend);
             shouldAppend = false;
           }
 
-          if (shouldAppend){body.append(HTTPbuffer, 0, toappend);}
-          HTTPbuffer.erase(0, toappend);
+          if (shouldAppend){body.append(data + pos, toappend);}
+          pos += toappend;
 
           // return true if there is no body, otherwise we only stop when the connection is dropped
           possiblyComplete = true;
@@ -820,11 +820,15 @@ void HTTP::Parser::Chunkify(const char *data, unsigned int size, Socket::Connect
       len[--offset] = hexa[t_size & 0xf];
       t_size >>= 4;
     }
-    conn.SendNow(len + offset, 10 - offset);
-    // send the chunk itself
-    conn.SendNow(data, size);
-    // append \r\n
-    conn.SendNow("\r\n", 2);
+    // send the chunk size, the chunk itself and the trailing \r\n in one go
+    struct iovec parts[3];
+    parts[0].iov_base = len + offset;
+    parts[0].iov_len = 10 - offset;
+    parts[1].iov_base = (void *)data;
+    parts[1].iov_len = size;
+    parts[2].iov_base = (void *)"\r\n";
+    parts[2].iov_len = 2;
+    conn.SendNow(parts, 3);
   }else{
     // just send the chunk itself
     conn.SendNow(data, size);
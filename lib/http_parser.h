@@ -73,6 +73,7 @@ namespace HTTP{
     bool possiblyComplete;
     unsigned int doingChunk;
     bool parse(std::string &HTTPbuffer, Util::DataCallback &cb = Util::defaultDataCallback);
+    bool parse(const char *data, size_t len, size_t &pos, Util::DataCallback &cb = Util::defaultDataCallback);
     std::string builder;
     std::string read_buffer;
     std::map<std::string, std::string> headers;
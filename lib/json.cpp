@@ -265,7 +265,14 @@ static std::string UTF16(uint32_t c){
 }
 
 std::string JSON::string_escape(const std::string &val){
-  std::string out = "\"";
+  std::string out;
+  string_escape(out, val);
+  return out;
+}
+
+/// Appends the JSON-string-escaped value to out, without building a temporary string.
+void JSON::string_escape(std::string &out, const std::string &val){
+  out += "\"";
   for (size_t i = 0; i < val.size(); ++i){
     const char &c = val.data()[i];
     switch (c){
@@ -319,7 +326,6 @@ std::string JSON::string_escape(const std::string &val){
     }
   }
   out += "\"";
-  return out;
 }
 
 /// Skips an std::istream forward until any of the following characters is seen: ,]}
@@ -1485,3 +1491,541 @@ JSON::Value JSON::fromDTMI2(const char *data, uint64_t len, uint32_t &i){
   fromDTMI2(data, len, i, ret);
   return ret;
 }
+
+JSON::Writer::Writer() : afterKey(false){}
+
+/// Writes the comma needed before the next item, if any.
+void JSON::Writer::separate(){
+  if (afterKey){
+    afterKey = false;
+    return;
+  }
+  if (!hasItems.size()){return;}
+  if (hasItems.back()){
+    buffer += ',';
+  }else{
+    hasItems.back() = true;
+  }
+}
+
+void JSON::Writer::objectBegin(){
+  separate();
+  buffer += '{';
+  hasItems.push_back(false);
+}
+
+void JSON::Writer::objectEnd(){
+  buffer += '}';
+  hasItems.pop_back();
+}
+
+void JSON::Writer::arrayBegin(){
+  separate();
+  buffer += '[';
+  hasItems.push_back(false);
+}
+
+void JSON::Writer::arrayEnd(){
+  buffer += ']';
+  hasItems.pop_back();
+}
+
+/// Writes the name of the next member of the current object; must be followed by its value.
+void JSON::Writer::key(const std::string &name){
+  separate();
+  string_escape(buffer, name);
+  buffer += ':';
+  afterKey = true;
+}
+
+void JSON::Writer::value(const std::string &val){
+  separate();
+  string_escape(buffer, val);
+}
+
+void JSON::Writer::value(const char *val){
+  value(std::string(val));
+}
+
+void JSON::Writer::value(int32_t val){
+  value((int64_t)val);
+}
+
+void JSON::Writer::value(int64_t val){
+  separate();
+  char num[24];
+  buffer.append(num, snprintf(num, 24, "%" PRId64, val));
+}
+
+void JSON::Writer::value(uint32_t val){
+  value((uint64_t)val);
+}
+
+void JSON::Writer::value(uint64_t val){
+  separate();
+  char num[24];
+  buffer.append(num, snprintf(num, 24, "%" PRIu64, val));
+}
+
+void JSON::Writer::value(double val){
+  separate();
+  std::stringstream st;
+  st.precision(10);
+  st << std::fixed << val;
+  buffer += st.str();
+}
+
+void JSON::Writer::value(bool val){
+  separate();
+  buffer += val ? "true" : "false";
+}
+
+/// Writes an already built JSON::Value, for small parts of the output.
+void JSON::Writer::value(const Value &val){
+  separate();
+  buffer += val.toString();
+}
+
+void JSON::Writer::null(){
+  separate();
+  buffer += "null";
+}
+
+/// Returns the text written so far; callers may send it out and clear it at any time.
+std::string &JSON::Writer::str(){
+  return buffer;
+}
+
+JSON::Flat::Flat(){}
+
+JSON::Flat::Flat(const std::string &json){
+  parse(json.data(), json.size());
+}
+
+JSON::Flat::Flat(const char *data, size_t len){
+  parse(data, len);
+}
+
+/// Appends a node for a new value to the document, as a child of the innermost open object or
+/// array (if any), using the pending member name for objects.
+JSON::Flat::Node &JSON::Flat::addNode(ValueType type, const std::vector<uint32_t> &open, bool &haveKey,
+                                      uint32_t keyOff, uint32_t keyLen){
+  Node n;
+  n.type = type;
+  n.next = nodes.size() + 1;
+  n.size = 0;
+  n.key = 0;
+  n.keyLen = 0;
+  n.intVal = 0;
+  if (open.size()){
+    Node &parent = nodes[open.back()];
+    parent.size++;
+    if (parent.type == OBJECT && haveKey){
+      n.key = keyOff;
+      n.keyLen = keyLen;
+    }
+  }
+  haveKey = false;
+  nodes.push_back(n);
+  return nodes.back();
+}
+
+/// Decodes a string starting at position p (just past the opening separator) into the strings
+/// buffer, the same way JSON::fromString does. Returns the position just past the closing separator.
+size_t JSON::Flat::readString(const char *data, size_t len, size_t p, char separator){
+  uint32_t fullChar = 0;
+  while (p < len){
+    char c = data[p++];
+    if (c != '\\'){
+      if (fullChar){
+        strings += UTF8(fullChar >> 16);
+        fullChar = 0;
+      }
+      if (c == separator){return p;}
+      strings += c;
+      continue;
+    }
+    if (p >= len){break;}
+    c = data[p++];
+    if (fullChar && c != 'u'){
+      strings += UTF8(fullChar >> 16);
+      fullChar = 0;
+    }
+    switch (c){
+    case 'b': strings += '\b'; break;
+    case 'f': strings += '\f'; break;
+    case 'n': strings += '\n'; break;
+    case 'r': strings += '\r'; break;
+    case 't': strings += '\t'; break;
+    case 'x':
+      if (p + 2 > len){return len;}
+      strings += (char)(c2hex(data[p + 1]) + (c2hex(data[p]) << 4));
+      p += 2;
+      break;
+    case 'u':{
+      // A separator inside the escape ends the string, like for JSON::fromString
+      for (size_t i = 0; i < 4; ++i){
+        if (p + i >= len || data[p + i] == separator){
+          if (fullChar){strings += UTF8(fullChar >> 16);}
+          return p + i + 1;
+        }
+      }
+      uint32_t tmpChar = (c2hex(data[p + 3]) + (c2hex(data[p + 2]) << 4) + (c2hex(data[p + 1]) << 8) +
+                          (c2hex(data[p]) << 12));
+      p += 4;
+      if (fullChar && (tmpChar < 0xDC00 || tmpChar > 0xDFFF)){
+        // not a low surrogate - handle high surrogate separately!
+        strings += UTF8(fullChar >> 16);
+        fullChar = 0;
+      }
+      fullChar |= tmpChar;
+      if (fullChar >= 0xD800 && fullChar <= 0xDBFF){
+        // possibly high surrogate! Read next characters before handling...
+        fullChar <<= 16;
+      }else{
+        strings += UTF8(fullChar);
+        fullChar = 0;
+      }
+      break;
+    }
+    default: strings += c; break;
+    }
+  }
+  if (fullChar){strings += UTF8(fullChar >> 16);}
+  return len;
+}
+
+/// Parses the given JSON text, replacing any previous contents.
+/// Parsing stops after the first complete top-level value.
+void JSON::Flat::parse(const char *data, size_t len){
+  nodes.clear();
+  strings.clear();
+  // Decoded strings plus their terminators never take more space than the text they came from
+  strings.reserve(len);
+  std::vector<uint32_t> open;
+  bool haveKey = false;
+  uint32_t keyOff = 0, keyLen = 0;
+  size_t p = 0;
+  while (p < len){
+    char c = data[p];
+    switch (c){
+    case '{':
+    case '[':
+      addNode(c == '{' ? OBJECT : ARRAY, open, haveKey, keyOff, keyLen);
+      open.push_back(nodes.size() - 1);
+      ++p;
+      break;
+    case '}':
+    case ']':
+      ++p;
+      haveKey = false;
+      if (!open.size()){
+        p = len;
+        break;
+      }
+      nodes[open.back()].next = nodes.size();
+      open.pop_back();
+      if (!open.size()){p = len;}
+      break;
+    case '\'':
+    case '"':{
+      uint32_t off = strings.size();
+      p = readString(data, len, p + 1, c);
+      uint32_t sLen = strings.size() - off;
+      strings += '\0';
+      // Strings inside objects are alternately member names and values
+      if (open.size() && nodes[open.back()].type == OBJECT && !haveKey){
+        haveKey = true;
+        keyOff = off;
+        keyLen = sLen;
+        break;
+      }
+      Node &n = addNode(STRING, open, haveKey, keyOff, keyLen);
+      n.strOffset = off;
+      n.size = sLen;
+      if (!open.size()){p = len;}
+      break;
+    }
+    case '-':
+    case '0':
+    case '1':
+    case '2':
+    case '3':
+    case '4':
+    case '5':
+    case '6':
+    case '7':
+    case '8':
+    case '9':{
+      // Same digit-by-digit calculation as JSON::fromString, so results are identical
+      bool negative = (c == '-');
+      if (negative){++p;}
+      int64_t intVal = 0;
+      double dblVal = 0, dblDivider = 1;
+      bool isDouble = false;
+      while (p < len){
+        c = data[p];
+        if (c >= '0' && c <= '9'){
+          if (isDouble){
+            dblDivider *= 10;
+            dblVal += ((double)((c - '0')) / dblDivider);
+          }else{
+            intVal = intVal * 10 + (c - '0');
+          }
+        }else if (c == '.' && !isDouble){
+          isDouble = true;
+          dblVal = intVal;
+        }else{
+          break;
+        }
+        ++p;
+      }
+      Node &n = addNode(isDouble ? DOUBLE : INTEGER, open, haveKey, keyOff, keyLen);
+      if (isDouble){
+        n.dblVal = negative ? -dblVal : dblVal;
+      }else{
+        n.intVal = negative ? -intVal : intVal;
+      }
+      if (!open.size()){p = len;}
+      break;
+    }
+    case 't':
+    case 'T':
+    case 'f':
+    case 'F':
+    case 'n':
+    case 'N':{
+      bool isNull = (c == 'n' || c == 'N');
+      Node &n = addNode(isNull ? EMPTY : BOOL, open, haveKey, keyOff, keyLen);
+      n.intVal = (c == 't' || c == 'T');
+      while (p < len && ((data[p] >= 'a' && data[p] <= 'z') || (data[p] >= 'A' && data[p] <= 'Z'))){++p;}
+      if (!open.size()){p = len;}
+      break;
+    }
+    default: ++p; break;
+    }
+  }
+  // Close anything left open by a truncated document
+  while (open.size()){
+    nodes[open.back()].next = nodes.size();
+    open.pop_back();
+  }
+}
+
+/// Returns the top-level value of the document.
+JSON::Flat::Ref JSON::Flat::root() const{
+  return Ref(this, 0, nodes.size());
+}
+
+/// Returns the total amount of values in the document.
+size_t JSON::Flat::nodeCount() const{
+  return nodes.size();
+}
+
+JSON::Flat::Ref::Ref() : doc(0), index(0), parentEnd(0){}
+
+JSON::Flat::Ref::Ref(const Flat *doc, uint32_t index, uint32_t parentEnd)
+    : doc(doc), index(index), parentEnd(parentEnd){}
+
+/// True if this refers to a value in the document, which may be a null value.
+bool JSON::Flat::Ref::exists() const{
+  return doc && index < doc->nodes.size();
+}
+
+JSON::ValueType JSON::Flat::Ref::getType() const{
+  if (!exists()){return EMPTY;}
+  return doc->nodes[index].type;
+}
+
+bool JSON::Flat::Ref::isInt() const{
+  return getType() == INTEGER;
+}
+
+bool JSON::Flat::Ref::isDouble() const{
+  return getType() == DOUBLE;
+}
+
+bool JSON::Flat::Ref::isString() const{
+  return getType() == STRING;
+}
+
+bool JSON::Flat::Ref::isBool() const{
+  return getType() == BOOL;
+}
+
+bool JSON::Flat::Ref::isObject() const{
+  return getType() == OBJECT;
+}
+
+bool JSON::Flat::Ref::isArray() const{
+  return getType() == ARRAY;
+}
+
+bool JSON::Flat::Ref::isNull() const{
+  return getType() == EMPTY;
+}
+
+/// Converts to an integer the same way JSON::Value::asInt does.
+int64_t JSON::Flat::Ref::asInt() const{
+  switch (getType()){
+  case INTEGER:
+  case BOOL: return doc->nodes[index].intVal;
+  case DOUBLE: return (int64_t)doc->nodes[index].dblVal;
+  case STRING: return atoll(c_str());
+  default: return 0;
+  }
+}
+
+/// Converts to a double the same way JSON::Value::asDouble does.
+double JSON::Flat::Ref::asDouble() const{
+  switch (getType()){
+  case INTEGER: return (double)doc->nodes[index].intVal;
+  case DOUBLE: return doc->nodes[index].dblVal;
+  case STRING: return atof(c_str());
+  default: return 0;
+  }
+}
+
+/// True if there is anything meaningful stored, the same way JSON::Value::asBool does.
+bool JSON::Flat::Ref::asBool() const{
+  switch (getType()){
+  case STRING: return doc->nodes[index].size != 0;
+  case DOUBLE: return doc->nodes[index].dblVal != 0;
+  case INTEGER:
+  case BOOL: return doc->nodes[index].intVal != 0;
+  case OBJECT:
+  case ARRAY: return doc->nodes[index].size != 0;
+  default: return false;
+  }
+}
+
+/// Returns the raw string value for strings, an empty string for null values and the JSON text
+/// of anything else, the same way JSON::Value::asString does.
+std::string JSON::Flat::Ref::asString() const{
+  switch (getType()){
+  case STRING: return std::string(c_str(), doc->nodes[index].size);
+  case EMPTY: return "";
+  default: return toString();
+  }
+}
+
+/// Returns the string value, or an empty string if this is not a string.
+/// Strings may contain null characters, use size() for their length.
+const char *JSON::Flat::Ref::c_str() const{
+  if (getType() != STRING){return "";}
+  return doc->strings.data() + doc->nodes[index].strOffset;
+}
+
+/// Returns the amount of members or elements for objects and arrays, the length for strings and
+/// zero for anything else.
+uint32_t JSON::Flat::Ref::size() const{
+  if (!exists()){return 0;}
+  return doc->nodes[index].size;
+}
+
+bool JSON::Flat::Ref::isMember(const std::string &name) const{
+  return (*this)[name].exists();
+}
+
+/// Returns the member with the given name, which does not exist if this is not an object or has no
+/// such member. Goes over all members, so iterate with firstChild/nextSibling to read all of them.
+JSON::Flat::Ref JSON::Flat::Ref::operator[](const std::string &name) const{
+  if (getType() != OBJECT){return Ref();}
+  const std::vector<Node> &N = doc->nodes;
+  uint32_t found = N.size();
+  for (uint32_t i = index + 1; i < N[index].next; i = N[i].next){
+    if (N[i].keyLen == name.size() && !memcmp(doc->strings.data() + N[i].key, name.data(), name.size())){
+      found = i;
+    }
+  }
+  return Ref(doc, found, N[index].next);
+}
+
+/// Returns the element at the given position, which does not exist if this is not an array or is
+/// too short. Skips over all preceding elements, so iterate with firstChild/nextSibling instead.
+JSON::Flat::Ref JSON::Flat::Ref::operator[](uint32_t i) const{
+  if (getType() != ARRAY || i >= size()){return Ref();}
+  Ref r = firstChild();
+  while (i--){r = r.nextSibling();}
+  return r;
+}
+
+/// Returns the first member or element of an object or array, if any.
+JSON::Flat::Ref JSON::Flat::Ref::firstChild() const{
+  if (!size() || (getType() != OBJECT && getType() != ARRAY)){return Ref();}
+  return Ref(doc, index + 1, doc->nodes[index].next);
+}
+
+/// Returns the next member or element of the object or array this is part of, if any.
+JSON::Flat::Ref JSON::Flat::Ref::nextSibling() const{
+  if (!exists() || doc->nodes[index].next >= parentEnd){return Ref();}
+  return Ref(doc, doc->nodes[index].next, parentEnd);
+}
+
+/// Returns the member name, for members of an object.
+std::string JSON::Flat::Ref::key() const{
+  if (!exists()){return "";}
+  return std::string(doc->strings.data() + doc->nodes[index].key, doc->nodes[index].keyLen);
+}
+
+/// Converts to a regular JSON::Value, e.g. to make changes.
+JSON::Value JSON::Flat::Ref::toValue() const{
+  JSON::Value ret;
+  toValue(ret);
+  return ret;
+}
+
+/// Converts to a regular JSON::Value, replacing the contents of out.
+void JSON::Flat::Ref::toValue(JSON::Value &out) const{
+  switch (getType()){
+  case INTEGER: out = (int64_t)doc->nodes[index].intVal; break;
+  case DOUBLE: out = doc->nodes[index].dblVal; break;
+  case BOOL: out = (doc->nodes[index].intVal != 0); break;
+  case STRING: out = asString(); break;
+  case ARRAY:{
+    // Start from an empty array, so that empty arrays stay arrays
+    static const JSON::Value emptyArray = JSON::fromString("[]");
+    out = emptyArray;
+    for (Ref child = firstChild(); child.exists(); child = child.nextSibling()){child.toValue(out.append());}
+    break;
+  }
+  case OBJECT:{
+    static const JSON::Value emptyObject = JSON::fromString("{}");
+    out = emptyObject;
+    for (Ref child = firstChild(); child.exists(); child = child.nextSibling()){child.toValue(out[child.key()]);}
+    break;
+  }
+  default: out.null(); break;
+  }
+}
+
+/// Writes this value out, with object members in document order.
+void JSON::Flat::Ref::write(JSON::Writer &w) const{
+  switch (getType()){
+  case INTEGER: w.value((int64_t)doc->nodes[index].intVal); break;
+  case DOUBLE: w.value(doc->nodes[index].dblVal); break;
+  case BOOL: w.value(doc->nodes[index].intVal != 0); break;
+  case STRING: w.value(asString()); break;
+  case ARRAY:
+    w.arrayBegin();
+    for (Ref child = firstChild(); child.exists(); child = child.nextSibling()){child.write(w);}
+    w.arrayEnd();
+    break;
+  case OBJECT:
+    w.objectBegin();
+    for (Ref child = firstChild(); child.exists(); child = child.nextSibling()){
+      w.key(child.key());
+      child.write(w);
+    }
+    w.objectEnd();
+    break;
+  default: w.null(); break;
+  }
+}
+
+/// Converts to JSON text, with object members in document order.
+std::string JSON::Flat::Ref::toString() const{
+  JSON::Writer w;
+  write(w);
+  return w.str();
+}
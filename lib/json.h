@@ -19,6 +19,7 @@ namespace JSON{
 
   /// JSON-string-escapes a value
   std::string string_escape(const std::string &val);
+  void string_escape(std::string &out, const std::string &val);
 
   /// A JSON::Value is either a string or an integer, but may also be an object, array or null.
   class Value{
@@ -123,6 +124,109 @@ namespace JSON{
   void fromDTMI(const std::string &data, Value &ret);
   void fromDTMI(const char *data, uint64_t len, uint32_t &i, Value &ret);
 
+  /// Writes JSON text directly, without building a JSON::Value tree first.
+  /// The output is formatted exactly like Value::toString would format the same data.
+  /// The text collects in str(), which may be sent out and cleared at any point in between.
+  class Writer{
+  public:
+    Writer();
+    void objectBegin();
+    void objectEnd();
+    void arrayBegin();
+    void arrayEnd();
+    void key(const std::string &name);
+    void value(const std::string &val);
+    void value(const char *val);
+    void value(int32_t val);
+    void value(int64_t val);
+    void value(uint32_t val);
+    void value(uint64_t val);
+    void value(double val);
+    void value(bool val);
+    void value(const Value &val);
+    void null();
+    std::string &str();
+
+  private:
+    void separate();
+    std::string buffer;
+    std::vector<bool> hasItems; ///< For each open object or array, whether it has any items yet.
+    bool afterKey;
+  };
+
+  /// Read-only JSON document, parsed in a single pass into one flat list of nodes, with all strings
+  /// stored back-to-back in a single buffer instead of a heap allocation per value.
+  /// Parses like JSON::fromString does, but is much cheaper to build and to throw away, which makes
+  /// it the better choice for large documents that are only read from.
+  /// Object members are kept in document order; if a name is repeated the last one is found, which
+  /// is also the one JSON::Value would keep.
+  class Flat{
+  public:
+    /// Refers to a single value inside a Flat document, for as long as the document is not
+    /// changed or destroyed. Values that do not exist read as null.
+    class Ref{
+    public:
+      Ref();
+      Ref(const Flat *doc, uint32_t index, uint32_t parentEnd);
+      bool exists() const;
+      ValueType getType() const;
+      bool isInt() const;
+      bool isDouble() const;
+      bool isString() const;
+      bool isBool() const;
+      bool isObject() const;
+      bool isArray() const;
+      bool isNull() const;
+      int64_t asInt() const;
+      double asDouble() const;
+      bool asBool() const;
+      std::string asString() const;
+      const char *c_str() const;
+      uint32_t size() const;
+      bool isMember(const std::string &name) const;
+      Ref operator[](const std::string &name) const;
+      Ref operator[](uint32_t i) const;
+      Ref firstChild() const;
+      Ref nextSibling() const;
+      std::string key() const;
+      Value toValue() const;
+      void toValue(Value &out) const;
+      void write(Writer &w) const;
+      std::string toString() const;
+
+    private:
+      const Flat *doc;
+      uint32_t index;
+      uint32_t parentEnd; ///< Where the object or array this value is part of ends.
+    };
+
+    Flat();
+    Flat(const std::string &json);
+    Flat(const char *data, size_t len);
+    void parse(const char *data, size_t len);
+    Ref root() const;
+    size_t nodeCount() const;
+
+  private:
+    struct Node{
+      ValueType type;
+      uint32_t next;    ///< Index of the first node after this value and all of its children.
+      uint32_t size;    ///< Amount of children for objects and arrays, length for strings.
+      uint32_t key;     ///< Offset of the member name in strings, for object members.
+      uint32_t keyLen;
+      union{
+        int64_t intVal;
+        double dblVal;
+        uint64_t strOffset;
+      };
+    };
+    Node &addNode(ValueType type, const std::vector<uint32_t> &open, bool &haveKey, uint32_t keyOff,
+                  uint32_t keyLen);
+    size_t readString(const char *data, size_t len, size_t p, char separator);
+    std::vector<Node> nodes;
+    std::string strings;
+  };
+
   class Iter{
   public:
     Iter(Value &root);              ///< Construct from a root Value to iterate over.
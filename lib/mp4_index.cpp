@@ -0,0 +1,232 @@
+/// \file mp4_index.cpp
+/// Byte offset index of the interleaved media data of progressive MP4 files.
+
+#include "mp4_index.h"
+#include "bitfields.h"
+#include "checksum.h"
+#include "defines.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <unistd.h>
+
+#define INDEX_MAGIC "MP4I"
+#define INDEX_VERSION 1
+#define INDEX_ENDED 0xFFFFFFFFFFFFFFFFull
+
+namespace MP4{
+
+  /// Orders parts the way they are interleaved in the media data: by time, then by track.
+  struct IndexOrder{
+    bool operator()(const IndexPart &a, const IndexPart &b) const{
+      if (a.time != b.time){return a.time < b.time;}
+      if (a.trackID != b.trackID){return a.trackID < b.trackID;}
+      return a.index < b.index;
+    }
+  };
+
+  ProgressiveIndex::ProgressiveIndex(){clear();}
+
+  void ProgressiveIndex::clear(){
+    key.clear();
+    header.clear();
+    fileSize = 0;
+    dataSize = 0;
+    trackIDs.clear();
+    offsets.clear();
+    states.clear();
+  }
+
+  /// Returns a string that changes whenever the media data or header of a progressive MP4 file
+  /// made from the given tracks changes, such as when their header is extended.
+  std::string ProgressiveIndex::fingerprint(const DTSC::Meta &M, const std::set<size_t> &tracks){
+    std::stringstream r;
+    for (std::set<size_t>::const_iterator it = tracks.begin(); it != tracks.end(); ++it){
+      DTSC::Keys keys(M.keys(*it));
+      std::string init = M.getInit(*it);
+      r << *it << ":" << M.getCodec(*it) << ":" << M.getLang(*it) << ":" << M.getFirstms(*it)
+        << "-" << M.getLastms(*it) << ":" << keys.getFirstValid() << "-" << keys.getEndValid()
+        << ":" << keys.getTotalPartCount() << ":" << M.getWidth(*it) << "x" << M.getHeight(*it)
+        << ":" << M.getRate(*it) << ":" << M.getChannels(*it) << ":" << init.size() << ":"
+        << checksum::crc32(0, init.data(), init.size()) << "/";
+    }
+    return r.str();
+  }
+
+  /// Walks the parts of the given tracks in the order a progressive MP4 file interleaves them,
+  /// remembering where every interval'th part starts. Does not touch key and header.
+  void ProgressiveIndex::build(const DTSC::Meta &M, const std::set<size_t> &tracks, size_t interval){
+    trackIDs.clear();
+    offsets.clear();
+    states.clear();
+    dataSize = 0;
+    if (!interval){interval = 1;}
+
+    std::deque<DTSC::Parts> parts;
+    std::vector<uint64_t> lastms;
+    std::vector<bool> isMeta;
+    std::vector<uint64_t> cur;
+    std::set<IndexPart, IndexOrder> order;
+    for (std::set<size_t>::const_iterator it = tracks.begin(); it != tracks.end(); ++it){
+      DTSC::Keys keys(M.keys(*it));
+      IndexPart P;
+      P.trackID = trackIDs.size();
+      P.time = keys.getTime(keys.getFirstValid());
+      P.index = keys.getFirstPart(keys.getFirstValid());
+      order.insert(P);
+      trackIDs.push_back(*it);
+      parts.push_back(DTSC::Parts(M.parts(*it)));
+      lastms.push_back(M.getLastms(*it));
+      // Subtitle samples are prefixed with their length
+      isMeta.push_back(M.getType(*it) == "meta");
+      cur.push_back(P.index);
+      cur.push_back(P.time);
+    }
+
+    uint64_t count = 0;
+    while (!order.empty()){
+      if (!(count++ % interval)){
+        offsets.push_back(dataSize);
+        states.insert(states.end(), cur.begin(), cur.end());
+      }
+      // The order holds track numbers instead of IDs, which sort the same way
+      IndexPart P = *order.begin();
+      order.erase(order.begin());
+      DTSC::Parts &tParts = parts[P.trackID];
+      dataSize += tParts.getSize(P.index) + (isMeta[P.trackID] ? 2 : 0);
+      uint64_t duration = tParts.getDuration(P.index);
+      if (P.time + duration < lastms[P.trackID]){
+        P.time += duration;
+        ++P.index;
+        order.insert(P);
+        cur[P.trackID * 2] = P.index;
+        cur[P.trackID * 2 + 1] = P.time;
+      }else{
+        cur[P.trackID * 2] = INDEX_ENDED;
+      }
+    }
+  }
+
+  /// Finds the last checkpoint at or before the given offset within the media data, and fills
+  /// next with the parts that come next at that point, one per track that has not ended.
+  /// Returns the offset of that checkpoint within the media data.
+  uint64_t ProgressiveIndex::seek(uint64_t dataOffset, std::deque<IndexPart> &next) const{
+    next.clear();
+    if (!offsets.size()){return 0;}
+    size_t cp = std::upper_bound(offsets.begin(), offsets.end(), dataOffset) - offsets.begin();
+    if (cp){--cp;}
+    const uint64_t *state = &states[cp * trackIDs.size() * 2];
+    for (size_t i = 0; i < trackIDs.size(); ++i){
+      if (state[i * 2] == INDEX_ENDED){continue;}
+      IndexPart P;
+      P.trackID = trackIDs[i];
+      P.index = state[i * 2];
+      P.time = state[i * 2 + 1];
+      next.push_back(P);
+    }
+    return offsets[cp];
+  }
+
+  size_t ProgressiveIndex::getCheckpoints() const{return offsets.size();}
+
+  /// Loads an index stored by write, if it was built for expectKey.
+  bool ProgressiveIndex::read(const std::string &file, const std::string &expectKey){
+    std::ifstream in(file.c_str(), std::ios::in | std::ios::binary);
+    if (!in){return false;}
+    std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    const char *p = data.data();
+    const char *end = p + data.size();
+    if (data.size() < 12 || memcmp(p, INDEX_MAGIC, 4) || Bit::btohl(p + 4) != INDEX_VERSION){return false;}
+    uint32_t keyLen = Bit::btohl(p + 8);
+    p += 12;
+    if ((uint64_t)(end - p) < keyLen + 20ull || std::string(p, keyLen) != expectKey){return false;}
+    clear();
+    key = expectKey;
+    p += keyLen;
+    fileSize = Bit::btohll(p);
+    dataSize = Bit::btohll(p + 8);
+    uint32_t headerLen = Bit::btohl(p + 16);
+    p += 20;
+    if ((uint64_t)(end - p) < headerLen + 4ull){
+      clear();
+      return false;
+    }
+    header.assign(p, headerLen);
+    p += headerLen;
+    uint32_t trackCount = Bit::btohl(p);
+    p += 4;
+    if ((uint64_t)(end - p) < trackCount * 4ull + 8){
+      clear();
+      return false;
+    }
+    for (uint32_t i = 0; i < trackCount; ++i){trackIDs.push_back(Bit::btohl(p + i * 4));}
+    p += trackCount * 4;
+    uint64_t cpCount = Bit::btohll(p);
+    p += 8;
+    if ((uint64_t)(end - p) != cpCount * 8 * (1 + trackCount * 2)){
+      clear();
+      return false;
+    }
+    offsets.resize(cpCount);
+    for (uint64_t i = 0; i < cpCount; ++i){offsets[i] = Bit::btohll(p + i * 8);}
+    p += cpCount * 8;
+    states.resize(cpCount * trackCount * 2);
+    for (uint64_t i = 0; i < states.size(); ++i){states[i] = Bit::btohll(p + i * 8);}
+    return true;
+  }
+
+  /// Stores the index in the given file. Writes to a temporary file first, so concurrent readers
+  /// never see a partially written index.
+  bool ProgressiveIndex::write(const std::string &file) const{
+    std::string data(INDEX_MAGIC);
+    char buf[8];
+    Bit::htobl(buf, INDEX_VERSION);
+    data.append(buf, 4);
+    Bit::htobl(buf, key.size());
+    data.append(buf, 4);
+    data.append(key);
+    Bit::htobll(buf, fileSize);
+    data.append(buf, 8);
+    Bit::htobll(buf, dataSize);
+    data.append(buf, 8);
+    Bit::htobl(buf, header.size());
+    data.append(buf, 4);
+    data.append(header);
+    Bit::htobl(buf, trackIDs.size());
+    data.append(buf, 4);
+    for (size_t i = 0; i < trackIDs.size(); ++i){
+      Bit::htobl(buf, trackIDs[i]);
+      data.append(buf, 4);
+    }
+    Bit::htobll(buf, offsets.size());
+    data.append(buf, 8);
+    for (size_t i = 0; i < offsets.size(); ++i){
+      Bit::htobll(buf, offsets[i]);
+      data.append(buf, 8);
+    }
+    for (size_t i = 0; i < states.size(); ++i){
+      Bit::htobll(buf, states[i]);
+      data.append(buf, 8);
+    }
+
+    std::stringstream tmpName;
+    tmpName << file << "." << getpid();
+    std::ofstream out(tmpName.str().c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!out){
+      WARN_MSG("Could not open %s for writing", tmpName.str().c_str());
+      return false;
+    }
+    out.write(data.data(), data.size());
+    out.close();
+    if (!out || rename(tmpName.str().c_str(), file.c_str())){
+      WARN_MSG("Could not write %s", file.c_str());
+      unlink(tmpName.str().c_str());
+      return false;
+    }
+    return true;
+  }
+
+}// namespace MP4
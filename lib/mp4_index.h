@@ -0,0 +1,50 @@
+/// \file mp4_index.h
+/// Byte offset index of the interleaved media data of progressive MP4 files.
+
+#pragma once
+#include "dtsc.h"
+#include <deque>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace MP4{
+
+  /// A part of a track, as found in the interleaved media data of a progressive MP4 file
+  struct IndexPart{
+    size_t trackID;
+    uint64_t time;
+    uint64_t index;
+  };
+
+  /// Header and byte offset index of a progressive (non-fragmented) MP4 file made from a set of
+  /// VoD tracks. The media data interleaves the parts of all tracks in time order; the index
+  /// remembers, for every interval'th part of that order, where it starts within the media data
+  /// and which part of every track comes next. Mapping a byte offset to a position in the file
+  /// then takes a binary search and a walk over at most interval parts, instead of a walk over
+  /// all parts before it.
+  /// Can be stored to and loaded from a file, so it is built only once for all viewers.
+  class ProgressiveIndex{
+  public:
+    ProgressiveIndex();
+    void clear();
+    static std::string fingerprint(const DTSC::Meta &M, const std::set<size_t> &tracks);
+    void build(const DTSC::Meta &M, const std::set<size_t> &tracks, size_t interval = 1024);
+    uint64_t seek(uint64_t dataOffset, std::deque<IndexPart> &next) const;
+    bool read(const std::string &file, const std::string &expectKey);
+    bool write(const std::string &file) const;
+    size_t getCheckpoints() const;
+
+    std::string key;    ///< Identifies the stream, tracks and metadata the index was built for
+    std::string header; ///< Everything before the first media data byte
+    uint64_t fileSize;  ///< Size of the whole file, including the header
+    uint64_t dataSize;  ///< Size of the media data
+
+  private:
+    std::vector<size_t> trackIDs;
+    std::vector<uint64_t> offsets; ///< Start of every checkpoint within the media data
+    /// For every checkpoint and track, the next part index and its time, or ~0 if the track ended
+    std::vector<uint64_t> states;
+  };
+
+}// namespace MP4
@@ -0,0 +1,227 @@
+/// \file prefetch.cpp
+/// Downloads URIs ahead of their use on a pool of threads.
+
+#include "prefetch.h"
+#include "defines.h"
+#include "timing.h"
+#include "urireader.h"
+#include <cstring>
+
+#define PREFETCH_QUEUED 0
+#define PREFETCH_RUNNING 1
+#define PREFETCH_DONE 2
+
+/// Time after which downloads that nobody took are dropped, in milliseconds
+#define PREFETCH_EXPIRE 60000
+
+namespace HTTP{
+
+  /// Collects the data of a single download, keeping the memory use of its prefetcher up to date.
+  class PrefetchBuffer : public Util::DataCallback{
+  public:
+    PrefetchBuffer(Prefetcher &p, Util::ResizeablePointer &b) : P(p), buf(b){}
+    virtual void dataCallback(const char *ptr, size_t size){
+      buf.append(ptr, size);
+      tthread::lock_guard<tthread::mutex> guard(P.prefetchMutex);
+      P.bytes += size;
+    }
+    virtual size_t getDataCallbackPos() const{return buf.size();}
+
+  private:
+    Prefetcher &P;
+    Util::ResizeablePointer &buf;
+  };
+
+  Prefetcher::Prefetcher(){
+    owner = 0;
+    running = false;
+    maxBytes = 0;
+    bytes = 0;
+    memset(&stats, 0, sizeof(stats));
+  }
+
+  /// Waits for running downloads to finish, and discards all others.
+  Prefetcher::~Prefetcher(){stop();}
+
+  /// Starts the given amount of download threads, which stop starting new downloads while more
+  /// than maxBytes are held. Does nothing if already started.
+  void Prefetcher::start(size_t threads, size_t _maxBytes){
+    if (isActive()){return;}
+    if (running){stop();}
+    tthread::lock_guard<tthread::mutex> guard(prefetchMutex);
+    running = true;
+    owner = getpid();
+    maxBytes = _maxBytes;
+    for (size_t i = 0; i < threads; ++i){workers.push_back(new tthread::thread(runWorker, this));}
+  }
+
+  /// Waits for running downloads to finish, stops the download threads and discards all downloads.
+  /// In a process forked off after start(), where the download threads do not exist, only discards.
+  void Prefetcher::stop(){
+    {
+      tthread::lock_guard<tthread::mutex> guard(prefetchMutex);
+      running = false;
+    }
+    while (workers.size()){
+      // Threads of another process can be neither joined nor destroyed
+      if (owner == getpid()){
+        workers.front()->join();
+        delete workers.front();
+      }
+      workers.pop_front();
+    }
+    tthread::lock_guard<tthread::mutex> guard(prefetchMutex);
+    downloads.clear();
+    queue.clear();
+    bytes = 0;
+  }
+
+  /// True if the download threads are running in this process.
+  bool Prefetcher::isActive() const{return running && owner == getpid();}
+
+  /// Queues the given URI for download, unless it is already queued or downloaded.
+  void Prefetcher::want(const std::string &uri){
+    tthread::lock_guard<tthread::mutex> guard(prefetchMutex);
+    if (!running || downloads.count(uri)){return;}
+    Download &D = downloads[uri];
+    D.status = PREFETCH_QUEUED;
+    D.wanted = Util::bootMS();
+    D.started = 0;
+    D.finished = 0;
+    queue.push_back(uri);
+  }
+
+  /// Hands over the downloaded data of the given URI, waiting up to maxWait milliseconds for a
+  /// running download to complete. Downloads that did not start yet are removed from the queue,
+  /// so the caller can download them directly instead.
+  Prefetcher::takeResult Prefetcher::take(const std::string &uri, Util::ResizeablePointer &data, uint64_t maxWait){
+    uint64_t start = Util::bootMS();
+    bool waited = false;
+    while (true){
+      {
+        tthread::lock_guard<tthread::mutex> guard(prefetchMutex);
+        std::map<std::string, Download>::iterator it = downloads.find(uri);
+        if (it == downloads.end() || it->second.status == PREFETCH_QUEUED){
+          if (it != downloads.end()){
+            for (std::deque<std::string>::iterator q = queue.begin(); q != queue.end(); ++q){
+              if (*q == uri){
+                queue.erase(q);
+                break;
+              }
+            }
+            downloads.erase(it);
+          }
+          ++stats.missed;
+          return PREFETCH_MISS;
+        }
+        uint64_t now = Util::bootMS();
+        if (it->second.status == PREFETCH_DONE){
+          data.swap(it->second.data);
+          bytes -= data.size();
+          downloads.erase(it);
+          if (waited){
+            ++stats.waited;
+            stats.waitMs += now - start;
+            HIGH_MSG("Waited %" PRIu64 "ms for prefetch of %s", now - start, uri.c_str());
+          }else{
+            ++stats.ready;
+          }
+          return PREFETCH_READY;
+        }
+        if (now >= start + maxWait){
+          if (waited){stats.waitMs += now - start;}
+          return PREFETCH_BUSY;
+        }
+      }
+      waited = true;
+      Util::sleep(5);
+    }
+  }
+
+  /// Returns the counters of this prefetcher.
+  Prefetcher::Stats Prefetcher::getStats(){
+    tthread::lock_guard<tthread::mutex> guard(prefetchMutex);
+    return stats;
+  }
+
+  void Prefetcher::runWorker(void *arg){((Prefetcher *)arg)->worker();}
+
+  /// Downloads queued URIs, oldest first, until the prefetcher is stopped.
+  void Prefetcher::worker(){
+    while (true){
+      std::string uri;
+      {
+        tthread::lock_guard<tthread::mutex> guard(prefetchMutex);
+        if (!running){return;}
+        expire(Util::bootMS());
+        if (queue.size() && bytes < maxBytes){
+          uri = queue.front();
+          queue.pop_front();
+          Download &D = downloads[uri];
+          D.status = PREFETCH_RUNNING;
+          D.started = Util::bootMS();
+        }
+      }
+      if (!uri.size()){
+        Util::sleep(10);
+        continue;
+      }
+
+      Util::ResizeablePointer buf;
+      PrefetchBuffer cb(*this, buf);
+      HTTP::URIReader dl;
+      bool ok = dl.open(uri) && dl;
+      if (ok){
+        size_t expected = dl.getSize();
+        if (expected != std::string::npos){buf.allocate(expected);}
+        dl.readAll(cb);
+        ok = buf.size() && (expected == std::string::npos || buf.size() == expected);
+      }
+      dl.close();
+
+      tthread::lock_guard<tthread::mutex> guard(prefetchMutex);
+      uint64_t now = Util::bootMS();
+      Download &D = downloads[uri];
+      if (!ok){
+        WARN_MSG("Could not prefetch %s", uri.c_str());
+        ++stats.failures;
+        bytes -= buf.size();
+        downloads.erase(uri);
+        continue;
+      }
+      D.data.swap(buf);
+      D.finished = now;
+      D.status = PREFETCH_DONE;
+      ++stats.downloads;
+      stats.bytes += D.data.size();
+      stats.downloadMs += now - D.started;
+      MEDIUM_MSG("Prefetched %s: %zu bytes in %" PRIu64 "ms, %" PRIu64 "ms after it was wanted",
+                 uri.c_str(), D.data.size(), now - D.started, now - D.wanted);
+    }
+  }
+
+  /// Drops queued and finished downloads nobody took in time. The mutex must be held.
+  void Prefetcher::expire(uint64_t now){
+    std::map<std::string, Download>::iterator it = downloads.begin();
+    while (it != downloads.end()){
+      uint64_t since = (it->second.status == PREFETCH_DONE) ? it->second.finished : it->second.wanted;
+      if (it->second.status == PREFETCH_RUNNING || since + PREFETCH_EXPIRE > now){
+        ++it;
+        continue;
+      }
+      if (it->second.status == PREFETCH_QUEUED){
+        for (std::deque<std::string>::iterator q = queue.begin(); q != queue.end(); ++q){
+          if (*q == it->first){
+            queue.erase(q);
+            break;
+          }
+        }
+      }
+      HIGH_MSG("Dropping unused prefetch of %s", it->first.c_str());
+      bytes -= it->second.data.size();
+      ++stats.dropped;
+      downloads.erase(it++);
+    }
+  }
+
+}// namespace HTTP
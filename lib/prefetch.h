@@ -0,0 +1,76 @@
+/// \file prefetch.h
+/// Downloads URIs ahead of their use on a pool of threads.
+
+#pragma once
+#include "tinythread.h"
+#include "util.h"
+#include <deque>
+#include <map>
+#include <string>
+#include <unistd.h>
+
+namespace HTTP{
+
+  /// Downloads URIs ahead of their use on a pool of threads, so a consumer that reads them one
+  /// after the other (such as the segments of a HLS playlist) only waits for downloads that did
+  /// not finish in time, instead of for every download in turn.
+  /// No new download starts while the finished and running downloads together hold more than the
+  /// configured amount of memory. Downloads that are not taken within a minute are dropped.
+  class Prefetcher{
+  public:
+    /// Result of a take
+    enum takeResult{
+      PREFETCH_MISS, ///< Not wanted, not started yet, or failed: download it yourself
+      PREFETCH_BUSY, ///< Still downloading, try again later
+      PREFETCH_READY ///< Downloaded, data now holds it
+    };
+
+    /// Counters of a prefetcher
+    struct Stats{
+      uint64_t downloads;  ///< Downloads completed
+      uint64_t failures;   ///< Downloads that failed
+      uint64_t dropped;    ///< Downloads dropped because nobody took them
+      uint64_t bytes;      ///< Bytes downloaded
+      uint64_t downloadMs; ///< Time spent downloading, summed over all downloads
+      uint64_t ready;      ///< Takes that found their download completed
+      uint64_t waited;     ///< Takes that had to wait for their download to complete
+      uint64_t waitMs;     ///< Time takes spent waiting for their download to complete
+      uint64_t missed;     ///< Takes of URIs that were not downloaded
+    };
+
+    Prefetcher();
+    ~Prefetcher();
+    void start(size_t threads, size_t maxBytes);
+    void stop();
+    bool isActive() const;
+    void want(const std::string &uri);
+    takeResult take(const std::string &uri, Util::ResizeablePointer &data, uint64_t maxWait);
+    Stats getStats();
+
+  private:
+    /// State of a single wanted URI
+    struct Download{
+      uint8_t status;
+      uint64_t wanted;   ///< When it was wanted, in boot milliseconds
+      uint64_t started;  ///< When its download started, in boot milliseconds
+      uint64_t finished; ///< When its download finished, in boot milliseconds
+      Util::ResizeablePointer data;
+    };
+
+    static void runWorker(void *arg);
+    void worker();
+    void expire(uint64_t now);
+
+    tthread::mutex prefetchMutex; ///< Protects everything below
+    std::deque<tthread::thread *> workers;
+    pid_t owner; ///< Process the download threads run in
+    bool running;
+    size_t maxBytes;
+    size_t bytes; ///< Bytes held by running and finished downloads
+    std::map<std::string, Download> downloads;
+    std::deque<std::string> queue; ///< Wanted URIs not yet being downloaded, oldest first
+    Stats stats;
+    friend class PrefetchBuffer;
+  };
+
+}// namespace HTTP
@@ -169,7 +169,7 @@ namespace RTP{
     // Payload
     memcpy(rtpBuf + 28, data + 8, fecContext.lengthRecovery);
 
-    ((Socket::UDPConnection *)socket)->SendNow(reinterpret_cast<char*>(rtpBuf), fecContext.rtpBufSize);
+    ((Socket::UDPConnection *)socket)->sendPaced(reinterpret_cast<char*>(rtpBuf), fecContext.rtpBufSize);
     sentPackets++;
     sentBytes += fecContext.rtpBufSize;
     free(rtpBuf);
@@ -268,8 +268,8 @@ namespace RTP{
     INSANE_MSG("Sending RTP packet with header size %u and payload size %u", getHsize(), payloadlen);
     // Set timestamp to current time
     setTimestamp(Util::bootMS()*90);
-    // Send RTP packet itself
-    ((Socket::UDPConnection *)socket)->SendNow(data, getHsize() + payloadlen);
+    // Queue RTP packet itself; the caller flushes the queue once per frame
+    ((Socket::UDPConnection *)socket)->sendPaced(data, getHsize() + payloadlen);
     // Increment counters
     sentPackets++;
     sentBytes += payloadlen + getHsize();
@@ -706,6 +706,75 @@ namespace RTP{
   void MPEGVideoHeader::setBegin(){data[2] |= 0x10;}
   void MPEGVideoHeader::setEnd(){data[2] |= 0x8;}
 
+  PacketRing::PacketRing(){
+    memset(seqs, 0, sizeof(seqs));
+    memset(used, 0, sizeof(used));
+    count = 0;
+  }
+
+  PacketRing::PacketRing(const PacketRing &o){
+    count = 0;
+    *this = o;
+  }
+
+  /// Copies the buffered packets of o; buffers are never shared between rings.
+  PacketRing &PacketRing::operator=(const PacketRing &o){
+    if (&o == this){return *this;}
+    for (size_t i = 0; i < RTP_SORTER_RING; ++i){
+      if (o.used[i]){slots[i].assign(o.slots[i], o.slots[i].size());}
+      seqs[i] = o.seqs[i];
+      used[i] = o.used[i];
+    }
+    count = o.count;
+    return *this;
+  }
+
+  bool PacketRing::has(uint16_t seq) const{
+    size_t i = seq & (RTP_SORTER_RING - 1);
+    return used[i] && seqs[i] == seq;
+  }
+
+  /// Returns true if the slot for the given sequence number holds a packet with another one.
+  bool PacketRing::taken(uint16_t seq) const{
+    size_t i = seq & (RTP_SORTER_RING - 1);
+    return used[i] && seqs[i] != seq;
+  }
+
+  /// Returns the data of the buffered packet with the given sequence number, which must exist.
+  const char *PacketRing::getData(uint16_t seq) const{return slots[seq & (RTP_SORTER_RING - 1)];}
+
+  size_t PacketRing::getSize(uint16_t seq) const{return slots[seq & (RTP_SORTER_RING - 1)].size();}
+
+  /// Copies pack into its slot, replacing whatever was there.
+  void PacketRing::insert(const Packet &pack){
+    uint16_t seq = pack.getSequence();
+    size_t i = seq & (RTP_SORTER_RING - 1);
+    if (!used[i]){++count;}
+    slots[i].assign(pack.ptr(), pack.getDataLen());
+    seqs[i] = seq;
+    used[i] = true;
+  }
+
+  void PacketRing::release(uint16_t seq){
+    size_t i = seq & (RTP_SORTER_RING - 1);
+    if (!used[i] || seqs[i] != seq){return;}
+    used[i] = false;
+    --count;
+  }
+
+  /// Returns the numerically lowest buffered sequence number, or zero if there is none.
+  uint16_t PacketRing::lowest() const{
+    bool found = false;
+    uint16_t ret = 0;
+    for (size_t i = 0; i < RTP_SORTER_RING; ++i){
+      if (used[i] && (!found || seqs[i] < ret)){
+        ret = seqs[i];
+        found = true;
+      }
+    }
+    return ret;
+  }
+
   Sorter::Sorter(uint64_t trackId, void (*cb)(const uint64_t track, const Packet &p)){
     packTrack = trackId;
     rtpSeq = 0;
@@ -744,13 +813,14 @@ namespace RTP{
       //If we've buffered the first 5 packets, assume we have the first one known
       if (packBuffer.size() >= 5){
         preBuffer = false;
-        rtpSeq = packBuffer.begin()->first;
+        rtpSeq = packBuffer.lowest();
         rtpWSeq = rtpSeq;
       }
     }else{
       // packet is very early - assume dropped after PACKET_DROP_TIMEOUT packets
       while ((int16_t)(rtpSeq - pSNo) < -(int)PACKET_DROP_TIMEOUT){
         VERYHIGH_MSG("Giving up on track %" PRIu64 " packet %u", packTrack, rtpSeq);
+        packBuffer.release(rtpSeq);
         ++rtpSeq;
         ++lostTotal;
         ++lostCurrent;
@@ -763,27 +833,61 @@ namespace RTP{
     // packet is somewhat early - ask for packet after PACKET_REORDER_WAIT packets
     while ((int16_t)(rtpWSeq - pSNo) < -(int)PACKET_REORDER_WAIT){
       //Only wanted if we don't already have it
-      if (!packBuffer.count(rtpWSeq)){
+      if (!packBuffer.has(rtpWSeq)){
         wantedSeqs.insert(rtpWSeq);
       }
       ++rtpWSeq;
     }
     // send any buffered packets we may have
     uint16_t prertpSeq = rtpSeq;
-    while (packBuffer.count(rtpSeq)){
-      outPacket(packTrack, packBuffer[rtpSeq]);
-      packBuffer.erase(rtpSeq);
+    while (packBuffer.has(rtpSeq)){
+      Packet buffered(packBuffer.getData(rtpSeq), packBuffer.getSize(rtpSeq));
+      outPacket(packTrack, buffered);
+      packBuffer.release(rtpSeq);
       ++rtpSeq;
       ++packTotal;
       ++packCurrent;
     }
     if (prertpSeq != rtpSeq){
-      INFO_MSG("Sent packets %" PRIu16 "-%" PRIu16 ", now %zu in buffer", prertpSeq, rtpSeq, packBuffer.size());
+      VERYHIGH_MSG("Sent packets %" PRIu16 "-%" PRIu16 ", now %zu in buffer", prertpSeq, rtpSeq, packBuffer.size());
     }
     // packet is slightly early - buffer it
     if ((int16_t)(rtpSeq - pSNo) < 0){
-      VERYHIGH_MSG("Buffering early packet #%u->%u", rtpSeq, pack.getSequence());
-      packBuffer[pack.getSequence()] = pack;
+      // Its slot still holds a packet RTP_SORTER_RING or more before it, which happens when
+      // PACKET_DROP_TIMEOUT is that large: give up on what is missing up to that packet, so it is
+      // sent instead of overwritten.
+      if (packBuffer.taken(pSNo) && preBuffer){
+        preBuffer = false;
+        rtpSeq = packBuffer.lowest();
+        rtpWSeq = rtpSeq;
+      }
+      while (packBuffer.taken(pSNo) && (int16_t)(rtpSeq - pSNo) < 0){
+        if (packBuffer.has(rtpSeq)){
+          Packet buffered(packBuffer.getData(rtpSeq), packBuffer.getSize(rtpSeq));
+          outPacket(packTrack, buffered);
+          packBuffer.release(rtpSeq);
+        }else{
+          VERYHIGH_MSG("Giving up on track %" PRIu64 " packet %u", packTrack, rtpSeq);
+          ++lostTotal;
+          ++lostCurrent;
+        }
+        ++rtpSeq;
+        ++packTotal;
+        ++packCurrent;
+      }
+      // Anything after the packet we made room for that is buffered already can go out now too
+      while (packBuffer.has(rtpSeq)){
+        Packet buffered(packBuffer.getData(rtpSeq), packBuffer.getSize(rtpSeq));
+        outPacket(packTrack, buffered);
+        packBuffer.release(rtpSeq);
+        ++rtpSeq;
+        ++packTotal;
+        ++packCurrent;
+      }
+      if ((int16_t)(rtpSeq - pSNo) < 0){
+        VERYHIGH_MSG("Buffering early packet #%u->%u", rtpSeq, pack.getSequence());
+        packBuffer.insert(pack);
+      }
     }
     // packet is late
     if ((int16_t)(rtpSeq - pSNo) > 0){
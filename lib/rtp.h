@@ -116,9 +116,39 @@ namespace RTP{
     Packet(const char *dat, uint64_t len);
     const char *getData();
     char *ptr() const{return data;}
+    uint32_t getDataLen() const{return maxDataLen;} ///< Size of the data, or of the buffer when sending
     std::string toString() const;
   };
 
+/// Amount of packets a Sorter can hold while waiting for the ones before them; must be a power of two
+#define RTP_SORTER_RING 256
+
+  /// Ring of RTP packets indexed by sequence number, for packets that arrived before the ones
+  /// preceding them. Slots keep their buffer when a packet is released, so once every slot was
+  /// used, buffering a packet is a copy into memory that is already there.
+  /// A packet replaces the one in its slot, which is a multiple of RTP_SORTER_RING sequence
+  /// numbers before or after it; Sorter uses taken() to give up on that one first instead.
+  class PacketRing{
+  public:
+    PacketRing();
+    PacketRing(const PacketRing &o);
+    PacketRing &operator=(const PacketRing &o);
+    bool has(uint16_t seq) const;
+    bool taken(uint16_t seq) const;
+    const char *getData(uint16_t seq) const;
+    size_t getSize(uint16_t seq) const;
+    void insert(const Packet &pack);
+    void release(uint16_t seq);
+    uint16_t lowest() const;
+    size_t size() const{return count;}
+
+  private:
+    Util::ResizeablePointer slots[RTP_SORTER_RING];
+    uint16_t seqs[RTP_SORTER_RING];
+    bool used[RTP_SORTER_RING];
+    size_t count; ///< Amount of used slots
+  };
+
   /// Sorts RTP packets, outputting them through a callback in correct order.
   /// Also keeps track of statistics, which it expects to be read/reset externally (for now).
   /// Optionally can be inherited from with the outPacket function overridden to not use a callback.
@@ -143,7 +173,7 @@ namespace RTP{
     uint64_t lastBootMS; ///< bootMS time of last Sender Report
   private:
     uint64_t packTrack;
-    std::map<uint16_t, Packet> packBuffer;
+    PacketRing packBuffer;
     std::map<uint16_t, Packet> packetHistory;
     void (*callback)(const uint64_t track, const Packet &p);
   };
@@ -0,0 +1,297 @@
+/// \file segcache.cpp
+/// Holds the shared cache of finished media segments of live streams.
+
+#include "segcache.h"
+#include "defines.h"
+#include "procs.h"
+#include "timing.h"
+#include <cstring>
+#include <unistd.h>
+
+#define SEGCACHE_FREE 0
+#define SEGCACHE_FILLING 1
+#define SEGCACHE_READY 2
+
+// Counters in the header of the index page
+#define SEGCACHE_HITS 0
+#define SEGCACHE_MISSES 1
+#define SEGCACHE_EVICTIONS 2
+#define SEGCACHE_BYTES 3
+
+namespace Util{
+
+  SegmentCache::SegmentCache(){
+    claimed = INVALID_RECORD_INDEX;
+    claimedGen = 0;
+    segmentSize = 0;
+  }
+
+  /// Gives up on a segment this process claimed but did not store.
+  /// Neither the index nor stored segments are removed: they outlive the process.
+  SegmentCache::~SegmentCache(){abandon();}
+
+  /// Opens the segment cache of the given stream, creating it if it does not exist yet and create
+  /// is true. Does nothing if the cache of this stream is already open, unless it was removed since.
+  void SegmentCache::reload(const std::string &_streamName, bool create){
+    if (*this && streamName == _streamName){return;}
+    abandon();
+    segment.close();
+    index.close();
+    streamName = _streamName;
+    char name[NAME_BUFFER_SIZE];
+    snprintf(name, NAME_BUFFER_SIZE, SHM_SEGCACHE, streamName.c_str());
+    index.init(name, 0, false, false);
+    if (!index.mapped && !create){return;}
+    char semName[NAME_BUFFER_SIZE];
+    snprintf(semName, NAME_BUFFER_SIZE, SEM_SEGCACHE, streamName.c_str());
+    sem.open(semName, O_CREAT | O_RDWR, ACCESSPERMS, 1);
+    if (!sem){
+      index.close();
+      return;
+    }
+    if (!index.mapped){
+      IPC::semGuard G(&sem);
+      index.init(name, 0, false, false);
+      if (!index.mapped){
+        index.init(name, SEGCACHE_HEADER + 1024 + SEGCACHE_ENTRIES * 64, true, false);
+        if (!index.mapped){return;}
+        Util::RelAccX A(index.mapped + SEGCACHE_HEADER, false);
+        A.addField("status", RAX_UINT);
+        A.addField("key", RAX_64UINT);
+        A.addField("gen", RAX_64UINT);
+        A.addField("pid", RAX_32UINT);
+        A.addField("track", RAX_32UINT);
+        A.addField("start", RAX_64UINT);
+        A.addField("size", RAX_64UINT);
+        A.addField("lastuse", RAX_64UINT);
+        A.setRCount(SEGCACHE_ENTRIES);
+        A.setEndPos(SEGCACHE_ENTRIES);
+        A.setReady();
+        index.master = false;
+      }
+    }
+    entries = Util::RelAccX(index.mapped + SEGCACHE_HEADER, false);
+    if (!entries.isReady()){
+      index.close();
+      return;
+    }
+    statusField = entries.getFieldData("status");
+    keyField = entries.getFieldData("key");
+    genField = entries.getFieldData("gen");
+    pidField = entries.getFieldData("pid");
+    trackField = entries.getFieldData("track");
+    startField = entries.getFieldData("start");
+    sizeField = entries.getFieldData("size");
+    lastUseField = entries.getFieldData("lastuse");
+  }
+
+  /// True if the cache is open and was not removed since.
+  SegmentCache::operator bool() const{return index.mapped && entries.isReady() && !entries.isExit();}
+
+  /// Returns a key identifying a segment by its format, the tracks it contains and its time range.
+  /// The format should include everything other than the tracks and time range that changes the
+  /// generated bytes.
+  uint64_t SegmentCache::segmentKey(const std::string &format, const std::string &tracks, uint64_t from, uint64_t until){
+    char times[48];
+    snprintf(times, 48, "%" PRIu64 "-%" PRIu64, from, until);
+    std::string id = format + "\n" + tracks + "\n" + times;
+    // 64 bits FNV-1a hash
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < id.size(); ++i){
+      hash ^= (uint8_t)id[i];
+      hash *= 0x100000001b3ull;
+    }
+    return hash;
+  }
+
+  /// Looks up the segment with the given key.
+  /// If another process is generating it, waits up to maxWait milliseconds for it to be stored.
+  /// A maxWait of zero never waits: the segment is reported as a miss right away instead.
+  /// Otherwise, claims it for this process to generate, making room by evicting segments that
+  /// start before the buffer window of their track, or else the least recently used segment.
+  /// \param track The track whose buffer window the segment belongs to.
+  /// \param start The time the segment starts at on that track.
+  SegmentCache::lookupResult SegmentCache::lookup(uint64_t key, const DTSC::Meta &M, size_t track,
+                                                  uint64_t start, uint64_t maxWait){
+    abandon();
+    segment.close();
+    if (!*this){return SEGCACHE_MISS;}
+    std::set<size_t> validTracks = M.getValidTracks();
+    uint64_t deadline = Util::bootMS() + maxWait;
+    while (true){
+      {
+        IPC::semGuard G(&sem);
+        uint64_t now = Util::bootMS();
+        size_t found = INVALID_RECORD_INDEX;
+        size_t target = INVALID_RECORD_INDEX;
+        size_t oldest = INVALID_RECORD_INDEX;
+        for (size_t i = 0; i < entries.getRCount(); ++i){
+          uint64_t status = entries.getInt(statusField, i);
+          if (status != SEGCACHE_FREE && entries.getInt(keyField, i) == key){
+            found = i;
+            continue;
+          }
+          if (status != SEGCACHE_FREE){
+            size_t t = entries.getInt(trackField, i);
+            if (!validTracks.count(t) || entries.getInt(startField, i) < M.getFirstms(t)){
+              evict(i);
+              status = SEGCACHE_FREE;
+            }
+          }
+          if (status == SEGCACHE_FREE){
+            if (target == INVALID_RECORD_INDEX){target = i;}
+            continue;
+          }
+          if (status == SEGCACHE_READY &&
+              (oldest == INVALID_RECORD_INDEX || entries.getInt(lastUseField, i) < entries.getInt(lastUseField, oldest))){
+            oldest = i;
+          }
+        }
+
+        if (found != INVALID_RECORD_INDEX){
+          if (entries.getInt(statusField, found) == SEGCACHE_READY){
+            char name[NAME_BUFFER_SIZE];
+            snprintf(name, NAME_BUFFER_SIZE, SHM_SEGCACHE_DATA, streamName.c_str(), found,
+                     entries.getInt(genField, found));
+            segment.init(name, 0, false, false);
+            segmentSize = entries.getInt(sizeField, found);
+            if (segment.mapped && segment.len >= segmentSize){
+              entries.setInt(lastUseField, now, found);
+              count(SEGCACHE_HITS);
+              return SEGCACHE_HIT;
+            }
+            WARN_MSG("Cached segment %s is missing, generating it again", name);
+            segment.close();
+            evict(found);
+            target = found;
+          }else if (Util::Procs::isRunning(entries.getInt(pidField, found))){
+            if (now >= deadline){
+              count(SEGCACHE_MISSES);
+              return SEGCACHE_MISS;
+            }
+            target = INVALID_RECORD_INDEX;
+          }else{
+            // The process generating it went away
+            evict(found);
+            target = found;
+          }
+        }
+
+        if (found == INVALID_RECORD_INDEX || target != INVALID_RECORD_INDEX){
+          if (target == INVALID_RECORD_INDEX && oldest != INVALID_RECORD_INDEX){
+            evict(oldest);
+            target = oldest;
+          }
+          if (target == INVALID_RECORD_INDEX){
+            count(SEGCACHE_MISSES);
+            return SEGCACHE_MISS;
+          }
+          claimed = target;
+          claimedGen = entries.getInt(genField, target) + 1;
+          entries.setInt(keyField, key, target);
+          entries.setInt(genField, claimedGen, target);
+          entries.setInt(pidField, getpid(), target);
+          entries.setInt(trackField, track, target);
+          entries.setInt(startField, start, target);
+          entries.setInt(sizeField, 0, target);
+          entries.setInt(lastUseField, now, target);
+          entries.setInt(statusField, SEGCACHE_FILLING, target);
+          count(SEGCACHE_MISSES);
+          return SEGCACHE_FILL;
+        }
+      }
+      Util::sleep(5);
+    }
+  }
+
+  /// Returns a pointer to the segment found by the last lookup, if it was a hit.
+  const char *SegmentCache::data() const{return segment.mapped;}
+
+  /// Returns the size of the segment found by the last lookup, if it was a hit.
+  size_t SegmentCache::size() const{return segment.mapped ? segmentSize : 0;}
+
+  /// Stores the segment claimed by the last lookup, and makes it available to other processes.
+  void SegmentCache::store(const std::string &seg){
+    if (claimed == INVALID_RECORD_INDEX){return;}
+    // Don't leave a segment behind in a cache that was removed while we were generating it
+    if (!seg.size() || !*this){
+      abandon();
+      return;
+    }
+    char name[NAME_BUFFER_SIZE];
+    snprintf(name, NAME_BUFFER_SIZE, SHM_SEGCACHE_DATA, streamName.c_str(), claimed, claimedGen);
+    IPC::sharedPage P(name, seg.size(), true, false);
+    if (!P.mapped){
+      abandon();
+      return;
+    }
+    memcpy(P.mapped, seg.data(), seg.size());
+    IPC::semGuard G(&sem);
+    if (entries.getInt(statusField, claimed) == SEGCACHE_FILLING && entries.getInt(genField, claimed) == claimedGen){
+      entries.setInt(sizeField, seg.size(), claimed);
+      entries.setInt(lastUseField, Util::bootMS(), claimed);
+      entries.setInt(statusField, SEGCACHE_READY, claimed);
+      count(SEGCACHE_BYTES, seg.size());
+      P.master = false;
+    }
+    claimed = INVALID_RECORD_INDEX;
+  }
+
+  /// Releases the segment claimed by the last lookup without storing it, so another process can
+  /// generate it instead.
+  void SegmentCache::abandon(){
+    if (claimed == INVALID_RECORD_INDEX){return;}
+    if (*this){
+      IPC::semGuard G(&sem);
+      if (entries.getInt(statusField, claimed) == SEGCACHE_FILLING && entries.getInt(genField, claimed) == claimedGen){
+        entries.setInt(statusField, SEGCACHE_FREE, claimed);
+      }
+    }
+    claimed = INVALID_RECORD_INDEX;
+  }
+
+  /// Removes the given entry and the page holding its segment. The semaphore must be held.
+  void SegmentCache::evict(size_t entry){
+    if (entries.getInt(statusField, entry) == SEGCACHE_READY){
+      char name[NAME_BUFFER_SIZE];
+      snprintf(name, NAME_BUFFER_SIZE, SHM_SEGCACHE_DATA, streamName.c_str(), entry,
+               entries.getInt(genField, entry));
+      IPC::sharedPage P(name, 0, false, false);
+      P.master = true;
+      count(SEGCACHE_EVICTIONS);
+    }
+    entries.setInt(statusField, SEGCACHE_FREE, entry);
+  }
+
+  /// Adds to one of the counters in the index page header.
+  void SegmentCache::count(size_t counter, uint64_t amount){((uint64_t *)index.mapped)[counter] += amount;}
+
+  /// Returns the counters of the cache: segments served from it, segments generated because they
+  /// were not in it, segments evicted from it, and the total bytes stored in it.
+  void SegmentCache::getStats(uint64_t &hits, uint64_t &misses, uint64_t &evictions, uint64_t &bytes) const{
+    hits = misses = evictions = bytes = 0;
+    if (!*this){return;}
+    uint64_t *counters = (uint64_t *)index.mapped;
+    hits = counters[SEGCACHE_HITS];
+    misses = counters[SEGCACHE_MISSES];
+    evictions = counters[SEGCACHE_EVICTIONS];
+    bytes = counters[SEGCACHE_BYTES];
+  }
+
+  /// Removes the segment cache of the given stream, including all stored segments.
+  void SegmentCache::remove(const std::string &_streamName){
+    SegmentCache C;
+    C.reload(_streamName, false);
+    if (!C){return;}
+    {
+      IPC::semGuard G(&C.sem);
+      // Tells processes that still have it open to stop using it
+      C.entries.setExit();
+      for (size_t i = 0; i < C.entries.getRCount(); ++i){C.evict(i);}
+      C.index.master = true;
+      C.index.close();
+    }
+    C.sem.unlink();
+  }
+
+}// namespace Util
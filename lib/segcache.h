@@ -0,0 +1,64 @@
+/// \file segcache.h
+/// Holds the shared cache of finished media segments of live streams.
+
+#pragma once
+#include "dtsc.h"
+#include "shared_memory.h"
+#include "util.h"
+#include <string>
+
+namespace Util{
+
+  /// Shared cache of finished media segments of a single live stream.
+  /// Segmented outputs (HLS, CMAF) look up every segment they are asked for. The first process
+  /// asking for a segment generates it as usual and stores the result, every other process waiting
+  /// for or asking for it later serves the stored bytes instead of generating it again.
+  /// Segments are kept in shared memory pages of their own, and are evicted once their start falls
+  /// out of the buffer window of their track, or when room is needed for a new segment.
+  class SegmentCache{
+  public:
+    /// Result of a lookup
+    enum lookupResult{
+      SEGCACHE_MISS, ///< Segment not cached and not claimed: generate it without storing it
+      SEGCACHE_FILL, ///< Segment claimed: generate it and pass it to store() when complete
+      SEGCACHE_HIT   ///< Segment available through data() and size()
+    };
+
+    SegmentCache();
+    ~SegmentCache();
+    void reload(const std::string &_streamName, bool create = true);
+    operator bool() const;
+
+    static uint64_t segmentKey(const std::string &format, const std::string &tracks, uint64_t from, uint64_t until);
+    lookupResult lookup(uint64_t key, const DTSC::Meta &M, size_t track, uint64_t start, uint64_t maxWait);
+    const char *data() const;
+    size_t size() const;
+    void store(const std::string &seg);
+    void abandon();
+
+    void getStats(uint64_t &hits, uint64_t &misses, uint64_t &evictions, uint64_t &bytes) const;
+    static void remove(const std::string &_streamName);
+
+  private:
+    void evict(size_t entry);
+    void count(size_t counter, uint64_t amount = 1);
+
+    std::string streamName;
+    IPC::semaphore sem;
+    IPC::sharedPage index;
+    IPC::sharedPage segment; ///< Page of the last cache hit
+    uint64_t segmentSize;
+    Util::RelAccX entries;
+    Util::RelAccXFieldData statusField;
+    Util::RelAccXFieldData keyField;
+    Util::RelAccXFieldData genField;
+    Util::RelAccXFieldData pidField;
+    Util::RelAccXFieldData trackField;
+    Util::RelAccXFieldData startField;
+    Util::RelAccXFieldData sizeField;
+    Util::RelAccXFieldData lastUseField;
+    size_t claimed; ///< Entry this process is filling, or INVALID_RECORD_INDEX
+    uint64_t claimedGen;
+  };
+
+}// namespace Util
@@ -5,7 +5,9 @@
 #include "defines.h"
 #include "socket.h"
 #include "timing.h"
+#include <algorithm>
 #include <cstdlib>
+#include <limits.h>
 #include <ifaddrs.h>
 #include <netdb.h>
 #include <netinet/in.h>
@@ -15,6 +17,18 @@
 #include <sys/stat.h>
 #include <fstream>
 #include <sys/select.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+#if defined(__linux__) && !defined(__CYGWIN__)
+#include <netinet/udp.h>
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#endif
 
 #define BUFFER_BLOCKSIZE 4096 // set buffer blocksize to 4KiB
 
@@ -24,6 +38,9 @@
 #define SOCKETSIZE 51200ul
 #endif
 
+#define UDP_BATCH 32 // datagrams handled per recvmmsg/sendmmsg call
+#define UDP_MAX_SEGMENTS 64 // datagrams the kernel splits a single UDP GSO send into, at most
+
 /// Local-scope only helper function that prints address families
 static const char *addrFam(int f){
   switch (f){
@@ -327,6 +344,71 @@ bool Socket::getPeerName(int fd, std::string &host, uint32_t &port){
   return getPeerName(fd, host, port, (sockaddr*)&tmpaddr, &addrLen);
 }
 
+/// Passes file descriptor fd over the Unix socket sock, together with the given data.
+/// The data may not be empty, and should be small enough to fit in a single datagram.
+/// Returns true if the descriptor was sent, false otherwise.
+bool Socket::sendDescriptor(int sock, int fd, const std::string &data){
+  if (sock < 0 || fd < 0 || !data.size()){return false;}
+  struct msghdr msg;
+  struct iovec iov;
+  char ctrl[CMSG_SPACE(sizeof(int))];
+  memset(&msg, 0, sizeof(msg));
+  memset(ctrl, 0, sizeof(ctrl));
+  iov.iov_base = (void *)data.data();
+  iov.iov_len = data.size();
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = ctrl;
+  msg.msg_controllen = sizeof(ctrl);
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+  memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+  ssize_t r;
+  do{
+    r = sendmsg(sock, &msg, 0);
+  }while (r < 0 && errno == EINTR);
+  if (r != (ssize_t)data.size()){
+    FAIL_MSG("Could not pass descriptor %d over socket %d: %s", fd, sock, r < 0 ? strerror(errno) : "short write");
+    return false;
+  }
+  return true;
+}
+
+/// Receives a file descriptor sent with sendDescriptor over the Unix socket sock.
+/// The accompanying data is stored in data. Blocks if sock is blocking.
+/// Returns the received file descriptor, or -1 if none could be received.
+int Socket::receiveDescriptor(int sock, std::string &data){
+  data.clear();
+  if (sock < 0){return -1;}
+  struct msghdr msg;
+  struct iovec iov;
+  char buf[BUFFER_BLOCKSIZE * 4];
+  char ctrl[CMSG_SPACE(sizeof(int))];
+  memset(&msg, 0, sizeof(msg));
+  iov.iov_base = buf;
+  iov.iov_len = sizeof(buf);
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = ctrl;
+  msg.msg_controllen = sizeof(ctrl);
+  ssize_t r;
+  do{
+    r = recvmsg(sock, &msg, 0);
+  }while (r < 0 && errno == EINTR);
+  if (r <= 0){return -1;}
+  int fd = -1;
+  for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)){
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS){
+      memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+      break;
+    }
+  }
+  if (fd >= 0){data.assign(buf, r);}
+  return fd;
+}
+
 std::string uint2string(unsigned int i){
   std::stringstream st;
   st << i;
@@ -335,199 +417,229 @@ std::string uint2string(unsigned int i){
 
 Socket::Buffer::Buffer(){
   splitter = "\n";
+  buf = 0;
+  bufLen = 0;
+  start = 0;
+  end = 0;
+}
+
+Socket::Buffer::Buffer(const Buffer &rhs){
+  buf = 0;
+  bufLen = 0;
+  start = 0;
+  end = 0;
+  *this = rhs;
+}
+
+Socket::Buffer &Socket::Buffer::operator=(const Buffer &rhs){
+  if (&rhs == this){return *this;}
+  splitter = rhs.splitter;
+  front = rhs.front;
+  start = 0;
+  end = 0;
+  if (rhs.end > rhs.start){
+    memcpy(reserve(rhs.end - rhs.start), rhs.buf + rhs.start, rhs.end - rhs.start);
+    end = rhs.end - rhs.start;
+  }
+  return *this;
+}
+
+Socket::Buffer::~Buffer(){
+  if (buf){free(buf);}
+}
+
+/// Returns the total amount of bytes in the buffer.
+size_t Socket::Buffer::length() const{
+  return front.size() + end - start;
+}
+
+/// Returns a pointer to all data in the buffer, which is guaranteed to hold at least count
+/// contiguous bytes. Returns a null pointer if less than count bytes are available.
+/// The pointer is valid until the next call that adds data to the buffer.
+const char *Socket::Buffer::peek(size_t count){
+  unget();
+  if (end - start < count){return 0;}
+  return buf + start;
+}
+
+/// Removes count bytes from the front of the buffer, or all bytes if less are available.
+void Socket::Buffer::consume(size_t count){
+  unget();
+  if (count >= end - start){
+    start = end = 0;
+    return;
+  }
+  start += count;
+}
+
+/// Returns a pointer to at least count bytes of free space at the end of the buffer.
+/// After writing to it, call commit() with the amount of bytes actually written.
+char *Socket::Buffer::reserve(size_t count){
+  if (bufLen - end >= count){return buf + end;}
+  // Move the data to the start of the allocation first, and grow it if that is not enough
+  if (start){
+    if (end > start){memmove(buf, buf + start, end - start);}
+    end -= start;
+    start = 0;
+  }
+  if (bufLen - end < count){
+    size_t newLen = bufLen ? bufLen * 2 : BUFFER_BLOCKSIZE * 4;
+    while (newLen - end < count){newLen *= 2;}
+    char *newBuf = (char *)realloc(buf, newLen);
+    if (!newBuf){
+      FAIL_MSG("Could not grow buffer to %zu bytes", newLen);
+      return 0;
+    }
+    buf = newBuf;
+    bufLen = newLen;
+  }
+  return buf + end;
+}
+
+/// Adds count bytes written into the space returned by reserve() to the end of the buffer.
+void Socket::Buffer::commit(size_t count){
+  end += count;
+  if (end > bufLen){end = bufLen;}
+}
+
+/// Inserts data in front of the data in buf.
+void Socket::Buffer::insert(const char *newdata, size_t newdatasize){
+  if (!newdatasize){return;}
+  if (start >= newdatasize){
+    start -= newdatasize;
+    memcpy(buf + start, newdata, newdatasize);
+    return;
+  }
+  if (!reserve(newdatasize)){return;}
+  memmove(buf + start + newdatasize, buf + start, end - start);
+  memcpy(buf + start, newdata, newdatasize);
+  end += newdatasize;
 }
 
-/// Returns the amount of elements in the internal std::deque of std::string objects.
-/// The back is popped as long as it is empty, first - this way this function is
-/// guaranteed to return 0 if the buffer is empty.
+/// Puts the part handed out by get(), if any, back in front of the data in buf.
+void Socket::Buffer::unget(){
+  if (front.empty()){return;}
+  insert(front.data(), front.size());
+  front.clear();
+}
+
+/// Returns the amount of parts in the buffer: zero if it is empty, one if all data is a single
+/// part as get() would return it, two or more otherwise.
+/// The buffer no longer keeps its data in parts, so this never counts beyond two.
 unsigned int Socket::Buffer::size(){
-  while (data.size() > 0 && data.back().empty()){data.pop_back();}
-  return data.size();
+  if (end == start){return front.size() ? 1 : 0;}
+  if (front.size()){return 2;}
+  if (end - start > BUFFER_BLOCKSIZE){return 2;}
+  if (splitter.size()){
+    const char *split = std::search(buf + start, buf + end, splitter.data(), splitter.data() + splitter.size());
+    if (split != buf + end && split + splitter.size() != buf + end){return 2;}
+  }
+  return 1;
 }
 
 /// Returns either the amount of total bytes available in the buffer or max, whichever is smaller.
 unsigned int Socket::Buffer::bytes(unsigned int max){
-  unsigned int i = 0;
-  for (std::deque<std::string>::iterator it = data.begin(); it != data.end(); ++it){
-    i += (*it).size();
-    if (i >= max){return max;}
-  }
-  return i;
+  return std::min(length(), (size_t)max);
 }
 
 /// Returns how many bytes to read until the next splitter, or 0 if none found.
 unsigned int Socket::Buffer::bytesToSplit(){
-  unsigned int i = 0;
-  for (std::deque<std::string>::reverse_iterator it = data.rbegin(); it != data.rend(); ++it){
-    i += (*it).size();
-    if ((*it).size() >= splitter.size() && (*it).substr((*it).size() - splitter.size()) == splitter){
-      return i;
-    }
-  }
-  return 0;
+  if (!splitter.size()){return 0;}
+  unget();
+  const char *split = std::search(buf + start, buf + end, splitter.data(), splitter.data() + splitter.size());
+  if (split == buf + end){return 0;}
+  return split - (buf + start) + splitter.size();
 }
 
-/// Appends this string to the internal std::deque of std::string objects.
-/// It is automatically split every BUFFER_BLOCKSIZE bytes and when the splitter string is
-/// encountered.
+/// Appends this string to the end of the buffer.
 void Socket::Buffer::append(const std::string &newdata){
   append(newdata.data(), newdata.size());
 }
 
-/// Helper function that does a short-circuiting string compare
-inline bool string_compare(const char *a, const char *b, const size_t len){
-  for (size_t i = 0; i < len; ++i){
-    if (a[i] != b[i]){return false;}
-  }
-  return true;
-}
-
-/// Appends this data block to the internal std::deque of std::string objects.
-/// It is automatically split every BUFFER_BLOCKSIZE bytes and when the splitter string is
-/// encountered.
+/// Appends this data block to the end of the buffer.
 void Socket::Buffer::append(const char *newdata, const unsigned int newdatasize){
-  uint32_t i = 0;
-  while (i < newdatasize){
-    uint32_t j = 0;
-    if (!splitter.size()){
-      if (newdatasize - i > BUFFER_BLOCKSIZE){
-        j = BUFFER_BLOCKSIZE;
-      }else{
-        j = newdatasize - i;
-      }
-    }else{
-      while (j + i < newdatasize && j < BUFFER_BLOCKSIZE){
-        j++;
-        if (j >= splitter.size()){
-          if (string_compare(newdata + i + j - splitter.size(), splitter.data(), splitter.size())){
-            break;
-          }
-        }
-      }
-    }
-    if (j){
-      data.push_front("");
-      data.front().assign(newdata + i, (size_t)j);
-      i += j;
-    }else{
-      FAIL_MSG("Appended an empty string to buffer: aborting!");
-      break;
-    }
-  }
-  if (data.size() > 5000){
-    WARN_MSG("Warning: After %d new bytes, buffer has %d parts containing over %u bytes!",
-             newdatasize, (int)data.size(), bytes(9000));
-  }
+  if (!newdatasize){return;}
+  char *target = reserve(newdatasize);
+  if (!target){return;}
+  memcpy(target, newdata, newdatasize);
+  end += newdatasize;
 }
 
-/// Prepends this data block to the internal std::deque of std::string objects.
-/// It is _not_ automatically split every BUFFER_BLOCKSIZE bytes.
+/// Prepends this string to the front of the buffer.
 void Socket::Buffer::prepend(const std::string &newdata){
-  data.push_back(newdata);
+  prepend(newdata.data(), newdata.size());
 }
 
-/// Prepends this data block to the internal std::deque of std::string objects.
-/// It is _not_ automatically split every BUFFER_BLOCKSIZE bytes.
+/// Prepends this data block to the front of the buffer.
 void Socket::Buffer::prepend(const char *newdata, const unsigned int newdatasize){
-  data.push_back(std::string(newdata, (size_t)newdatasize));
+  unget();
+  insert(newdata, newdatasize);
 }
 
 /// Returns true if at least count bytes are available in this buffer.
 bool Socket::Buffer::available(unsigned int count){
-  size();
-  unsigned int i = 0;
-  for (std::deque<std::string>::iterator it = data.begin(); it != data.end(); ++it){
-    i += (*it).size();
-    if (i >= count){return true;}
-  }
-  return false;
+  return length() >= count;
 }
 
 /// Returns true if at least count bytes are available in this buffer.
 bool Socket::Buffer::available(unsigned int count) const{
-  unsigned int i = 0;
-  for (std::deque<std::string>::const_iterator it = data.begin(); it != data.end(); ++it){
-    i += (*it).size();
-    if (i >= count){return true;}
-  }
-  return false;
+  return length() >= count;
 }
 
 /// Removes count bytes from the buffer, returning them by value.
 /// Returns an empty string if not all count bytes are available.
 std::string Socket::Buffer::remove(unsigned int count){
-  size();
-  if (!available(count)){return "";}
-  unsigned int i = 0;
-  std::string ret;
-  ret.reserve(count);
-  for (std::deque<std::string>::reverse_iterator it = data.rbegin(); it != data.rend(); ++it){
-    if (i + (*it).size() < count){
-      ret.append(*it);
-      i += (*it).size();
-      (*it).clear();
-    }else{
-      ret.append(*it, 0, count - i);
-      (*it).erase(0, count - i);
-      break;
-    }
-  }
+  const char *ptr = peek(count);
+  if (!ptr){return "";}
+  std::string ret(ptr, count);
+  consume(count);
   return ret;
 }
 
 /// Removes count bytes from the buffer, appending them to the given ptr.
 /// Does nothing if not all count bytes are available.
 void Socket::Buffer::remove(Util::ResizeablePointer & ptr, unsigned int count){
-  size();
-  if (!available(count)){return;}
-  unsigned int i = 0;
-  for (std::deque<std::string>::reverse_iterator it = data.rbegin(); it != data.rend(); ++it){
-    if (i + (*it).size() < count){
-      ptr.append(*it);
-      i += (*it).size();
-      (*it).clear();
-    }else{
-      ptr.append(it->data(), count - i);
-      (*it).erase(0, count - i);
-      break;
-    }
-  }
+  const char *data = peek(count);
+  if (!data){return;}
+  ptr.append(data, count);
+  consume(count);
 }
 
 /// Copies count bytes from the buffer, returning them by value.
 /// Returns an empty string if not all count bytes are available.
 std::string Socket::Buffer::copy(unsigned int count){
-  size();
-  if (!available(count)){return "";}
-  unsigned int i = 0;
-  std::string ret;
-  ret.reserve(count);
-  for (std::deque<std::string>::reverse_iterator it = data.rbegin(); it != data.rend(); ++it){
-    if (i + (*it).size() < count){
-      ret.append(*it);
-      i += (*it).size();
-    }else{
-      ret.append(*it, 0, count - i);
-      break;
-    }
-  }
-  return ret;
+  const char *ptr = peek(count);
+  if (!ptr){return "";}
+  return std::string(ptr, count);
 }
 
-/// Gets a reference to the back of the internal std::deque of std::string objects.
+/// Gets a reference to the first part of the buffer: up to and including the first splitter, or
+/// at most BUFFER_BLOCKSIZE bytes. The part is taken out of the buffer; changes to it are kept, and
+/// clearing it removes it.
 std::string &Socket::Buffer::get(){
-  size();
-  static std::string empty;
-  if (data.size() > 0){
-    return data.back();
-  }else{
-    return empty;
+  if (front.empty() && end > start){
+    size_t len = std::min(end - start, (size_t)BUFFER_BLOCKSIZE);
+    if (splitter.size()){
+      const char *split = std::search(buf + start, buf + start + len, splitter.data(), splitter.data() + splitter.size());
+      if (split != buf + start + len){len = split - (buf + start) + splitter.size();}
+    }
+    front.assign(buf + start, len);
+    start += len;
+    if (start == end){start = end = 0;}
   }
+  return front;
 }
 
 /// Completely empties the buffer
 void Socket::Buffer::clear(){
-  data.clear();
+  front.clear();
+  start = end = 0;
+  // Don't hold on to large allocations after a burst of data
+  if (bufLen > BUFFER_BLOCKSIZE * 256){
+    free(buf);
+    buf = 0;
+    bufLen = 0;
+  }
 }
 
 void Socket::Connection::setBoundAddr(){
@@ -599,6 +711,9 @@ void Socket::Connection::clear(){
   Error = false;
   Blocking = false;
   skipCount = 0;
+  sendBuffering = false;
+  upbuffer.clear();
+  upbufferPos = 0;
   memset(&remoteaddr, 0, sizeof(remoteaddr));
 #ifdef SSL
   sslConnected = false;
@@ -647,7 +762,9 @@ bool isFDBlocking(int FD){
 }
 
 /// Set this socket to be blocking (true) or nonblocking (false).
+/// While send buffering is on, the socket stays nonblocking.
 void Socket::Connection::setBlocking(bool blocking){
+  if (sendBuffering){blocking = false;}
 #ifdef SSL
   if (sslConnected){
     if (blocking == Blocking){return;}
@@ -1031,7 +1148,7 @@ uint64_t Socket::Connection::dataDown(){
 /// Returns true if new data was received, false otherwise.
 bool Socket::Connection::spool(bool strictMode){
   /// \todo Provide better mechanism to prevent overbuffering.
-  if (!strictMode && downbuffer.size() > 10000){
+  if (!strictMode && downbuffer.length() > BUFFER_BLOCKSIZE * 10000){
     return true;
   }else{
     return iread(downbuffer);
@@ -1056,7 +1173,12 @@ const Socket::Buffer &Socket::Connection::Received() const{
 
 /// Will not buffer anything but always send right away. Blocks.
 /// Any data that could not be send will block until it can be send or the connection is severed.
+/// With send buffering on, writes what it can and keeps the rest for flushSends instead.
 void Socket::Connection::SendNow(const char *data, size_t len){
+  if (sendBuffering){
+    queueSend(data, len);
+    return;
+  }
   bool bing = isBlocking();
   if (!bing){setBlocking(true);}
   unsigned int i = iwrite(data, std::min((long unsigned int)len, SOCKETSIZE));
@@ -1066,6 +1188,45 @@ void Socket::Connection::SendNow(const char *data, size_t len){
   if (!bing){setBlocking(false);}
 }
 
+/// Will not buffer anything but always send right away. Blocks.
+/// Sends all given buffers in order, gathering as many of them as possible per system call.
+/// Any data that could not be send will block until it can be send or the connection is severed.
+void Socket::Connection::SendNow(const struct iovec *vec, size_t count){
+  if (sendBuffering){
+    size_t i = 0;
+    if (!sendPending()){
+      size_t done = iwrite(vec, count);
+      while (i < count && done >= vec[i].iov_len){
+        done -= vec[i].iov_len;
+        ++i;
+      }
+      if (done && i < count){
+        queueSend((const char *)vec[i].iov_base + done, vec[i].iov_len - done);
+        ++i;
+      }
+    }
+    for (; i < count; ++i){queueSend((const char *)vec[i].iov_base, vec[i].iov_len);}
+    return;
+  }
+  bool bing = isBlocking();
+  if (!bing){setBlocking(true);}
+  size_t i = 0;
+  while (i < count && connected()){
+    size_t done = iwrite(vec + i, count - i);
+    // Skip over all buffers that were written completely
+    while (i < count && done >= vec[i].iov_len){
+      done -= vec[i].iov_len;
+      ++i;
+    }
+    // Finish a partially written buffer by itself, then continue gathering after it
+    if (done && i < count){
+      SendNow((const char *)vec[i].iov_base + done, vec[i].iov_len - done);
+      ++i;
+    }
+  }
+  if (!bing){setBlocking(false);}
+}
+
 /// Will not buffer anything but always send right away. Blocks.
 /// Any data that could not be send will block until it can be send or the connection is severed.
 void Socket::Connection::SendNow(const char *data){
@@ -1079,6 +1240,124 @@ void Socket::Connection::SendNow(const std::string &data){
   SendNow(data.data(), data.size());
 }
 
+/// Sends len bytes from file descriptor fd, starting at the given offset, right away. Blocks.
+/// On Linux, regular connections let the kernel copy the data straight from the file to the socket.
+/// SSL connections, pending skipped bytes and other platforms fall back to reading into a buffer.
+/// The file position of fd is not changed.
+/// \returns True if all data was sent, false if the file could not be read or the connection broke.
+bool Socket::Connection::sendFile(int fd, uint64_t offset, uint64_t len){
+  bool bing = isBlocking();
+  if (!bing && !sendBuffering){setBlocking(true);}
+#ifdef __linux__
+  // With send buffering on, the data goes through SendNow so whatever cannot be written is kept
+  bool inKernel = !skipCount && !sendBuffering;
+#ifdef SSL
+  if (sslConnected){inKernel = false;}
+#endif
+  while (inKernel && len && connected()){
+    off_t off = offset;
+    ssize_t r = sendfile(sSend, fd, &off, std::min(len, (uint64_t)SOCKETSIZE * 16));
+    if (r < 0){
+      if (errno == EINTR || errno == EAGAIN){continue;}
+      // Not supported for this kind of file or socket, use the regular path instead
+      if (errno == EINVAL || errno == ENOSYS){
+        HIGH_MSG("Cannot sendfile on this socket, falling back to regular writes");
+        break;
+      }
+      Error = true;
+      lastErr = strerror(errno);
+      INSANE_MSG("Could not sendfile data! Error: %s", lastErr.c_str());
+      close();
+      break;
+    }
+    if (!r){
+      FAIL_MSG("File ended %" PRIu64 " bytes before the requested range did", len);
+      if (!bing){setBlocking(false);}
+      return false;
+    }
+    up += r;
+    offset += r;
+    len -= r;
+  }
+#endif
+  char buf[BUFFER_BLOCKSIZE * 16];
+  while (len && connected()){
+    ssize_t r = pread(fd, buf, std::min(len, (uint64_t)sizeof(buf)), offset);
+    if (r < 0 && errno == EINTR){continue;}
+    if (r <= 0){
+      FAIL_MSG("Could not read file to send: %s", r ? strerror(errno) : "unexpected end of file");
+      break;
+    }
+    SendNow(buf, r);
+    offset += r;
+    len -= r;
+  }
+  if (!bing){setBlocking(false);}
+  return !len;
+}
+
+/// Turns send buffering on or off. With send buffering on, SendNow and sendFile never block:
+/// whatever cannot be written right away is kept, to be written by flushSends once the socket
+/// accepts more data. Meant for processes that serve many connections from a single thread.
+/// Turning it off again writes out everything still waiting, blocking if needed.
+void Socket::Connection::setSendBuffering(bool buffering){
+  if (buffering == sendBuffering){return;}
+  sendBuffering = buffering;
+  if (buffering){
+    setBlocking(false);
+    return;
+  }
+  if (sendPending()){
+    std::string waiting = upbuffer.substr(upbufferPos);
+    upbuffer.clear();
+    upbufferPos = 0;
+    SendNow(waiting);
+  }
+}
+
+/// Returns the amount of bytes that were sent while send buffering was on, but not written yet.
+size_t Socket::Connection::sendPending() const{
+  return upbuffer.size() - upbufferPos;
+}
+
+/// Writes as much waiting data as the socket accepts, without blocking.
+/// \returns True if no data is waiting anymore.
+bool Socket::Connection::flushSends(){
+  while (sendPending() && connected()){
+    unsigned int r = iwrite(upbuffer.data() + upbufferPos, std::min(sendPending(), (size_t)SOCKETSIZE));
+    if (!r){break;}
+    upbufferPos += r;
+  }
+  if (!sendPending() || !connected()){
+    upbuffer.clear();
+    upbufferPos = 0;
+    return true;
+  }
+  // Drop what was written once it is at least half of the buffer, so it doesn't grow forever
+  if (upbufferPos > upbuffer.size() / 2){
+    upbuffer.erase(0, upbufferPos);
+    upbufferPos = 0;
+  }
+  return false;
+}
+
+/// Writes what it can of the given data without blocking, and keeps the rest, behind any data that
+/// was already waiting.
+void Socket::Connection::queueSend(const char *data, size_t len){
+  if (!len){return;}
+  if (!flushSends()){
+    upbuffer.append(data, len);
+    return;
+  }
+  size_t i = 0;
+  while (i < len && connected()){
+    unsigned int r = iwrite(data + i, std::min(len - i, (size_t)SOCKETSIZE));
+    if (!r){break;}
+    i += r;
+  }
+  if (i < len && connected()){upbuffer.append(data + i, len - i);}
+}
+
 void Socket::Connection::skipBytes(uint32_t byteCount){
   INFO_MSG("Skipping first %" PRIu32 " bytes going to socket", byteCount);
   skipCount = byteCount;
@@ -1091,33 +1370,7 @@ void Socket::Connection::skipBytes(uint32_t byteCount){
 /// \returns The amount of bytes actually written.
 unsigned int Socket::Connection::iwrite(const void *buffer, int len){
 #ifdef SSL
-  if (sslConnected){
-    DONTEVEN_MSG("SSL iwrite");
-    if (!connected() || len < 1){return 0;}
-    int r;
-    r = mbedtls_ssl_write(ssl, (const unsigned char *)buffer, len);
-    if (r < 0){
-      switch (errno){
-      case MBEDTLS_ERR_SSL_WANT_WRITE: return 0; break;
-      case MBEDTLS_ERR_SSL_WANT_READ: return 0; break;
-      case EWOULDBLOCK: return 0; break;
-      case EINTR: return 0; break;
-      default:
-        Error = true;
-        lastErr = strerror(errno);
-        INSANE_MSG("Could not iwrite data! Error: %s", lastErr.c_str());
-        close();
-        return 0;
-        break;
-      }
-    }
-    if (r == 0 && (sSend >= 0)){
-      DONTEVEN_MSG("Socket closed by remote");
-      close();
-    }
-    up += r;
-    return r;
-  }
+  if (sslConnected){return ssl_iwrite(buffer, len);}
 #endif
   if (!connected() || len < 1){return 0;}
   if (skipCount){
@@ -1159,6 +1412,91 @@ unsigned int Socket::Connection::iwrite(const void *buffer, int len){
   return r;
 }// Socket::Connection::iwrite
 
+#ifdef SSL
+/// Incremental write call for SSL connections.
+/// Works like iwrite, but encrypts the data into a single TLS record first.
+/// On a partial write, mbedtls requires the next call to start with the same data.
+unsigned int Socket::Connection::ssl_iwrite(const void *buffer, int len){
+  DONTEVEN_MSG("SSL iwrite");
+  if (!connected() || len < 1){return 0;}
+  int r;
+  r = mbedtls_ssl_write(ssl, (const unsigned char *)buffer, len);
+  if (r < 0){
+    switch (errno){
+    case MBEDTLS_ERR_SSL_WANT_WRITE: return 0; break;
+    case MBEDTLS_ERR_SSL_WANT_READ: return 0; break;
+    case EWOULDBLOCK: return 0; break;
+    case EINTR: return 0; break;
+    default:
+      Error = true;
+      lastErr = strerror(errno);
+      INSANE_MSG("Could not iwrite data! Error: %s", lastErr.c_str());
+      close();
+      return 0;
+      break;
+    }
+  }
+  if (r == 0 && (sSend >= 0)){
+    DONTEVEN_MSG("Socket closed by remote");
+    close();
+  }
+  up += r;
+  return r;
+}
+#endif
+
+/// Incremental scatter-gather write call. This function tries to write all given buffers to the
+/// socket in a single system call, returning the amount of bytes it actually wrote.
+/// SSL connections gather the buffers into a single TLS record instead.
+/// \param vec Array of buffers to write, in order.
+/// \param count Amount of buffers in vec.
+/// \returns The amount of bytes actually written, counted over all buffers.
+unsigned int Socket::Connection::iwrite(const struct iovec *vec, size_t count){
+  if (!count){return 0;}
+#ifdef SSL
+  if (sslConnected){
+    if (count == 1){return ssl_iwrite(vec[0].iov_base, vec[0].iov_len);}
+    // Gather as much as fits in a single TLS record, so we don't send a record per buffer.
+    // Since this always starts at the first buffer, retries after a partial write see the same data.
+    char gathered[16384];
+    size_t len = 0;
+    for (size_t i = 0; i < count && len < sizeof(gathered); ++i){
+      size_t part = std::min(vec[i].iov_len, sizeof(gathered) - len);
+      memcpy(gathered + len, vec[i].iov_base, part);
+      len += part;
+    }
+    return ssl_iwrite(gathered, len);
+  }
+#endif
+  if (!connected()){return 0;}
+  // Skipped bytes are handled by the regular write call, one buffer at a time
+  if (skipCount){return iwrite(vec[0].iov_base, vec[0].iov_len);}
+  ssize_t r = writev(sSend, vec, std::min(count, (size_t)IOV_MAX));
+  if (r < 0){
+    switch (errno){
+    case EWOULDBLOCK: return 0; break;
+    case EINTR: return 0; break;
+    default:
+      Error = true;
+      lastErr = strerror(errno);
+      INSANE_MSG("Could not iwrite data! Error: %s", lastErr.c_str());
+      close();
+      return 0;
+      break;
+    }
+  }
+  if (r == 0 && (sSend >= 0)){
+    bool empty = true;
+    for (size_t i = 0; i < count && empty; ++i){empty = !vec[i].iov_len;}
+    if (!empty){
+      DONTEVEN_MSG("Socket closed by remote");
+      close();
+    }
+  }
+  up += r;
+  return r;
+}
+
 /// Incremental read call. This function tries to read len bytes to the buffer from the socket,
 /// returning the amount of bytes it actually read.
 /// \param buffer Location of the buffer to read to.
@@ -1237,10 +1575,12 @@ int Socket::Connection::iread(void *buffer, int len, int flags){
 /// \param flags Flags to use in the recv call. Ignored on fake sockets.
 /// \return True if new data arrived, false otherwise.
 bool Socket::Connection::iread(Buffer &buffer, int flags){
-  char cbuffer[BUFFER_BLOCKSIZE];
-  int num = iread(cbuffer, BUFFER_BLOCKSIZE, flags);
+  // Read straight into the free space at the end of the buffer
+  char *target = buffer.reserve(BUFFER_BLOCKSIZE * 4);
+  if (!target){return false;}
+  int num = iread(target, BUFFER_BLOCKSIZE * 4, flags);
   if (num < 1){return false;}
-  buffer.append(cbuffer, num);
+  buffer.commit(num);
   return true;
 }// iread
 
@@ -1663,6 +2003,46 @@ static int dTLS_send(void *s, const unsigned char *buf, size_t len){
 #endif
 
 
+namespace Socket{
+  /// Datagrams received by a single recvmmsg call, each in its own slot of buffer.
+  struct UDPBatch{
+#if defined(__linux__) && !defined(__CYGWIN__)
+    mmsghdr msgs[UDP_BATCH];
+    iovec iov[UDP_BATCH];
+    sockaddr_in6 addrs[UDP_BATCH];
+    char ctrl[UDP_BATCH][0x100];
+#endif
+    Util::ResizeablePointer buffer;
+    size_t slotSize;
+    size_t count; ///< Amount of datagrams received
+    size_t pos;   ///< Next datagram to hand out
+  };
+}// namespace Socket
+
+#if !defined(__CYGWIN__) && !defined(_WIN32)
+/// Fills cmsg with the local address and interface a UDP datagram was received on, so replies
+/// are sent from the same address. Returns the amount of control buffer space used.
+static size_t setPktInfo(cmsghdr *cmsg, void *recvAddr, int recvInterface){
+  cmsg->cmsg_level = IPPROTO_IP;
+  cmsg->cmsg_type = IP_PKTINFO;
+  struct in_pktinfo in_pktinfo;
+  memcpy(&(in_pktinfo.ipi_spec_dst), &(((sockaddr_in*)recvAddr)->sin_family), sizeof(in_pktinfo.ipi_spec_dst));
+  in_pktinfo.ipi_ifindex = recvInterface;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(in_pktinfo));
+  *(struct in_pktinfo*)CMSG_DATA(cmsg) = in_pktinfo;
+  return CMSG_SPACE(sizeof(in_pktinfo));
+}
+#endif
+
+/// Time in microseconds between two paced packets, for a pace queue of qSize packets.
+static uint64_t paceInterval(size_t qSize){
+  // Target clearing the queue in 25ms at most.
+  uint64_t targetTime = 25000 / qSize;
+  // If this slows us to below 1 packet per 5ms, go that speed instead.
+  if (targetTime > 5000){targetTime = 5000;}
+  return targetTime;
+}
+
 /// Create a new UDP Socket.
 /// Will attempt to create an IPv6 UDP socket, on fail try a IPV4 UDP socket.
 /// If both fail, prints an DLVL_FAIL debug message.
@@ -1691,6 +2071,16 @@ void Socket::UDPConnection::init(bool _nonblock, int _family){
     if (_nonblock){setBlocking(!_nonblock);}
     checkRecvBuf();
   }
+  batch = 0;
+  noSegment = true;
+#if defined(__linux__) && !defined(__CYGWIN__)
+  // Kernels that can segment UDP datagrams (GSO) know about this option
+  if (sock != -1){
+    int segSize = 0;
+    socklen_t segLen = sizeof(segSize);
+    noSegment = getsockopt(sock, SOL_UDP, UDP_SEGMENT, &segSize, &segLen) != 0;
+  }
+#endif
 
   {
     // Allow address re-use
@@ -1964,6 +2354,10 @@ Socket::UDPConnection::~UDPConnection(){
     free(recvAddr);
     recvAddr = 0;
   }
+  if (batch){
+    delete batch;
+    batch = 0;
+  }
 #ifdef SSL
   deinitDTLS();
 #endif
@@ -2242,18 +2636,7 @@ void Socket::UDPConnection::SendNow(const char *sdata, size_t len, sockaddr * dA
     mHdr.msg_control = msg_control;
     mHdr.msg_controllen = sizeof(msg_control);
     mHdr.msg_flags = 0;
-    int cmsg_space = 0;
-    cmsghdr * cmsg = CMSG_FIRSTHDR(&mHdr);
-    cmsg->cmsg_level = IPPROTO_IP;
-    cmsg->cmsg_type = IP_PKTINFO;
-
-    struct in_pktinfo in_pktinfo;
-    memcpy(&(in_pktinfo.ipi_spec_dst), &(((sockaddr_in*)recvAddr)->sin_family), sizeof(in_pktinfo.ipi_spec_dst));
-    in_pktinfo.ipi_ifindex = recvInterface;
-    cmsg->cmsg_len = CMSG_LEN(sizeof(in_pktinfo));
-    *(struct in_pktinfo*)CMSG_DATA(cmsg) = in_pktinfo;
-    cmsg_space += CMSG_SPACE(sizeof(in_pktinfo));
-    mHdr.msg_controllen = cmsg_space;
+    mHdr.msg_controllen = setPktInfo(CMSG_FIRSTHDR(&mHdr), recvAddr, recvInterface);
 
     int r = sendmsg(sock, &mHdr, 0);
     if (r > 0){
@@ -2318,11 +2701,7 @@ size_t Socket::UDPConnection::timeToNextPace(uint64_t uTime){
   if (!qSize){return std::string::npos;} // No queue? No time. Return highest possible value.
   if (!uTime){uTime = Util::getMicros();}
   uint64_t paceWait = uTime - lastPace; // Time we've waited so far already
-
-  // Target clearing the queue in 25ms at most.
-  uint64_t targetTime = 25000 / qSize;
-  // If this slows us to below 1 packet per 5ms, go that speed instead.
-  if (targetTime > 5000){targetTime = 5000;}
+  uint64_t targetTime = paceInterval(qSize);
   // If the wait is over, send now.
   if (paceWait >= targetTime){return 0;}
   // Return remaining wait time
@@ -2341,11 +2720,18 @@ void Socket::UDPConnection::sendPaced(uint64_t uSendWindow){
 
     // Not sleeping? Send now!
     if (!sleepTime){
-      SendNow(*paceQueue.begin(), paceQueue.begin()->size());
-      paceQueue.pop_front();
+      // Send everything that became due since the last send at once
+      size_t count = UDP_BATCH;
+      uint64_t interval = paceInterval(paceQueue.size());
+      if (interval && (uTime - lastPace) / interval < count){count = (uTime - lastPace) / interval;}
+      if (!count){count = 1;}
+      if (count > paceQueue.size()){count = paceQueue.size();}
+      sendQueued(count);
       lastPace = uTime;
       continue;
     }
+    // Datagrams we already read do not make the socket readable
+    if (hasQueued()){return;}
 
     {
       // Use select to wait until a packet arrives or until the next packet should be sent
@@ -2365,6 +2751,116 @@ void Socket::UDPConnection::sendPaced(uint64_t uSendWindow){
   }while(uTime - currPace < uSendWindow);
 }
 
+/// Sends every packet queued by sendPaced right away, instead of spreading them out.
+/// For senders that queue all packets of a frame with sendPaced and then send them at once, so
+/// they go out in as few system calls as possible.
+void Socket::UDPConnection::flushQueue(){
+  if (!paceQueue.size()){return;}
+  sendQueued(paceQueue.size());
+  lastPace = Util::getMicros();
+}
+
+/// Sends the first count packets of the pace queue and removes them from it.
+/// On Linux, uses a single sendmmsg call for up to UDP_BATCH datagrams. Runs of packets of the
+/// same size, optionally followed by a smaller one, become one datagram the kernel segments (UDP
+/// GSO), if it can.
+void Socket::UDPConnection::sendQueued(size_t count){
+  if (count > paceQueue.size()){count = paceQueue.size();}
+#if defined(__linux__) && !defined(__CYGWIN__)
+  size_t done = 0;
+  while (count - done > 1 && sock != -1){
+    mmsghdr msgs[UDP_BATCH];
+    iovec iov[UDP_BATCH];
+    size_t msgPackets[UDP_BATCH];
+    union{
+      cmsghdr align;
+      char buf[CMSG_SPACE(sizeof(in_pktinfo)) + CMSG_SPACE(sizeof(uint16_t))];
+    }ctrl[UDP_BATCH];
+    memset(msgs, 0, sizeof(msgs));
+    memset(ctrl, 0, sizeof(ctrl));
+    size_t msgCount = 0;
+    size_t i = done;
+    while (i < count && i - done < UDP_BATCH){
+      msghdr &mHdr = msgs[msgCount].msg_hdr;
+      size_t segSize = paceQueue[i].size();
+      size_t total = segSize;
+      size_t n = 1;
+      if (!noSegment){
+        while (i + n < count && i + n - done < UDP_BATCH && n < UDP_MAX_SEGMENTS &&
+               paceQueue[i + n].size() <= segSize && total + paceQueue[i + n].size() <= 65000){
+          total += paceQueue[i + n].size();
+          // A smaller packet can only be the last segment
+          if (paceQueue[i + n++].size() < segSize){break;}
+        }
+      }
+      for (size_t j = 0; j < n; ++j){
+        iov[i - done + j].iov_base = (void *)(char *)paceQueue[i + j];
+        iov[i - done + j].iov_len = paceQueue[i + j].size();
+      }
+      mHdr.msg_iov = iov + (i - done);
+      mHdr.msg_iovlen = n;
+      if (!isConnected){
+        mHdr.msg_name = destAddr;
+        mHdr.msg_namelen = destAddr_size;
+      }
+      mHdr.msg_control = ctrl[msgCount].buf;
+      mHdr.msg_controllen = sizeof(ctrl[msgCount].buf);
+      size_t cLen = 0;
+      cmsghdr *cmsg = CMSG_FIRSTHDR(&mHdr);
+      if (!isConnected && hasReceiveData && recvAddr){
+        cLen += setPktInfo(cmsg, recvAddr, recvInterface);
+        cmsg = CMSG_NXTHDR(&mHdr, cmsg);
+      }
+      if (n > 1){
+        cmsg->cmsg_level = SOL_UDP;
+        cmsg->cmsg_type = UDP_SEGMENT;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+        *(uint16_t *)CMSG_DATA(cmsg) = segSize;
+        cLen += CMSG_SPACE(sizeof(uint16_t));
+      }
+      mHdr.msg_controllen = cLen;
+      if (!cLen){mHdr.msg_control = 0;}
+      msgPackets[msgCount++] = n;
+      i += n;
+    }
+
+    int r = sendmmsg(sock, msgs, msgCount, 0);
+    if (r > 0){
+      for (int m = 0; m < r; ++m){
+        up += msgs[m].msg_len;
+        done += msgPackets[m];
+      }
+      continue;
+    }
+    if (msgPackets[0] > 1){
+      // Kernel or network device cannot segment for us; send every packet as-is from now on
+      INFO_MSG("Could not send segmented UDP data through %d (%s), sending datagrams one by one", sock, strerror(errno));
+      noSegment = true;
+      continue;
+    }
+    if (isConnected && errno == EDESTADDRREQ){
+      close();
+      break;
+    }
+    if (errno != ENETUNREACH){
+      FAIL_MSG("Could not send UDP data through %d: %s", sock, strerror(errno));
+    }
+    ++done;
+  }
+  if (done < count && sock != -1){SendNow(paceQueue[done], paceQueue[done].size());}
+#else
+  for (size_t i = 0; i < count; ++i){SendNow(paceQueue[i], paceQueue[i].size());}
+#endif
+  paceQueue.erase(paceQueue.begin(), paceQueue.begin() + count);
+}
+
+/// Returns true if Receive() has datagrams to return that were already read from the socket.
+/// These do not make the socket readable for select or poll, so callers waiting on the socket
+/// must check this first.
+bool Socket::UDPConnection::hasQueued() const{
+  return pretendReceive || (batch && batch->pos < batch->count);
+}
+
 std::string Socket::UDPConnection::getBoundAddress(){
   std::string boundaddr;
   uint32_t boundport;
@@ -2636,6 +3132,7 @@ bool Socket::UDPConnection::connect(){
 /// Attempt to receive a UDP packet.
 /// This will automatically allocate or resize the internal data buffer if needed.
 /// If a packet is received, it will be placed in the "data" member, with it's length in "data_len".
+/// On Linux, reads all waiting datagrams (up to UDP_BATCH) at once, and returns them one by one.
 /// \return True if a packet was received, false otherwise.
 bool Socket::UDPConnection::Receive(){
   if (pretendReceive){
@@ -2644,6 +3141,27 @@ bool Socket::UDPConnection::Receive(){
   }
   if (sock == -1){return false;}
   data.truncate(0);
+#if defined(__linux__) && !defined(__CYGWIN__)
+  if (!hasQueued() && !receiveBatch()){return false;}
+  UDPBatch &B = *batch;
+  size_t slot = B.pos++;
+  msghdr &mHdr = B.msgs[slot].msg_hdr;
+  unsigned int r = B.msgs[slot].msg_len;
+  if (!isConnected){
+    socklen_t destsize = mHdr.msg_namelen;
+    if (destAddr && destsize && destAddr_size >= destsize){memcpy(destAddr, B.addrs + slot, destsize);}
+    onPktInfo(mHdr);
+  }
+  down += r;
+  //Handle UDP packets that are too large: they were cut off, so skip them
+  if (B.slotSize < r){
+    INFO_MSG("Doubling UDP socket buffer from %" PRIu32 " to %" PRIu32, data.rsize(), data.rsize()*2);
+    data.allocate(data.rsize()*2);
+    return Receive();
+  }
+  data.assign((char *)B.buffer + slot * B.slotSize, r);
+  return onData();
+#else
   if (isConnected){
     int r = recv(sock, data, data.rsize(), MSG_TRUNC | MSG_DONTWAIT);
     if (r == -1){
@@ -2686,6 +3204,57 @@ bool Socket::UDPConnection::Receive(){
     return false;
   }
   if (destAddr && destsize && destAddr_size >= destsize){memcpy(destAddr, &addr, destsize);}
+  onPktInfo(mHdr);
+  data.append(0, r);
+  down += r;
+  //Handle UDP packets that are too large
+  if (data.rsize() < (unsigned int)r){
+    INFO_MSG("Doubling UDP socket buffer from %" PRIu32 " to %" PRIu32, data.rsize(), data.rsize()*2);
+    data.allocate(data.rsize()*2);
+  }
+  return onData();
+#endif
+}
+
+#if defined(__linux__) && !defined(__CYGWIN__)
+/// Reads all waiting datagrams, up to UDP_BATCH, with a single recvmmsg call.
+/// Returns false if there were none.
+bool Socket::UDPConnection::receiveBatch(){
+  if (!batch){batch = new UDPBatch();}
+  UDPBatch &B = *batch;
+  B.pos = 0;
+  B.count = 0;
+  B.slotSize = data.rsize();
+  if (!B.buffer.allocate(B.slotSize * UDP_BATCH)){return false;}
+  memset(B.msgs, 0, sizeof(B.msgs));
+  for (size_t i = 0; i < UDP_BATCH; ++i){
+    msghdr &mHdr = B.msgs[i].msg_hdr;
+    B.iov[i].iov_base = (char *)B.buffer + i * B.slotSize;
+    B.iov[i].iov_len = B.slotSize;
+    mHdr.msg_iov = B.iov + i;
+    mHdr.msg_iovlen = 1;
+    if (!isConnected){
+      mHdr.msg_name = B.addrs + i;
+      mHdr.msg_namelen = sizeof(sockaddr_in6);
+      mHdr.msg_control = B.ctrl[i];
+      mHdr.msg_controllen = sizeof(B.ctrl[i]);
+    }
+  }
+  int r = recvmmsg(sock, B.msgs, UDP_BATCH, MSG_TRUNC | MSG_DONTWAIT, 0);
+  if (r < 1){
+    if (r == -1 && errno != EAGAIN){
+      INFO_MSG("UDP receive: %d (%s)", errno, strerror(errno));
+      if (isConnected && errno == ECONNREFUSED){close();}
+    }
+    return false;
+  }
+  B.count = r;
+  return true;
+}
+#endif
+
+/// Stores the local address and interface a datagram was received on, if it carries them.
+void Socket::UDPConnection::onPktInfo(msghdr &mHdr){
 #if !defined(__CYGWIN__) && !defined(_WIN32)
   if (recvAddr){
     for ( struct cmsghdr *cmsg = CMSG_FIRSTHDR(&mHdr); cmsg != NULL; cmsg = CMSG_NXTHDR(&mHdr, cmsg)){
@@ -2700,14 +3269,6 @@ bool Socket::UDPConnection::Receive(){
     }
   }
 #endif
-  data.append(0, r);
-  down += r;
-  //Handle UDP packets that are too large
-  if (data.rsize() < (unsigned int)r){
-    INFO_MSG("Doubling UDP socket buffer from %" PRIu32 " to %" PRIu32, data.rsize(), data.rsize()*2);
-    data.allocate(data.rsize()*2);
-  }
-  return onData();
 }
 
 bool Socket::UDPConnection::onData(){
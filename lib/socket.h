@@ -11,6 +11,7 @@
 #include <string>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 #include <unistd.h>
 #include "util.h"
@@ -65,15 +66,38 @@ namespace Socket{
   bool getSocketName(int fd, std::string &host, uint32_t &port);
   bool getPeerName(int fd, std::string &host, uint32_t &port);
   bool getPeerName(int fd, std::string &host, uint32_t &port, sockaddr * tmpaddr, socklen_t * addrlen);
+  bool sendDescriptor(int sock, int fd, const std::string &data);
+  int receiveDescriptor(int sock, std::string &data);
 
-  /// A buffer made out of std::string objects that can be efficiently read from and written to.
+  /// A buffer that can be efficiently read from and written to.
+  /// Holds received data in a single growable allocation.
+  /// New data is appended at the end, and read data is removed from the front by moving a read
+  /// offset; the remaining data is moved back to the start of the allocation only when space runs
+  /// out. All data is always contiguous, so it can be parsed in place through peek() and consume().
+  /// The older part-based interface (size(), get(), etc) is still available on top of this.
   class Buffer{
   private:
-    std::deque<std::string> data;
+    char *buf;         ///< Single allocation holding the data
+    size_t bufLen;     ///< Allocated size of buf
+    size_t start;      ///< Offset of the first unread byte in buf
+    size_t end;        ///< Offset just past the last unread byte in buf
+    std::string front; ///< Part handed out by get(), which logically comes before the data in buf
+    void insert(const char *newdata, size_t newdatasize);
+    void unget();
 
   public:
     std::string splitter; ///< String to automatically split on if encountered. \n by default
     Buffer();
+    Buffer(const Buffer &rhs);
+    Buffer &operator=(const Buffer &rhs);
+    ~Buffer();
+    // contiguous access
+    size_t length() const;
+    const char *peek(size_t count);
+    void consume(size_t count);
+    char *reserve(size_t count);
+    void commit(size_t count);
+    // part-based access
     unsigned int size();
     unsigned int bytes(unsigned int max);
     unsigned int bytesToSplit();
@@ -110,6 +134,10 @@ namespace Socket{
     int iread(void *buffer, int len, int flags = 0);  ///< Incremental read call.
     bool iread(Buffer &buffer, int flags = 0); ///< Incremental write call that is compatible with Socket::Buffer.
     void setBoundAddr();
+    bool sendBuffering;   ///< If true, sending never blocks, but keeps what could not be written yet
+    std::string upbuffer; ///< Data waiting to be written, if sendBuffering is set
+    size_t upbufferPos;   ///< Amount of bytes at the start of upbuffer that were written already
+    void queueSend(const char *data, size_t len);
 
   protected:
     std::string lastErr; ///< Stores last error, if any.
@@ -170,11 +198,17 @@ namespace Socket{
     void SendNow(const char *data); ///< Will not buffer anything but always send right away. Blocks.
     void SendNow(const char *data,
                  size_t len); ///< Will not buffer anything but always send right away. Blocks.
+    void SendNow(const struct iovec *vec, size_t count); ///< Sends all buffers right away, gathered. Blocks.
+    bool sendFile(int fd, uint64_t offset, uint64_t len); ///< Sends a file region right away, in-kernel if possible. Blocks.
+    void setSendBuffering(bool buffering); ///< Makes the send calls above keep what they cannot write instead of blocking.
+    size_t sendPending() const;            ///< Returns the amount of bytes waiting to be written.
+    bool flushSends();                     ///< Writes waiting data without blocking. True if none is left.
     void skipBytes(uint32_t byteCount);
     uint32_t skipCount;
     // unbuffered i/o methods
     unsigned int iwrite(const void *buffer, int len); ///< Incremental write call.
     bool iwrite(std::string &buffer); ///< Write call that is compatible with std::string.
+    unsigned int iwrite(const struct iovec *vec, size_t count); ///< Incremental scatter-gather write call.
     // stats related methods
     unsigned int connTime(); ///< Returns the time this socket has been connected.
     uint64_t dataUp();       ///< Returns total amount of bytes sent.
@@ -212,6 +246,8 @@ namespace Socket{
     int getSocket();   ///< Returns internal socket number.
   };
 
+  struct UDPBatch;
+
   class UDPConnection{
   private:
     void init(bool nonblock, int family = AF_INET6);
@@ -235,6 +271,11 @@ namespace Socket{
     bool isConnected;
     bool pretendReceive; ///< If true, will pretend to have just received the current data buffer on new Receive() call
     bool onData();
+    void onPktInfo(msghdr &mHdr);
+    UDPBatch *batch;   ///< Datagrams received by a single system call, handed out one per Receive() call
+    bool receiveBatch();
+    bool noSegment;    ///< True if the kernel refused to segment (GSO) a datagram for this socket
+    void sendQueued(size_t count);
    
     // dTLS-related members
     bool hasDTLS; ///< True if dTLS is enabled
@@ -285,7 +326,9 @@ namespace Socket{
     void SendNow(const char *sdata, size_t len, sockaddr * dAddr, size_t dAddrLen);
     void sendPaced(const char * data, size_t len, bool encrypt = true);
     void sendPaced(uint64_t uSendWindow);
+    void flushQueue();
     size_t timeToNextPace(uint64_t uTime = 0);
+    bool hasQueued() const;
     void setSocketFamily(int AF_TYPE);
 
 
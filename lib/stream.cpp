@@ -157,10 +157,11 @@ size_t Util::streamCustomVariables(std::string &str){
   }
   // Extract variables
   Util::RelAccX varAccX(variablePage.mapped, false);
+  Util::FieldAccX nameField = varAccX.getFieldAccX("name");
+  Util::FieldAccX valField = varAccX.getFieldAccX("lastVal");
+  if (!nameField || !valField){return count;}
   for (size_t i = 0; i < varAccX.getEndPos(); i++){
-    if (varAccX.getPointer("name", i)){
-      count += replaceVar(str, varAccX.getPointer("name", i), varAccX.getPointer("lastVal", i));
-    }
+    count += replaceVar(str, nameField.ptr(i), valField.ptr(i));
   }
   return count;
 }
@@ -485,12 +486,14 @@ std::set<std::string> Util::streamTags(const std::string &streamname){
 
   uint64_t startPos = rlxStreams.getDeleted();
   uint64_t endPos = rlxStreams.getEndPos();
+  Util::FieldAccX strmField = rlxStreams.getFieldAccX("stream");
+  Util::FieldAccX tagsField = rlxStreams.getFieldAccX("tags");
+  if (!strmField || !tagsField){return ret;}
   for (uint64_t cPos = startPos; cPos < endPos; ++cPos){
-    const std::string & strm = rlxStreams.getPointer("stream", cPos);
-    if (strm != streamname){continue;}
+    if (streamname != strmField.ptr(cPos)){continue;}
 
     // Found it! Fill and break, since only one match can exist.
-    std::string tags = rlxStreams.getPointer("tags", cPos);
+    std::string tags = tagsField.string(cPos);
     while (tags.size()){
       size_t endPos = tags.find(' ');
       if (!endPos){
@@ -15,6 +15,21 @@
 /// Currently, all triggers are handled asynchronously and responses (if any) are completely
 /// ignored. In the future this may change.
 ///
+/// Asynchronous triggers handled by an URL are queued and sent by a background thread in each
+/// process, which keeps connections to handlers open between triggers. Failed deliveries are retried
+/// a few times with increasing delays. When too many triggers are queued, new ones are sent
+/// directly instead, slowing down the process that fires them. Processes send what is still
+/// queued when they exit.
+///
+/// Responses to blocking triggers may be cached, by setting "cache_ok" and/or "cache_fail" on the
+/// trigger to the amount of seconds to keep a response that allows or denies, respectively.
+/// Cached responses are kept per trigger, handler and payload, where "cache_key" may list the
+/// payload line numbers (starting at 1) to look at instead of the full payload. For example, a
+/// USER_NEW trigger with "cache_key" [1, 2] reuses its response for all sessions of the same
+/// viewer IP for the same stream. Failed handler executions are never cached, and changing the
+/// trigger configuration empties the cache. Responses of 256 bytes or more are not cached, nor are
+/// triggers whose type, handler and (selected) payload lines together take 256 bytes or more.
+///
 
 #include "bitfields.h"  //for strToBool
 #include "defines.h"    //for FAIL_MSG and INFO_MSG
@@ -26,47 +41,409 @@
 #include "util.h"
 #include "json.h"
 #include "stream.h"
+#include "tinythread.h"
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <pthread.h>
+#include <set>
 #include <string.h> //for strncmp
 
 namespace Triggers{
 
-  static void submitTriggerStat(const std::string trigger, uint64_t millis, bool ok){
+  static tthread::mutex envMutex;
+
+  static void submitTriggerStat(const std::string trigger, uint64_t millis, bool ok, int64_t queued = -1){
     JSON::Value j;
     j["trigger_stat"]["name"] = trigger;
     j["trigger_stat"]["ms"] = Util::bootMS() - millis;
     j["trigger_stat"]["ok"] = ok;
+    if (queued >= 0){
+      j["trigger_stat"]["queue"] = queued;
+      j["trigger_stat"]["pid"] = getpid();
+    }
     Util::sendUDPApi(j);
   }
 
+  static void setTriggerHeaders(HTTP::Downloader &DL, const std::string &trigger){
+    DL.setHeader("X-Trigger", trigger);
+    std::string iid = Util::getGlobalConfig("iid").asString();
+    if (iid.size()){
+      DL.setHeader("X-Instance", iid);
+    }
+    std::string hrn = Util::getGlobalConfig("hrn").asString();
+    if (hrn.size()){
+      DL.setHeader("X-Name", hrn);
+    }
+    DL.setHeader("Content-Type", "text/plain");
+  }
+
+  /// An asynchronous trigger waiting to be sent to its URL by the dispatcher thread
+  struct queuedTrigger{
+    std::string trigger;
+    std::string url;
+    std::string payload;
+    uint64_t fired;   ///< Util::bootMS() time the trigger was fired at
+    uint64_t retryAt; ///< Util::bootMS() time before which it should not be sent again
+    size_t attempts;
+  };
+
+  static tthread::mutex queueMutex;
+  static tthread::condition_variable queueCond;
+  static std::deque<queuedTrigger> triggerQueue;
+  static tthread::thread *dispatcher = 0;
+  static bool dispatcherStop = false;
+
+#define TRIGGER_DELIVERED 0
+#define TRIGGER_REJECTED 1
+#define TRIGGER_FAILED 2
+#define TRIGGER_UNANSWERED 3
+
+  /// Sends a batch of triggers for the same host over a single connection, sending all requests
+  /// before reading the responses, so that there is only one round trip for the whole batch.
+  /// Sets a result per trigger: any 2XX response counts as delivered, 4XX responses as rejected
+  /// by the handler (not worth retrying), and everything else as failed.
+  /// Only the first trigger without a response counts as failed; any after it are left unanswered,
+  /// as they say nothing about the handler and should be sent again without counting an attempt.
+  /// Sets pipelined to false if the handler closes the connection after a response, since it then
+  /// can not be sent more than one trigger per connection.
+  /// Returns false if the connection failed before any response came in, in which case it is closed.
+  static bool sendBatch(HTTP::Downloader &DL, const std::deque<queuedTrigger> &batch, std::deque<int> &result, bool &pipelined){
+    Socket::Connection &s = DL.getSocket();
+    // Notice when the handler closed the connection while it was unused, so a new one gets opened
+    if (s){s.spool();}
+    size_t sent = 0;
+    while (sent < batch.size()){
+      setTriggerHeaders(DL, batch[sent].trigger);
+      DL.doRequest(HTTP::URL(batch[sent].url), "POST", batch[sent].payload);
+      if (!s){break;}
+      ++sent;
+    }
+    HTTP::Parser &H = DL.getHTTP();
+    result.assign(batch.size(), TRIGGER_UNANSWERED);
+    size_t done = 0;
+    bool closing = false;
+    uint64_t timeout = Util::bootMS() + DL.dataTimeout * 1000;
+    while (done < sent && !closing && s && Util::bootMS() < timeout){
+      if (!s.spool()){Util::sleep(1);}
+      while (done < sent && !closing && H.Read(s)){
+        uint32_t code = DL.getStatusCode();
+        if (code >= 200 && code < 300){
+          result[done] = TRIGGER_DELIVERED;
+        }else if (code >= 400 && code < 500){
+          result[done] = TRIGGER_REJECTED;
+        }else{
+          result[done] = TRIGGER_FAILED;
+        }
+        if (result[done] != TRIGGER_DELIVERED){
+          WARN_MSG("Asynchronous %s trigger to %s failed (%s)", batch[done].trigger.c_str(),
+                   batch[done].url.c_str(), DL.getStatusText().c_str());
+        }
+        closing = (H.GetHeader("Connection") == "close");
+        H.Clean();
+        ++done;
+        timeout = Util::bootMS() + DL.dataTimeout * 1000;
+      }
+    }
+    if (closing && done < batch.size()){pipelined = false;}
+    // Handlers that do not pipeline get one request per connection, so we never write to one they closed
+    if (closing || !pipelined){s.close();}
+    if (done < batch.size()){
+      if (!done){
+        result[0] = TRIGGER_FAILED;
+        WARN_MSG("Connection for asynchronous triggers to %s failed; %zu of %zu triggers sent, none answered",
+                 batch[0].url.c_str(), sent, batch.size());
+      }else if (pipelined){
+        // Answered some, then stopped: this handler does not answer more than one request per connection
+        INFO_MSG("Handler for asynchronous triggers at %s answered %zu of %zu pipelined triggers; sending one per connection from now on",
+                 batch[0].url.c_str(), done, batch.size());
+        pipelined = false;
+      }
+      // Responses may still come in for requests we gave up on, so this connection can not be reused
+      s.close();
+      return done > 0;
+    }
+    return true;
+  }
+
+  /// Sends queued asynchronous triggers, keeping a connection open per handler host.
+  /// Each round takes everything that is queued and sends it per host in batches. Failed triggers
+  /// are put back with an increasing delay, as are the remaining triggers for a host that could
+  /// not be reached. Once asked to stop, everything left is attempted once more and the thread exits.
+  static void dispatchTriggers(void *){
+    std::map<std::string, HTTP::Downloader *> conns;
+    std::set<std::string> noPipelining; ///< Hosts that only answer one request per connection
+    std::deque<queuedTrigger> work, later;
+    while (true){
+      bool stopping;
+      {
+        tthread::lock_guard<tthread::mutex> guard(queueMutex);
+        while (!triggerQueue.size() && !dispatcherStop){queueCond.wait(queueMutex);}
+        if (!triggerQueue.size()){break;}
+        stopping = dispatcherStop;
+        work.swap(triggerQueue);
+      }
+      uint64_t now = Util::bootMS();
+      size_t pending = 0;
+      std::map<std::string, std::deque<queuedTrigger> > byHost;
+      while (work.size()){
+        queuedTrigger &T = work.front();
+        if (!stopping && T.retryAt > now){
+          later.push_back(T);
+        }else{
+          HTTP::URL url(T.url);
+          byHost[url.protocol + "://" + url.host + ":" + JSON::Value(url.getPort()).asString()].push_back(T);
+          ++pending;
+        }
+        work.pop_front();
+      }
+
+      for (std::map<std::string, std::deque<queuedTrigger> >::iterator it = byHost.begin(); it != byHost.end(); ++it){
+        HTTP::Downloader *&DL = conns[it->first];
+        if (!DL){DL = new HTTP::Downloader();}
+        std::deque<queuedTrigger> &hostQueue = it->second;
+        bool reachable = true;
+        while (hostQueue.size()){
+          std::deque<queuedTrigger> batch;
+          std::deque<int> result;
+          if (!reachable){
+            if (stopping){
+              FAIL_MSG("Giving up on %zu asynchronous triggers for %s", hostQueue.size(), it->first.c_str());
+              for (size_t i = 0; i < hostQueue.size(); ++i){
+                submitTriggerStat(hostQueue[i].trigger, hostQueue[i].fired, false, 0);
+              }
+            }else{
+              // Keep the rest for later, without counting this as an attempt for them
+              for (size_t i = 0; i < hostQueue.size(); ++i){
+                hostQueue[i].retryAt = Util::bootMS() + 1000;
+                later.push_back(hostQueue[i]);
+              }
+            }
+            pending -= hostQueue.size();
+            hostQueue.clear();
+            break;
+          }
+          bool pipelined = !noPipelining.count(it->first);
+          size_t batchSize = std::min(hostQueue.size(), pipelined ? (size_t)TRIGGER_ASYNC_BATCH : (size_t)1);
+          batch.assign(hostQueue.begin(), hostQueue.begin() + batchSize);
+          hostQueue.erase(hostQueue.begin(), hostQueue.begin() + batchSize);
+          reachable = sendBatch(*DL, batch, result, pipelined);
+          if (!pipelined){noPipelining.insert(it->first);}
+          // Triggers that were never answered go back in line, without counting as an attempt
+          for (size_t i = batch.size(); i > 0; --i){
+            if (result[i - 1] == TRIGGER_UNANSWERED){hostQueue.push_front(batch[i - 1]);}
+          }
+          pending -= batch.size();
+          size_t queued;
+          {
+            tthread::lock_guard<tthread::mutex> guard(queueMutex);
+            queued = triggerQueue.size() + pending + later.size();
+          }
+          for (size_t i = 0; i < batch.size(); ++i){
+            queuedTrigger &T = batch[i];
+            if (result[i] == TRIGGER_UNANSWERED){
+              ++pending;
+            }else if (result[i] == TRIGGER_DELIVERED){
+              submitTriggerStat(T.trigger, T.fired, true, queued);
+            }else if (result[i] == TRIGGER_FAILED && ++T.attempts < TRIGGER_ASYNC_ATTEMPTS && !stopping){
+              T.retryAt = Util::bootMS() + Util::expBackoffMs(T.attempts - 1, TRIGGER_ASYNC_ATTEMPTS, 30000);
+              later.push_back(T);
+            }else{
+              if (result[i] == TRIGGER_FAILED){
+                FAIL_MSG("Giving up on asynchronous %s trigger to %s after %zu attempts", T.trigger.c_str(),
+                         T.url.c_str(), T.attempts);
+              }
+              submitTriggerStat(T.trigger, T.fired, false, queued);
+            }
+          }
+        }
+      }
+
+      if (later.size()){
+        tthread::lock_guard<tthread::mutex> guard(queueMutex);
+        triggerQueue.insert(triggerQueue.begin(), later.begin(), later.end());
+        later.clear();
+      }
+      // Only delayed triggers left? Wait a little instead of looping over them constantly.
+      if (!byHost.size() && !stopping){Util::sleep(100);}
+    }
+    for (std::map<std::string, HTTP::Downloader *>::iterator it = conns.begin(); it != conns.end(); ++it){
+      delete it->second;
+    }
+  }
+
+  /// Sends what is still queued and stops the dispatcher thread. Runs when the process exits.
+  static void stopDispatcher(){
+    tthread::thread *T;
+    {
+      tthread::lock_guard<tthread::mutex> guard(queueMutex);
+      if (!dispatcher){return;}
+      dispatcherStop = true;
+      queueCond.notify_one();
+      T = dispatcher;
+    }
+    T->join();
+    delete T;
+    tthread::lock_guard<tthread::mutex> guard(queueMutex);
+    dispatcher = 0;
+    dispatcherStop = false;
+  }
+
+  static void forkPrepare(){queueMutex.lock();}
+  static void forkParent(){queueMutex.unlock();}
+  /// Forked children do not have the dispatcher thread, and leave the queued triggers to the parent.
+  static void forkChild(){
+    triggerQueue.clear();
+    dispatcher = 0;
+    dispatcherStop = false;
+    queueMutex.unlock();
+  }
+
+  /// Queues an asynchronous trigger for the dispatcher thread, starting it if needed.
+  /// Returns false if too many triggers are queued already, in which case the caller should send it.
+  static bool queueTrigger(const std::string &trigger, const std::string &url, const std::string &payload){
+    static bool registered = false;
+    tthread::lock_guard<tthread::mutex> guard(queueMutex);
+    if (triggerQueue.size() >= TRIGGER_ASYNC_QUEUE){return false;}
+    if (!dispatcher){
+      if (!registered){
+        pthread_atfork(forkPrepare, forkParent, forkChild);
+        atexit(stopDispatcher);
+        registered = true;
+      }
+      dispatcher = new tthread::thread(dispatchTriggers, 0);
+    }
+    queuedTrigger T;
+    T.trigger = trigger;
+    T.url = url;
+    T.payload = payload;
+    T.fired = Util::bootMS();
+    T.retryAt = 0;
+    T.attempts = 0;
+    triggerQueue.push_back(T);
+    queueCond.notify_one();
+    return true;
+  }
+
+  static void submitCacheStat(const std::string trigger, bool hit){
+    JSON::Value j;
+    j["trigger_stat"]["name"] = trigger;
+    j["trigger_stat"]["cache"] = hit ? "hit" : "miss";
+    Util::sendUDPApi(j);
+  }
+
+  /// Returns what identifies a response in the cache: the trigger type, handler and payload.
+  /// If lines is nonzero, only the payload lines with their bit set (bit 0 being the first line)
+  /// are used instead of the full payload.
+  static std::string cacheMatch(const std::string &type, const std::string &uri, const std::string &payload, uint64_t lines){
+    std::string match = type + "\n" + uri + "\n";
+    if (!lines){return match + payload;}
+    size_t line = 0, start = 0;
+    while (start < payload.size() && line < 64){
+      size_t end = payload.find('\n', start);
+      end = (end == std::string::npos) ? payload.size() : end + 1;
+      if (lines & (1ull << line)){match.append(payload, start, end - start);}
+      start = end;
+      ++line;
+    }
+    return match;
+  }
+
+  /// Hashes what cacheMatch() returned into the slot number to start looking for it at.
+  static uint64_t cacheKey(const std::string &match){
+    // 64-bit FNV-1a
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < match.size(); ++i){h = (h ^ (uint8_t)match[i]) * 1099511628211ULL;}
+    return h ? h : 1;
+  }
+
+  /// Looks up a cached response. Returns true and sets response if one was found and has not expired.
+  /// Records are only used if their full match equals the given one, never on the hash alone.
+  static bool cacheGet(const std::string &match, std::string &response){
+    IPC::sharedPage page(SHM_TRIGGER_CACHE, 0, false, false);
+    if (!page.mapped){return false;}
+    Util::RelAccX C(page.mapped, false);
+    if (!C.isReady() || !C.getRCount()){return false;}
+    Util::RelAccXFieldData fKey = C.getFieldData("key");
+    Util::RelAccXFieldData fExpires = C.getFieldData("expires");
+    Util::RelAccXFieldData fMatch = C.getFieldData("match");
+    Util::RelAccXFieldData fResponse = C.getFieldData("response");
+    // Pages made by older versions can not tell apart responses with the same hash
+    if (!fMatch || match.size() >= fMatch.size){return false;}
+    uint64_t key = cacheKey(match);
+    uint64_t now = Util::bootMS();
+    IPC::semaphore sem(SEM_TRIGGER_CACHE, O_CREAT | O_RDWR, ACCESSPERMS, 1);
+    IPC::semGuard G(&sem);
+    for (size_t n = 0; n < TRIGGER_CACHE_PROBE; ++n){
+      size_t i = (key + n) % C.getRCount();
+      if (C.getInt(fKey, i) == key && C.getInt(fExpires, i) > now && match == C.getPointer(fMatch, i)){
+        response = C.getPointer(fResponse, i);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /// Stores a response in the cache for the given amount of seconds, replacing an older response
+  /// for the same match, an expired response, or the one expiring first, in that order of preference.
+  /// Matches and responses that do not fit in their fields (or contain null bytes) are not cached.
+  static void cachePut(const std::string &match, const std::string &response, uint64_t seconds){
+    IPC::sharedPage page(SHM_TRIGGER_CACHE, 0, false, false);
+    if (!page.mapped){return;}
+    Util::RelAccX C(page.mapped, false);
+    if (!C.isReady() || !C.getRCount()){return;}
+    Util::RelAccXFieldData fKey = C.getFieldData("key");
+    Util::RelAccXFieldData fExpires = C.getFieldData("expires");
+    Util::RelAccXFieldData fMatch = C.getFieldData("match");
+    Util::RelAccXFieldData fResponse = C.getFieldData("response");
+    if (!fMatch || match.size() >= fMatch.size || response.size() >= fResponse.size){return;}
+    if (match.find('\0') != std::string::npos || response.find('\0') != std::string::npos){return;}
+    uint64_t key = cacheKey(match);
+    uint64_t now = Util::bootMS();
+    IPC::semaphore sem(SEM_TRIGGER_CACHE, O_CREAT | O_RDWR, ACCESSPERMS, 1);
+    IPC::semGuard G(&sem);
+    size_t target = key % C.getRCount();
+    for (size_t n = 0; n < TRIGGER_CACHE_PROBE; ++n){
+      size_t i = (key + n) % C.getRCount();
+      if ((C.getInt(fKey, i) == key && match == C.getPointer(fMatch, i)) || C.getInt(fExpires, i) <= now){
+        target = i;
+        break;
+      }
+      if (C.getInt(fExpires, i) < C.getInt(fExpires, target)){target = i;}
+    }
+    C.setString(fMatch, match, target);
+    C.setString(fResponse, response, target);
+    C.setInt(fExpires, now + seconds * 1000, target);
+    C.setInt(fKey, key, target);
+  }
+
   ///\brief Handles a trigger by sending a payload to a destination.
   ///\param trigger Trigger event type.
   ///\param value Destination. This can be an (HTTP)URL, or an absolute path to a binary/script
   ///\param payload This data will be sent to the destionation URL/program
   ///\param sync If true, handler is executed blocking and uses the response data.
+  ///\param ok If set, is set to true when the handler was executed successfully.
   ///\returns String, false if further processing should be aborted.
   std::string handleTrigger(const std::string &trigger, const std::string &value,
-                            const std::string &payload, int sync, const std::string &defaultResponse){
+                            const std::string &payload, int sync, const std::string &defaultResponse, bool *ok){
     uint64_t tStartMs = Util::bootMS();
+    if (ok){*ok = false;}
     if (!value.size()){
       WARN_MSG("Trigger requested with empty destination");
       return "true";
     }
     INFO_MSG("Executing %s trigger: %s (%s)", trigger.c_str(), value.c_str(), sync ? "blocking" : "asynchronous");
     if (value.substr(0, 7) == "http://" || value.substr(0, 8) == "https://"){// interpret as url
-      HTTP::Downloader DL;
-      DL.setHeader("X-Trigger", trigger);
-      std::string iid = Util::getGlobalConfig("iid").asString();
-      if (iid.size()){
-        DL.setHeader("X-Instance", iid);
-      }
-      std::string hrn = Util::getGlobalConfig("hrn").asString();
-      if (hrn.size()){
-        DL.setHeader("X-Name", hrn);
+      if (!sync && queueTrigger(trigger, value, payload)){
+        if (ok){*ok = true;}
+        return defaultResponse;
       }
-      DL.setHeader("Content-Type", "text/plain");
+      HTTP::Downloader DL;
+      setTriggerHeaders(DL, trigger);
       HTTP::URL url(value);
       if (DL.post(url, payload, sync) && (!sync || DL.isOk())){
         submitTriggerStat(trigger, tStartMs, true);
+        if (ok){*ok = true;}
         return DL.data();
       }
       FAIL_MSG("Trigger failed to execute (%s), using default response: %s",
@@ -82,21 +459,26 @@ namespace Triggers{
       argv[0] = (char *)value.c_str();
       argv[1] = (char *)trigger.c_str();
       argv[2] = NULL;
-      setenv("MIST_TRIGGER", trigger.c_str(), 1);
-      setenv("MIST_TRIG_DEF", defaultResponse.c_str(), 1);
-      std::string iid = Util::getGlobalConfig("iid").asString();
-      if (iid.size()){
-        setenv("MIST_INSTANCE", iid.c_str(), 1);
-      }
-      std::string hrn = Util::getGlobalConfig("hrn").asString();
-      if (hrn.size()){
-        setenv("MIST_NAME", hrn.c_str(), 1);
+      pid_t myProc;
+      {
+        // The environment is shared by all threads, so only one of them at a time may set it up
+        tthread::lock_guard<tthread::mutex> guard(envMutex);
+        setenv("MIST_TRIGGER", trigger.c_str(), 1);
+        setenv("MIST_TRIG_DEF", defaultResponse.c_str(), 1);
+        std::string iid = Util::getGlobalConfig("iid").asString();
+        if (iid.size()){
+          setenv("MIST_INSTANCE", iid.c_str(), 1);
+        }
+        std::string hrn = Util::getGlobalConfig("hrn").asString();
+        if (hrn.size()){
+          setenv("MIST_NAME", hrn.c_str(), 1);
+        }
+        myProc = Util::Procs::StartPiped(argv, &fdIn, &fdOut, &fdErr); // start new process and return stdin file desc.
+        unsetenv("MIST_TRIGGER");
+        unsetenv("MIST_TRIG_DEF");
+        unsetenv("MIST_INSTANCE");
+        unsetenv("MIST_NAME");
       }
-      pid_t myProc = Util::Procs::StartPiped(argv, &fdIn, &fdOut, &fdErr); // start new process and return stdin file desc.
-      unsetenv("MIST_TRIGGER");
-      unsetenv("MIST_TRIG_DEF");
-      unsetenv("MIST_INSTANCE");
-      unsetenv("MIST_NAME");
       if (fdIn == -1 || fdOut == -1 || myProc == -1){
         FAIL_MSG("Could not execute trigger executable: %s", strerror(errno));
         submitTriggerStat(trigger, tStartMs, false);
@@ -136,16 +518,16 @@ namespace Triggers{
           return defaultResponse;
         }
         submitTriggerStat(trigger, tStartMs, true);
+        if (ok){*ok = true;}
         return ret;
       }
       close(fdOut);
       submitTriggerStat(trigger, tStartMs, true);
+      if (ok){*ok = true;}
       return defaultResponse;
     }
   }
 
-  static std::string usually_empty;
-
   ///\brief returns true if a trigger of the specified type should be handled for a specified stream
   ///(, or entire server) \param type Trigger event type. \param streamName the stream to be handled
   ///\return returns true if so
@@ -154,7 +536,7 @@ namespace Triggers{
   /// handled for a specified stream (, or entire server)
   bool shouldTrigger(const std::string &type, const std::string &streamName,
                      bool paramsCB(const char *, const void *), const void *extraParam){
-    usually_empty.clear();
+    std::string usually_empty;
     return doTrigger(type, empty, streamName, true, usually_empty, paramsCB, extraParam);
   }
 
@@ -164,7 +546,7 @@ namespace Triggers{
   /// processing should be aborted.
   /// calls doTrigger with dryRun set to false
   bool doTrigger(const std::string &type, const std::string &payload, const std::string &streamName){
-    usually_empty.clear();
+    std::string usually_empty;
     return doTrigger(type, payload, streamName, false, usually_empty);
   }
 
@@ -205,6 +587,10 @@ namespace Triggers{
     }
     size_t splitter = streamName.find_first_of("+ ");
     bool retVal = true;
+    // Older pages may lack the cache settings
+    Util::RelAccXFieldData fCacheOk = trigs.getFieldData("cache_ok");
+    Util::RelAccXFieldData fCacheFail = trigs.getFieldData("cache_fail");
+    Util::RelAccXFieldData fCacheKey = trigs.getFieldData("cache_key");
 
     for (uint32_t i = 0; i < trigs.getRCount(); ++i){
       std::string uri = std::string(trigs.getPointer("url", i));
@@ -246,7 +632,22 @@ namespace Triggers{
         VERYHIGH_MSG("%s trigger handled by %s", type.c_str(), uri.c_str());
         if (dryRun){return true;}
         if (sync){
-          response = handleTrigger(type, uri, payload, sync, defaultResponse); // do it.
+          uint64_t cacheOk = fCacheOk ? trigs.getInt(fCacheOk, i) : 0;
+          uint64_t cacheFail = fCacheFail ? trigs.getInt(fCacheFail, i) : 0;
+          if (cacheOk || cacheFail){
+            std::string match = cacheMatch(type, uri, payload, fCacheKey ? trigs.getInt(fCacheKey, i) : 0);
+            if (cacheGet(match, response)){
+              submitCacheStat(type, true);
+            }else{
+              submitCacheStat(type, false);
+              bool ok = false;
+              response = handleTrigger(type, uri, payload, sync, defaultResponse, &ok); // do it.
+              uint64_t ttl = Util::stringToBool(response) ? cacheOk : cacheFail;
+              if (ok && ttl){cachePut(match, response, ttl);}
+            }
+          }else{
+            response = handleTrigger(type, uri, payload, sync, defaultResponse); // do it.
+          }
           retVal &= Util::stringToBool(response);
         }else{
           std::string unused_response = handleTrigger(type, uri, payload, sync, defaultResponse); // do it.
@@ -755,6 +755,44 @@ namespace TS{
     return 184 - ((getAdaptationField() > 1 ? getAdaptationFieldLen() + 1 : 0));
   }
 
+  /// Adds dataLen bytes of data to the TS packets of PID pkgPid, sending every packet that is
+  /// full first. Calling this with no data only sends the current packet if it is full.
+  /// A packet started while firstPack is set is marked as the start of a unit and clears
+  /// firstPack; for video it also gets a PCR of time (in milliseconds) and, for keyframes, the
+  /// random access flags.
+  void PacketFiller::fillPacket(const char *data, size_t dataLen, bool &firstPack, bool video,
+                                bool keyframe, size_t pkgPid, uint16_t &contPkg, uint64_t time){
+    do{
+      if (!packData.getBytesFree()){
+        sendPacket();
+        packData.clear();
+      }
+
+      if (!dataLen){return;}
+
+      if (packData.getBytesFree() == 184){
+        packData.clear();
+        packData.setPID(pkgPid);
+        packData.setContinuityCounter(++contPkg);
+        if (firstPack){
+          packData.setUnitStart(1);
+          if (video){
+            if (keyframe){
+              packData.setRandomAccess(true);
+              packData.setESPriority(true);
+            }
+            packData.setPCR(time * 27000);
+          }
+          firstPack = false;
+        }
+      }
+
+      size_t tmp = packData.fillFree(data, dataLen);
+      data += tmp;
+      dataLen -= tmp;
+    }while (dataLen);
+  }
+
   ProgramAssociationTable &ProgramAssociationTable::operator=(const Packet &rhs){
     memcpy(strBuf, rhs.checkAndGetBuffer(), 188);
     pos = 188;
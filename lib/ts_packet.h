@@ -94,6 +94,21 @@ namespace TS{
     unsigned int pos;
   };
 
+  /// Spreads the PES data of tracks over TS packets, as the TS based outputs send them.
+  /// Each packet is started with the PID, continuity counter and flags of the track its data
+  /// belongs to, and is handed to sendPacket once it is full and more data follows.
+  class PacketFiller{
+  public:
+    virtual ~PacketFiller(){}
+    void fillPacket(const char *data, size_t dataLen, bool &firstPack, bool video, bool keyframe,
+                    size_t pkgPid, uint16_t &contPkg, uint64_t time);
+
+  protected:
+    /// Sends packData, which is full. It is cleared afterwards.
+    virtual void sendPacket() = 0;
+    Packet packData;
+  };
+
   class ProgramAssociationTable : public Packet{
   public:
     ProgramAssociationTable &operator=(const Packet &rhs);
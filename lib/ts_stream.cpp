@@ -6,12 +6,17 @@
 #include "nal.h"
 #include "ts_stream.h"
 #include <stdint.h>
+#include <cstring>
 #include <sys/stat.h>
 #include "tinythread.h"
 #include "opus.h"
+#include "timing.h"
+#include "urireader.h"
 
-tthread::recursive_mutex tMutex;
-
+/// Classes of PIDs in Stream::pidClass
+#define PID_CLASS_PAT 1
+#define PID_CLASS_PMT 2
+#define PID_CLASS_DATA 4
 
 namespace TS{
 
@@ -58,30 +63,41 @@ namespace TS{
     // Watch out! We push here to a global, in order for threads to be able to access it.
     size_t junk = 0;
     while (offset < len){
-      if (ptr[offset] == 0x47 && (offset+188 >= len || ptr[offset+188] == 0x47)){// check for sync byte
-        if (junk){
-          INFO_MSG("%zu bytes of non-sync-byte data received", junk);
-          junk = 0;
-        }
-        if (offset + 188 <= len){
-          tsBuf.FromPointer(ptr + offset);
-          if (!ret && tsBuf.getUnitStart()){ret = true;}
-          if (parse){
-            TSStrm.parse(tsBuf, isLive?0:bytePos);
-          }else{
-            TSStrm.add(tsBuf);
-            if (!TSStrm.isDataTrack(tsBuf.getPID())){TSStrm.parse(tsBuf.getPID());}
-          }
-        }else{
-          leftData.assign(ptr + offset, len - offset);
-        }
-        bytePos += 188;
-        offset += 188;
-      }else{
+      if (ptr[offset] != 0x47){
+        // Skip ahead to the next possible sync byte
+        const char *sync = (const char *)memchr(ptr + offset, 0x47, len - offset);
+        size_t skip = sync ? (size_t)(sync - (ptr + offset)) : (len - offset);
+        junk += skip;
+        offset += skip;
+        bytePos += skip;
+        continue;
+      }
+      // Find the run of complete packets that are each followed by a sync byte, or by the end
+      size_t end = offset;
+      while (end + 188 <= len && ptr[end] == 0x47 && (end + 188 == len || ptr[end + 188] == 0x47)){
+        end += 188;
+      }
+      if (end == offset && offset + 188 < len){
+        // Sync byte not followed by another one: not a packet start after all
         ++junk;
         ++offset;
         ++bytePos;
+        continue;
       }
+      if (junk){
+        INFO_MSG("%zu bytes of non-sync-byte data received", junk);
+        junk = 0;
+      }
+      if (end == offset){
+        leftData.assign(ptr + offset, len - offset);
+        break;
+      }
+      bool keepPos = parse && !isLive;
+      if (TSStrm.addBatch(ptr + offset, (end - offset) / 188, parse, keepPos ? bytePos : 0, keepPos)){
+        ret = true;
+      }
+      bytePos += end - offset;
+      offset = end;
     }
     return ret;
   }
@@ -150,7 +166,9 @@ namespace TS{
   Stream::Stream(){
     psCache = 0;
     psCacheTid = 0;
+    wantPrev = 0;
     rParser = NONE;
+    updatePidClasses();
   }
 
   void Stream::setRawDataParser(rawDataType parser){rParser = parser;}
@@ -168,6 +186,7 @@ namespace TS{
     pesStreams.clear();
     psCacheTid = 0;
     psCache = 0;
+    wantPrev = 0;
     pesPositions.clear();
     outPackets.clear();
     buildPacket.clear();
@@ -192,13 +211,14 @@ namespace TS{
     pmtTracks.clear();
     remainders.clear();
     associationTable = ProgramAssociationTable();
+    updatePidClasses();
   }
 
   void Stream::finish(){
     tthread::lock_guard<tthread::recursive_mutex> guard(tMutex);
     if (!pesStreams.size()){return;}
 
-    for (std::map<size_t, std::deque<Packet> >::const_iterator i = pesStreams.begin();
+    for (std::map<size_t, std::vector<Packet> >::const_iterator i = pesStreams.begin();
          i != pesStreams.end(); i++){
       parsePES(i->first, true);
     }
@@ -214,9 +234,8 @@ namespace TS{
     tthread::lock_guard<tthread::recursive_mutex> guard(tMutex);
     uint32_t tid = newPack.getPID();
     bool unitStart = newPack.getUnitStart();
-    static uint32_t wantPrev = 0;
-    bool isData = pidToCodec.count(tid);
-    bool wantTrack = ((wantPrev == tid) || (tid == 0 || newPack.isPMT(pmtTracks) || isData));
+    bool isData = pidClass[tid] & PID_CLASS_DATA;
+    bool wantTrack = ((wantPrev == tid) || pidClass[tid]);
     if (!wantTrack){return;}
     if (psCacheTid != tid || !psCache){
       psCache = &(pesStreams[tid]);
@@ -232,6 +251,57 @@ namespace TS{
     }
   }
 
+  /// Adds count back to back packets, starting at ptr, as add does, and parses them as parse does
+  /// if parsePackets is true. Otherwise parses only the PAT, PMTs and other non-data packets.
+  /// Reads the PID straight from the data and looks it up in pidClass, so packets of PIDs that are
+  /// not wanted are skipped without being copied. Locks the stream only once.
+  /// \param bytePos Position of the first packet, advancing by 188 per packet if advancePos is true.
+  /// \returns True if any of the packets starts a unit.
+  bool Stream::addBatch(const char *ptr, size_t count, bool parsePackets, uint64_t bytePos, bool advancePos){
+    tthread::lock_guard<tthread::recursive_mutex> guard(tMutex);
+    bool ret = false;
+    Packet tsBuf;
+    for (size_t i = 0; i < count; ++i, ptr += 188){
+      uint32_t tid = (((uint8_t)ptr[1] & 0x1F) << 8) | (uint8_t)ptr[2];
+      bool unitStart = ptr[1] & 0x40;
+      if (unitStart){ret = true;}
+      uint64_t pos = advancePos ? bytePos + i * 188 : bytePos;
+      if (wantPrev != tid && !pidClass[tid]){
+        // Drops what may be left of a stream that is no longer wanted, as parse(tid) does
+        if (unitStart && pesStreams.count(tid)){parse(tid);}
+        continue;
+      }
+      bool isData = pidClass[tid] & PID_CLASS_DATA;
+      if (psCacheTid != tid || !psCache){
+        psCache = &(pesStreams[tid]);
+        psCacheTid = tid;
+      }
+      if (unitStart || !psCache->empty()){
+        wantPrev = tid;
+        tsBuf.FromPointer(ptr);
+        psCache->push_back(tsBuf);
+        if (unitStart && isData){
+          pesPositions[tid].push_back(pos);
+          ++(seenUnitStart[tid]);
+        }
+      }
+      if (parsePackets ? (!tid || unitStart) : !isData){parse(tid);}
+    }
+    return ret;
+  }
+
+  /// Updates pidClass from the PAT, the PMTs and the streams found in them.
+  void Stream::updatePidClasses(){
+    memset(pidClass, 0, sizeof(pidClass));
+    pidClass[0] = PID_CLASS_PAT;
+    for (std::set<unsigned int>::iterator it = pmtTracks.begin(); it != pmtTracks.end(); ++it){
+      if (*it < 8192){pidClass[*it] |= PID_CLASS_PMT;}
+    }
+    for (std::map<size_t, uint32_t>::iterator it = pidToCodec.begin(); it != pidToCodec.end(); ++it){
+      if (it->first < 8192){pidClass[it->first] |= PID_CLASS_DATA;}
+    }
+  }
+
   bool Stream::isDataTrack(size_t tid) const{
     if (tid == 0){return false;}
     {
@@ -254,6 +324,7 @@ namespace TS{
       associationTable = psCache->back();
       lastPAT = Util::bootSecs();
       associationTable.parsePIDs(pmtTracks);
+      updatePidClasses();
       pesStreams.erase(0);
       psCacheTid = 0;
       psCache = 0;
@@ -304,6 +375,7 @@ namespace TS{
         }
         entry.advance();
       }
+      updatePidClasses();
 
       pesStreams.erase(tid);
       psCacheTid = 0;
@@ -410,7 +482,7 @@ namespace TS{
     }
     // Find number of packets before unit Start
     size_t packNum = 1;
-    std::deque<Packet>::iterator curPack = psCache->begin();
+    std::vector<Packet>::iterator curPack = psCache->begin();
 
     if (seenUnitStart[tid] == 2 && psCache->begin()->getUnitStart() && psCache->rbegin()->getUnitStart()){
       packNum = psCache->size() - 1;
@@ -453,11 +525,11 @@ namespace TS{
     VERYHIGH_MSG("Parsing PES for track %zu, length %" PRIu32, tid, paySize);
     // allocate a buffer, do it all again, but this time also copy the data bytes over to char*
     // payload
-    char *payload = (char *)malloc(paySize);
-    if (!payload){
+    if (!pesBuffer.allocate(paySize)){
       FAIL_MSG("cannot allocate PES packet!");
       return;
     }
+    char *payload = pesBuffer;
 
     paySize = 0;
     curPack = psCache->begin();
@@ -578,7 +650,6 @@ namespace TS{
         buildPacket.erase(tid);
       }
     }
-    free(payload);
   }
 
   void Stream::setLastms(size_t tid, uint64_t timestamp){
@@ -831,10 +902,10 @@ namespace TS{
       return;
     }
 
-    pack = DTSC::Packet(outPackets[tid].front(), mappedAs);
-    outPackets[tid].pop_front();
-
-    if (!outPackets[tid].size()){outPackets.erase(tid);}
+    // Empty queues are kept, so they don't have to be allocated again for the next packet
+    std::deque<DTSC::Packet> &out = outPackets[tid];
+    pack = DTSC::Packet(out.front(), mappedAs);
+    out.pop_front();
   }
 
   void Stream::parseNal(size_t tid, const char *pesPayload, const char *nextPtr, bool &isKeyFrame){
@@ -867,15 +938,20 @@ namespace TS{
         if (firstSlice){
           firstSlice = false;
           if (!isKeyFrame){
-            Utils::bitstream bs;
+            // Gather the start of the slice header first, so the bitstream allocates only once
+            char hdr[12];
+            size_t hdrLen = 0;
             for (size_t i = 1; i < 10 && i < (nextPtr - pesPayload); i++){
               if (i + 2 < (nextPtr - pesPayload) && (memcmp(pesPayload + i, "\000\000\003", 3) == 0)){// Emulation prevention bytes
-                bs.append(pesPayload + i, 2);
+                memcpy(hdr + hdrLen, pesPayload + i, 2);
+                hdrLen += 2;
                 i += 2;
               }else{
-                bs.append(pesPayload + i, 1);
+                hdr[hdrLen++] = pesPayload[i];
               }
             }
+            Utils::bitstream bs;
+            bs.append(hdr, hdrLen);
             bs.getExpGolomb(); // Discard first_mb_in_slice
             uint64_t sliceType = bs.getUExpGolomb();
             if (sliceType == 2 || sliceType == 4 || sliceType == 7 || sliceType == 9){
@@ -942,7 +1018,7 @@ namespace TS{
 
     for (std::map<size_t, std::deque<DTSC::Packet> >::iterator it = outPackets.begin();
          it != outPackets.end(); it++){
-      if (it->second.front().getTime() < packTime){
+      if (it->second.size() && it->second.front().getTime() < packTime){
         packTrack = it->first;
         packTime = it->second.front().getTime();
       }
@@ -1232,4 +1308,263 @@ namespace TS{
     pesPositions.erase(tid);
     outPackets.erase(tid);
   }
+  /// Amount of data at the start of a file searched for the PAT and PMTs by scanHeader
+#define SCAN_TABLES_SIZE (4 * 1024 * 1024)
+  /// Maximum amount of data scanHeader reads past the end of a chunk to complete its last PES packets
+#define SCAN_OVERSHOOT_MAX (64 * 1024 * 1024)
+
+  /// Metadata of a single packet found by a ChunkScan.
+  struct ScanRecord{
+    uint64_t time;
+    int64_t offset;
+    uint64_t bpos;
+    size_t pid;
+    size_t dataLen;
+    size_t packLen;
+    bool keyframe;
+    bool flushed; ///< Only complete because reading stopped, so possibly cut short
+  };
+
+  /// Parses the packets of one byte range of a TS file on a thread of its own, for scanHeader.
+  /// Packets belong to the range their PES packet starts in; reading continues past the end of
+  /// the range until every track that started a PES packet in it has started the next one.
+  class ChunkScan : public Util::DataCallback{
+  public:
+    ChunkScan(const HTTP::URL &u, uint64_t s, uint64_t e, const std::deque<std::string> &t,
+              const std::set<size_t> &p, rawDataType parser)
+        : uri(u), start(s), end(e), tables(t), esPids(p){
+      pos = start;
+      ok = false;
+      finished = false;
+      flushing = false;
+      stream.setRawDataParser(parser);
+    }
+
+    static void run(void *arg){
+      ChunkScan *S = (ChunkScan *)arg;
+      S->scan();
+      S->finished = true;
+    }
+
+    void scan(){
+      for (std::deque<std::string>::const_iterator it = tables.begin(); it != tables.end(); ++it){
+        Packet tablePack;
+        tablePack.FromPointer(it->data());
+        stream.parse(tablePack, 0);
+      }
+      HTTP::URIReader reader;
+      if (!reader.open(uri) || !reader.seek(start)){
+        FAIL_MSG("Could not read %s from byte %" PRIu64, uri.getUrl().c_str(), start);
+        return;
+      }
+      while (!reader.isEOF() && (pos < end || (opened.size() > closed.size() && pos < end + SCAN_OVERSHOOT_MAX))){
+        uint64_t prePos = pos;
+        reader.readSome(1024 * 1024, *this);
+        if (pos == prePos){Util::sleep(50);}
+        drain();
+      }
+      stream.finish();
+      flushing = true;
+      drain();
+      ok = true;
+    }
+
+    virtual void dataCallback(const char *ptr, size_t size){
+      assembler.assemble(stream, ptr, size, true, pos);
+      // Note which tracks start PES packets, only looking at packets aligned to the range start
+      uint64_t skip = (188 - (pos - start) % 188) % 188;
+      for (uint64_t i = skip; i + 188 <= size; i += 188){
+        const char *p = ptr + i;
+        if (p[0] != 0x47 || !(p[1] & 0x40)){continue;}
+        size_t pid = ((p[1] & 0x1F) << 8) | (uint8_t)p[2];
+        if (!esPids.count(pid)){continue;}
+        if (pos + i < end){
+          opened.insert(pid);
+        }else if (opened.count(pid)){
+          closed.insert(pid);
+        }
+      }
+      pos += size;
+    }
+    virtual size_t getDataCallbackPos() const{return pos;}
+
+    /// Takes the finished packets from the stream, keeping those that start within the range.
+    void drain(){
+      DTSC::Packet pack;
+      while (stream.hasPacket()){
+        stream.getEarliestPacket(pack);
+        if (!pack){break;}
+        ScanRecord R;
+        R.bpos = pack.getInt("bpos");
+        if (R.bpos < start || R.bpos >= end){continue;}
+        char *data;
+        pack.getString("data", data, R.dataLen);
+        R.time = pack.getTime();
+        R.offset = pack.getInt("offset");
+        R.pid = pack.getTrackId();
+        R.packLen = pack.getDataLen();
+        R.keyframe = pack.getFlag("keyframe");
+        R.flushed = flushing;
+        records.push_back(R);
+      }
+    }
+
+    HTTP::URL uri;
+    uint64_t start; ///< First byte of the range
+    uint64_t end;   ///< Byte after the range
+    const std::deque<std::string> &tables; ///< PAT and PMT packets of the file
+    const std::set<size_t> &esPids;        ///< Elementary stream PIDs of the file
+    volatile uint64_t pos; ///< Current read position, for progress reporting
+    volatile bool finished;
+    bool ok;
+    bool flushing; ///< Set once the stream is finished, for the packets that forces out
+    Stream stream;
+    Assembler assembler;
+    std::set<size_t> opened; ///< Tracks that started a PES packet within the range
+    std::set<size_t> closed; ///< Tracks of the above that started another one after the range
+    std::deque<ScanRecord> records;
+  };
+
+  /// Fills meta with the tracks and packets of the TS file at the given URI, by splitting the file
+  /// into the given amount of byte ranges and parsing them in parallel, one thread per range.
+  /// Timestamps that roll over between ranges are corrected while merging. If progress is set,
+  /// it is updated with the fraction of the file read, 0 through 255.
+  /// If positions is set, it receives the position of the last packet of every track. If it is
+  /// not empty, meta already holds the packets up to those positions, and only the packets after
+  /// them are added: this resumes indexing a file that grew since.
+  /// If growing is set, the file may still be written to, and the last packet of every track is
+  /// left out: only the end of the file completes it, so it may be cut short. The positions are
+  /// kept before it, so that it gets added once the file grew.
+  /// Returns false if the file cannot be read in ranges, in which case meta is not touched.
+  bool scanHeader(const HTTP::URL &uri, DTSC::Meta &meta, size_t chunks, uint8_t *progress,
+                  rawDataType parser, ScanPositions *positions, bool growing){
+    HTTP::URIReader reader;
+    if (!reader.open(uri) || !reader.isSeekable() || reader.getSize() == std::string::npos){return false;}
+    uint64_t size = reader.getSize();
+    if (!chunks){chunks = 1;}
+    uint64_t from = 0;
+    std::map<size_t, uint64_t> lastTime;
+    if (positions && positions->size()){
+      from = positions->begin()->second;
+      for (ScanPositions::iterator it = positions->begin(); it != positions->end(); ++it){
+        if (it->second < from){from = it->second;}
+        size_t idx = meta.trackIDToIndex(it->first, getpid());
+        if (idx != INVALID_TRACK_ID){lastTime[it->first] = meta.getLastms(idx);}
+      }
+      if (from > size){return false;}
+    }
+
+    // Collect the first PAT, and the first packet of each PMT it lists
+    std::deque<std::string> tables;
+    std::set<size_t> esPids;
+    {
+      Util::ResizeablePointer head;
+      while (!reader.isEOF() && head.size() < SCAN_TABLES_SIZE){
+        char *ptr;
+        size_t len;
+        reader.readSome(ptr, len, SCAN_TABLES_SIZE - head.size());
+        if (!len){break;}
+        head.append(ptr, len);
+      }
+      std::set<unsigned int> pmtPids;
+      std::set<unsigned int> foundPmts;
+      for (size_t i = 0; i + 188 <= head.size(); ++i){
+        const char *p = (const char *)head + i;
+        if (p[0] != 0x47 || (i + 188 < head.size() && p[188] != 0x47)){continue;}
+        size_t pid = ((p[1] & 0x1F) << 8) | (uint8_t)p[2];
+        if (p[1] & 0x40){
+          if (!pid && !tables.size()){
+            Packet tablePack;
+            tablePack.FromPointer(p);
+            ProgramAssociationTable pat;
+            pat = tablePack;
+            pat.parsePIDs(pmtPids);
+            tables.push_back(std::string(p, 188));
+          }else if (pmtPids.count(pid) && !foundPmts.count(pid)){
+            Packet tablePack;
+            tablePack.FromPointer(p);
+            ProgramMappingTable pmt;
+            pmt = tablePack;
+            ProgramMappingEntry entry = pmt.getEntry(0);
+            while (entry){
+              esPids.insert(entry.getElementaryPid());
+              entry.advance();
+            }
+            foundPmts.insert(pid);
+            tables.push_back(std::string(p, 188));
+          }
+          if (tables.size() && foundPmts.size() == pmtPids.size()){break;}
+        }
+        i += 187;
+      }
+      if (!tables.size() || foundPmts.size() != pmtPids.size()){
+        WARN_MSG("No PAT and PMT found near the start of %s, cannot read it in parallel", uri.getUrl().c_str());
+        return false;
+      }
+    }
+    reader.close();
+
+    // Split on packet boundaries, and scan all ranges in parallel
+    std::deque<ChunkScan *> scans;
+    std::deque<tthread::thread *> threads;
+    for (size_t i = 0; i < chunks; ++i){
+      uint64_t s = from + ((size - from) * i / chunks) / 188 * 188;
+      uint64_t e = (i + 1 == chunks) ? size : from + ((size - from) * (i + 1) / chunks) / 188 * 188;
+      scans.push_back(new ChunkScan(uri, s, e, tables, esPids, parser));
+    }
+    for (size_t i = 0; i < chunks; ++i){threads.push_back(new tthread::thread(ChunkScan::run, scans[i]));}
+    bool finished = false;
+    while (!finished){
+      finished = true;
+      uint64_t done = 0;
+      for (size_t i = 0; i < chunks; ++i){
+        uint64_t p = scans[i]->pos;
+        done += (p < scans[i]->end ? p : scans[i]->end) - scans[i]->start;
+        if (!scans[i]->finished){finished = false;}
+      }
+      if (progress && size > from){*progress = (255 * done) / (size - from);}
+      if (!finished){Util::sleep(100);}
+    }
+    bool ok = true;
+    for (size_t i = 0; i < chunks; ++i){
+      threads[i]->join();
+      delete threads[i];
+      if (!scans[i]->ok){ok = false;}
+    }
+
+    // Merge the ranges in order, moving timestamps that rolled over since the previous range
+    ScanPositions resume;
+    if (positions){resume = *positions;}
+    for (size_t i = 0; i < chunks && ok; ++i){
+      ChunkScan &S = *scans[i];
+      std::map<size_t, uint64_t> shift;
+      for (std::deque<ScanRecord>::iterator it = S.records.begin(); it != S.records.end(); ++it){
+        if (resume.count(it->pid) && it->bpos <= resume[it->pid]){continue;}
+        if (growing && it->flushed && S.end == size){
+          // Tracks with nothing indexed yet resume one TS packet before this one
+          if (positions && !positions->count(it->pid)){(*positions)[it->pid] = it->bpos >= 188 ? it->bpos - 188 : 0;}
+          continue;
+        }
+        if (positions){(*positions)[it->pid] = it->bpos;}
+        if (!shift.count(it->pid)){
+          uint64_t &sh = shift[it->pid];
+          sh = 0;
+          if (lastTime.count(it->pid)){
+            while (it->time + sh + TS_PTS_ROLLOVER / 2 < lastTime[it->pid]){sh += TS_PTS_ROLLOVER;}
+          }
+        }
+        uint64_t time = it->time + shift[it->pid];
+        lastTime[it->pid] = time;
+        size_t idx = meta.trackIDToIndex(it->pid, getpid());
+        if (idx == INVALID_TRACK_ID || !meta.getCodec(idx).size()){
+          S.stream.initializeMetadata(meta, it->pid);
+          idx = meta.trackIDToIndex(it->pid, getpid());
+        }
+        meta.update(time, it->offset, idx, it->dataLen, it->bpos, it->keyframe, it->packLen);
+      }
+    }
+    if (progress && ok){*progress = 255;}
+    for (size_t i = 0; i < chunks; ++i){delete scans[i];}
+    return ok;
+  }
 }// namespace TS
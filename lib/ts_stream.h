@@ -4,8 +4,11 @@
 #include <deque>
 #include <map>
 #include <set>
+#include <vector>
 
 #include "shared_memory.h"
+#include "tinythread.h"
+#include "url.h"
 #define TS_PTS_ROLLOVER 95443718
 
 namespace TS{
@@ -52,6 +55,14 @@ namespace TS{
 
   class Assembler;
 
+  /// Recursive mutex that is copied along with the Stream holding it: every copy gets its own.
+  class StreamMutex : public tthread::recursive_mutex{
+  public:
+    StreamMutex(){}
+    StreamMutex(const StreamMutex &) : tthread::recursive_mutex(){}
+    StreamMutex &operator=(const StreamMutex &){return *this;}
+  };
+
   class Stream{
   friend class Assembler;
   public:
@@ -59,6 +70,7 @@ namespace TS{
     ~Stream();
     void add(char *newPack, uint64_t bytePos = 0);
     void add(Packet &newPack, uint64_t bytePos = 0);
+    bool addBatch(const char *ptr, size_t count, bool parsePackets, uint64_t bytePos, bool advancePos);
     void parse(Packet &newPack, uint64_t bytePos);
     void parse(char *newPack, uint64_t bytePos);
     void parse(size_t tid);
@@ -83,6 +95,7 @@ namespace TS{
     void setRawDataParser(rawDataType parser);
 
   private:
+    mutable StreamMutex tMutex; ///< Protects this stream, so threads can share it
     uint64_t lastPAT;
     rawDataType rParser;
     ProgramAssociationTable associationTable;
@@ -93,9 +106,12 @@ namespace TS{
     std::map<size_t, uint64_t> lastPMT;
     std::map<size_t, ProgramMappingTable> mappingTable;
 
-    std::map<size_t, std::deque<Packet> > pesStreams;
-    std::deque<Packet> *psCache; /// Used only for internal speed optimizes.
+    /// Packets of each PID that were not parsed yet. Kept in vectors rather than deques, so
+    /// their memory is reused from one PES packet to the next instead of allocated per packet.
+    std::map<size_t, std::vector<Packet> > pesStreams;
+    std::vector<Packet> *psCache; /// Used only for internal speed optimizes.
     uint32_t psCacheTid;         /// Used only for internal speed optimizes.
+    uint32_t wantPrev;           /// PID of the last packet added, to keep its continuations
     std::map<size_t, std::deque<uint64_t> > pesPositions;
     std::map<size_t, std::deque<DTSC::Packet> > outPackets;
     std::map<size_t, DTSC::Packet> buildPacket;
@@ -114,7 +130,11 @@ namespace TS{
     std::map<size_t, size_t> rolloverCount;
     std::map<size_t, unsigned long long> lastms;
 
+    uint8_t pidClass[8192]; ///< Per PID: whether it carries the PAT, a PMT or a known stream
+    Util::ResizeablePointer pesBuffer; ///< Payload of the PES packet being parsed, reused by parsePES
+
     void parsePES(size_t tid, bool finished = false);
+    void updatePidClasses();
   };
 
   class Assembler{
@@ -129,4 +149,10 @@ namespace TS{
     TS::Packet tsBuf;
   };
 
+  /// Byte position of the last packet indexed, per track ID
+  typedef std::map<size_t, uint64_t> ScanPositions;
+
+  bool scanHeader(const HTTP::URL &uri, DTSC::Meta &meta, size_t chunks, uint8_t *progress = 0,
+                  rawDataType parser = NONE, ScanPositions *positions = 0, bool growing = false);
+
 }// namespace TS
@@ -428,6 +428,19 @@ namespace Util{
     if (currSize > newLen){currSize = newLen;}
   }
 
+  /// Exchanges the contents of this pointer with those of another, without copying any data.
+  void ResizeablePointer::swap(ResizeablePointer &rhs){
+    void *tmpPtr = ptr;
+    size_t tmpSize = currSize;
+    size_t tmpMax = maxSize;
+    ptr = rhs.ptr;
+    currSize = rhs.currSize;
+    maxSize = rhs.maxSize;
+    rhs.ptr = tmpPtr;
+    rhs.currSize = tmpSize;
+    rhs.maxSize = tmpMax;
+  }
+
   /// Redirects stderr to log parser, writes log parser to the old stderr.
   /// Does nothing if the MIST_CONTROL environment variable is set.
   void redirectLogsIfNeeded(){
@@ -59,6 +59,7 @@ namespace Util{
     void shift(size_t byteCount);
     uint32_t rsize();
     void truncate(const size_t newLen);
+    void swap(ResizeablePointer &rhs);
     inline operator char *(){return (char *)ptr;}
     inline operator const char *() const{return (const char *)ptr;}
     inline operator void *(){return ptr;}
@@ -129,6 +129,8 @@ void statusMonitor(void *np){
       }
       // checks stream statuses, reports changes to status
       Controller::CheckAllStreams(Controller::Storage["streams"]);
+      // starts or retires the shared session tracker
+      Controller::checkSessionTracker();
     }
 
     Util::sleep(3000); // wait at most 3 seconds
@@ -354,6 +354,56 @@ void Controller::handleWebSocket(HTTP::Parser &H, Socket::Connection &C, bool au
   }
 }
 
+/// Sends an API response over HTTP, writing the "clients" and "totals" responses straight into
+/// the (chunked) output instead of adding them to the Response tree first, as those can be huge.
+/// The output is identical to sending Response with those members filled in.
+static void sendDirectResponse(HTTP::Parser &H, Socket::Connection &conn, const std::string &jsonp,
+                               JSON::Value &Response, JSON::Value &direct){
+  HTTP::Parser R;
+  R.SetHeader("Content-Type", "text/javascript");
+  R.setCORSHeaders();
+  R.StartResponse("200", "OK", H, conn);
+  JSON::Writer W;
+  if (jsonp.size()){W.str() = jsonp + "(";}
+  // Members go out in the same (sorted) order JSON::Value::toString would use
+  std::set<std::string> keys;
+  jsonForEachConst(Response, it){keys.insert(it.key());}
+  jsonForEachConst(direct, it){keys.insert(it.key());}
+  W.objectBegin();
+  for (std::set<std::string>::iterator k = keys.begin(); k != keys.end(); ++k){
+    if (!direct.isMember(*k)){
+      W.key(*k);
+      W.value(Response[*k]);
+      continue;
+    }
+    JSON::Value &req = direct[*k];
+    // An empty list of requests gets no reply at all
+    if (req.isArray() && !req.size()){continue;}
+    W.key(*k);
+    if (req.isArray()){W.arrayBegin();}
+    for (unsigned int i = 0; i < (req.isArray() ? req.size() : 1); ++i){
+      JSON::Value &subReq = req.isArray() ? req[i] : req;
+      if (*k == "clients"){
+        Controller::fillClients(subReq, W);
+      }else{
+        Controller::fillTotals(subReq, W);
+      }
+      // Send out what we have after every part, so the full response is never buffered
+      if (W.str().size()){
+        R.Chunkify(W.str(), conn);
+        W.str().clear();
+      }
+    }
+    if (req.isArray()){W.arrayEnd();}
+  }
+  W.objectEnd();
+  W.str() += jsonp.size() ? ");\n\n" : "\n\n";
+  R.Chunkify(W.str(), conn);
+  R.Chunkify("", conn);
+  // Without chunked encoding, the end of the response is marked by closing the connection
+  if (!R.sendingChunks){conn.close();}
+}
+
 /// Handles a single incoming API connection.
 /// Assumes the connection is unauthorized and will allow for 4 requests without authorization before disconnecting.
 int Controller::handleAPIConnection(Socket::Connection &conn){
@@ -439,6 +489,16 @@ int Controller::handleAPIConnection(Socket::Connection &conn){
         break;
       }
       if (H.url == "/api2"){Request["minimal"] = true;}
+      // Requests with potentially huge responses are answered while sending, see sendDirectResponse
+      JSON::Value direct;
+      if (Request.isMember("clients")){
+        direct["clients"] = Request["clients"];
+        Request.removeMember("clients");
+      }
+      if (Request.isMember("totals")){
+        direct["totals"] = Request["totals"];
+        Request.removeMember("totals");
+      }
       {// lock the config mutex here - do not unlock until done processing
         tthread::lock_guard<tthread::mutex> guard(configMutex);
         if (!Controller::conf.is_active){return 0;}
@@ -464,6 +524,11 @@ int Controller::handleAPIConnection(Socket::Connection &conn){
       std::string jsonp = "";
       if (H.GetVar("callback") != ""){jsonp = H.GetVar("callback");}
       if (H.GetVar("jsonp") != ""){jsonp = H.GetVar("jsonp");}
+      if (authorized && direct.size()){
+        sendDirectResponse(H, conn, jsonp, Response, direct);
+        H.Clean();
+        continue;
+      }
       H.Clean();
       H.SetHeader("Content-Type", "text/javascript");
       H.setCORSHeaders();
@@ -575,11 +640,31 @@ void Controller::handleAPICommands(JSON::Value &Request, JSON::Value &Response){
   // These are only used internally. We abort further processing if encountered.
   if (Request.isMember("trigger_stat")){
     JSON::Value &tStat = Request["trigger_stat"];
+    if (tStat.isMember("name") && tStat.isMember("cache")){
+      Controller::triggerLog &tLog = Controller::triggerStats[tStat["name"].asStringRef()];
+      if (tStat["cache"].asStringRef() == "hit"){
+        tLog.cacheHits++;
+      }else{
+        tLog.cacheMisses++;
+      }
+      return;
+    }
     if (tStat.isMember("name") && tStat.isMember("ms")){
       Controller::triggerLog &tLog = Controller::triggerStats[tStat["name"].asStringRef()];
       tLog.totalCount++;
       tLog.ms += tStat["ms"].asInt();
       if (!tStat.isMember("ok") || !tStat["ok"].asBool()){tLog.failCount++;}
+      for (size_t i = 0; i < TRIGGER_LATENCY_BUCKETS; ++i){
+        if ((uint64_t)tStat["ms"].asInt() <= triggerLatencyBounds[i]){
+          tLog.latency[i]++;
+          break;
+        }
+      }
+      if (tStat.isMember("queue") && tStat.isMember("pid")){
+        Controller::triggerQueue &tQueue = Controller::triggerQueues[tStat["pid"].asInt()];
+        tQueue.depth = tStat["queue"].asInt();
+        tQueue.lastSeen = Util::bootSecs();
+      }
     }
     return;
   }
@@ -679,6 +764,7 @@ void Controller::handleAPICommands(JSON::Value &Request, JSON::Value &Response){
     if (in.isMember("sessionUnspecifiedMode")){out["sessionUnspecifiedMode"] = in["sessionUnspecifiedMode"];}
     if (in.isMember("sessionStreamInfoMode")){out["sessionStreamInfoMode"] = in["sessionStreamInfoMode"];}
     if (in.isMember("tknMode")){out["tknMode"] = in["tknMode"];}
+    if (in.isMember("sessionTracker")){out["sessionTracker"] = in["sessionTracker"];}
     if (in.isMember("defaultStream")){out["defaultStream"] = in["defaultStream"];}
     if (in.isMember("location") && in["location"].isObject()){
       out["location"]["lat"] = in["location"]["lat"].asDouble();
@@ -193,8 +193,11 @@ namespace Controller{
       // list connectors that go through HTTP as 'enabled' without actually running them.
       const JSON::Value &connCapa = capabilities["connectors"][connName];
       if (connCapa.isMember("socket") || (connCapa.isMember("deps") && connCapa["deps"].asStringRef() == "HTTP")){
-        (*ait)["online"] = "Enabled";
-        continue;
+        // HTTP-based connectors with multiplexed workers run a worker pool that HTTP hands connections to
+        if (connCapa.isMember("socket") || !(*ait).isMember("workers") || (*ait)["workers"].asInt() < 0){
+          (*ait)["online"] = "Enabled";
+          continue;
+        }
       }
       // check required parameters, skip if anything is missing
       if (connCapa.isMember("required")){
@@ -11,6 +11,7 @@
 #include <mist/config.h>
 #include <mist/dtsc.h>
 #include <mist/procs.h>
+#include <mist/segcache.h>
 #include <mist/shared_memory.h>
 #include <mist/stream.h>
 #include <mist/url.h>
@@ -51,6 +52,7 @@
 std::map<std::string, Controller::statSession> sessions;
 
 std::map<std::string, Controller::triggerLog> Controller::triggerStats; ///< Holds prometheus stats for trigger executions
+std::map<uint64_t, Controller::triggerQueue> Controller::triggerQueues; ///< Holds asynchronous trigger queue depth per PID
 bool Controller::killOnExit = KILL_ON_EXIT;
 tthread::recursive_mutex statsMutex;
 uint64_t Controller::statDropoff = 0;
@@ -83,11 +85,7 @@ class tagQueueItem{
 
 std::map<std::string, tagQueueItem> tagQueue;
 
-const char nullAddress[16] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
-static Controller::statLog emptyLogEntry = {0, 0, 0, 0, 0, 0 ,0 ,0, "", nullAddress, ""};
-bool notEmpty(const Controller::statLog & dta){
-  return dta.time || dta.firstActive || dta.lastSecond || dta.down || dta.up || dta.streamName.size() || dta.connectors.size();
-}
+static const Controller::statLabels emptyLabels = Controller::statLabels();
 
 // For server-wide totals. Local to this file only.
 struct streamTotals{
@@ -127,6 +125,14 @@ static uint64_t servPackLoss = 0;
 static uint64_t servPackRetrans = 0;
 // Total time watched for all sessions which are no longer active
 static uint64_t viewSecondsTotal = 0;
+// Running per-second totals of all sessions, for "totals" requests
+static Controller::statTotals runningTotals;
+// Sessions active right now by type, and viewers by protocol, as counted by the last stats pass
+static uint32_t activeViewers = 0;
+static uint32_t activeInputs = 0;
+static uint32_t activeOutputs = 0;
+static uint32_t activeUnspecified = 0;
+static std::map<std::string, uint32_t> activeProtocols;
 // Mapping of streamName -> summary of stream-wide statistics
 static std::map<std::string, struct streamTotals> streamStats;
 
@@ -204,7 +210,11 @@ void Controller::sessions_invalidate(const std::string &streamname){
     if (statComm.getStream(i) == streamname){
       sessCount++;
       // Re-trigger USER_NEW trigger for this session
-      kill(statComm.getPid(i), SIGUSR1);
+      if (statComm.getStatus(i) & COMM_STATUS_NOKILL){
+        statComm.setStatus(COMM_STATUS_REQINVALIDATE | statComm.getStatus(i), i);
+      }else{
+        kill(statComm.getPid(i), SIGUSR1);
+      }
     }
   }
   INFO_MSG("Invalidated %u session(s) for stream %s", sessCount, streamname.c_str());
@@ -347,7 +357,10 @@ void Controller::sessions_shutdown(const std::string &streamname, const std::str
       (!protocol.size() || statComm.hasConnector(i, protocol))){
       uint32_t pid = statComm.getPid(i);
       sessCount++;
-      if (pid > 1){
+      if (statComm.getStatus(i) & COMM_STATUS_NOKILL){
+        // Kept by the session tracker, which we should not kill
+        statComm.setStatus(COMM_STATUS_REQDISCONNECT | statComm.getStatus(i), i);
+      }else if (pid > 1){
         Util::Procs::Stop(pid);
         INFO_MSG("Killing PID %" PRIu32, pid);
       }
@@ -472,10 +485,13 @@ void Controller::SharedMemStats(void *config){
           // This part handles ending sessions, keeping them in cache for now
           if (it->second.getEnd() < cutOffPoint){
             viewSecondsTotal += it->second.getConnTime();
+            it->second.wipeTotals();
             mustWipe.push_back(it->first);
             // Don't count this session as a viewer
             continue;
           }
+          // Count sessions that are still active for every second up to now
+          if (it->second.getFirstActive()){it->second.updateTotals(Util::bootSecs());}
           // Recount input, output and viewer type sessions
           switch (it->second.getSessType()){
           case SESS_UNSET: break;
@@ -507,10 +523,22 @@ void Controller::SharedMemStats(void *config){
           mustWipe.pop_front();
         }
       }
+      {
+        uint64_t cutOffPoint = Util::bootSecs();
+        runningTotals.wipe(cutOffPoint > STAT_CUTOFF ? cutOffPoint - STAT_CUTOFF : 0);
+      }
       Util::RelAccX *strmStats = streamsAccessor();
       if (!strmStats || !strmStats->isReady()){strmStats = 0;}
       uint64_t strmPos = 0;
+      Util::FieldAccX strmName, strmStatus, strmViewers, strmInputs, strmOutputs, strmUnspecified, strmTags;
       if (strmStats){
+        strmName = strmStats->getFieldAccX("stream");
+        strmStatus = strmStats->getFieldAccX("status");
+        strmViewers = strmStats->getFieldAccX("viewers");
+        strmInputs = strmStats->getFieldAccX("inputs");
+        strmOutputs = strmStats->getFieldAccX("outputs");
+        strmUnspecified = strmStats->getFieldAccX("unspecified");
+        strmTags = strmStats->getFieldAccX("tags");
         if (shiftWrites || (strmStats->getEndPos() - strmStats->getDeleted() != streamStats.size())){
           shiftWrites = true;
           strmPos = strmStats->getEndPos();
@@ -538,21 +566,21 @@ void Controller::SharedMemStats(void *config){
             if (!it->second.currSessions){inactiveStreams.insert(it->first);}
           }
           if (strmStats){
-            if (shiftWrites){strmStats->setString("stream", it->first, strmPos);}
-            strmStats->setInt("status", it->second.status, strmPos);
-            strmStats->setInt("viewers", it->second.currViews, strmPos);
-            strmStats->setInt("inputs", it->second.currIns, strmPos);
-            strmStats->setInt("outputs", it->second.currOuts, strmPos);
-            strmStats->setInt("unspecified", it->second.currUnspecified, strmPos);
+            if (shiftWrites){strmName.set(it->first, strmPos);}
+            strmStatus.set(it->second.status, strmPos);
+            strmViewers.set(it->second.currViews, strmPos);
+            strmInputs.set(it->second.currIns, strmPos);
+            strmOutputs.set(it->second.currOuts, strmPos);
+            strmUnspecified.set(it->second.currUnspecified, strmPos);
             if (it->second.tags.size()){
               std::string tags;
               for (std::set<std::string>::iterator jt = it->second.tags.begin(); jt != it->second.tags.end(); ++jt){
                 if (tags.size()){tags += " ";}
                 tags += *jt;
               }
-              strmStats->setString("tags", tags, strmPos);
+              strmTags.set(tags, strmPos);
             }else{
-              strmStats->setString("tags", "", strmPos);
+              strmTags.set("", strmPos);
             }
             ++strmPos;
           }
@@ -617,16 +645,18 @@ std::set<std::string> Controller::getActiveStreams(const std::string &prefix){
   Util::RelAccX *strmStats = streamsAccessor();
   if (!strmStats || !strmStats->isReady()){return ret;}
   uint64_t endPos = strmStats->getEndPos();
+  Util::FieldAccX strmStatus = strmStats->getFieldAccX("status");
+  Util::FieldAccX strmName = strmStats->getFieldAccX("stream");
   if (prefix.size()){
     for (uint64_t i = strmStats->getDeleted(); i < endPos; ++i){
-      if (strmStats->getInt("status", i) != STRMSTAT_READY){continue;}
-      const char *S = strmStats->getPointer("stream", i);
+      if (strmStatus.uint(i) != STRMSTAT_READY){continue;}
+      const char *S = strmName.ptr(i);
       if (streamMatches(S, prefix)){ret.insert(S);}
     }
   }else{
     for (uint64_t i = strmStats->getDeleted(); i < endPos; ++i){
-      if (strmStats->getInt("status", i) != STRMSTAT_READY){continue;}
-      ret.insert(strmStats->getPointer("stream", i));
+      if (strmStatus.uint(i) != STRMSTAT_READY){continue;}
+      ret.insert(strmName.ptr(i));
     }
   }
   return ret;
@@ -641,7 +671,10 @@ void Controller::killConnections(std::string sessId){
       if (statComm.getStatus(i) == COMM_STATUS_INVALID || (statComm.getStatus(i) & COMM_STATUS_DISCONNECT)){continue;}
       if (statComm.getSessId(i) == sessId){
         uint32_t pid = statComm.getPid(i);
-        if (pid > 1){
+        if (statComm.getStatus(i) & COMM_STATUS_NOKILL){
+          // Kept by the session tracker, which we should not kill
+          statComm.setStatus(COMM_STATUS_REQDISCONNECT | statComm.getStatus(i), i);
+        }else if (pid > 1){
           Util::Procs::Stop(pid);
           INFO_MSG("Killing PID %" PRIu32, pid);
         }
@@ -650,6 +683,34 @@ void Controller::killConnections(std::string sessId){
   }
 }
 
+/// Starts or retires the shared session tracker, following the "sessionTracker" setting.
+/// While a tracker runs, new sessions are kept by it instead of by a MistSession process each.
+/// Should be called with the configMutex held.
+void Controller::checkSessionTracker(){
+  Comms::SessionRequests req;
+  bool running = req.open() && !req.getExit();
+  if (Storage["config"]["sessionTracker"].asBool()){
+    if (running){return;}
+    std::deque<std::string> args;
+    args.push_back(Util::getMyPath() + "MistSession");
+    args.push_back("--tracker");
+    int err = fileno(stderr);
+    pid_t pid = Util::Procs::StartPiped(args, 0, 0, &err);
+    if (!pid){
+      FAIL_MSG("Could not start the session tracker");
+      return;
+    }
+    Util::Procs::forget(pid);
+    Log("CONF", "Started session tracker (PID " + JSON::Value(pid).asString() + ")");
+    return;
+  }
+  if (running){
+    // The tracker finishes the sessions it is keeping, and then exits
+    req.setExit();
+    Log("CONF", "Retiring session tracker");
+  }
+}
+
 /// Updates the given active connection with new stats data.
 void Controller::statSession::update(uint64_t index, Comms::Sessions &statComm){
   if (sessId == ""){
@@ -668,7 +729,7 @@ void Controller::statSession::update(uint64_t index, Comms::Sessions &statComm){
     }
   }
 
-  uint64_t prevNow = curData.log.size() ? curData.log.rbegin()->first : 0;
+  uint64_t prevNow = curData.getEnd();
   // only parse last received data, if newer
   if (prevNow > statComm.getNow(index)){return;};
   long long prevDown = getDown();
@@ -699,7 +760,7 @@ void Controller::statSession::update(uint64_t index, Comms::Sessions &statComm){
   uint64_t currPktRetrans = getPktRetransmit();
   if (currUp - prevUp < 0 || currDown - prevDown < 0){
     INFO_MSG("Negative data usage! %lldu/%lldd (u%lld->%lld) in %s over %s, #%" PRIu64, currUp - prevUp,
-             currDown - prevDown, prevUp, currUp, streamName.c_str(), curData.log.rbegin()->second.connectors.c_str(), index);
+             currDown - prevDown, prevUp, currUp, streamName.c_str(), getConnectors().c_str(), index);
   }else{
     if (!noBWCount){
       size_t bwMatchOffset = 0;
@@ -762,6 +823,18 @@ void Controller::statSession::update(uint64_t index, Comms::Sessions &statComm){
     streamStats[streamName].packRetrans += currPktRetrans - prevPktRetrans;
     if (sessionType == SESS_VIEWER){streamStats[streamName].viewSeconds += secIncr;}
   }
+  updateTotals(getEnd());
+}
+
+/// Adds the data of this session to the running totals, forward-filling the newest data up to
+/// and including second until.
+void Controller::statSession::updateTotals(uint64_t until){
+  totals.update(runningTotals, curData, sessionType, until);
+}
+
+/// Takes the seconds this session forward-filled out of the running totals again.
+void Controller::statSession::wipeTotals(){
+  totals.clear(runningTotals);
 }
 
 Controller::sessType Controller::statSession::getSessType(){
@@ -822,7 +895,9 @@ void Controller::statSession::finish(){
   }
   tags.clear();
   // Insert null datapoint
-  curData.log[curData.log.rbegin()->first + 1] = emptyLogEntry;
+  curData.finish();
+  // Stop counting the session from the null datapoint on
+  updateTotals(getEnd());
 }
 
 /// Constructs an empty session
@@ -834,14 +909,12 @@ Controller::statSession::statSession(){
 
 /// Returns the first measured timestamp in this session.
 uint64_t Controller::statSession::getStart(){
-  if (!curData.log.size()){return 0;}
-  return curData.log.begin()->first;
+  return curData.getStart();
 }
 
 /// Returns the last measured timestamp in this session.
 uint64_t Controller::statSession::getEnd(){
-  if (!curData.log.size()){return 0;}
-  return curData.log.rbegin()->first;
+  return curData.getEnd();
 }
 
 /// Returns true if there is data for this session at timestamp t.
@@ -855,24 +928,21 @@ const std::string& Controller::statSession::getSessId(){
 }
 
 uint64_t Controller::statSession::getFirstActive(){
-  if (curData.log.size()){
-    return curData.log.rbegin()->second.firstActive;
-  }
-  return 0;
+  return curData.getFirstActive();
 }
 
 const std::string& Controller::statSession::getStreamName(uint64_t t){
   if (curData.hasDataFor(t)){
-    return curData.getDataFor(t).streamName;
+    return curData.getLabels(curData.getPos(t)).streamName;
   }
-  return emptyLogEntry.streamName;
+  return emptyLabels.streamName;
 }
 
 const std::string& Controller::statSession::getStreamName(){
-  if (curData.log.size()){
-    return curData.log.rbegin()->second.streamName;
+  if (curData.size()){
+    return curData.getLabels(curData.size() - 1).streamName;
   }
-  return emptyLogEntry.streamName;
+  return emptyLabels.streamName;
 }
 
 std::string Controller::statSession::getStrHost(uint64_t t){
@@ -889,44 +959,44 @@ std::string Controller::statSession::getStrHost(){
 
 const std::string& Controller::statSession::getHost(uint64_t t){
   if (curData.hasDataFor(t)){
-    return curData.getDataFor(t).host;
+    return curData.getLabels(curData.getPos(t)).host;
   }
-  return emptyLogEntry.host;
+  return emptyLabels.host;
 }
 
 const std::string& Controller::statSession::getHost(){
-  if (curData.log.size()){
-    return curData.log.rbegin()->second.host;
+  if (curData.size()){
+    return curData.getLabels(curData.size() - 1).host;
   }
-  return emptyLogEntry.host;
+  return emptyLabels.host;
 }
 
 const std::string& Controller::statSession::getConnectors(uint64_t t){
   if (curData.hasDataFor(t)){
-    return curData.getDataFor(t).connectors;
+    return curData.getLabels(curData.getPos(t)).connectors;
   }
-  return emptyLogEntry.connectors;
+  return emptyLabels.connectors;
 }
 
 const std::string& Controller::statSession::getConnectors(){
-  if (curData.log.size()){
-    return curData.log.rbegin()->second.connectors;
+  if (curData.size()){
+    return curData.getLabels(curData.size() - 1).connectors;
   }
-  return emptyLogEntry.connectors;
+  return emptyLabels.connectors;
 }
 
 /// Returns the cumulative connected time for this session at timestamp t.
 uint64_t Controller::statSession::getConnTime(uint64_t t){
   if (curData.hasDataFor(t)){
-    return curData.getDataFor(t).time;
+    return curData.at(curData.getPos(t)).time;
   }
   return 0;
 }
 
 /// Returns the cumulative connected time for this session.
 uint64_t Controller::statSession::getConnTime(){
-  if (curData.log.size()){
-    return curData.log.rbegin()->second.time;
+  if (curData.size()){
+    return curData.at(curData.size() - 1).time;
   }
   return 0;
 }
@@ -934,7 +1004,7 @@ uint64_t Controller::statSession::getConnTime(){
 /// Returns the last requested media timestamp for this session at timestamp t.
 uint64_t Controller::statSession::getLastSecond(uint64_t t){
   if (curData.hasDataFor(t)){
-    return curData.getDataFor(t).lastSecond;
+    return curData.at(curData.getPos(t)).lastSecond;
   }
   return 0;
 }
@@ -942,7 +1012,7 @@ uint64_t Controller::statSession::getLastSecond(uint64_t t){
 /// Returns the cumulative downloaded bytes for this session at timestamp t.
 uint64_t Controller::statSession::getDown(uint64_t t){
   if (curData.hasDataFor(t)){
-    return curData.getDataFor(t).down;
+    return curData.getCounter(curData.getPos(t), STAT_DOWN);
   }
   return 0;
 }
@@ -950,148 +1020,109 @@ uint64_t Controller::statSession::getDown(uint64_t t){
 /// Returns the cumulative uploaded bytes for this session at timestamp t.
 uint64_t Controller::statSession::getUp(uint64_t t){
   if (curData.hasDataFor(t)){
-    return curData.getDataFor(t).up;
+    return curData.getCounter(curData.getPos(t), STAT_UP);
   }
   return 0;
 }
 
 /// Returns the cumulative downloaded bytes for this session at timestamp t.
 uint64_t Controller::statSession::getDown(){
-  if (curData.log.size()){
-    return curData.log.rbegin()->second.down;
+  if (curData.size()){
+    return curData.getCounter(curData.size() - 1, STAT_DOWN);
   }
   return 0;
 }
 
 /// Returns the cumulative uploaded bytes for this session at timestamp t.
 uint64_t Controller::statSession::getUp(){
-  if (curData.log.size()){
-    return curData.log.rbegin()->second.up;
+  if (curData.size()){
+    return curData.getCounter(curData.size() - 1, STAT_UP);
   }
   return 0;
 }
 
 uint64_t Controller::statSession::getPktCount(uint64_t t){
   if (curData.hasDataFor(t)){
-    return curData.getDataFor(t).pktCount;
+    return curData.getCounter(curData.getPos(t), STAT_PKTCOUNT);
   }
   return 0;
 }
 
 /// Returns the cumulative uploaded bytes for this session at timestamp t.
 uint64_t Controller::statSession::getPktCount(){
-  if (curData.log.size()){
-    return curData.log.rbegin()->second.pktCount;
+  if (curData.size()){
+    return curData.getCounter(curData.size() - 1, STAT_PKTCOUNT);
   }
   return 0;
 }
 
 uint64_t Controller::statSession::getPktLost(uint64_t t){
   if (curData.hasDataFor(t)){
-    return curData.getDataFor(t).pktLost;
+    return curData.getCounter(curData.getPos(t), STAT_PKTLOST);
   }
   return 0;
 }
 
 /// Returns the cumulative uploaded bytes for this session at timestamp t.
 uint64_t Controller::statSession::getPktLost(){
-  if (curData.log.size()){
-    return curData.log.rbegin()->second.pktLost;
+  if (curData.size()){
+    return curData.getCounter(curData.size() - 1, STAT_PKTLOST);
   }
   return 0;
 }
 
 uint64_t Controller::statSession::getPktRetransmit(uint64_t t){
   if (curData.hasDataFor(t)){
-    return curData.getDataFor(t).pktRetransmit;
+    return curData.getCounter(curData.getPos(t), STAT_PKTRETRANSMIT);
   }
   return 0;
 }
 
 /// Returns the cumulative uploaded bytes for this session at timestamp t.
 uint64_t Controller::statSession::getPktRetransmit(){
-  if (curData.log.size()){
-    return curData.log.rbegin()->second.pktRetransmit;
+  if (curData.size()){
+    return curData.getCounter(curData.size() - 1, STAT_PKTRETRANSMIT);
   }
   return 0;
 }
 
 /// Returns the cumulative downloaded bytes per second for this session at timestamp t.
 uint64_t Controller::statSession::getBpsDown(uint64_t t){
-  uint64_t aTime = t - 5;
-  if (aTime < curData.log.begin()->first){aTime = curData.log.begin()->first;}
-  if (t <= aTime){return 0;}
-  uint64_t valA = getDown(aTime);
-  uint64_t valB = getDown(t);
-  return (valB - valA) / (t - aTime);
+  return curData.getBps(t, STAT_DOWN);
 }
 
 /// Returns the cumulative uploaded bytes per second for this session at timestamp t.
 uint64_t Controller::statSession::getBpsUp(uint64_t t){
-  uint64_t aTime = t - 5;
-  if (aTime < curData.log.begin()->first){aTime = curData.log.begin()->first;}
-  if (t <= aTime){return 0;}
-  uint64_t valA = getUp(aTime);
-  uint64_t valB = getUp(t);
-  return (valB - valA) / (t - aTime);
-}
-
-/// Returns true if there is data available for timestamp t.
-bool Controller::statStorage::hasDataFor(unsigned long long t){
-  if (!log.size()){return false;}
-  return (t >= log.begin()->first);
-}
-
-/// Returns a reference to the most current data available at timestamp t.
-Controller::statLog &Controller::statStorage::getDataFor(unsigned long long t){
-  if (!log.size()){
-    return emptyLogEntry;
-  }
-  std::map<unsigned long long, statLog>::iterator it = log.upper_bound(t);
-  if (it != log.begin()){it--;}
-  return it->second;
-}
-
-/// This function is called by parseStatistics.
-/// It updates the internally saved statistics data.
-void Controller::statStorage::update(Comms::Sessions &statComm, size_t index){
-  statLog tmp;
-  tmp.time = statComm.getTime(index);
-  if (!log.size() || !log.rbegin()->second.firstActive){
-    tmp.firstActive = statComm.getNow(index);
-  } else{
-    tmp.firstActive = log.rbegin()->second.firstActive;
-  }
-  tmp.lastSecond = statComm.getLastSecond(index);
-  tmp.down = statComm.getDown(index);
-  tmp.up = statComm.getUp(index);
-  tmp.pktCount = statComm.getPacketCount(index);
-  tmp.pktLost = statComm.getPacketLostCount(index);
-  tmp.pktRetransmit = statComm.getPacketRetransmitCount(index);
-  tmp.connectors = statComm.getConnector(index);
-  tmp.streamName = statComm.getStream(index);
-  tmp.host = statComm.getHost(index);
-  log[statComm.getNow(index)] = tmp;
-  // wipe data older than STAT_CUTOFF seconds
-  // Ensure cutOffPoint is either time of boot or 10 minutes ago, whichever is closer.
-  // Prevents wrapping around to high values close to system boot time.
-  uint64_t cutOffPoint = Util::bootSecs();
-  if (cutOffPoint > STAT_CUTOFF){
-    cutOffPoint -= STAT_CUTOFF;
-  }else{
-    cutOffPoint = 0;
-  }
-  while (log.size() && log.begin()->first < cutOffPoint){log.erase(log.begin());}
+  return curData.getBps(t, STAT_UP);
 }
 
 void Controller::statLeadIn(){
   statDropoff = Util::bootSecs() - 3;
+  activeViewers = 0;
+  activeInputs = 0;
+  activeOutputs = 0;
+  activeUnspecified = 0;
+  activeProtocols.clear();
 }
 
 void Controller::statOnActive(size_t id){
+  const std::string sessId = statComm.getSessId(id);
+  // Count active viewers, inputs, outputs and protocols
+  if (!(statComm.getStatus(id) & COMM_STATUS_DISCONNECT)){
+    if (sessId[0] == 'I'){
+      activeInputs++;
+    }else if (sessId[0] == 'U'){
+      activeUnspecified++;
+    }else if (sessId[0] == 'O'){
+      activeOutputs++;
+    }else{
+      activeViewers++;
+      activeProtocols[statComm.getConnector(id)]++;
+    }
+  }
   if (statComm.getNow(id) >= statDropoff){
     // update the session with the latest data
-    sessions[statComm.getSessId(id)].update(id, statComm);
+    sessions[sessId].update(id, statComm);
   }
 }
 
@@ -1174,7 +1205,7 @@ bool Controller::hasViewers(std::string streamName){
 ///}
 /// ~~~~~~~~~~~~~~~
 /// In case of the second method, the response is an array in the same order as the requests.
-void Controller::fillClients(JSON::Value &req, JSON::Value &rep){
+void Controller::fillClients(JSON::Value &req, JSON::Writer &rep){
   tthread::lock_guard<tthread::recursive_mutex> guard(statsMutex);
   // first, figure out the timestamp wanted
   int64_t reqTime = 0;
@@ -1199,7 +1230,6 @@ void Controller::fillClients(JSON::Value &req, JSON::Value &rep){
     reqTime = cutOffPoint;
   }
   // at this point, we have the absolute timestamp in bootsecs.
-  rep["time"] = reqTime + (Controller::systemBoot/1000); // fill the absolute timestamp
 
   unsigned int fields = 0;
   // next, figure out the fields wanted
@@ -1232,23 +1262,10 @@ void Controller::fillClients(JSON::Value &req, JSON::Value &rep){
   if (req.isMember("protocols") && req["protocols"].size()){
     jsonForEach(req["protocols"], it){protos.insert((*it).asStringRef());}
   }
-  // output the selected fields
-  rep["fields"].null();
-  if (fields & STAT_CLI_HOST){rep["fields"].append("host");}
-  if (fields & STAT_CLI_STREAM){rep["fields"].append("stream");}
-  if (fields & STAT_CLI_PROTO){rep["fields"].append("protocol");}
-  if (fields & STAT_CLI_CONNTIME){rep["fields"].append("conntime");}
-  if (fields & STAT_CLI_POSITION){rep["fields"].append("position");}
-  if (fields & STAT_CLI_DOWN){rep["fields"].append("down");}
-  if (fields & STAT_CLI_UP){rep["fields"].append("up");}
-  if (fields & STAT_CLI_BPS_DOWN){rep["fields"].append("downbps");}
-  if (fields & STAT_CLI_BPS_UP){rep["fields"].append("upbps");}
-  if (fields & STAT_CLI_SESSID){rep["fields"].append("sessid");}
-  if (fields & STAT_CLI_PKTCOUNT){rep["fields"].append("pktcount");}
-  if (fields & STAT_CLI_PKTLOST){rep["fields"].append("pktlost");}
-  if (fields & STAT_CLI_PKTRETRANSMIT){rep["fields"].append("pktretransmit");}
-  // output the data itself
-  rep["data"].null();
+  // output the data itself, followed by the selected fields and the absolute timestamp
+  rep.objectBegin();
+  rep.key("data");
+  bool hasData = false;
   // loop over all sessions
   if (sessions.size()){
     for (std::map<std::string, statSession>::iterator it = sessions.begin(); it != sessions.end(); it++){
@@ -1258,28 +1275,62 @@ void Controller::fillClients(JSON::Value &req, JSON::Value &rep){
       if ((it->second.getEnd() >= time && it->second.getStart() <= time) &&
           (!streams.size() || streams.count(it->second.getStreamName(time))) &&
           (!protos.size() || protos.count(it->second.getConnectors(time)))){
-        const statLog & dta = it->second.curData.getDataFor(time);
-        if (notEmpty(dta)){
-          JSON::Value d;
-          if (fields & STAT_CLI_HOST){d.append(it->second.getStrHost(time));}
-          if (fields & STAT_CLI_STREAM){d.append(it->second.getStreamName(time));}
-          if (fields & STAT_CLI_PROTO){d.append(it->second.getConnectors(time));}
-          if (fields & STAT_CLI_CONNTIME){d.append(it->second.getConnTime(time));}
-          if (fields & STAT_CLI_POSITION){d.append(it->second.getLastSecond(time));}
-          if (fields & STAT_CLI_DOWN){d.append(it->second.getDown(time));}
-          if (fields & STAT_CLI_UP){d.append(it->second.getUp(time));}
-          if (fields & STAT_CLI_BPS_DOWN){d.append(it->second.getBpsDown(time));}
-          if (fields & STAT_CLI_BPS_UP){d.append(it->second.getBpsUp(time));}
-          if (fields & STAT_CLI_SESSID){d.append(it->second.getSessId());}
-          if (fields & STAT_CLI_PKTCOUNT){d.append(it->second.getPktCount(time));}
-          if (fields & STAT_CLI_PKTLOST){d.append(it->second.getPktLost(time));}
-          if (fields & STAT_CLI_PKTRETRANSMIT){d.append(it->second.getPktRetransmit(time));}
-          rep["data"].append(d);
+        if (!it->second.curData.at(it->second.curData.getPos(time)).empty){
+          if (!hasData){
+            rep.arrayBegin();
+            hasData = true;
+          }
+          rep.arrayBegin();
+          if (fields & STAT_CLI_HOST){rep.value(it->second.getStrHost(time));}
+          if (fields & STAT_CLI_STREAM){rep.value(it->second.getStreamName(time));}
+          if (fields & STAT_CLI_PROTO){rep.value(it->second.getConnectors(time));}
+          if (fields & STAT_CLI_CONNTIME){rep.value(it->second.getConnTime(time));}
+          if (fields & STAT_CLI_POSITION){rep.value(it->second.getLastSecond(time));}
+          if (fields & STAT_CLI_DOWN){rep.value(it->second.getDown(time));}
+          if (fields & STAT_CLI_UP){rep.value(it->second.getUp(time));}
+          if (fields & STAT_CLI_BPS_DOWN){rep.value(it->second.getBpsDown(time));}
+          if (fields & STAT_CLI_BPS_UP){rep.value(it->second.getBpsUp(time));}
+          if (fields & STAT_CLI_SESSID){rep.value(it->second.getSessId());}
+          if (fields & STAT_CLI_PKTCOUNT){rep.value(it->second.getPktCount(time));}
+          if (fields & STAT_CLI_PKTLOST){rep.value(it->second.getPktLost(time));}
+          if (fields & STAT_CLI_PKTRETRANSMIT){rep.value(it->second.getPktRetransmit(time));}
+          rep.arrayEnd();
         }
       }
     }
   }
-  // all done! return is by reference, so no need to return anything here.
+  if (hasData){
+    rep.arrayEnd();
+  }else{
+    rep.null();
+  }
+  rep.key("fields");
+  rep.arrayBegin();
+  if (fields & STAT_CLI_HOST){rep.value("host");}
+  if (fields & STAT_CLI_STREAM){rep.value("stream");}
+  if (fields & STAT_CLI_PROTO){rep.value("protocol");}
+  if (fields & STAT_CLI_CONNTIME){rep.value("conntime");}
+  if (fields & STAT_CLI_POSITION){rep.value("position");}
+  if (fields & STAT_CLI_DOWN){rep.value("down");}
+  if (fields & STAT_CLI_UP){rep.value("up");}
+  if (fields & STAT_CLI_BPS_DOWN){rep.value("downbps");}
+  if (fields & STAT_CLI_BPS_UP){rep.value("upbps");}
+  if (fields & STAT_CLI_SESSID){rep.value("sessid");}
+  if (fields & STAT_CLI_PKTCOUNT){rep.value("pktcount");}
+  if (fields & STAT_CLI_PKTLOST){rep.value("pktlost");}
+  if (fields & STAT_CLI_PKTRETRANSMIT){rep.value("pktretransmit");}
+  rep.arrayEnd();
+  rep.key("time");
+  rep.value(reqTime + (Controller::systemBoot/1000)); // the absolute timestamp
+  rep.objectEnd();
+}
+
+/// This takes a "clients" request, and fills in the response data.
+/// Builds the whole response in memory; the HTTP API writes it out directly instead.
+void Controller::fillClients(JSON::Value &req, JSON::Value &rep){
+  JSON::Writer w;
+  fillClients(req, w);
+  rep = JSON::fromString(w.str());
 }
 
 /// This takes a "active_streams" request, and fills in the response data.
@@ -1514,46 +1565,8 @@ void Controller::fillActive(JSON::Value &req, JSON::Value &rep){
   // all done! return is by reference, so no need to return anything here.
 }
 
-class totalsData{
-public:
-  totalsData(){
-    clients = 0;
-    inputs = 0;
-    outputs = 0;
-    unspecified = 0;
-    downbps = 0;
-    upbps = 0;
-    pktCount = 0;
-    pktLost = 0;
-    pktRetransmit = 0;
-  }
-  void add(uint64_t down, uint64_t up, Controller::sessType sT, uint64_t pCount, uint64_t pLost, uint64_t pRetransmit){
-    switch (sT){
-    case Controller::SESS_VIEWER: clients++; break;
-    case Controller::SESS_INPUT: inputs++; break;
-    case Controller::SESS_OUTPUT: outputs++; break;
-    case Controller::SESS_UNSPECIFIED: unspecified++; break;
-    default: break;
-    }
-    downbps += down;
-    upbps += up;
-    pktCount += pCount;
-    pktLost += pLost;
-    pktRetransmit += pRetransmit;
-  }
-  uint64_t clients;
-  uint64_t inputs;
-  uint64_t outputs;
-  uint64_t unspecified;
-  uint64_t downbps;
-  uint64_t upbps;
-  uint64_t pktCount;
-  uint64_t pktLost;
-  uint64_t pktRetransmit;
-};
-
 /// This takes a "totals" request, and fills in the response data.
-void Controller::fillTotals(JSON::Value &req, JSON::Value &rep){
+void Controller::fillTotals(JSON::Value &req, JSON::Writer &rep){
   tthread::lock_guard<tthread::recursive_mutex> guard(statsMutex);
   // first, figure out the timestamps wanted
   int64_t reqStart = 0;
@@ -1608,93 +1621,116 @@ void Controller::fillTotals(JSON::Value &req, JSON::Value &rep){
   if (req.isMember("protocols") && req["protocols"].size()){
     jsonForEach(req["protocols"], it){protos.insert((*it).asStringRef());}
   }
-  // output the selected fields
-  rep["fields"].null();
-  if (fields & STAT_TOT_CLIENTS){rep["fields"].append("clients");}
-  if (fields & STAT_TOT_INPUTS){rep["fields"].append("inputs");}
-  if (fields & STAT_TOT_OUTPUTS){rep["fields"].append("outputs");}
-  if (fields & STAT_TOT_BPS_DOWN){rep["fields"].append("downbps");}
-  if (fields & STAT_TOT_BPS_UP){rep["fields"].append("upbps");}
-  if (fields & STAT_TOT_PERCLOST){rep["fields"].append("perc_lost");}
-  if (fields & STAT_TOT_PERCRETRANS){rep["fields"].append("perc_retrans");}
-  // start data collection
-  std::map<uint64_t, totalsData> totalsCount;
-  // loop over all sessions
+  // collect the data from the running totals
   /// \todo Make the interval configurable instead of 1 second
-  if (sessions.size()){
-    for (std::map<std::string, statSession>::iterator it = sessions.begin(); it != sessions.end(); it++){
-      // data present and wanted? insert it!
-      if ((it->second.getEnd() >= (unsigned long long)reqStart ||
-           it->second.getStart() <= (unsigned long long)reqEnd) &&
-          (!streams.size() || streams.count(it->second.getStreamName())) &&
-          (!protos.size() || protos.count(it->second.getConnectors()))){
-        for (unsigned long long i = reqStart; i <= reqEnd; ++i){
-          if (it->second.hasDataFor(i)){
-            totalsCount[i].add(it->second.getBpsDown(i), it->second.getBpsUp(i), it->second.getSessType(), it->second.getPktCount(), it->second.getPktLost(), it->second.getPktRetransmit());
-          }
-        }
-      }
-    }
-  }
-  // output the data itself
+  std::map<uint64_t, totalsData> totalsCount;
+  runningTotals.fill(reqStart, reqEnd, streams, protos, totalsCount);
+  // output the data itself, followed by the end time, selected fields, intervals and start time
+  rep.objectBegin();
+  rep.key("data");
+  JSON::Value interval;
   if (!totalsCount.size()){
     // Oh noes! No data. We'll just reply with a bunch of nulls.
-    rep["start"].null();
-    rep["end"].null();
-    rep["data"].null();
-    rep["interval"].null();
-    return;
-  }
-  // yay! We have data!
-  rep["start"] = totalsCount.begin()->first + (Controller::systemBoot/1000);
-  rep["end"] = totalsCount.rbegin()->first + (Controller::systemBoot/1000);
-  rep["data"].null();
-  rep["interval"].null();
-  uint64_t prevT = 0;
-  JSON::Value i;
-  for (std::map<uint64_t, totalsData>::iterator it = totalsCount.begin(); it != totalsCount.end(); it++){
-    JSON::Value d;
-    if (fields & STAT_TOT_CLIENTS){d.append(it->second.clients);}
-    if (fields & STAT_TOT_INPUTS){d.append(it->second.inputs);}
-    if (fields & STAT_TOT_OUTPUTS){d.append(it->second.outputs);}
-    if (fields & STAT_TOT_BPS_DOWN){d.append(it->second.downbps);}
-    if (fields & STAT_TOT_BPS_UP){d.append(it->second.upbps);}
-    if (fields & STAT_TOT_PERCLOST){
-      if (it->second.pktCount > 0){
-        d.append((it->second.pktLost*100)/it->second.pktCount);
-      }else{
-        d.append(0);
+    rep.null();
+  }else{
+    // yay! We have data!
+    rep.arrayBegin();
+    uint64_t prevT = 0;
+    JSON::Value i;
+    for (std::map<uint64_t, totalsData>::iterator it = totalsCount.begin(); it != totalsCount.end(); it++){
+      rep.arrayBegin();
+      if (fields & STAT_TOT_CLIENTS){rep.value(it->second.clients);}
+      if (fields & STAT_TOT_INPUTS){rep.value(it->second.inputs);}
+      if (fields & STAT_TOT_OUTPUTS){rep.value(it->second.outputs);}
+      if (fields & STAT_TOT_BPS_DOWN){rep.value(it->second.downbps);}
+      if (fields & STAT_TOT_BPS_UP){rep.value(it->second.upbps);}
+      if (fields & STAT_TOT_PERCLOST){
+        if (it->second.pktCount > 0){
+          rep.value((it->second.pktLost*100)/it->second.pktCount);
+        }else{
+          rep.value(0);
+        }
       }
-    }
-    if (fields & STAT_TOT_PERCRETRANS){
-      if (it->second.pktCount > 0){
-        d.append((it->second.pktRetransmit*100)/it->second.pktCount);
-      }else{
-        d.append(0);
+      if (fields & STAT_TOT_PERCRETRANS){
+        if (it->second.pktCount > 0){
+          rep.value((it->second.pktRetransmit*100)/it->second.pktCount);
+        }else{
+          rep.value(0);
+        }
       }
-    }
-    rep["data"].append(d);
-    if (prevT){
-      if (i.size() < 2){
-        i.append(1u);
-        i.append(it->first - prevT);
-      }else{
-        if (i[1u].asInt() != it->first - prevT){
-          rep["interval"].append(i);
-          i[0u] = 1u;
-          i[1u] = it->first - prevT;
+      rep.arrayEnd();
+      if (prevT){
+        if (i.size() < 2){
+          i.append(1u);
+          i.append(it->first - prevT);
         }else{
-          i[0u] = i[0u].asInt() + 1;
+          if (i[1u].asInt() != it->first - prevT){
+            interval.append(i);
+            i[0u] = 1u;
+            i[1u] = it->first - prevT;
+          }else{
+            i[0u] = i[0u].asInt() + 1;
+          }
         }
       }
+      prevT = it->first;
     }
-    prevT = it->first;
+    if (i.size() > 1){
+      interval.append(i);
+      i.null();
+    }
+    rep.arrayEnd();
   }
-  if (i.size() > 1){
-    rep["interval"].append(i);
-    i.null();
+  rep.key("end");
+  if (totalsCount.size()){
+    rep.value(totalsCount.rbegin()->first + (Controller::systemBoot/1000));
+  }else{
+    rep.null();
+  }
+  rep.key("fields");
+  rep.arrayBegin();
+  if (fields & STAT_TOT_CLIENTS){rep.value("clients");}
+  if (fields & STAT_TOT_INPUTS){rep.value("inputs");}
+  if (fields & STAT_TOT_OUTPUTS){rep.value("outputs");}
+  if (fields & STAT_TOT_BPS_DOWN){rep.value("downbps");}
+  if (fields & STAT_TOT_BPS_UP){rep.value("upbps");}
+  if (fields & STAT_TOT_PERCLOST){rep.value("perc_lost");}
+  if (fields & STAT_TOT_PERCRETRANS){rep.value("perc_retrans");}
+  rep.arrayEnd();
+  rep.key("interval");
+  rep.value(interval);
+  rep.key("start");
+  if (totalsCount.size()){
+    rep.value(totalsCount.begin()->first + (Controller::systemBoot/1000));
+  }else{
+    rep.null();
   }
-  // all done! return is by reference, so no need to return anything here.
+  rep.objectEnd();
+}
+
+/// This takes a "totals" request, and fills in the response data.
+/// Builds the whole response in memory; the HTTP API writes it out directly instead.
+void Controller::fillTotals(JSON::Value &req, JSON::Value &rep){
+  JSON::Writer w;
+  fillTotals(req, w);
+  rep = JSON::fromString(w.str());
+}
+
+/// Returns the total amount of asynchronous triggers queued in all processes, forgetting about
+/// processes that have not reported in for a minute.
+static uint64_t triggerQueueDepth(){
+  uint64_t total = 0;
+  uint64_t now = Util::bootSecs();
+  std::map<uint64_t, Controller::triggerQueue>::iterator it = Controller::triggerQueues.begin();
+  while (it != Controller::triggerQueues.end()){
+    if (it->second.lastSeen + 60 < now){
+      Controller::triggerQueues.erase(it++);
+      continue;
+    }
+    total += it->second.depth;
+    ++it;
+  }
+  return total;
 }
 
 void Controller::handlePrometheus(HTTP::Parser &H, Socket::Connection &conn, int mode){
@@ -1711,26 +1747,16 @@ void Controller::handlePrometheus(HTTP::Parser &H, Socket::Connection &conn, int
   H.SetHeader("Server", APPIDENT);
   H.StartResponse("200", "OK", H, conn, true);
 
-  // Counters of current active viewers, inputs and outputs of the Session stats cache
+  // Counters of current active viewers, inputs and outputs, as kept up to date by the stats thread
   std::map<std::string, uint32_t> outputs;
-  uint32_t totViewers = 0;
-  uint32_t totInputs = 0;
-  uint32_t totOutputs = 0;
-  uint32_t totUnspecified = 0;
-  for (uint64_t idx = 0; idx < statComm.recordCount(); idx++){
-    if (statComm.getStatus(idx) == COMM_STATUS_INVALID || statComm.getStatus(idx) & COMM_STATUS_DISCONNECT){continue;}
-    const std::string thisSessId = statComm.getSessId(idx);
-    // Count active viewers, inputs, outputs and protocols
-    if (thisSessId[0] == 'I'){
-      totInputs++;
-    }else if (thisSessId[0] == 'U'){
-      totUnspecified++;
-    }else if (thisSessId[0] == 'O'){
-      totOutputs++;
-    }else{
-      totViewers++;
-      outputs[statComm.getConnector(idx)]++;
-    }
+  uint32_t totViewers, totInputs, totOutputs, totUnspecified;
+  {
+    tthread::lock_guard<tthread::recursive_mutex> guard(statsMutex);
+    outputs = activeProtocols;
+    totViewers = activeViewers;
+    totInputs = activeInputs;
+    totOutputs = activeOutputs;
+    totUnspecified = activeUnspecified;
   }
 
   // Collect core server stats
@@ -1864,6 +1890,12 @@ void Controller::handlePrometheus(HTTP::Parser &H, Socket::Connection &conn, int
       response << "# TYPE mist_bw counter\n";
       response << "# HELP mist_packets Total number of packets sent/received/lost over lossy protocols.\n";
       response << "# TYPE mist_packets counter\n";
+      response << "# HELP mist_segment_cache Segment lookups in the shared segment cache, by result.\n";
+      response << "# TYPE mist_segment_cache counter\n";
+      response << "# HELP mist_segment_cache_evictions Segments evicted from the shared segment cache.\n";
+      response << "# TYPE mist_segment_cache_evictions counter\n";
+      response << "# HELP mist_segment_cache_bytes Count of bytes stored in the shared segment cache.\n";
+      response << "# TYPE mist_segment_cache_bytes counter\n";
       for (std::map<std::string, struct streamTotals>::iterator it = streamStats.begin();
             it != streamStats.end(); ++it){
         response << "mist_sessions{stream=\"" << it->first << "\",sessType=\"viewers\"}"
@@ -1881,20 +1913,50 @@ void Controller::handlePrometheus(HTTP::Parser &H, Socket::Connection &conn, int
         response << "mist_packets{stream=\"" << it->first << "\",pkttype=\"sent\"}" << it->second.packSent << "\n";
         response << "mist_packets{stream=\"" << it->first << "\",pkttype=\"lost\"}" << it->second.packLoss << "\n";
         response << "mist_packets{stream=\"" << it->first << "\",pkttype=\"retrans\"}" << it->second.packRetrans << "\n";
+        Util::SegmentCache segCache;
+        segCache.reload(it->first, false);
+        if (segCache){
+          uint64_t hits, misses, evictions, bytes;
+          segCache.getStats(hits, misses, evictions, bytes);
+          response << "mist_segment_cache{stream=\"" << it->first << "\",result=\"hit\"}" << hits << "\n";
+          response << "mist_segment_cache{stream=\"" << it->first << "\",result=\"miss\"}" << misses << "\n";
+          response << "mist_segment_cache_evictions{stream=\"" << it->first << "\"}" << evictions << "\n";
+          response << "mist_segment_cache_bytes{stream=\"" << it->first << "\"}" << bytes << "\n";
+        }
       }
 
       if (Controller::triggerStats.size()){
         response << "\n# HELP mist_trigger_count Total executions for the given trigger\n";
         response << "# HELP mist_trigger_time Total execution time in millis for the given trigger\n";
         response << "# HELP mist_trigger_fails Total failed executions for the given trigger\n";
+        response << "# HELP mist_trigger_cache Cached response lookups for the given trigger\n";
+        response << "# HELP mist_trigger_latency Execution time in millis for the given trigger, for asynchronous triggers including time queued\n";
+        response << "# TYPE mist_trigger_latency histogram\n";
         for (std::map<std::string, Controller::triggerLog>::iterator it = Controller::triggerStats.begin();
             it != Controller::triggerStats.end(); it++){
           response << "mist_trigger_count{trigger=\"" << it->first << "\"}" << it->second.totalCount << "\n";
           response << "mist_trigger_time{trigger=\"" << it->first << "\"}" << it->second.ms << "\n";
           response << "mist_trigger_fails{trigger=\"" << it->first << "\"}" << it->second.failCount << "\n";
+          if (it->second.cacheHits || it->second.cacheMisses){
+            response << "mist_trigger_cache{trigger=\"" << it->first << "\",result=\"hit\"}" << it->second.cacheHits << "\n";
+            response << "mist_trigger_cache{trigger=\"" << it->first << "\",result=\"miss\"}" << it->second.cacheMisses << "\n";
+          }
+          uint64_t cumulative = 0;
+          for (size_t i = 0; i < TRIGGER_LATENCY_BUCKETS; ++i){
+            cumulative += it->second.latency[i];
+            response << "mist_trigger_latency_bucket{trigger=\"" << it->first << "\",le=\"" << triggerLatencyBounds[i]
+                     << "\"}" << cumulative << "\n";
+          }
+          response << "mist_trigger_latency_bucket{trigger=\"" << it->first << "\",le=\"+Inf\"}" << it->second.totalCount << "\n";
+          response << "mist_trigger_latency_sum{trigger=\"" << it->first << "\"}" << it->second.ms << "\n";
+          response << "mist_trigger_latency_count{trigger=\"" << it->first << "\"}" << it->second.totalCount << "\n";
         }
         response << "\n";
       }
+      if (Controller::triggerQueues.size()){
+        response << "# HELP mist_trigger_queue Asynchronous triggers currently queued for sending\n";
+        response << "mist_trigger_queue " << triggerQueueDepth() << "\n\n";
+      }
     }
     H.Chunkify(response.str(), conn);
   }
@@ -1934,8 +1996,14 @@ void Controller::handlePrometheus(HTTP::Parser &H, Socket::Connection &conn, int
           tVal["count"] = it->second.totalCount;
           tVal["ms"] = it->second.ms;
           tVal["fails"] = it->second.failCount;
+          if (it->second.cacheHits || it->second.cacheMisses){
+            tVal["cache_hits"] = it->second.cacheHits;
+            tVal["cache_misses"] = it->second.cacheMisses;
+          }
+          for (size_t i = 0; i < TRIGGER_LATENCY_BUCKETS; ++i){tVal["latency"].append(it->second.latency[i]);}
         }
       }
+      if (Controller::triggerQueues.size()){resp["trigger_queue"] = triggerQueueDepth();}
       if (Storage["config"].isMember("location") && Storage["config"]["location"].isMember("lat") && Storage["config"]["location"].isMember("lon")){
         resp["loc"]["lat"] = Storage["config"]["location"]["lat"].asDouble();
         resp["loc"]["lon"] = Storage["config"]["location"]["lon"].asDouble();
@@ -1960,6 +2028,16 @@ void Controller::handlePrometheus(HTTP::Parser &H, Socket::Connection &conn, int
         resp["streams"][it->first]["pkts"].append(it->second.packSent);
         resp["streams"][it->first]["pkts"].append(it->second.packLoss);
         resp["streams"][it->first]["pkts"].append(it->second.packRetrans);
+        Util::SegmentCache segCache;
+        segCache.reload(it->first, false);
+        if (segCache){
+          uint64_t hits, misses, evictions, bytes;
+          segCache.getStats(hits, misses, evictions, bytes);
+          resp["streams"][it->first]["segcache"].append(hits);
+          resp["streams"][it->first]["segcache"].append(misses);
+          resp["streams"][it->first]["segcache"].append(evictions);
+          resp["streams"][it->first]["segcache"].append(bytes);
+        }
       }
       for (std::map<std::string, uint32_t>::iterator it = outputs.begin(); it != outputs.end(); ++it){
         resp["output_counts"][it->first] = it->second;
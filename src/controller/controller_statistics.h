@@ -1,4 +1,5 @@
 #pragma once
+#include "controller_totals.h"
 #include <map>
 #include <mist/comms.h>
 #include <mist/defines.h>
@@ -8,11 +9,7 @@
 #include <mist/socket.h>
 #include <mist/timing.h>
 #include <string>
-
-/// The STAT_CUTOFF define sets how many seconds of statistics history is kept.
-#ifndef STAT_CUTOFF
-#define STAT_CUTOFF 600
-#endif
+#include <vector>
 
 namespace Controller{
 
@@ -25,30 +22,6 @@ namespace Controller{
 
   void updateBandwidthConfig();
 
-  struct statLog{
-    uint64_t time;
-    uint64_t firstActive;
-    uint64_t lastSecond;
-    uint64_t down;
-    uint64_t up;
-    uint64_t pktCount;
-    uint64_t pktLost;
-    uint64_t pktRetransmit;
-    std::string streamName;
-    std::string host;
-    std::string connectors;
-  };
-
-  enum sessType{SESS_UNSET = 0, SESS_INPUT, SESS_OUTPUT, SESS_VIEWER, SESS_UNSPECIFIED};
-
-  class statStorage{
-  public:
-    void update(Comms::Sessions &statComm, size_t index);
-    bool hasDataFor(unsigned long long);
-    statLog &getDataFor(unsigned long long);
-    std::map<unsigned long long, statLog> log;
-  };
-
   /// A session class that keeps track of both current and archived connections.
   /// Allows for moving of connections to another session.
   class statSession{
@@ -56,6 +29,7 @@ namespace Controller{
     sessType sessionType;
     uint8_t noBWCount; ///< Set to 2 when not to count for external bandwidth
     std::string sessId;
+    sessionTotals totals; ///< What this session added to the running totals
 
   public:
     statSession();
@@ -64,6 +38,8 @@ namespace Controller{
     std::set<std::string> tags;
     sessType getSessType();
     void update(uint64_t index, Comms::Sessions &data);
+    void updateTotals(uint64_t until);
+    void wipeTotals();
     uint64_t getStart();
     uint64_t getEnd();
     bool hasDataFor(uint64_t time);
@@ -98,13 +74,27 @@ namespace Controller{
 
   extern uint64_t statDropoff;
 
+#define TRIGGER_LATENCY_BUCKETS 8
+  /// Upper bounds in milliseconds of the buckets of the trigger execution time histogram
+  static const uint64_t triggerLatencyBounds[TRIGGER_LATENCY_BUCKETS] = {10, 50, 100, 250, 500, 1000, 5000, 10000};
+
   struct triggerLog{
     uint64_t totalCount;
     uint64_t failCount;
     uint64_t ms;
+    uint64_t cacheHits;
+    uint64_t cacheMisses;
+    uint64_t latency[TRIGGER_LATENCY_BUCKETS]; ///< Executions per bucket, not cumulative
+  };
+
+  /// Asynchronous triggers queued in a process, as last reported by it
+  struct triggerQueue{
+    uint64_t depth;
+    uint64_t lastSeen;
   };
 
   extern std::map<std::string, triggerLog> triggerStats;
+  extern std::map<uint64_t, triggerQueue> triggerQueues;
 
   void statLeadIn();
   void statOnActive(size_t id);
@@ -114,9 +104,11 @@ namespace Controller{
   std::set<std::string> getActiveStreams(const std::string &prefix = "");
   void killStatistics(char *data, size_t len, unsigned int id);
   void fillClients(JSON::Value &req, JSON::Value &rep);
+  void fillClients(JSON::Value &req, JSON::Writer &rep);
   void fillActive(JSON::Value &req, JSON::Value &rep);
   void fillHasStats(JSON::Value &req, JSON::Value &rep);
   void fillTotals(JSON::Value &req, JSON::Value &rep);
+  void fillTotals(JSON::Value &req, JSON::Writer &rep);
   void SharedMemStats(void *config);
   void sessions_invalidate(const std::string &streamname);
   void sessions_shutdown(JSON::Iter &i);
@@ -130,6 +122,7 @@ namespace Controller{
   bool hasViewers(std::string streamName);
   void writeSessionCache(); /*LTS*/
   void killConnections(std::string sessId);
+  void checkSessionTracker();
 
   bool streamMatches(const std::string &stream, const std::string &matchString);
 
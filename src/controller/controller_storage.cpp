@@ -669,6 +669,7 @@ namespace Controller{
 
     /*LTS-START*/
     static std::map<std::string, IPC::sharedPage> pageForType; // should contain one page for every trigger type
+    static IPC::sharedPage trigCache; // cached responses of blocking triggers
     static JSON::Value writtenTrigs;
     char tmpBuf[NAME_BUFFER_SIZE];
 
@@ -676,6 +677,12 @@ namespace Controller{
       writtenTrigs = Storage["config"]["triggers"];
       // for all shm pages that hold triggers
       pageForType.clear();
+      // Cached responses may no longer apply to the new configuration
+      bool useCache = false;
+      if (trigCache){
+        trigCache.master = true;
+        trigCache.close();
+      }
 
       if (Storage["config"]["triggers"].size()){
         jsonForEach(Storage["config"]["triggers"], it){
@@ -694,6 +701,9 @@ namespace Controller{
           tPage.addField("streams", RAX_256RAW);
           tPage.addField("params", RAX_128STRING);
           tPage.addField("default", RAX_128STRING);
+          tPage.addField("cache_ok", RAX_32UINT);
+          tPage.addField("cache_fail", RAX_32UINT);
+          tPage.addField("cache_key", RAX_64UINT);
           tPage.setReady();
           uint32_t i = 0;
           uint32_t max = (32 * 1024 - tPage.getOffset()) / tPage.getRSize();
@@ -754,6 +764,19 @@ namespace Controller{
               }else{
                 tPage.setString("default", "", i);
               }
+              uint64_t cacheOk = triggIt->isMember("cache_ok") ? (*triggIt)["cache_ok"].asInt() : 0;
+              uint64_t cacheFail = triggIt->isMember("cache_fail") ? (*triggIt)["cache_fail"].asInt() : 0;
+              // Payload line numbers start at 1, bit 0 is the first line
+              uint64_t cacheKey = 0;
+              if (triggIt->isMember("cache_key") && (*triggIt)["cache_key"].isArray()){
+                jsonForEach((*triggIt)["cache_key"], kIt){
+                  if (kIt->asInt() >= 1 && kIt->asInt() <= 64){cacheKey |= 1ull << (kIt->asInt() - 1);}
+                }
+              }
+              tPage.setInt("cache_ok", cacheOk, i);
+              tPage.setInt("cache_fail", cacheFail, i);
+              tPage.setInt("cache_key", cacheKey, i);
+              if (tPage.getInt("sync", i) && (cacheOk || cacheFail)){useCache = true;}
             }
 
             ++i;
@@ -762,6 +785,25 @@ namespace Controller{
           tPage.setEndPos(std::min(i, max));
         }
       }
+      if (useCache){
+        // Remove any page left behind by an earlier run
+        trigCache.init(SHM_TRIGGER_CACHE, 0, false, false);
+        if (trigCache){
+          trigCache.master = true;
+          trigCache.close();
+        }
+        trigCache.init(SHM_TRIGGER_CACHE, SHM_TRIGGER_CACHE_SIZE, true, false);
+        Util::RelAccX cPage(trigCache.mapped, false);
+        cPage.addField("key", RAX_64UINT);
+        cPage.addField("expires", RAX_64UINT);
+        cPage.addField("match", RAX_256STRING);
+        cPage.addField("response", RAX_256STRING);
+        uint32_t max = (SHM_TRIGGER_CACHE_SIZE - cPage.getOffset()) / cPage.getRSize();
+        cPage.setRCount(max);
+        cPage.setEndPos(max);
+        cPage.setReady();
+        addShmPage(SHM_TRIGGER_CACHE);
+      }
     }
 
     static bool serverStartTriggered;
@@ -0,0 +1,396 @@
+#include "controller_totals.h"
+#include <cstring>
+#include <mist/timing.h>
+
+static const Controller::statLabels emptyLabels = Controller::statLabels();
+
+Controller::totalsData::totalsData(){
+  clients = 0;
+  inputs = 0;
+  outputs = 0;
+  unspecified = 0;
+  downbps = 0;
+  upbps = 0;
+  pktCount = 0;
+  pktLost = 0;
+  pktRetransmit = 0;
+}
+
+void Controller::totalsData::add(uint64_t down, uint64_t up, sessType sT, uint64_t pCount, uint64_t pLost, uint64_t pRetransmit){
+  switch (sT){
+  case SESS_VIEWER: clients++; break;
+  case SESS_INPUT: inputs++; break;
+  case SESS_OUTPUT: outputs++; break;
+  case SESS_UNSPECIFIED: unspecified++; break;
+  default: break;
+  }
+  downbps += down;
+  upbps += up;
+  pktCount += pCount;
+  pktLost += pLost;
+  pktRetransmit += pRetransmit;
+}
+
+void Controller::totalsData::add(const totalsData &d){
+  clients += d.clients;
+  inputs += d.inputs;
+  outputs += d.outputs;
+  unspecified += d.unspecified;
+  downbps += d.downbps;
+  upbps += d.upbps;
+  pktCount += d.pktCount;
+  pktLost += d.pktLost;
+  pktRetransmit += d.pktRetransmit;
+}
+
+void Controller::totalsData::remove(const totalsData &d){
+  clients -= d.clients;
+  inputs -= d.inputs;
+  outputs -= d.outputs;
+  unspecified -= d.unspecified;
+  downbps -= d.downbps;
+  upbps -= d.upbps;
+  pktCount -= d.pktCount;
+  pktLost -= d.pktLost;
+  pktRetransmit -= d.pktRetransmit;
+}
+
+bool Controller::totalsData::operator==(const totalsData &d) const{
+  return clients == d.clients && inputs == d.inputs && outputs == d.outputs && unspecified == d.unspecified &&
+         downbps == d.downbps && upbps == d.upbps && pktCount == d.pktCount && pktLost == d.pktLost &&
+         pktRetransmit == d.pktRetransmit;
+}
+
+/// Adds the statistics of a session for second t.
+void Controller::statTotals::add(uint64_t t, const std::string &stream, const std::string &protocol, const totalsData &d){
+  seconds[t][std::make_pair(stream, protocol)].add(d);
+}
+
+/// Removes statistics previously added for second t, e.g. because newer data for that second came in.
+void Controller::statTotals::remove(uint64_t t, const std::string &stream, const std::string &protocol, const totalsData &d){
+  std::map<uint64_t, secondTotals>::iterator it = seconds.find(t);
+  if (it == seconds.end()){return;}
+  secondTotals::iterator jt = it->second.find(std::make_pair(stream, protocol));
+  if (jt == it->second.end()){return;}
+  jt->second.remove(d);
+  if (jt->second == totalsData()){
+    it->second.erase(jt);
+    if (!it->second.size()){seconds.erase(it);}
+  }
+}
+
+/// Forgets all seconds before the given one.
+void Controller::statTotals::wipe(uint64_t before){
+  seconds.erase(seconds.begin(), seconds.lower_bound(before));
+}
+
+/// Sums up the totals of every second from start to end (inclusive) into out, for the given
+/// streams and protocols only. Empty sets match everything. Seconds without matching data are
+/// left out.
+void Controller::statTotals::fill(uint64_t start, uint64_t end, const std::set<std::string> &streams,
+                                  const std::set<std::string> &protos, std::map<uint64_t, totalsData> &out) const{
+  std::map<uint64_t, secondTotals>::const_iterator it = seconds.lower_bound(start);
+  for (; it != seconds.end() && it->first <= end; ++it){
+    for (secondTotals::const_iterator jt = it->second.begin(); jt != it->second.end(); ++jt){
+      if (streams.size() && !streams.count(jt->first.first)){continue;}
+      if (protos.size() && !protos.count(jt->first.second)){continue;}
+      out[it->first].add(jt->second);
+    }
+  }
+}
+
+Controller::statStorage::statStorage(){
+  head = 0;
+  count = 0;
+  firstActive = 0;
+  memset(first, 0, sizeof(first));
+  memset(last, 0, sizeof(last));
+}
+
+/// Returns true if there is data available for timestamp t.
+bool Controller::statStorage::hasDataFor(uint64_t t) const{
+  if (!count){return false;}
+  return (t >= rec(0).now);
+}
+
+/// Returns the amount of seconds of statistics stored.
+size_t Controller::statStorage::size() const{
+  return count;
+}
+
+/// Returns the timestamp of the oldest statistics stored, or zero if there are none.
+uint64_t Controller::statStorage::getStart() const{
+  return count ? rec(0).now : 0;
+}
+
+/// Returns the timestamp of the newest statistics stored, or zero if there are none.
+uint64_t Controller::statStorage::getEnd() const{
+  return count ? rec(count - 1).now : 0;
+}
+
+/// Returns the time at which the session became active, or zero if it ended.
+uint64_t Controller::statStorage::getFirstActive() const{
+  return firstActive;
+}
+
+/// Returns the position of the most current data available at timestamp t, or of the oldest data
+/// if there is none that old. Must not be called when there is no data at all.
+size_t Controller::statStorage::getPos(uint64_t t) const{
+  if (t >= rec(count - 1).now){return count - 1;}
+  size_t lo = 0, hi = count;
+  while (lo < hi){
+    size_t mid = lo + (hi - lo) / 2;
+    if (rec(mid).now > t){
+      hi = mid;
+    }else{
+      lo = mid + 1;
+    }
+  }
+  return lo ? lo - 1 : 0;
+}
+
+/// Returns the data at the given position.
+const Controller::statRecord &Controller::statStorage::at(size_t pos) const{
+  return rec(pos);
+}
+
+/// Returns the stream name, host and connectors of the data at the given position.
+const Controller::statLabels &Controller::statStorage::getLabels(size_t pos) const{
+  uint16_t idx = rec(pos).labels;
+  if (idx == STAT_NO_LABELS){return emptyLabels;}
+  return labels[idx];
+}
+
+/// Returns the value of the given counter at the given position.
+/// Walks back from the newest data, as that is what is asked for most. If the counter restarted in
+/// between, walks forward from the oldest data instead.
+uint64_t Controller::statStorage::getCounter(size_t pos, statCounter c) const{
+  uint64_t v = last[c];
+  for (size_t i = count - 1; i > pos; --i){
+    const statRecord &r = rec(i);
+    if (r.resets & (1 << c)){
+      v = first[c];
+      for (size_t j = 1; j <= pos; ++j){
+        const statRecord &f = rec(j);
+        v = (f.resets & (1 << c)) ? f.delta[c] : v + f.delta[c];
+      }
+      return v;
+    }
+    v -= r.delta[c];
+  }
+  return v;
+}
+
+/// Returns the increase of the given counter from position posA to position posB, or zero if
+/// the counter went down in between (e.g. because the session ended).
+uint64_t Controller::statStorage::getIncrease(size_t posA, size_t posB, statCounter c) const{
+  uint64_t v = 0;
+  for (size_t i = posA + 1; i <= posB; ++i){
+    const statRecord &r = rec(i);
+    if (r.resets & (1 << c)){
+      uint64_t a = getCounter(posA, c);
+      uint64_t b = getCounter(posB, c);
+      return (b > a) ? b - a : 0;
+    }
+    v += r.delta[c];
+  }
+  return v;
+}
+
+/// Returns the average increase per second of the given counter over the 5 seconds up to t.
+uint64_t Controller::statStorage::getBps(uint64_t t, statCounter c) const{
+  if (!count){return 0;}
+  uint64_t aTime = t - 5;
+  if (aTime < getStart()){aTime = getStart();}
+  if (t <= aTime){return 0;}
+  return getIncrease(getPos(aTime), getPos(t), c) / (t - aTime);
+}
+
+/// Appends a second of data, with the given counter values.
+/// Counters are stored as the increase since the previous second, or as the value itself if it
+/// went down. Increases or values that do not fit 32 bits are capped.
+void Controller::statStorage::push(const statRecord &r, const uint64_t *values){
+  if (count == records.size()){
+    if (records.size() < STAT_CUTOFF + 2){
+      // Grow the ring, unwrapping it while at it
+      size_t newSize = records.size() ? records.size() * 2 : 8;
+      if (newSize > STAT_CUTOFF + 2){newSize = STAT_CUTOFF + 2;}
+      std::vector<statRecord> newRecords(newSize);
+      for (size_t i = 0; i < count; ++i){newRecords[i] = rec(i);}
+      records.swap(newRecords);
+      head = 0;
+    }else{
+      popFront();
+    }
+  }
+  statRecord &n = rec(count);
+  n = r;
+  n.resets = 0;
+  for (size_t c = 0; c < STAT_COUNTERS; ++c){
+    uint64_t d;
+    if (!count || values[c] < last[c]){
+      n.resets |= (1 << c);
+      d = values[c];
+    }else{
+      d = values[c] - last[c];
+    }
+    if (d > 0xFFFFFFFFull){d = 0xFFFFFFFFull;}
+    n.delta[c] = d;
+    last[c] = (n.resets & (1 << c)) ? d : last[c] + d;
+    if (!count){first[c] = last[c];}
+  }
+  ++count;
+}
+
+/// Removes the oldest second of data.
+void Controller::statStorage::popFront(){
+  head = (head + 1) % records.size();
+  --count;
+  if (!count){return;}
+  const statRecord &r = rec(0);
+  for (size_t c = 0; c < STAT_COUNTERS; ++c){
+    first[c] = (r.resets & (1 << c)) ? r.delta[c] : first[c] + r.delta[c];
+  }
+}
+
+/// Removes the newest second of data.
+void Controller::statStorage::popBack(){
+  if (count == 1){
+    count = 0;
+    head = 0;
+    return;
+  }
+  const statRecord &r = rec(count - 1);
+  for (size_t c = 0; c < STAT_COUNTERS; ++c){
+    if (r.resets & (1 << c)){
+      last[c] = getCounter(count - 2, (statCounter)c);
+    }else{
+      last[c] -= r.delta[c];
+    }
+  }
+  --count;
+}
+
+/// Inserts a null datapoint one second after the last datapoint, marking the end of the session.
+void Controller::statStorage::finish(){
+  if (!count){return;}
+  statRecord r;
+  memset(&r, 0, sizeof(r));
+  r.now = getEnd() + 1;
+  r.labels = STAT_NO_LABELS;
+  r.empty = 1;
+  uint64_t values[STAT_COUNTERS] = {0};
+  push(r, values);
+  firstActive = 0;
+}
+
+/// This function is called by parseStatistics.
+/// It updates the internally saved statistics data.
+void Controller::statStorage::update(Comms::Sessions &statComm, size_t index){
+  uint64_t values[STAT_COUNTERS];
+  values[STAT_DOWN] = statComm.getDown(index);
+  values[STAT_UP] = statComm.getUp(index);
+  values[STAT_PKTCOUNT] = statComm.getPacketCount(index);
+  values[STAT_PKTLOST] = statComm.getPacketLostCount(index);
+  values[STAT_PKTRETRANSMIT] = statComm.getPacketRetransmitCount(index);
+  update(statComm.getNow(index), statComm.getTime(index), statComm.getLastSecond(index), values,
+         statComm.getStream(index), statComm.getHost(index), statComm.getConnector(index));
+}
+
+/// Stores the statistics of a session for second now, with the counter values in the order of
+/// statCounter. Newer data for the same second replaces the older data.
+void Controller::statStorage::update(uint64_t now, uint64_t time, uint64_t lastSecond, const uint64_t *values,
+                                     const std::string &streamName, const std::string &host,
+                                     const std::string &connectors){
+  if (count && rec(count - 1).now == now){popBack();}
+  if (!count || !firstActive){firstActive = now;}
+
+  statRecord tmp;
+  tmp.now = now;
+  tmp.time = time;
+  tmp.lastSecond = lastSecond;
+  tmp.empty = 0;
+
+  // Stream, host and connectors hardly ever change, so are only stored once per combination
+  tmp.labels = STAT_NO_LABELS;
+  for (size_t i = labels.size(); i > 0; --i){
+    const statLabels &L = labels[i - 1];
+    if (L.streamName == streamName && L.host == host && L.connectors == connectors){
+      tmp.labels = i - 1;
+      break;
+    }
+  }
+  if (tmp.labels == STAT_NO_LABELS){
+    if (labels.size() < STAT_NO_LABELS){labels.resize(labels.size() + 1);}
+    statLabels &L = labels.back();
+    L.streamName = streamName;
+    L.host = host;
+    L.connectors = connectors;
+    tmp.labels = labels.size() - 1;
+  }
+  push(tmp, values);
+
+  // wipe data older than STAT_CUTOFF seconds
+  // Ensure cutOffPoint is either time of boot or 10 minutes ago, whichever is closer.
+  // Prevents wrapping around to high values close to system boot time.
+  uint64_t cutOffPoint = Util::bootSecs();
+  if (cutOffPoint > STAT_CUTOFF){
+    cutOffPoint -= STAT_CUTOFF;
+  }else{
+    cutOffPoint = 0;
+  }
+  while (count && rec(0).now < cutOffPoint){popFront();}
+}
+
+Controller::sessionTotals::sessionTotals(){
+  next = 0;
+}
+
+/// Adds the statistics of a session to the running totals, for every second from where the
+/// previous call left off up to and including until (or the newest statistics, if those are newer).
+/// Seconds that were forward-filled earlier and are now covered by newer statistics are replaced.
+/// Seconds after the end of a finished session are not counted.
+void Controller::sessionTotals::update(statTotals &T, const statStorage &S, sessType sT, uint64_t until){
+  if (!S.size()){return;}
+  uint64_t end = S.getEnd();
+  while (added.size() && added.back().t >= end){
+    const addedSecond &A = added.back();
+    T.remove(A.t, A.stream, A.proto, A.d);
+    if (next > A.t){next = A.t;}
+    added.pop_back();
+  }
+  if (until < end){until = end;}
+  uint64_t t = next ? next : S.getStart();
+  if (t > end){t = end;}
+  for (; t <= until; ++t){
+    size_t pos = S.getPos(t);
+    if (S.at(pos).empty){continue;}
+    const statLabels &L = S.getLabels(pos);
+    totalsData d;
+    d.add(S.getBps(t, STAT_DOWN), S.getBps(t, STAT_UP), sT, S.getCounter(pos, STAT_PKTCOUNT),
+          S.getCounter(pos, STAT_PKTLOST), S.getCounter(pos, STAT_PKTRETRANSMIT));
+    T.add(t, L.streamName, L.connectors, d);
+    // Only seconds from the newest statistics on can change later on
+    if (t >= end){
+      addedSecond A;
+      A.t = t;
+      A.stream = L.streamName;
+      A.proto = L.connectors;
+      A.d = d;
+      added.push_back(A);
+    }
+  }
+  next = until + 1;
+  // Everything before the newest statistics is final now
+  while (added.size() && added.front().t < end){added.pop_front();}
+}
+
+/// Removes the seconds that may still change from the running totals.
+/// Used when the session is wiped, after which nothing may refer to it.
+void Controller::sessionTotals::clear(statTotals &T){
+  while (added.size()){
+    const addedSecond &A = added.back();
+    T.remove(A.t, A.stream, A.proto, A.d);
+    added.pop_back();
+  }
+}
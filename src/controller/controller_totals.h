@@ -0,0 +1,139 @@
+#pragma once
+#include <deque>
+#include <map>
+#include <mist/comms.h>
+#include <set>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/// The STAT_CUTOFF define sets how many seconds of statistics history is kept.
+#ifndef STAT_CUTOFF
+#define STAT_CUTOFF 600
+#endif
+
+/// Label index of statistics records that have no labels
+#define STAT_NO_LABELS 0xFFFF
+
+namespace Controller{
+
+  enum sessType{SESS_UNSET = 0, SESS_INPUT, SESS_OUTPUT, SESS_VIEWER, SESS_UNSPECIFIED};
+
+  /// Sum of the statistics of a group of sessions during a single second.
+  class totalsData{
+  public:
+    totalsData();
+    void add(uint64_t down, uint64_t up, sessType sT, uint64_t pCount, uint64_t pLost, uint64_t pRetransmit);
+    void add(const totalsData &d);
+    void remove(const totalsData &d);
+    bool operator==(const totalsData &d) const;
+    uint64_t clients;
+    uint64_t inputs;
+    uint64_t outputs;
+    uint64_t unspecified;
+    uint64_t downbps;
+    uint64_t upbps;
+    uint64_t pktCount;
+    uint64_t pktLost;
+    uint64_t pktRetransmit;
+  };
+
+  /// Running per-second totals of all sessions, per stream and protocol.
+  /// Sessions add their statistics as they come in, so that answering a totals request only needs
+  /// to go over the streams and protocols of the requested seconds, not over every session.
+  class statTotals{
+  public:
+    void add(uint64_t t, const std::string &stream, const std::string &protocol, const totalsData &d);
+    void remove(uint64_t t, const std::string &stream, const std::string &protocol, const totalsData &d);
+    void wipe(uint64_t before);
+    void fill(uint64_t start, uint64_t end, const std::set<std::string> &streams,
+              const std::set<std::string> &protos, std::map<uint64_t, totalsData> &out) const;
+
+  private:
+    typedef std::map<std::pair<std::string, std::string>, totalsData> secondTotals;
+    std::map<uint64_t, secondTotals> seconds;
+  };
+
+  /// Session statistics that rarely change during a session.
+  /// Stored once per distinct combination per session, and referred to by index from each second
+  /// of statistics.
+  struct statLabels{
+    std::string streamName;
+    std::string host;
+    std::string connectors;
+  };
+
+  /// Cumulative session counters. These are stored per second as the increase since the
+  /// previous second.
+  enum statCounter{STAT_DOWN = 0, STAT_UP, STAT_PKTCOUNT, STAT_PKTLOST, STAT_PKTRETRANSMIT, STAT_COUNTERS};
+
+  /// One second of statistics of a single session.
+  struct statRecord{
+    uint32_t now;        ///< Boot time in seconds at which these statistics were taken
+    uint32_t time;       ///< Cumulative connected time in seconds
+    uint64_t lastSecond; ///< Last requested media timestamp
+    uint32_t delta[STAT_COUNTERS]; ///< Increase of each counter since the previous record
+    uint16_t labels;     ///< Index into statStorage::labels, or STAT_NO_LABELS
+    uint8_t resets;      ///< Bit (1 << counter) set if that counter restarted from zero at this record
+    uint8_t empty;       ///< Set for the null datapoint that marks the end of a session
+  };
+
+  /// Ring buffer holding the last STAT_CUTOFF seconds of statistics of a single session.
+  /// Grows as needed, so short sessions only take the memory they need.
+  class statStorage{
+  public:
+    statStorage();
+    void update(Comms::Sessions &statComm, size_t index);
+    void update(uint64_t now, uint64_t time, uint64_t lastSecond, const uint64_t *values,
+                const std::string &streamName, const std::string &host, const std::string &connectors);
+    void finish();
+    bool hasDataFor(uint64_t t) const;
+    size_t size() const;
+    uint64_t getStart() const;
+    uint64_t getEnd() const;
+    uint64_t getFirstActive() const;
+    size_t getPos(uint64_t t) const;
+    const statRecord &at(size_t pos) const;
+    const statLabels &getLabels(size_t pos) const;
+    uint64_t getCounter(size_t pos, statCounter c) const;
+    uint64_t getIncrease(size_t posA, size_t posB, statCounter c) const;
+    uint64_t getBps(uint64_t t, statCounter c) const;
+
+  private:
+    std::vector<statRecord> records;
+    size_t head;  ///< Position of the oldest record in records
+    size_t count; ///< Number of records in use
+    std::vector<statLabels> labels;
+    uint64_t firstActive;
+    uint64_t first[STAT_COUNTERS]; ///< Counter values at the oldest record
+    uint64_t last[STAT_COUNTERS];  ///< Counter values at the newest record
+    statRecord &rec(size_t pos){return records[(head + pos) % records.size()];}
+    const statRecord &rec(size_t pos) const{return records[(head + pos) % records.size()];}
+    void push(const statRecord &r, const uint64_t *values);
+    void popFront();
+    void popBack();
+  };
+
+  /// What a single session added to the running totals.
+  /// The seconds from the newest statistics of the session up to now are forward-filled with
+  /// those statistics, the same way a full recompute over all sessions would count them, and are
+  /// replaced as soon as newer statistics come in.
+  class sessionTotals{
+  public:
+    sessionTotals();
+    void update(statTotals &T, const statStorage &S, sessType sT, uint64_t until);
+    void clear(statTotals &T);
+
+  private:
+    /// A forward-filled second, that may still need to be replaced
+    struct addedSecond{
+      uint64_t t;
+      std::string stream;
+      std::string proto;
+      totalsData d;
+    };
+    uint64_t next; ///< First second that was not added yet, or zero if nothing was added
+    std::deque<addedSecond> added;
+  };
+
+}// namespace Controller
@@ -44,16 +44,15 @@ namespace Mist{
     DONTEVEN_MSG("User with ID:%zu is on %zu:%zu -> %zu (timestamp %" PRIu64 ")", id, track, key, endKey, time);
     for (size_t i = key; i <= endKey; ){
       const Util::RelAccX &tPages = M.pages(track);
-      Util::RelAccXFieldData firstkeyEntry = tPages.getFieldData("firstkey");
-      Util::RelAccXFieldData keyCountEntry = tPages.getFieldData("keycount");
+      const DTSC::Pages pages = M.getPages(track);
       if (!tPages.getEndPos()){return;}
       DTSC::Keys keys(M.keys(track));
       if (i > keys.getEndValid()){return;}
       bool found = false;
       uint64_t cnt = 1, pageNumber = 0;
       for (uint64_t j = tPages.getDeleted(); j < tPages.getEndPos(); j++){
-        pageNumber = tPages.getInt(firstkeyEntry, j);
-        cnt = tPages.getInt(keyCountEntry, j);
+        pageNumber = pages.getFirstKey(j);
+        cnt = pages.getKeycount(j);
         if (pageNumber <= i && pageNumber + cnt > i){
           found = true;
           break;
@@ -254,6 +253,7 @@ namespace Mist{
     srtTrack = 0;
     lastBufferCheck = 0;
     bufferPid = 0;
+    headerOutdated = false;
     internalOnly = false;
     isBuffer = false;
     startTime = Util::bootSecs();
@@ -287,9 +287,10 @@ namespace Mist{
         return;
       }
       // the same second is not enough - add a 15 second window where we consider it too old
+      // The header is kept, so readExistingHeader can extend it if the file was only appended to
       if (bufHeader.st_mtime < bufStream.st_mtime + 15){
-        INFO_MSG("Overwriting outdated DTSH header file: %s ", headerFile.c_str());
-        remove(headerFile.c_str());
+        INFO_MSG("Outdated DTSH header file: %s ", headerFile.c_str());
+        headerOutdated = true;
       }
 
       // the same second is not enough - add a 15 second window where we consider it too old
@@ -1316,6 +1317,63 @@ namespace Mist{
     return false;
   }
 
+  /// Returns the amount of byte ranges a file of the given size should be split into to generate
+  /// its header in parallel, following the "headerthreads" option: one per thread, of at least
+  /// HEADER_CHUNK_MIN bytes each. Returns 1 if the header should be generated in order instead.
+  size_t Input::headerChunks(uint64_t fileSize){
+    size_t threads = config->getInteger("headerthreads");
+    if (!threads){
+      long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+      threads = cpus > 0 ? cpus : 1;
+    }
+    if (fileSize == std::string::npos){return 1;}
+    uint64_t chunks = fileSize / HEADER_CHUNK_MIN;
+    if (chunks > threads){chunks = threads;}
+    return chunks ? chunks : 1;
+  }
+
+  /// Returns the MD5 hash of the first len bytes of the given URI, or an empty string if there are
+  /// not that many bytes to read.
+  static std::string headPrint(const HTTP::URL &uri, uint64_t len){
+    HTTP::URIReader reader;
+    if (!reader.open(uri)){return "";}
+    std::string head;
+    while (head.size() < len && !reader.isEOF()){
+      char *ptr;
+      size_t got;
+      reader.readSome(ptr, got, len - head.size());
+      if (!got){break;}
+      head.append(ptr, got);
+    }
+    if (head.size() < len){return "";}
+    return Secure::md5(head);
+  }
+
+  /// Stores a fingerprint of the start of the input file with the metadata, so that extending its
+  /// header later can check whether the file was only appended to, rather than replaced.
+  void Input::setHeadPrint(const HTTP::URL &uri){
+    HTTP::URIReader reader;
+    if (!reader.open(uri)){return;}
+    uint64_t len = reader.getSize();
+    reader.close();
+    if (len == std::string::npos){return;}
+    if (len > HEADER_PRINT_SIZE){len = HEADER_PRINT_SIZE;}
+    meta.inputLocalVars["headLen"] = len;
+    meta.inputLocalVars["headPrint"] = headPrint(uri, len);
+  }
+
+  /// Returns true if the start of the input file still matches the fingerprint stored by setHeadPrint.
+  bool Input::checkHeadPrint(const HTTP::URL &uri){
+    if (!M.inputLocalVars.isMember("headPrint") || !M.inputLocalVars["headPrint"].asStringRef().size()){
+      return false;
+    }
+    if (headPrint(uri, M.inputLocalVars["headLen"].asInt()) != M.inputLocalVars["headPrint"].asStringRef()){
+      INFO_MSG("Start of %s changed since its header was generated", uri.getUrl().c_str());
+      return false;
+    }
+    return true;
+  }
+
   void Input::parseHeader(){
     if (hasSrt){readSrtHeader();}
     DONTEVEN_MSG("Parsing the header");
@@ -1356,6 +1414,7 @@ namespace Mist{
       uint32_t endKey = keys.getEndValid();
 
       Util::RelAccX &tPages = meta.pages(*it);
+      DTSC::Pages pages = meta.getPages(*it);
       // Generate page data only if not set yet (might be crash-recovering here)
       if (!tPages.getEndPos()){
         int32_t pageNum = -1;
@@ -1367,18 +1426,18 @@ namespace Mist{
             }
             tPages.addRecords(1);
             ++pageNum;
-            tPages.setInt("firsttime", keyTime, pageNum);
-            tPages.setInt("firstkey", j, pageNum);
+            pages.setFirstTime(pageNum, keyTime);
+            pages.setFirstKey(pageNum, j);
 
             newData = false;
           }
-          tPages.setInt("keycount", tPages.getInt("keycount", pageNum) + 1, pageNum);
-          tPages.setInt("parts", tPages.getInt("parts", pageNum) + keys.getParts(j), pageNum);
-          tPages.setInt("size", tPages.getInt("size", pageNum) + keys.getSize(j), pageNum);
-          tPages.setInt("lastkeytime", keyTime, pageNum);
-          if ((tPages.getInt("size", pageNum) > FLIP_DATA_PAGE_SIZE ||
-               keyTime - tPages.getInt("firsttime", pageNum) > FLIP_TARGET_DURATION) &&
-              keyTime - tPages.getInt("firsttime", pageNum) > FLIP_MIN_DURATION){
+          pages.setKeycount(pageNum, pages.getKeycount(pageNum) + 1);
+          pages.setParts(pageNum, pages.getParts(pageNum) + keys.getParts(j));
+          pages.setSize(pageNum, pages.getSize(pageNum) + keys.getSize(j));
+          pages.setLastKeyTime(pageNum, keyTime);
+          if ((pages.getSize(pageNum) > FLIP_DATA_PAGE_SIZE ||
+               keyTime - pages.getFirstTime(pageNum) > FLIP_TARGET_DURATION) &&
+              keyTime - pages.getFirstTime(pageNum) > FLIP_MIN_DURATION){
             newData = true;
           }
         }
@@ -1415,15 +1474,16 @@ namespace Mist{
 
     for (std::set<size_t>::iterator it = validTracks.begin(); it != validTracks.end(); ++it){
       const Util::RelAccX &tPages = meta.pages(*it);
+      const DTSC::Pages pages = meta.getPages(*it);
       if (!tPages.getEndPos()){
         WARN_MSG("No pages for track %zu found", *it);
         continue;
       }
       MEDIUM_MSG("Track %zu (%s) split into %" PRIu64 " pages", *it, M.getCodec(*it).c_str(), tPages.getEndPos());
       for (size_t j = tPages.getDeleted(); j < tPages.getEndPos(); j++){
-        size_t pageNumber = tPages.getInt("firstkey", j);
-        size_t pageKeys = tPages.getInt("keycount", j);
-        size_t pageSize = tPages.getInt("size", j);
+        size_t pageNumber = pages.getFirstKey(j);
+        size_t pageKeys = pages.getKeycount(j);
+        size_t pageSize = pages.getSize(j);
 
         HIGH_MSG("  Page %zu-%zu, (%zu bytes)", pageNumber, pageNumber + pageKeys - 1, pageSize);
       }
@@ -1517,6 +1577,7 @@ namespace Mist{
     if (sourceIdx == INVALID_TRACK_ID){sourceIdx = idx;}
 
     const Util::RelAccX &tPages = M.pages(idx);
+    const DTSC::Pages pages = M.getPages(idx);
     DTSC::Keys keys(M.keys(idx));
     uint64_t firstKey = keys.getFirstValid();
     if (keyNum < firstKey){
@@ -1541,10 +1602,10 @@ namespace Mist{
     }
     uint64_t pageIdx = 0;
     for (uint64_t i = tPages.getDeleted(); i < tPages.getEndPos(); i++){
-      if (tPages.getInt("firstkey", i) > keyNum) break;
+      if (pages.getFirstKey(i) > keyNum) break;
       pageIdx = i;
     }
-    uint32_t pageNumber = tPages.getInt("firstkey", pageIdx);
+    uint32_t pageNumber = pages.getFirstKey(pageIdx);
     pageCounter[idx][pageNumber] = Util::bootSecs();
     if (isBuffered(idx, pageNumber, meta)){
       // Mark the page as still actively requested
@@ -1576,7 +1637,7 @@ namespace Mist{
     }
     uint64_t stopTime = M.getLastms(idx) + 1;
     if (pageIdx != tPages.getEndPos() - 1){
-      stopTime = keys.getTime(pageNumber + tPages.getInt("keycount", pageIdx));
+      stopTime = keys.getTime(pageNumber + pages.getKeycount(pageIdx));
     }
     HIGH_MSG("Playing from %" PRIu64 " to %" PRIu64, keyTime, stopTime);
     if (isSrt){
@@ -1641,7 +1702,7 @@ namespace Mist{
           }
           //Sanity check: are we matching the key's data size?
           if (thisPacket.getFlag("keyframe")){
-            size_t currPos = tPages.getInt("avail", pageIdx);
+            size_t currPos = pages.getAvail(pageIdx);
             if (currPos){
               size_t keySize = keys.getSize(keyNum);
               if (currPos-prevPos == keySize){
@@ -1682,7 +1743,7 @@ namespace Mist{
       }
       //Sanity check: are we matching the key's data size?
       if (isVideo){
-        size_t currPos = tPages.getInt("avail", pageIdx);
+        size_t currPos = pages.getAvail(pageIdx);
         if (currPos){
           size_t keySize = keys.getSize(keyNum);
           if (currPos-prevPos == keySize){
@@ -1699,19 +1760,19 @@ namespace Mist{
     }
     page.close();
     bufferTimer = Util::bootMS() - bufferTimer;
-    if (packCounter < tPages.getInt("parts", pageIdx)){
+    if (packCounter < pages.getParts(pageIdx)){
       FAIL_MSG("Track %zu, page %" PRIu32 " (" PRETTY_PRINT_MSTIME " - " PRETTY_PRINT_MSTIME ") NOT FULLY buffered in %" PRIu64 "ms - erasing for later retry",
-               idx, pageNumber, PRETTY_ARG_MSTIME(tPages.getInt("firsttime", pageIdx)), PRETTY_ARG_MSTIME(thisTime), bufferTimer);
+               idx, pageNumber, PRETTY_ARG_MSTIME(pages.getFirstTime(pageIdx)), PRETTY_ARG_MSTIME(thisTime), bufferTimer);
       INFO_MSG("  (%" PRIu32 "/%" PRIu64 " parts, %" PRIu64 " bytes)", packCounter,
-               tPages.getInt("parts", pageIdx), byteCounter);
+               pages.getParts(pageIdx), byteCounter);
       pageCounter[idx].erase(pageNumber);
       bufferRemove(idx, pageNumber, pageIdx);
       return false;
     }else{
       INFO_MSG("Track %zu, page %" PRIu32 " (" PRETTY_PRINT_MSTIME " - " PRETTY_PRINT_MSTIME ") buffered in %" PRIu64 "ms",
-               idx, pageNumber, PRETTY_ARG_MSTIME(tPages.getInt("firsttime", pageIdx)), PRETTY_ARG_MSTIME(thisTime), bufferTimer);
+               idx, pageNumber, PRETTY_ARG_MSTIME(pages.getFirstTime(pageIdx)), PRETTY_ARG_MSTIME(thisTime), bufferTimer);
       INFO_MSG("  (%" PRIu32 "/%" PRIu64 " parts, %" PRIu64 " bytes)", packCounter,
-               tPages.getInt("parts", pageIdx), byteCounter);
+               pages.getParts(pageIdx), byteCounter);
       pageCounter[idx][pageNumber] = Util::bootSecs();
       return true;
     }
@@ -1761,9 +1822,25 @@ namespace Mist{
       INFO_MSG("Updating wrong version header file from version %u to %u", meta.version, DTSH_VERSION);
       return false;
     }
+    if (meta && headerOutdated){
+      uint64_t timer = Util::getMicros();
+      if (!extendHeader()){
+        INFO_MSG("Overwriting outdated DTSH header file: %s ", fileName.c_str());
+        return false;
+      }
+      headerOutdated = false;
+      INFO_MSG("Extended outdated DTSH header file %s in %.3f ms", fileName.c_str(), Util::getMicros(timer) / 1000.0);
+      M.toFile(fileName);
+    }
     return meta;
   }
 
+  /// Adds what was appended to the input file since its header was generated to the metadata
+  /// read from that header, instead of generating the header again from scratch.
+  /// Returns false if this is not possible, such as when the file changed in other ways.
+  /// Default implementation does not support this and always returns false.
+  bool Input::extendHeader(){return false;}
+
   bool Input::keepAlive(){
     if (!userSelect.size()){return config->is_active;}
 
@@ -17,6 +17,11 @@
 
 #include "../io.h"
 
+/// Smallest byte range a file is split into when generating its header in parallel
+#define HEADER_CHUNK_MIN (64 * 1024 * 1024)
+/// Amount of data at the start of a file that is hashed to tell if it was only appended to
+#define HEADER_PRINT_SIZE (64 * 1024)
+
 namespace Mist{
   struct booking{
     uint32_t first;
@@ -55,6 +60,7 @@ namespace Mist{
     virtual bool publishesTracks(){return true;}
 
   protected:
+    bool headerOutdated; ///< True if the input file changed since its header file was written
     bool internalOnly;
     bool isBuffer;
     Comms::Connections statComm;
@@ -70,6 +76,7 @@ namespace Mist{
     virtual bool isThread(){return false;}
     virtual bool isSingular(){return !config->getBool("realtime");}
     virtual bool readExistingHeader();
+    virtual bool extendHeader();
     virtual bool atKeyFrame();
     virtual void getNext(size_t idx = INVALID_TRACK_ID){}
     virtual void seek(uint64_t seekTime, size_t idx = INVALID_TRACK_ID){}
@@ -98,6 +105,9 @@ namespace Mist{
     virtual void userLeadOut();
     virtual void connStats(Comms::Connections & statComm);
     virtual void parseHeader();
+    size_t headerChunks(uint64_t fileSize);
+    void setHeadPrint(const HTTP::URL &uri);
+    bool checkHeadPrint(const HTTP::URL &uri);
     virtual JSON::Value enumerateSources(const std::string &){ return JSON::Value(); };
     virtual JSON::Value getSourceCapa(const std::string &){ return JSON::Value(); };
     bool bufferFrame(size_t track, uint32_t keyNum);
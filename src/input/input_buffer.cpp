@@ -9,6 +9,7 @@
 #include <mist/defines.h>
 #include <mist/langcodes.h>
 #include <mist/procs.h>
+#include <mist/segcache.h>
 #include <mist/stream.h>
 #include <mist/triggers.h>
 #include <string>
@@ -142,6 +143,7 @@ namespace Mist{
       liveMeta->unlink();
       delete liveMeta;
       liveMeta = 0;
+      Util::SegmentCache::remove(streamName);
     }
   }
 
@@ -159,6 +161,8 @@ namespace Mist{
     }
     // Delete the live stream semaphore, if any.
     if (liveMeta){liveMeta->unlink();}
+    // Delete any cached segments of this stream
+    Util::SegmentCache::remove(streamName);
     // Scoping to clear up metadata pages
     {
       DTSC::Meta cleanMeta(streamName, false);
@@ -212,7 +216,7 @@ namespace Mist{
       if (M.hasEmbeddedFrames(i)){
         fragCount = FRAG_BOOT;
       }else{
-        DTSC::Fragments fragments(M.fragments(i));
+        DTSC::Fragments fragments(M.getFragments(i));
         if (fragments.getEndValid() < fragCount){fragCount = fragments.getEndValid();}
       }
       if (M.getFirstms(i) < firstms){firstms = M.getFirstms(i);}
@@ -273,7 +277,7 @@ namespace Mist{
     // the following checks only run if we're not shutting down
     if (config->is_active){
       // Make sure we have at least 4 whole fragments at all times,
-      DTSC::Fragments fragments(M.fragments(tid));
+      DTSC::Fragments fragments(M.getFragments(tid));
       if (fragments.getValidCount() < 5){return false;}
       // ensure we have each fragment buffered for at least the whole bufferTime
       if ((M.getLastms(tid) - M.getFirstms(tid)) < bufferTime){return false;}
@@ -6,6 +6,7 @@
 #include <iostream>
 #include <mist/defines.h>
 #include <mist/stream.h>
+#include <mist/urireader.h>
 #include <mist/util.h>
 #include <string>
 #include <sys/stat.h>  //for stat
@@ -26,6 +27,19 @@ namespace Mist{
     capa["codecs"]["video"].append("VP6");
     capa["codecs"]["audio"].append("AAC");
     capa["codecs"]["audio"].append("MP3");
+
+    JSON::Value option;
+    option["arg"] = "integer";
+    option["long"] = "headerthreads";
+    option["help"] = "Threads used to generate the header of large files, 0 for one per CPU, 1 to read files in order";
+    option["value"].append(1);
+    config->addOption("headerthreads", option);
+    capa["optional"]["headerthreads"]["name"] = "Header threads";
+    capa["optional"]["headerthreads"]["help"] =
+        "Threads used to generate the header of large files, 0 for one per CPU, 1 to read files in order";
+    capa["optional"]["headerthreads"]["option"] = "--headerthreads";
+    capa["optional"]["headerthreads"]["type"] = "uint";
+    capa["optional"]["headerthreads"]["default"] = 1;
   }
 
   InputFLV::~InputFLV(){}
@@ -86,13 +100,47 @@ namespace Mist{
       return false;
     }
     meta.reInit(isSingular() ? streamName : "");
+    return readTags(13);
+  }
+
+  /// Adds the tags appended to a file since its header was generated, by resuming after the last
+  /// tag that was indexed.
+  bool InputFLV::extendHeader(){
+    if (!inFile || !M.inputLocalVars.isMember("indexed")){return false;}
+    struct stat statData;
+    if (fstat(fileno(inFile), &statData) || statData.st_size < M.inputLocalVars["indexed"].asInt()){return false;}
+    if (!checkHeadPrint(HTTP::localURIResolver().link(config->getString("input")))){return false;}
+    return readTags(M.inputLocalVars["indexed"].asInt());
+  }
+
+  /// Adds all tags from the given byte position onwards to the metadata, and stores the position
+  /// after the last complete tag so that extendHeader can resume from there.
+  bool InputFLV::readTags(uint64_t from){
+    uint64_t bench = Util::getMicros();
+    uint64_t indexed = from;
+
+    // Large files are split into byte ranges that are read in parallel
+    struct stat statData;
+    size_t chunks = fstat(fileno(inFile), &statData) ? 1 : headerChunks(statData.st_size - from);
+    if (chunks > 1){
+      uint8_t *progress = (streamStatus && streamStatus.len > 1) ? (uint8_t *)streamStatus.mapped + 1 : 0;
+      if (FLV::scanHeader(config->getString("input"), meta, chunks, progress, &indexed)){
+        INFO_MSG("Header generated in %" PRIu64 " ms using %zu threads", Util::getMicros(bench) / 1000, chunks);
+        meta.inputLocalVars["indexed"] = indexed;
+        setHeadPrint(HTTP::localURIResolver().link(config->getString("input")));
+        Util::fseek(inFile, 13, SEEK_SET);
+        return true;
+      }
+      WARN_MSG("Could not read %s in parallel, reading it in order", config->getString("input").c_str());
+    }
+
     // Create header file from FLV data
-    Util::fseek(inFile, 13, SEEK_SET);
+    Util::fseek(inFile, from, SEEK_SET);
     AMF::Object amf_storage;
-    uint64_t lastBytePos = 13;
-    uint64_t bench = Util::getMicros();
+    uint64_t lastBytePos = from;
     while (!feof(inFile) && !FLV::Parse_Error){
       if (tmpTag.FileLoader(inFile)){
+        indexed = Util::ftell(inFile);
         tmpTag.toMeta(meta, amf_storage);
         if (!tmpTag.getDataLen()){continue;}
         if (tmpTag.needsInitData() && tmpTag.isInitData()){continue;}
@@ -108,10 +156,13 @@ namespace Mist{
     INFO_MSG("Header generated in %" PRIu64 " ms: @%" PRIu64 ", %s, %s", bench / 1000, lastBytePos,
              M.getVod() ? "VoD" : "NOVoD", M.getLive() ? "Live" : "NOLive");
     if (FLV::Parse_Error){
-      tmpTag = FLV::Tag();
       FLV::Parse_Error = false;
       ERROR_MSG("Stopping at FLV parse error @%" PRIu64 ": %s", lastBytePos, FLV::Error_Str.c_str());
     }
+    // Discards what was read of a tag that was cut off by the end of the file
+    tmpTag = FLV::Tag();
+    meta.inputLocalVars["indexed"] = indexed;
+    setHeadPrint(HTTP::localURIResolver().link(config->getString("input")));
     Util::fseek(inFile, 13, SEEK_SET);
     return true;
   }
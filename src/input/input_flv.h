@@ -13,6 +13,8 @@ namespace Mist{
     bool checkArguments();
     bool preRun();
     bool readHeader();
+    bool extendHeader();
+    bool readTags(uint64_t from);
     void getNext(size_t idx = INVALID_TRACK_ID);
     void seek(uint64_t seekTime, size_t idx = INVALID_TRACK_ID);
     bool keepRunning();
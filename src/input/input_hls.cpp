@@ -1,7 +1,4 @@
 #include "input_hls.h"
-#ifdef SSL
-#include "mbedtls/aes.h"
-#endif
 #include <algorithm>
 #include <cerrno>
 #include <cstdio>
@@ -15,6 +12,7 @@
 #include <mist/flv_tag.h>
 #include <mist/http_parser.h>
 #include <mist/mp4_generic.h>
+#include <mist/prefetch.h>
 #include <mist/stream.h>
 #include <mist/timing.h>
 #include <mist/tinythread.h>
@@ -122,6 +120,9 @@ namespace Mist{
 
   size_t segBufTotalSize = 0;
 
+  /// Downloads upcoming segments while the current one is parsed
+  HTTP::Prefetcher segPrefetch;
+
   /// Track which segment numbers have been parsed
   std::map<uint64_t, uint64_t> parsedSegments;
 
@@ -252,17 +253,37 @@ namespace Mist{
     return output;
   }
 
+  /// Adds an empty entry for the given segment to the local RAM buffer and returns it.
+  /// Removes entries while above 16MiB in total size, unless we only have 1 entry (we keep two at least at all times)
+  static Util::ResizeablePointer *addSegBuf(const std::string &filename){
+    while (segBufTotalSize > 16 * 1024 * 1024 && segBufs.size() > 1){
+      HIGH_MSG("Dropping from segment cache: %s", segBufAccs.back().c_str());
+      segBufs.erase(segBufAccs.back());
+      segBufTotalSize -= segBufSize.back();
+      segBufAccs.pop_back();
+      segBufSize.pop_back();
+    }
+    segBufAccs.push_front(filename);
+    segBufSize.push_front(0);
+    return &(segBufs[filename]);
+  }
+
   SegmentDownloader::SegmentDownloader(){
     isOpen = false;
     segDL.onProgress(callbackFunc);
     encrypted = false;
     currBuf = 0;
     packetPtr = 0;
+    encOffset = 0;
   }
 
   /// Returns true if packetPtr is at the end of the current segment.
   bool SegmentDownloader::atEnd() const{
     if (!isOpen || !currBuf){return true;}
+    if (encrypted){
+      bool srcEnd = buffered ? currBuf->size() <= offset : !segDL;
+      return srcEnd && outData.size() < encOffset + 188;
+    }
     if (buffered){return currBuf->size() <= offset + 188;}
     return !segDL && currBuf->size() <= offset + 188;
     // return (packetPtr - segDL.const_data().data() + 188) > segDL.const_data().size();
@@ -292,18 +313,27 @@ namespace Mist{
       // Alright, we need to read some more data.
       // We read 192 bytes at a time: a single TS packet is 188 bytes but AES-128-CBC encryption works in 16-byte blocks.
       size_t len = 0;
-      segDL.readSome(packetPtr, len, 192);
+      bool srcEnd;
+      if (buffered){
+        len = currBuf->size() - offset;
+        if (len > 192){len = 192;}
+        packetPtr = *currBuf + offset;
+        offset += len;
+        srcEnd = (offset >= currBuf->size());
+      }else{
+        segDL.readSome(packetPtr, len, 192);
+        srcEnd = segDL.isEOF();
+      }
       if (!len){return false;}
       if (len % 16 != 0){
         FAIL_MSG("Read a non-16-multiple of bytes (%zu), cannot decode!", len);
         return false;
       }
       outData.allocate(outData.size() + len);
-      mbedtls_aes_crypt_cbc(&aes, MBEDTLS_AES_DECRYPT, len, tmpIvec, (const unsigned char *)packetPtr,
-                            ((unsigned char *)(char *)outData) + outData.size());
+      aes.decryptBlockCBC(tmpIvec, packetPtr, (char *)outData + outData.size(), len);
       outData.append(0, len);
       // End of the segment? Remove padding data.
-      if (segDL.isEOF()){
+      if (srcEnd){
         // The padding consists of X bytes of padding, all containing the raw value X.
         // Since padding is mandatory, we can simply read the last byte and remove X bytes from the length.
         if (outData.size() <= outData[outData.size() - 1]){
@@ -406,6 +436,21 @@ namespace Mist{
 
     offset = 0;
     firstPacket = true;
+    // Move the segment into the cache if it was prefetched, waiting for its download if needed
+    if (!segBufs.count(entry.filename) && segPrefetch.isActive()){
+      Util::ResizeablePointer prefetched;
+      HTTP::Prefetcher::takeResult res;
+      while ((res = segPrefetch.take(entry.filename, prefetched, 500)) == HTTP::Prefetcher::PREFETCH_BUSY){
+        if (!callbackFunc(0)){return false;}
+      }
+      if (res == HTTP::Prefetcher::PREFETCH_READY){
+        HIGH_MSG("Reading prefetched: %s", entry.filename.c_str());
+        Util::ResizeablePointer *buf = addSegBuf(entry.filename);
+        buf->swap(prefetched);
+        segBufSize.front() = buf->size();
+        segBufTotalSize += buf->size();
+      }
+    }
     buffered = segBufs.count(entry.filename);
     if (!buffered){
       HIGH_MSG("Reading non-cache: %s", entry.filename.c_str());
@@ -414,17 +459,7 @@ namespace Mist{
         return false;
       }
       if (!segDL){return false;}
-      //Remove cache entries while above 16MiB in total size, unless we only have 1 entry (we keep two at least at all times)
-      while (segBufTotalSize > 16 * 1024 * 1024 && segBufs.size() > 1){
-        HIGH_MSG("Dropping from segment cache: %s", segBufAccs.back().c_str());
-        segBufs.erase(segBufAccs.back());
-        segBufTotalSize -= segBufSize.back();
-        segBufAccs.pop_back();
-        segBufSize.pop_back();
-      }
-      segBufAccs.push_front(entry.filename);
-      segBufSize.push_front(0);
-      currBuf = &(segBufs[entry.filename]);
+      currBuf = addSegBuf(entry.filename);
     }else{
       HIGH_MSG("Reading from segment cache: %s", entry.filename.c_str());
       currBuf = &(segBufs[entry.filename]);
@@ -459,6 +494,7 @@ namespace Mist{
 
     encrypted = false;
     outData.truncate(0);
+    encOffset = 0;
     // If we have a non-null key, decrypt
     if (entry.keyAES[0] != 0 || entry.keyAES[1] != 0 || entry.keyAES[2] != 0 || entry.keyAES[3] != 0 ||
         entry.keyAES[4] != 0 || entry.keyAES[5] != 0 || entry.keyAES[6] != 0 || entry.keyAES[7] != 0 ||
@@ -467,7 +503,7 @@ namespace Mist{
       encrypted = true;
 #ifdef SSL
       // Load key
-      mbedtls_aes_setkey_dec(&aes, (const unsigned char *)entry.keyAES, 128);
+      aes.setDecryptKey(entry.keyAES);
       // Load initialization vector
       memcpy(tmpIvec, entry.ivec, 16);
 #endif
@@ -780,6 +816,32 @@ namespace Mist{
     capa["optional"]["bufferTime"]["default"] = 50000;
     option.null();
 
+    option["arg"] = "integer";
+    option["long"] = "prefetch";
+    option["help"] = "Amount of upcoming segments to download in parallel while the current one is parsed, 0 to disable";
+    option["value"].append(3);
+    config->addOption("prefetch", option);
+    capa["optional"]["prefetch"]["name"] = "Prefetched segments";
+    capa["optional"]["prefetch"]["help"] =
+        "Amount of upcoming segments to download in parallel while the current one is parsed, 0 to disable";
+    capa["optional"]["prefetch"]["option"] = "--prefetch";
+    capa["optional"]["prefetch"]["type"] = "uint";
+    capa["optional"]["prefetch"]["default"] = 3;
+    option.null();
+
+    option["arg"] = "integer";
+    option["long"] = "prefetchmem";
+    option["help"] = "Maximum memory in MiB used for prefetched segments. No more segments are prefetched while above it";
+    option["value"].append(32);
+    config->addOption("prefetchmem", option);
+    capa["optional"]["prefetchmem"]["name"] = "Prefetch memory (MiB)";
+    capa["optional"]["prefetchmem"]["help"] =
+        "Maximum memory in MiB used for prefetched segments. No more segments are prefetched while above it";
+    capa["optional"]["prefetchmem"]["option"] = "--prefetchmem";
+    capa["optional"]["prefetchmem"]["type"] = "uint";
+    capa["optional"]["prefetchmem"]["default"] = 32;
+    option.null();
+
     inFile = NULL;
   }
 
@@ -933,6 +995,7 @@ namespace Mist{
         ++currentSegment;
         tsStream.partialClear();
 
+        prefetchAfter(pListIt->second, entryIt - pListIt->second.begin());
         if (!segDowner.loadSegment(*entryIt)){
           FAIL_MSG("Failed to load segment - skipping to next");
           continue;
@@ -1100,6 +1163,7 @@ namespace Mist{
       FAIL_MSG("Tried to load segment with index '%" PRIu64 "', but the playlist only contains '%zu' entries!", segmentIndex, curList.size());
       return false;
     }
+    prefetchAfter(curList, segmentIndex);
     if (!segDowner.loadSegment(curList.at(segmentIndex))){
       FAIL_MSG("Failed to load segment");
       return false;
@@ -1432,6 +1496,7 @@ namespace Mist{
         return;
       }
       playListEntries &entry = curPlaylist.at(currentIndex);
+      prefetchAfter(curPlaylist, currentIndex);
       segDowner.loadSegment(entry);
       // If we have an offset, load it
       allowRemap = false;
@@ -1788,6 +1853,7 @@ namespace Mist{
         return false;
       }
       ntry = curList[currentIndex];
+      prefetchAfter(curList, currentIndex);
     }
 
     if (!segDowner.loadSegment(ntry)){
@@ -1831,7 +1897,30 @@ namespace Mist{
     return tmpId;
   }
 
+  /// Queues the segments following the given index of the given playlist for prefetching,
+  /// starting the prefetch threads on first use. Segments that are local files are not prefetched.
+  void InputHLS::prefetchAfter(const std::deque<playListEntries> &list, size_t index){
+    size_t count = config->getInteger("prefetch");
+    if (!count){return;}
+    if (!segPrefetch.isActive()){
+      segPrefetch.start(count, config->getInteger("prefetchmem") * 1024 * 1024);
+    }
+    for (size_t i = index + 1; i < list.size() && i <= index + count; ++i){
+      const std::string &file = list[i].filename;
+      if (segBufs.count(file) || HTTP::localURIResolver().link(file).isLocalPath()){continue;}
+      segPrefetch.want(file);
+    }
+  }
+
   void InputHLS::finish(){
+    if (segPrefetch.isActive()){
+      HTTP::Prefetcher::Stats S = segPrefetch.getStats();
+      INFO_MSG("Prefetched %" PRIu64 " segments (%" PRIu64 " bytes) in %" PRIu64 "ms of download time, %" PRIu64
+               " failed, %" PRIu64 " unused; %" PRIu64 " were ready in time, %" PRIu64 " needed %" PRIu64
+               "ms of waiting and %" PRIu64 " were not prefetched",
+               S.downloads, S.bytes, S.downloadMs, S.failures, S.dropped, S.ready, S.waited, S.waitMs, S.missed);
+      segPrefetch.stop();
+    }
     if (streamIsLive){ //< Already generated from readHeader
       INFO_MSG("Writing updated header to disk");
       injectLocalVars();
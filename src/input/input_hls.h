@@ -66,9 +66,9 @@ namespace Mist{
     Util::ResizeablePointer outData;
     Util::ResizeablePointer * currBuf;
     size_t encOffset;
-    unsigned char tmpIvec[16];
+    char tmpIvec[16];
 #ifdef SSL
-    mbedtls_aes_context aes;
+    Encryption::AES aes;
 #endif
     bool isOpen;
   };
@@ -169,6 +169,7 @@ namespace Mist{
     bool initPlaylist(const std::string &uri, bool fullInit = true);
     bool readPlaylist(const HTTP::URL &uri, const std::string & relurl, bool fullInit = true);
     bool readNextFile();
+    void prefetchAfter(const std::deque<playListEntries> &list, size_t index);
 
     void parseStreamHeader();
     void parseLivePoint();
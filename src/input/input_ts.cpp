@@ -277,6 +277,19 @@ namespace Mist{
     option["short"] = "R";
     option["help"] = "Enable raw MPEG-TS passthrough mode";
     config->addOption("raw", option);
+
+    option.null();
+    option["arg"] = "integer";
+    option["long"] = "headerthreads";
+    option["help"] = "Threads used to generate the header of large files, 0 for one per CPU, 1 to read files in order";
+    option["value"].append(1);
+    config->addOption("headerthreads", option);
+    capa["optional"]["headerthreads"]["name"] = "Header threads";
+    capa["optional"]["headerthreads"]["help"] =
+        "Threads used to generate the header of large files, 0 for one per CPU, 1 to read files in order";
+    capa["optional"]["headerthreads"]["option"] = "--headerthreads";
+    capa["optional"]["headerthreads"]["type"] = "uint";
+    capa["optional"]["headerthreads"]["default"] = 1;
   }
 
   InputTS::~InputTS(){
@@ -424,6 +437,24 @@ namespace Mist{
       return false;
     }
     meta.reInit(isSingular() ? streamName : "");
+
+    TS::ScanPositions positions;
+    bool growing = mayGrow();
+
+    // Large seekable files are split into byte ranges that are read in parallel
+    size_t chunks = reader.isSeekable() ? headerChunks(reader.getSize()) : 1;
+    if (chunks > 1){
+      uint64_t bench = Util::getMicros();
+      uint8_t *progress = (streamStatus && streamStatus.len > 1) ? (uint8_t *)streamStatus.mapped + 1 : 0;
+      if (TS::scanHeader(reader.getURI(), meta, chunks, progress,
+                         config->getString("datatrack") == "json" ? TS::JSON : TS::NONE, &positions, growing)){
+        INFO_MSG("Header generated in %" PRIu64 " ms using %zu threads", Util::getMicros(bench) / 1000, chunks);
+        setIndexed(positions);
+        return true;
+      }
+      WARN_MSG("Could not read %s in parallel, reading it in order", reader.getURI().getUrl().c_str());
+    }
+
     TS::Packet packet; // to analyse and extract data
     DTSC::Packet headerPack;
 
@@ -446,6 +477,7 @@ namespace Mist{
           headerPack.getString("data", data, dataLen);
           meta.update(headerPack.getTime(), headerPack.getInt("offset"), idx, dataLen,
                       headerPack.getInt("bpos"), headerPack.getFlag("keyframe"), headerPack.getDataLen());
+          positions[pid] = headerPack.getInt("bpos");
         }
         //Set progress counter
         if (streamStatus && streamStatus.len > 1 && reader.getSize()){
@@ -458,6 +490,12 @@ namespace Mist{
     while (tsStream.hasPacket()){
       tsStream.getEarliestPacket(headerPack);
       size_t pid = headerPack.getTrackId();
+      if (growing){
+        // Only the end of the file completes these, so they may be cut short: add them once it grew
+        uint64_t bpos = headerPack.getInt("bpos");
+        if (!positions.count(pid)){positions[pid] = bpos >= 188 ? bpos - 188 : 0;}
+        continue;
+      }
       size_t idx = M.trackIDToIndex(pid, getpid());
       if (idx == INVALID_TRACK_ID || !M.getCodec(idx).size()){
         tsStream.initializeMetadata(meta, pid);
@@ -468,10 +506,55 @@ namespace Mist{
       headerPack.getString("data", data, dataLen);
       meta.update(headerPack.getTime(), headerPack.getInt("offset"), idx, dataLen,
                   headerPack.getInt("bpos"), headerPack.getFlag("keyframe"), headerPack.getDataLen());
+      positions[pid] = headerPack.getInt("bpos");
     }
+    if (reader.isSeekable()){setIndexed(positions);}
     return true;
   }
 
+  /// Adds the packets appended to a file since its header was generated, by resuming the scan
+  /// at the last indexed packet of every track.
+  bool InputTS::extendHeader(){
+    if (!reader || !reader.isSeekable() || !M.inputLocalVars.isMember("indexed")){return false;}
+    uint64_t size = reader.getSize();
+    if (size == std::string::npos || size < M.inputLocalVars["indexedSize"].asInt()){return false;}
+    if (!checkHeadPrint(reader.getURI())){return false;}
+    TS::ScanPositions positions;
+    uint64_t from = size;
+    jsonForEachConst(M.inputLocalVars["indexed"], i){
+      positions[JSON::Value(i.key()).asInt()] = i->asInt();
+      if (i->asInt() < from){from = i->asInt();}
+    }
+    uint8_t *progress = (streamStatus && streamStatus.len > 1) ? (uint8_t *)streamStatus.mapped + 1 : 0;
+    if (!TS::scanHeader(reader.getURI(), meta, headerChunks(size - from), progress,
+                        config->getString("datatrack") == "json" ? TS::JSON : TS::NONE, &positions, mayGrow())){
+      return false;
+    }
+    setIndexed(positions);
+    return true;
+  }
+
+  /// Stores the position of the last indexed packet of every track, and the file size they were
+  /// found in, so that extendHeader can resume from there once the file grew.
+  void InputTS::setIndexed(const TS::ScanPositions &positions){
+    JSON::Value indexed;
+    for (TS::ScanPositions::const_iterator it = positions.begin(); it != positions.end(); ++it){
+      indexed[JSON::Value(it->first).asString()] = it->second;
+    }
+    meta.inputLocalVars["indexed"] = indexed;
+    meta.inputLocalVars["indexedSize"] = reader.getSize();
+    setHeadPrint(reader.getURI());
+  }
+
+  /// Returns true if the input is a file that may still be written to, because it was modified
+  /// within the window checkHeaderTimes considers a header generated from it outdated in.
+  bool InputTS::mayGrow(){
+    if (!reader.isSeekable() || !reader.getURI().isLocalPath()){return false;}
+    struct stat st;
+    if (stat(reader.getURI().getFilePath().c_str(), &st)){return false;}
+    return st.st_mtime + 15 > time(0);
+  }
+
   /// Gets the next packet that is to be sent
   /// At the moment, the logic of sending the last packet that was finished has been implemented,
   /// but the seeking and finding data is not yet ready.
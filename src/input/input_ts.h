@@ -30,6 +30,9 @@ namespace Mist{
     bool checkArguments();
     bool preRun();
     bool readHeader();
+    bool extendHeader();
+    void setIndexed(const TS::ScanPositions &positions);
+    bool mayGrow();
     virtual bool needHeader();
     virtual void postHeader();
     virtual void getNext(size_t idx = INVALID_TRACK_ID);
@@ -58,11 +58,11 @@ namespace Mist{
     }
 
     Util::RelAccX &tPages = aMeta.pages(idx);
+    DTSC::Pages pages = aMeta.getPages(idx);
 
     uint32_t pageIdx = INVALID_KEY_NUM;
-    Util::RelAccXFieldData firstKeyAccx = tPages.getFieldData("firstkey");
     for (uint32_t i = tPages.getDeleted(); i < tPages.getEndPos(); i++){
-      if (tPages.getInt(firstKeyAccx, i) == pageNumber){
+      if (pages.getFirstKey(i) == pageNumber){
         pageIdx = i;
         break;
       }
@@ -73,7 +73,7 @@ namespace Mist{
       WARN_MSG("Aborting page buffer start: %" PRIu32 " is not a valid page number on track %zu.", pageNumber, idx);
       std::stringstream test;
       for (uint32_t i = tPages.getDeleted(); i < tPages.getEndPos(); i++){
-        test << tPages.getInt("firstkey", i) << " ";
+        test << pages.getFirstKey(i) << " ";
       }
       INFO_MSG("Valid page numbers: %s", test.str().c_str());
       ///\return false if the pagenumber is not valid for this track
@@ -90,7 +90,7 @@ namespace Mist{
     // Open the correct page for the data
     char pageId[NAME_BUFFER_SIZE];
     snprintf(pageId, NAME_BUFFER_SIZE, SHM_TRACK_DATA, streamName.c_str(), idx, pageNumber);
-    uint64_t pageSize = tPages.getInt("size", pageIdx);
+    uint64_t pageSize = pages.getSize(pageIdx);
     std::string pageName(pageId);
     page.init(pageName, pageSize, true);
 
@@ -103,7 +103,7 @@ namespace Mist{
     page.master = false;
 
     // Set the current offset to 0, to allow for using it in bufferNext()
-    tPages.setInt("avail", 0, pageIdx);
+    pages.setAvail(pageIdx, 0);
 
     HIGH_MSG("Start buffering page %" PRIu32 " on track %zu successful", pageNumber, idx);
     return true;
@@ -139,11 +139,11 @@ namespace Mist{
     if (!standAlone){return;}// A different process will handle this for us
 
     Util::RelAccX &tPages = meta.pages(idx);
-    Util::RelAccXFieldData firstKey = tPages.getFieldData("firstkey");
+    DTSC::Pages pages = meta.getPages(idx);
 
     if (pageIdx == INVALID_KEY_NUM){
       for (uint32_t i = tPages.getDeleted(); i < tPages.getEndPos(); i++){
-        if (tPages.getInt(firstKey, i) == pageNumber){
+        if (pages.getFirstKey(i) == pageNumber){
           pageIdx = i;
           break;
         }
@@ -156,38 +156,38 @@ namespace Mist{
     }
 
     HIGH_MSG("Removing page %" PRIu32 " on track %zu from the corresponding metaPage", pageNumber, idx);
-    tPages.setInt("avail", 0, pageIdx);
+    pages.setAvail(pageIdx, 0);
 
     // Open the correct page
     char pageId[NAME_BUFFER_SIZE];
     snprintf(pageId, NAME_BUFFER_SIZE, SHM_TRACK_DATA, streamName.c_str(), idx, pageNumber);
     std::string pageName(pageId);
     IPC::sharedPage toErase;
-    toErase.init(pageName, tPages.getInt("size", pageIdx), false, false);
+    toErase.init(pageName, pages.getSize(pageIdx), false, false);
     // Set the master flag so that the page will be destroyed once it leaves scope
     toErase.master = true;
     // Update the page on the tracks index page if needed
-    uint64_t firstKeyNum = tPages.getInt(firstKey, pageIdx);
-    uint64_t keyCount = tPages.getInt("keycount", pageIdx);
+    uint64_t firstKeyNum = pages.getFirstKey(pageIdx);
+    uint64_t keyCount = pages.getKeycount(pageIdx);
     uint64_t newFirstKey = M.getKeys(idx).getFirstValid();
     if (firstKeyNum + keyCount <= newFirstKey){
       HIGH_MSG("Page %" PRIu64 " track %zu has expired during the time it was kept cached in memory (contains up to key %lu, but the earliest key is %lu). Removing it now", firstKeyNum, idx, firstKeyNum + keyCount, newFirstKey);
-      tPages.setInt("keycount", 0, pageIdx); //< Force removal by having avail and keycount both 0
+      pages.setKeycount(pageIdx, 0); //< Force removal by having avail and keycount both 0
     }else if (firstKeyNum < newFirstKey){
       uint64_t newPartCount = 0;
       DTSC::Keys keys = M.getKeys(idx);
       for (uint32_t i = newFirstKey; i < firstKeyNum + keyCount; i++){
         newPartCount += keys.getParts(i);
       }
-      uint64_t partCount = tPages.getInt("parts", pageIdx);
+      uint64_t partCount = pages.getParts(pageIdx);
       HIGH_MSG("Adjusting meta info for page %lu track %lu before unloading it. First key %lu -> %lu. Key count %lu -> %lu. Part count %lu -> %lu", firstKeyNum, idx, firstKeyNum, newFirstKey, keyCount, keyCount - (newFirstKey - firstKeyNum), partCount, newPartCount);
-      tPages.setInt("keycount", keyCount - (newFirstKey - firstKeyNum), pageIdx);
-      tPages.setInt("parts", newPartCount, pageIdx);
-      tPages.setInt("firstkey", newFirstKey, pageIdx);
+      pages.setKeycount(pageIdx, keyCount - (newFirstKey - firstKeyNum));
+      pages.setParts(pageIdx, newPartCount);
+      pages.setFirstKey(pageIdx, newFirstKey);
     }
     // Delete pages from the tracks index page that will never contain any more
     for (uint32_t i = tPages.getDeleted(); i < tPages.getEndPos(); i++){
-      if (tPages.getInt("keycount", i) || tPages.getInt("avail", i)){
+      if (pages.getKeycount(i) || pages.getAvail(i)){
         break;
       }
       tPages.deleteRecords(1);
@@ -208,13 +208,14 @@ namespace Mist{
   ///\param keyNum The number of the keyframe to find
   uint32_t InOutBase::bufferedOnPage(size_t idx, uint32_t keyNum, DTSC::Meta & aMeta){
     Util::RelAccX &tPages = aMeta.pages(idx);
+    DTSC::Pages pages = aMeta.getPages(idx);
 
     for (uint64_t i = tPages.getDeleted(); i < tPages.getEndPos(); i++){
-      uint64_t pageNum = tPages.getInt("firstkey", i);
+      uint64_t pageNum = pages.getFirstKey(i);
       if (pageNum > keyNum) continue;
-      uint64_t keyCount = tPages.getInt("keycount", i);
+      uint64_t keyCount = pages.getKeycount(i);
       if (!keyCount || pageNum + keyCount - 1 < keyNum) continue;
-      uint64_t avail = tPages.getInt("avail", i);
+      uint64_t avail = pages.getAvail(i);
       return avail ? pageNum : INVALID_KEY_NUM;
     }
     return INVALID_KEY_NUM;
@@ -257,18 +258,18 @@ namespace Mist{
     multiWrong = false;
 
     Util::RelAccX &tPages = aMeta.pages(packTrack);
+    DTSC::Pages pages = aMeta.getPages(packTrack);
     uint32_t pageIdx = 0;
     uint32_t currPagNum = atoi(page.name.data() + page.name.rfind('_') + 1);
-    Util::RelAccXFieldData firstkey = tPages.getFieldData("firstkey");
     for (uint64_t i = tPages.getDeleted(); i < tPages.getEndPos(); i++){
-      if (tPages.getInt(firstkey, i) == currPagNum){
+      if (pages.getFirstKey(i) == currPagNum){
         pageIdx = i;
         break;
       }
     }
     // Save the current write position
-    uint64_t pageOffset = tPages.getInt("avail", pageIdx);
-    uint64_t pageSize = tPages.getInt("size", pageIdx);
+    uint64_t pageOffset = pages.getAvail(pageIdx);
+    uint64_t pageSize = pages.getSize(pageIdx);
     INSANE_MSG("Current packet %" PRIu64 " on track %" PRIu32 " has an offset on page %s of %" PRIu64, packTime, packTrack, page.name.c_str(), pageOffset);
     // Do nothing when there is not enough free space on the page to add the packet.
     if (pageSize - pageOffset < packDataLen){
@@ -315,7 +316,7 @@ namespace Mist{
     memcpy(page.mapped + pageOffset, "DTP2", 4);
 
     DONTEVEN_MSG("Setting page %" PRIu32 " available to %" PRIu64, pageIdx, pageOffset + packDataLen);
-    tPages.setInt("avail", pageOffset + packDataLen, pageIdx);
+    pages.setAvail(pageIdx, pageOffset + packDataLen);
   }
 
   /// Wraps up the buffering of a shared memory data page
@@ -366,6 +367,7 @@ namespace Mist{
 
     // Store the trackid for easier access
     Util::RelAccX &tPages = aMeta.pages(packTrack);
+    DTSC::Pages pages = aMeta.getPages(packTrack);
 
     if (aMeta.getType(packTrack) != "video"){
       isKeyframe = false;
@@ -373,7 +375,7 @@ namespace Mist{
         // Assume this is the first packet on the track
         isKeyframe = true;
       }else{
-        if (packTime - tPages.getInt("lastkeytime", tPages.getEndPos() - 1) >= AUDIO_KEY_INTERVAL){
+        if (packTime - pages.getLastKeyTime(tPages.getEndPos() - 1) >= AUDIO_KEY_INTERVAL){
           isKeyframe = true;
         }
       }
@@ -398,9 +400,8 @@ namespace Mist{
       uint64_t endPage = tPages.getEndPos();
       size_t curPage = 0;
       size_t currPagNum = atoi(livePage[packTrack].name.data() + livePage[packTrack].name.rfind('_') + 1);
-      Util::RelAccXFieldData firstkey = tPages.getFieldData("firstkey");
       for (uint64_t i = tPages.getDeleted(); i < tPages.getEndPos(); i++){
-        if (tPages.getInt(firstkey, i) == currPagNum){
+        if (pages.getFirstKey(i) == currPagNum){
           curPage = i;
           break;
         }
@@ -420,11 +421,11 @@ namespace Mist{
         }
 
         curPage = endPage;
-        tPages.setInt("firstkey", curPageNum[packTrack], endPage);
-        tPages.setInt("firsttime", packTime, endPage);
-        tPages.setInt("size", DEFAULT_DATA_PAGE_SIZE, endPage);
-        tPages.setInt("keycount", 0, endPage);
-        tPages.setInt("avail", 0, endPage);
+        pages.setFirstKey(endPage, curPageNum[packTrack]);
+        pages.setFirstTime(endPage, packTime);
+        pages.setSize(endPage, DEFAULT_DATA_PAGE_SIZE);
+        pages.setKeycount(endPage, 0);
+        pages.setAvail(endPage, 0);
         tPages.addRecords(1);
         DONTEVEN_MSG("Opening new page #%zu to track %" PRIu32, curPageNum[packTrack], packTrack);
         if (!bufferStart(packTrack, curPageNum[packTrack], livePage[packTrack], aMeta)){
@@ -433,13 +434,13 @@ namespace Mist{
           return;
         }
       }else{
-        uint64_t prevPageTime = tPages.getInt("firsttime", curPage);
+        uint64_t prevPageTime = pages.getFirstTime(curPage);
         // Compare on 8 mb boundary and target duration
-        if (tPages.getInt("avail", curPage) > FLIP_DATA_PAGE_SIZE || packTime - prevPageTime > FLIP_TARGET_DURATION){
+        if (pages.getAvail(curPage) > FLIP_DATA_PAGE_SIZE || packTime - prevPageTime > FLIP_TARGET_DURATION){
           // Create the book keeping data for the new page
-          curPageNum[packTrack] = tPages.getInt("firstkey", curPage) + tPages.getInt("keycount", curPage);
+          curPageNum[packTrack] = pages.getFirstKey(curPage) + pages.getKeycount(curPage);
           DONTEVEN_MSG("Live page transition from %" PRIu32 ":%" PRIu64 " to %" PRIu32 ":%zu", packTrack,
-                  tPages.getInt("firstkey", curPage), packTrack, curPageNum[packTrack]);
+                  pages.getFirstKey(curPage), packTrack, curPageNum[packTrack]);
 
           if ((tPages.getEndPos() - tPages.getDeleted()) >= tPages.getRCount()){
             aMeta.resizeTrack(packTrack, aMeta.fragments(packTrack).getRCount(), aMeta.keys(packTrack).getRCount(), aMeta.parts(packTrack).getRCount(), tPages.getRCount() * 2, "not enough pages");
@@ -447,19 +448,19 @@ namespace Mist{
           // Finalize part count of the previous live page
           uint64_t newPartCount = 0;
           DTSC::Keys keys = M.getKeys(packTrack);
-          uint64_t lastKey = tPages.getInt("firstkey", curPage) + tPages.getInt("keycount", curPage);
-          for (uint32_t i = tPages.getInt("firstkey", curPage); i < lastKey; i++){
+          uint64_t lastKey = pages.getFirstKey(curPage) + pages.getKeycount(curPage);
+          for (uint32_t i = pages.getFirstKey(curPage); i < lastKey; i++){
             newPartCount += keys.getParts(i);
           }
-          tPages.setInt("parts", newPartCount, curPage);
+          pages.setParts(curPage, newPartCount);
           curPage = endPage;
-          tPages.setInt("firstkey", curPageNum[packTrack], endPage);
-          tPages.setInt("firsttime", packTime, endPage);
-          tPages.setInt("size", DEFAULT_DATA_PAGE_SIZE, endPage);
-          tPages.setInt("keycount", 0, endPage);
-          tPages.setInt("avail", 0, endPage);
-          tPages.setInt("parts", 0, endPage);
-          tPages.setInt("lastkeytime", 0, endPage);
+          pages.setFirstKey(endPage, curPageNum[packTrack]);
+          pages.setFirstTime(endPage, packTime);
+          pages.setSize(endPage, DEFAULT_DATA_PAGE_SIZE);
+          pages.setKeycount(endPage, 0);
+          pages.setAvail(endPage, 0);
+          pages.setParts(endPage, 0);
+          pages.setLastKeyTime(endPage, 0);
           tPages.addRecords(1);
           if (livePage[packTrack]){livePage[packTrack].close();}
           DONTEVEN_MSG("Opening new page #%zu to track %" PRIu32, curPageNum[packTrack], packTrack);
@@ -470,9 +471,9 @@ namespace Mist{
           }
         }
       }
-      DONTEVEN_MSG("Setting page %" PRIu64 " lastkeyTime to %" PRIu64 " and keycount to %" PRIu64, tPages.getInt("firstkey", curPage), packTime, tPages.getInt("keycount", curPage) + 1);
-      tPages.setInt("lastkeytime", packTime, curPage);
-      tPages.setInt("keycount", tPages.getInt("keycount", curPage) + 1, curPage);
+      DONTEVEN_MSG("Setting page %" PRIu64 " lastkeyTime to %" PRIu64 " and keycount to %" PRIu64, pages.getFirstKey(curPage), packTime, pages.getKeycount(curPage) + 1);
+      pages.setLastKeyTime(curPage, packTime);
+      pages.setKeycount(curPage, pages.getKeycount(curPage) + 1);
     }
     if (!livePage[packTrack]) {
       INFO_MSG("Track %" PRIu32 " page %zu not starting with a keyframe!", packTrack, curPageNum[packTrack]);
@@ -17,6 +17,10 @@ int spawnForked(Socket::Connection &S){
   return tmp.run();
 }
 
+Mist::Output *spawnMulti(Socket::Connection &S){
+  return new mistOut(S);
+}
+
 void handleUSR1(int signum, siginfo_t *sigInfo, void *ignore){
   HIGH_MSG("USR1 received - triggering rolling restart");
   Util::Config::is_restarting = true;
@@ -50,7 +54,12 @@ int main(int argc, char *argv[]){
       }
     }
     conf.activate();
-    if (mistOut::listenMode()){
+    // Processes started for a single connection on stdin (such as by the HTTP router) ignore workers
+    bool onStdin = (conf.hasOption("ip") && conf.getString("ip").size()) ||
+                   (conf.hasOption("prequest") && conf.getString("prequest").size());
+    if (!onStdin && conf.hasOption("workers") && conf.getInteger("workers") >= 0){
+      mistOut::multiListener(conf, spawnMulti, !mistOut::listenMode());
+    }else if (mistOut::listenMode()){
       {
         struct sigaction new_action;
         new_action.sa_sigaction = handleUSR1;
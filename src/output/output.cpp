@@ -20,6 +20,7 @@
 #include <mist/util.h>
 #include <mist/urireader.h>
 #include <sys/file.h>
+#include <sys/epoll.h>
 #include <mist/encode.h>
 
 /*LTS-START*/
@@ -115,6 +116,10 @@ namespace Mist{
     firstData = true;
     newUA = true;
     lastPushUpdate = 0;
+    stepping = false;
+    stepPending = false;
+    stepLookSince = 0;
+    stepWait = 0;
     Util::Config::binaryType = Util::OUTPUT;
 
     lastRecv = Util::bootSecs();
@@ -171,6 +176,217 @@ namespace Mist{
     conf.serveForkedSocket(callback);
   }
 
+  static Output *(*multiFactory)(Socket::Connection &S) = 0;
+  static bool multiHandoff = false;
+
+  /// Returns true if this process is a multiplexed worker, handling many connections at once.
+  bool Output::isMultiplexed(){return multiFactory != 0;}
+
+  /// Returns the Unix socket path a multiplexed worker pool for the given connector listens on.
+  /// HTTP handlers pass connections to this socket instead of starting a new process, if it exists.
+  std::string Output::multiSocketPath(const std::string &connector){
+    return Util::getTmpFolder() + "MstMux_" + connector;
+  }
+
+  /// Holds a single connection handled by a multiplexed worker.
+  struct multiEntry{
+    Socket::Connection *conn;
+    Output *out;
+    uint64_t nextStep;     ///< bootMS() at which the connection is stepped next, even without socket events.
+    uint32_t events;       ///< Socket events epoll will report next for this connection, zero if none.
+    uint64_t lastUp;       ///< Bytes sent over the connection as of lastProgress.
+    uint64_t lastProgress; ///< bootMS() at which the connection last accepted data or was stepped.
+    bool done;             ///< True once stepping ended, while the last data is still being written.
+  };
+
+  /// Makes epoll report the given events (once) for the connection with the given ID.
+  static void multiArm(int ep, uint64_t id, multiEntry &E, uint32_t events){
+    if (E.events == events){return;}
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events | EPOLLONESHOT;
+    ev.data.u64 = id;
+    epoll_ctl(ep, EPOLL_CTL_MOD, E.conn->getSocket(), &ev);
+    E.events = events;
+  }
+
+  /// Accepts a single new connection for a multiplexed worker.
+  /// In handoff mode, the accepted connection carries the real client socket as a passed descriptor,
+  /// preceded by the client host on the first line and the already-received request data after it.
+  static Socket::Connection *multiAccept(Socket::Server &srv){
+    Socket::Connection S = srv.accept(true);
+    if (!S){return 0;}
+    if (!multiHandoff){return new Socket::Connection(S);}
+    S.setBlocking(true);
+    std::string payload;
+    int fd = Socket::receiveDescriptor(S.getSocket(), payload);
+    S.close();
+    if (fd < 0){
+      WARN_MSG("Handoff connection did not contain a socket");
+      return 0;
+    }
+    Socket::Connection *C = new Socket::Connection(fd);
+    size_t lf = payload.find('\n');
+    if (lf != std::string::npos){
+      if (lf){C->setHost(payload.substr(0, lf));}
+      if (payload.size() > lf + 1){C->Received().prepend(payload.substr(lf + 1));}
+    }
+    C->setBlocking(false);
+    return C;
+  }
+
+  /// Main loop of a multiplexed worker process.
+  /// Waits for socket events with epoll and steps every connection that has data waiting, is busy
+  /// sending, or asked to be woken up again at a specific time.
+  /// Connections are known by a unique ID rather than their socket, since handing a connection
+  /// off or dropping it frees the socket number for the next one while its entry still exists.
+  /// Their sockets are watched one event at a time (EPOLLONESHOT), and only re-armed while they
+  /// are not busy sending: busy connections get stepped anyway, and an unread request must not
+  /// wake us up over and over again.
+  /// Sends never block: what a connection cannot write right away is kept in its send buffer, and
+  /// the connection is not stepped again until the socket took all of it (EPOLLOUT). Connections
+  /// that accept no data at all for MULTI_SEND_TIMEOUT seconds are dropped, so a stalled viewer
+  /// cannot hold on to its buffer forever.
+  static int multiWorker(Socket::Server &srv){
+    int ep = epoll_create(1024);
+    if (ep < 0){
+      FAIL_MSG("Could not create epoll instance: %s", strerror(errno));
+      return 1;
+    }
+    fcntl(ep, F_SETFD, FD_CLOEXEC);
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u64 = 0; // Connection IDs start at 1, zero is the server socket
+    epoll_ctl(ep, EPOLL_CTL_ADD, srv.getSocket(), &ev);
+
+    std::map<uint64_t, multiEntry> conns;
+    uint64_t nextId = 1;
+    struct epoll_event evs[256];
+    while (Util::Config::is_active && srv.connected()){
+      uint64_t now = Util::bootMS();
+      int timeout = 1000;
+      for (std::map<uint64_t, multiEntry>::iterator it = conns.begin(); it != conns.end(); ++it){
+        if (it->second.nextStep <= now){
+          timeout = 0;
+          break;
+        }
+        if (it->second.nextStep - now < (uint64_t)timeout){timeout = it->second.nextStep - now;}
+      }
+      int n = epoll_wait(ep, evs, 256, timeout);
+      now = Util::bootMS();
+      for (int i = 0; i < n; ++i){
+        if (evs[i].data.u64){
+          // Events for connections we no longer have can only come from sockets that were handed
+          // off; being one-shot, they will not repeat.
+          std::map<uint64_t, multiEntry>::iterator it = conns.find(evs[i].data.u64);
+          if (it != conns.end()){
+            it->second.nextStep = now;
+            it->second.events = 0;
+          }
+          continue;
+        }
+        // Accept everything that is waiting; another worker may beat us to it, that's fine
+        Socket::Connection *C;
+        while ((C = multiAccept(srv))){
+          // Make sure connectors started from this worker don't inherit our other connections
+          fcntl(C->getSocket(), F_SETFD, FD_CLOEXEC);
+          C->setSendBuffering(true);
+          uint64_t id = nextId++;
+          multiEntry &E = conns[id];
+          E.conn = C;
+          E.out = multiFactory(*C);
+          E.nextStep = now;
+          E.events = EPOLLIN | EPOLLRDHUP;
+          E.lastUp = 0;
+          E.lastProgress = now;
+          E.done = false;
+          ev.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+          ev.data.u64 = id;
+          epoll_ctl(ep, EPOLL_CTL_ADD, C->getSocket(), &ev);
+          if (!E.out->stepStart()){E.nextStep = 0xFFFFFFFFFFFFFFFFull;}
+          HIGH_MSG("Worker now handling %zu connections", conns.size());
+        }
+      }
+      for (std::map<uint64_t, multiEntry>::iterator it = conns.begin(); it != conns.end();){
+        multiEntry &E = it->second;
+        if (E.nextStep > now && E.nextStep != 0xFFFFFFFFFFFFFFFFull){
+          ++it;
+          continue;
+        }
+        bool alive = (E.nextStep != 0xFFFFFFFFFFFFFFFFull);
+        // Connections with data waiting to be written are not stepped until it is all written
+        if (alive && !E.conn->flushSends()){
+          if (E.conn->dataUp() != E.lastUp){
+            E.lastUp = E.conn->dataUp();
+            E.lastProgress = now;
+          }
+          if (now - E.lastProgress < MULTI_SEND_TIMEOUT * 1000){
+            multiArm(ep, it->first, E, EPOLLOUT);
+            E.nextStep = now + 1000;
+            ++it;
+            continue;
+          }
+          WARN_MSG("Dropping connection that did not accept any data for %d seconds", MULTI_SEND_TIMEOUT);
+          E.conn->close();
+          alive = false;
+        }
+        if (alive && !E.done && E.out->step() && *E.conn){
+          E.lastUp = E.conn->dataUp();
+          E.lastProgress = now;
+          // Connections that are busy sending are stepped again right away, others once per second
+          if (E.out->stepWait){
+            E.nextStep = now + E.out->stepWait;
+          }else if (E.out->isBusy() || E.conn->sendPending()){
+            E.nextStep = now;
+          }else{
+            E.nextStep = now + 1000;
+          }
+          if (!E.out->isBusy()){multiArm(ep, it->first, E, EPOLLIN | EPOLLRDHUP);}
+          ++it;
+          continue;
+        }
+        // A connection that is done may still have the end of its last response to write
+        if (alive && !E.done && *E.conn && E.conn->sendPending()){
+          E.done = true;
+          E.nextStep = now;
+          ++it;
+          continue;
+        }
+        // Sockets that were handed off or dropped are already closed and out of our hands
+        if (*E.conn){epoll_ctl(ep, EPOLL_CTL_DEL, E.conn->getSocket(), &ev);}
+        E.out->stepEnd();
+        delete E.out;
+        delete E.conn;
+        conns.erase(it++);
+      }
+    }
+    for (std::map<uint64_t, multiEntry>::iterator it = conns.begin(); it != conns.end(); ++it){
+      it->second.out->stepEnd();
+      delete it->second.out;
+      delete it->second.conn;
+    }
+    close(ep);
+    return 0;
+  }
+
+  /// Opt-in alternative to listener() that handles many connections per process.
+  /// Runs the configured amount of worker processes, each multiplexing its connections through
+  /// step() instead of forking a new process per connection.
+  /// \param factory Function that creates a new output instance for the given connection.
+  /// \param handoff If true, connections are not accepted from the configured port but passed in
+  /// by HTTP handlers over the Unix socket returned by multiSocketPath().
+  void Output::multiListener(Util::Config &conf, Output *(*factory)(Socket::Connection &S), bool handoff){
+    multiFactory = factory;
+    multiHandoff = handoff;
+    // Zero means one worker per CPU core, which serveWorkerSocket takes care of
+    size_t workers = conf.getInteger("workers");
+    INFO_MSG("Serving %s connections from %s multiplexed worker(s)%s", capa["name"].asStringRef().c_str(),
+             workers ? JSON::Value((uint64_t)workers).asString().c_str() : "per-core",
+             handoff ? " via handoff socket" : "");
+    conf.serveWorkerSocket(workers, multiWorker, handoff ? multiSocketPath(capa["name"].asStringRef()) : "");
+  }
+
   void Output::setBlocking(bool blocking){
     isBlocking = blocking;
     myConn.setBlocking(isBlocking);
@@ -540,12 +756,13 @@ namespace Mist{
   
   uint64_t Output::pageNumForKey(size_t trackId, size_t keyNum){
     const Util::RelAccX &tPages = M.pages(trackId);
+    const DTSC::Pages pages = M.getPages(trackId);
     for (uint64_t i = tPages.getDeleted(); i < tPages.getEndPos(); i++){
-      uint64_t pageNum = tPages.getInt("firstkey", i);
+      uint64_t pageNum = pages.getFirstKey(i);
       if (pageNum > keyNum) continue;
-      uint64_t pageKeys = tPages.getInt("keycount", i);
+      uint64_t pageKeys = pages.getKeycount(i);
       if (keyNum > pageNum + pageKeys - 1) continue;
-      uint64_t pageAvail = tPages.getInt("avail", i);
+      uint64_t pageAvail = pages.getAvail(i);
       return pageAvail == 0 ? INVALID_KEY_NUM : pageNum;
     }
     return INVALID_KEY_NUM;
@@ -554,9 +771,10 @@ namespace Mist{
   /// Gets the highest page number available for the given trackId.
   uint64_t Output::pageNumMax(size_t trackId){
     const Util::RelAccX &tPages = M.pages(trackId);
+    const DTSC::Pages pages = M.getPages(trackId);
     uint64_t highest = 0;
     for (uint64_t i = tPages.getDeleted(); i < tPages.getEndPos(); i++){
-      uint64_t pageNum = tPages.getInt("firstkey", i);
+      uint64_t pageNum = pages.getFirstKey(i);
       if (pageNum > highest){highest = pageNum;}
     }
     return highest;
@@ -1428,7 +1646,7 @@ namespace Mist{
         if (Util::bootSecs() - lastRecv > 300){
           WARN_MSG("Disconnecting 5 minute idle connection");
           onFail("Connection idle for 5 minutes");
-        }else{
+        }else if (!stepping){
           Util::sleep(20);
         }
       }
@@ -1441,6 +1659,10 @@ namespace Mist{
     if (realTime && M.getLive() && buffer.getSyncMode()){
       firstTime += millis;
     }
+    if (stepping){
+      stepWait = millis;
+      return;
+    }
     Util::wait(millis);
   }
 
@@ -2009,6 +2231,138 @@ namespace Mist{
     return 0;
   }
 
+  /// Prepares this output for being driven by step() instead of run().
+  /// Only supports regular viewer connections: recording and segmenting is left to run().
+  /// Returns false if the connection should be closed right away.
+  bool Output::stepStart(){
+    stepping = true;
+    setBlocking(false);
+    Comms::sessionConfigCache();
+    if (isRecording()){
+      FAIL_MSG("Recording is not supported by multiplexed workers");
+      return false;
+    }
+    /*LTS-START*/
+    if (Triggers::shouldTrigger("CONN_OPEN", streamName)){
+      std::string payload =
+          streamName + "\n" + getConnectedHost() + "\n" + capa["name"].asStringRef() + "\n" + reqUrl;
+      if (!Triggers::doTrigger("CONN_OPEN", payload, streamName)){return false;}
+    }
+    /*LTS-END*/
+    return true;
+  }
+
+  /// Runs a single iteration of the client handler loop from run(), without ever sleeping.
+  /// Waits that run() would sleep for are instead stored in stepWait, for the caller to honour.
+  /// Returns false once the connection is done, after which stepEnd() must be called.
+  bool Output::step(){
+    stepWait = 0;
+    Util::setStreamName(streamName);
+    if (!keepGoing() || !(wantRequest || parseData)){return false;}
+    thisBootMs = Util::bootMS();
+    Comms::sessionConfigCache(thisBootMs);
+    if (wantRequest){requestHandler();}
+    bool sentPacket = false;
+    if (stepPending && !thisPacket){stepPending = false;}
+    if (parseData){
+      if (!isInitialized){
+        initialize();
+        if (!isInitialized){
+          onFail("Stream initialization failed");
+          return false;
+        }
+      }
+      if (!sought){initialSeek();}
+      if (!sentHeader && keepGoing()){sendHeader();}
+      if (stepPending || prepareNext()){
+        if (thisPacket){
+          stepPending = true;
+          lastPacketTime = thisTime;
+          if (firstPacketTime == 0xFFFFFFFFFFFFFFFFull){firstPacketTime = lastPacketTime;}
+          // slow down processing, if real time speed is wanted
+          if (realTime && buffer.getSyncMode() && thisTime > targetTime()){
+            stepWait = std::min(thisTime - targetTime(), (uint64_t)1000);
+            stats();
+            return true;
+          }
+          // delay the stream until metadata has caught up, if needed
+          if (needsLookAhead && M.getLive()){
+            uint64_t needsTime = thisTime + needsLookAhead;
+            bool lookReady = true;
+            for (std::map<size_t, Comms::Users>::iterator it = userSelect.begin(); it != userSelect.end(); it++){
+              if (meta.getNowms(it->first) <= needsTime){
+                lookReady = false;
+                break;
+              }
+            }
+            if (!lookReady){
+              if (!stepLookSince){stepLookSince = thisBootMs;}
+              if (thisBootMs - stepLookSince < needsLookAhead * 2 + 10000){
+                meta.reloadReplacedPagesIfNeeded();
+                stepWait = std::min((uint64_t)20, needsLookAhead);
+                stats();
+                return true;
+              }
+              WARN_MSG("Waiting for lookahead (%" PRIu64 "ms in %zu tracks) timed out - resetting lookahead!", needsLookAhead, userSelect.size());
+              needsLookAhead = 0;
+            }
+            stepLookSince = 0;
+          }
+          stepPending = false;
+          if (reachedPlannedStop() && !onFinish()){
+            INFO_MSG("Shutting down because planned stopping point reached");
+            Util::logExitReason(ER_CLEAN_INTENDED_STOP, "planned stopping point reached");
+            return false;
+          }
+          sendNext();
+          sentPacket = true;
+        }else{
+          parseData = false;
+          /*LTS-START*/
+          if (Triggers::shouldTrigger("CONN_STOP", streamName)){
+            std::string payload =
+                streamName + "\n" + getConnectedHost() + "\n" + capa["name"].asStringRef() + "\n";
+            Triggers::doTrigger("CONN_STOP", payload, streamName);
+          }
+          /*LTS-END*/
+          if (!onFinish()){
+            Util::logExitReason(ER_CLEAN_EOF, "end of stream");
+            return false;
+          }
+        }
+      }
+      if (!meta){
+        Util::logExitReason(ER_SHM_LOST, "lost internal connection to stream data");
+        return false;
+      }
+      // Busy connections that made no progress must not be stepped again right away
+      if (parseData && !sentPacket && !stepWait){stepWait = 5;}
+    }
+    stats();
+    return true;
+  }
+
+  /// Cleans up after the last step() call, like run() does when its client handler loop ends.
+  void Output::stepEnd(){
+    Util::setStreamName(streamName);
+    if (!myConn){Util::logExitReason(ER_CLEAN_REMOTE_CLOSE, "connection closed");}
+    MEDIUM_MSG("Multiplexed client handler shutting down, exit reason: %s", Util::exitReason);
+    onFinish();
+    /*LTS-START*/
+    if (Triggers::shouldTrigger("CONN_CLOSE", streamName)){
+      std::string payload =
+          streamName + "\n" + getConnectedHost() + "\n" + capa["name"].asStringRef() + "\n" + reqUrl;
+      Triggers::doTrigger("CONN_CLOSE", payload, streamName);
+    }
+    outputEndTrigger();
+    /*LTS-END*/
+    disconnect();
+    stats(true);
+    userSelect.clear();
+    Util::Procs::socketList.erase(myConn.getSocket());
+    myConn.close();
+  }
+
   void Output::dropTrack(size_t trackId, const std::string &reason, bool probablyBad){
     //We can drop from the buffer without any checks, it's a no-op if no entry exists
     buffer.dropTrack(trackId);
@@ -2130,7 +2484,12 @@ namespace Mist{
         FAIL_MSG("Could not equalize tracks! This is very very very bad and I am now going to shut down to prevent worse.");
         Util::logExitReason(ER_INTERNAL_ERROR, "Could not equalize tracks");
         parseData = false;
-        config->is_active = false;
+        // Multiplexed workers serve other connections too, so only stop this one
+        if (stepping){
+          myConn.close();
+        }else{
+          config->is_active = false;
+        }
         return false;
       }
       // actually drop what we found.
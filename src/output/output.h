@@ -26,6 +26,7 @@ namespace Mist{
   public:
     // constructor and destructor
     Output(Socket::Connection &conn);
+    virtual ~Output(){}
     // static members for initialization and capabilities
     static void init(Util::Config *cfg);
     static JSON::Value capa;
@@ -60,6 +61,15 @@ namespace Mist{
     virtual void dropTrack(size_t trackId, const std::string &reason, bool probablyBad = true);
     virtual void onRequest();
     static void listener(Util::Config &conf, int (*callback)(Socket::Connection &S));
+    static void multiListener(Util::Config &conf, Output *(*factory)(Socket::Connection &S), bool handoff);
+    static std::string multiSocketPath(const std::string &connector);
+    static bool isMultiplexed();
+    // stepped (multiplexed) alternative to run()
+    bool stepStart();
+    bool step();
+    void stepEnd();
+    uint64_t stepWait; ///< Milliseconds the last step() call asked to be left alone for, if any.
+    bool isBusy() const{return parseData;}
     virtual void initialSeek(bool dryRun = false);
     uint64_t getMinKeepAway();
     virtual bool liveSeek(bool rateOnly = false);
@@ -108,6 +118,8 @@ namespace Mist{
     uint64_t lastPushUpdate;
     uint64_t outputStartMs; ///< bootMS() at time of output start (unrelated to media start)
     bool newUA;
+    bool stepPending;      ///< True if thisPacket was prepared by step() but not sent yet.
+    uint64_t stepLookSince; ///< bootMS() at which step() started waiting for lookahead, if waiting.
     
   protected:              // these are to be messed with by child classes
     virtual bool inlineRestartCapable() const{
@@ -149,6 +161,7 @@ namespace Mist{
     bool parseData; ///< If true, triggers initalization if not already done, sending of header, sending of packets.
     bool isInitialized; ///< If false, triggers initialization if parseData is true.
     bool sentHeader;    ///< If false, triggers sendHeader if parseData is true.
+    bool stepping;      ///< If true, we're driven by step() from a multiplexed worker and may never sleep.
 
     virtual bool isRecording();
     virtual bool isFileTarget();
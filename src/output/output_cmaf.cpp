@@ -20,6 +20,9 @@ uint64_t dataUp = 0;
 uint64_t dataDown = 0;
 
 namespace Mist{
+  /// Manifests generated by any connection of this process
+  static HLS::ManifestCache manifestCache;
+
   void CMAFPushTrack::connect(std::string debugParam){
     D.setHeader("Transfer-Encoding", "chunked");
     D.prepareRequest(url, "POST");
@@ -71,11 +74,12 @@ namespace Mist{
     if (!M.getValidTracks().size()){return false;}
     uint32_t mainTrack = M.mainTrack();
     if (mainTrack == INVALID_TRACK_ID){return false;}
-    DTSC::Fragments fragments(M.fragments(mainTrack));
+    DTSC::Fragments fragments(M.getFragments(mainTrack));
     return fragments.getValidCount() > 6;
   }
 
   OutCMAF::OutCMAF(Socket::Connection &conn) : HTTPOutput(conn){
+    segFilling = false;
     // load from global config
     systemBoot = Util::getGlobalConfig("systemBoot").asInt();
     // fall back to local calculation if loading from global config fails
@@ -181,6 +185,15 @@ namespace Mist{
         "significantly, but increases compatibility somewhat.";
     capa["optional"]["nonchunked"]["option"] = "--nonchunked";
 
+    cfg->addOption("segmentcache",
+                   JSON::fromString("{\"short\":\"K\",\"long\":\"segmentcache\",\"help\":\"Share "
+                                    "generated live segments with other CMAF processes.\"}"));
+    capa["optional"]["segmentcache"]["name"] = "Shared segment cache";
+    capa["optional"]["segmentcache"]["help"] =
+        "Keeps generated segments of live streams in shared memory until they leave the buffer "
+        "window, so every segment is generated only once no matter how many viewers request it.";
+    capa["optional"]["segmentcache"]["option"] = "--segmentcache";
+
     cfg->addOption("mergesessions",
                    JSON::fromString("{\"short\":\"M\",\"long\":\"mergesessions\",\"help\":\"Merge "
                                     "together sessions from one user into a single session.\"}"));
@@ -283,7 +296,7 @@ namespace Mist{
     };
 
     // Fragment & Key handlers
-    DTSC::Fragments fragments(M.fragments(trackData.timingTrackId));
+    DTSC::Fragments fragments(M.getFragments(trackData.timingTrackId));
     DTSC::Keys keys(M.getKeys(trackData.timingTrackId));
 
     uint32_t bprErrCode = HLS::blockPlaylistReload(M, userSelect, trackData, hlsSpec, fragments, keys);
@@ -295,15 +308,25 @@ namespace Mist{
       return;
     }
 
-    HLS::FragmentData fragData;
-    HLS::populateFragmentData(M, userSelect, fragData, trackData, fragments, keys);
-
-    std::stringstream result;
-    HLS::addStartingMetaTags(result, fragData, trackData, hlsSpec);
-    HLS::addMediaFragments(result, M, fragData, trackData, fragments, keys);
-    HLS::addEndingTags(result, M, userSelect, fragData, trackData);
+    // Everything other than the version that changes the playlist
+    std::stringstream cacheKey;
+    cacheKey << streamName << "/" << requestTid << "/" << timingTid << "/" << noLLHLS << "/"
+             << hlsSpec.hlsSkip << "/" << trackData.initMsn << "/" << trackData.sessionId << "/" << urlPrefix;
+    uint64_t version = HLS::playlistVersion(M, userSelect, trackData);
+    std::string manifest;
+    if (!manifestCache.get(cacheKey.str(), version, manifest)){
+      HLS::FragmentData fragData;
+      HLS::populateFragmentData(M, userSelect, fragData, trackData, fragments, keys);
+
+      std::stringstream result;
+      HLS::addStartingMetaTags(result, fragData, trackData, hlsSpec);
+      HLS::addMediaFragments(result, M, fragData, trackData, fragments, keys);
+      HLS::addEndingTags(result, M, userSelect, fragData, trackData);
+      manifest = result.str();
+      manifestCache.set(cacheKey.str(), version, manifest);
+    }
 
-    H.SetBody(result.str());
+    H.SetBody(manifest);
     H.SendResponse("200", "OK", myConn);
   }// namespace Mist
 
@@ -441,6 +464,25 @@ namespace Mist{
       return;
     }
 
+    segFilling = false;
+    segData.clear();
+    if (config->getBool("segmentcache") && M.getLive()){
+      std::stringstream trks;
+      trks << idx << "_" << mTrack;
+      segCache.reload(streamName);
+      uint64_t key = Util::SegmentCache::segmentKey("cmaf", trks.str(), startTime, targetTime);
+      // Multiplexed workers must not block on another process: they generate the segment themselves
+      uint64_t maxWait = isMultiplexed() ? 0 : targetTime - startTime + 5000;
+      Util::SegmentCache::lookupResult cached = segCache.lookup(key, M, idx, startTime, maxWait);
+      if (cached == Util::SegmentCache::SEGCACHE_HIT){
+        H.StartResponse(H, myConn, config->getBool("nonchunked"));
+        H.Chunkify(segCache.data(), segCache.size(), myConn);
+        H.Chunkify("", 0, myConn);
+        return;
+      }
+      segFilling = (cached == Util::SegmentCache::SEGCACHE_FILL);
+    }
+
     std::string headerData =
         CMAF::keyHeader(M, idx, startTime, targetTime, fragmentIndex, false, false);
 
@@ -451,6 +493,10 @@ namespace Mist{
     H.StartResponse(H, myConn, config->getBool("nonchunked"));
     H.Chunkify(headerData.c_str(), headerData.size(), myConn);
     H.Chunkify(mdatHeader, 8, myConn);
+    if (segFilling){
+      segData = headerData;
+      segData.append(mdatHeader, 8);
+    }
 
     seek(startTime);
 
@@ -467,6 +513,11 @@ namespace Mist{
       HIGH_MSG("Finished playback to %" PRIu64, targetTime);
       wantRequest = true;
       parseData = false;
+      if (segFilling){
+        segCache.store(segData);
+        segData.clear();
+        segFilling = false;
+      }
       H.Chunkify("", 0, myConn);
       return;
     }
@@ -474,6 +525,7 @@ namespace Mist{
     size_t dataLen;
     thisPacket.getString("data", data, dataLen);
     H.Chunkify(data, dataLen, myConn);
+    if (segFilling){segData.append(data, dataLen);}
   }
 
   /***************************************************************************************************/
@@ -501,7 +553,7 @@ namespace Mist{
     size_t mainTrack = *M.getValidTracks().begin(); // M.mainTrack();
 
     if (mainTrack == INVALID_TRACK_ID){return;}
-    DTSC::Fragments fragments(M.fragments(mainTrack));
+    DTSC::Fragments fragments(M.getFragments(mainTrack));
     uint32_t firstFragment = fragments.getFirstValid();
     uint32_t lastFragment = fragments.getEndValid();
     bool first = true;
@@ -670,6 +722,17 @@ namespace Mist{
 
     if (!vTracks.size() && !aTracks.size()){return "";}
 
+    // Segment lists follow the first valid track
+    size_t listTrack = *M.getValidTracks().begin();
+    std::stringstream cacheKey;
+    cacheKey << streamName << "/mpd/" << checkAlignment << "/" << listTrack;
+    for (std::map<size_t, Comms::Users>::iterator it = userSelect.begin(); it != userSelect.end(); it++){
+      cacheKey << "/" << it->first;
+    }
+    uint64_t version = HLS::playlistVersion(M, listTrack, M.getLastms(listTrack));
+    std::string manifest;
+    if (manifestCache.get(cacheKey.str(), version, manifest)){return manifest;}
+
     bool videoAligned = checkAlignment && tracksAligned(vTracks);
     bool audioAligned = checkAlignment && tracksAligned(aTracks);
 
@@ -716,6 +779,7 @@ namespace Mist{
 
     r << "</Period></MPD>" << std::endl;
 
+    manifestCache.set(cacheKey.str(), version, r.str());
     return r.str();
   }
 
@@ -1,6 +1,7 @@
 #include "output_http.h"
 #include <mist/downloader.h>
 #include <mist/http_parser.h>
+#include <mist/segcache.h>
 // #include <mist/mp4_generic.h>
 
 namespace Mist{
@@ -64,6 +65,9 @@ namespace Mist{
     bool tracksAligned(const std::set<size_t> &trackList);
     std::string buildNalUnit(size_t len, const char *data);
     uint64_t targetTime;
+    Util::SegmentCache segCache;
+    bool segFilling;     ///< True if the current segment is generated for the segment cache
+    std::string segData; ///< The current segment so far, if it is generated for the segment cache
 
     std::string h264init(const std::string &initData);
     std::string h265init(const std::string &initData);
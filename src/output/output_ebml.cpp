@@ -168,7 +168,7 @@ namespace Mist{
         // EXCEPT when they are more than 30 seconds long, because clusters are limited to -32 to 32
         // seconds.
         size_t idx = getMainSelectedTrack();
-        DTSC::Fragments fragments(M.fragments(idx));
+        DTSC::Fragments fragments(M.getFragments(idx));
         uint32_t fragIndice = M.getFragmentIndexForTime(idx, currentClusterTime);
         newClusterTime = M.getTimeForFragmentIndex(idx, fragIndice) + fragments.getDuration(fragIndice);
         // Limit clusters to 30s, and the last fragment should always be 30s, just in case.
@@ -530,7 +530,7 @@ namespace Mist{
     // Which, in turn, is dependent on the Cluster offsets.
     // We make this a bit easier by pre-calculating the sizes of all clusters first
     uint64_t fragNo = 0;
-    DTSC::Fragments fragments(M.fragments(idx));
+    DTSC::Fragments fragments(M.getFragments(idx));
     for (size_t i = fragments.getFirstValid(); i < fragments.getEndValid(); i++){
       uint64_t clusterStart = M.getTimeForFragmentIndex(idx, i);
       uint64_t clusterEnd = clusterStart + fragments.getDuration(i);
@@ -77,8 +77,8 @@ namespace Mist{
         }
       }
     }
-    tag.DTSCLoader(thisPacket, M, thisIdx);
     if (M.getCodec(thisIdx) == "PCM" && M.getSize(thisIdx) == 16){
+      tag.DTSCLoader(thisPacket, M, thisIdx);
       char *ptr = tag.getData();
       uint32_t ptrSize = tag.getDataLen();
       for (uint32_t i = 0; i < ptrSize; i += 2){
@@ -86,9 +86,29 @@ namespace Mist{
         ptr[i] = ptr[i + 1];
         ptr[i + 1] = tmpchar;
       }
+      myConn.SendNow(tag.data, tag.len);
+    }else if (tag.DTSCLoader(thisPacket, M, thisIdx, false)){
+      // Send the payload straight from the packet, between the tag header and trailer
+      char *dataPointer = 0;
+      size_t dataLen = 0;
+      thisPacket.getString("data", dataPointer, dataLen);
+      struct iovec parts[3];
+      parts[0].iov_base = tag.data;
+      parts[0].iov_len = tag.len - 4 - dataLen;
+      parts[1].iov_base = dataPointer;
+      parts[1].iov_len = dataLen;
+      parts[2].iov_base = tag.data + tag.len - 4;
+      parts[2].iov_len = 4;
+      myConn.SendNow(parts, 3);
+    }
+    if (config->getBool("keyframeonly")){
+      // Multiplexed workers serve other connections too, so only stop this one
+      if (stepping){
+        myConn.close();
+      }else{
+        config->is_active = false;
+      }
     }
-    myConn.SendNow(tag.data, tag.len);
-    if (config->getBool("keyframeonly")){config->is_active = false;}
   }
 
   void OutFLV::sendHeader(){
@@ -34,7 +34,7 @@ namespace Mist{
   ///\param tid The track this bootstrap is generated for.
   ///\return The generated bootstrap.
   std::string OutHDS::dynamicBootstrap(size_t idx){
-    DTSC::Fragments fragments(M.fragments(idx));
+    DTSC::Fragments fragments(M.getFragments(idx));
     DTSC::Keys keys(M.getKeys(idx));
     std::string empty;
 
@@ -247,7 +247,7 @@ namespace Mist{
       }
       // delay if we don't have the next fragment available yet
       unsigned int timeout = 0;
-      DTSC::Fragments fragments(M.fragments(idx));
+      DTSC::Fragments fragments(M.getFragments(idx));
       DTSC::Keys keys(M.getKeys(idx));
       while (myConn && fragIdx >= fragments.getEndValid() - 1){
         // time out after 21 seconds
@@ -1,17 +1,21 @@
 #include "output_hls.h"
+#include <mist/hls_support.h>
 #include <mist/langcodes.h> /*LTS*/
 #include <mist/stream.h>
 #include <mist/url.h>
 #include <unistd.h>
 
 namespace Mist{
+  /// Media playlists generated by any connection of this process
+  static HLS::ManifestCache manifestCache;
+
   bool OutHLS::isReadyForPlay(){
     if (!isInitialized){return false;}
     meta.reloadReplacedPagesIfNeeded();
     if (!M.getValidTracks().size()){return false;}
     uint32_t mainTrack = M.mainTrack();
     if (mainTrack == INVALID_TRACK_ID){return false;}
-    DTSC::Fragments fragments(M.fragments(mainTrack));
+    DTSC::Fragments fragments(M.getFragments(mainTrack));
     return fragments.getValidCount() > 4;
   }
 
@@ -90,6 +94,11 @@ namespace Mist{
     if (M.getType(timingTid) != "video"){timingTid = M.mainTrack();}
     if (timingTid == INVALID_TRACK_ID){timingTid = tid;}
 
+    std::string cacheKey = streamName + "/" + JSON::Value(tid).asString() + "/" + tknStr + "/" + urlPrefix;
+    uint64_t version = HLS::playlistVersion(M, timingTid, M.getLastms(timingTid));
+    std::string manifest;
+    if (manifestCache.get(cacheKey, version, manifest)){return manifest;}
+
     std::stringstream result;
     // parse single track
     uint32_t targetDuration = (M.biggestFragment(timingTid) / 1000) + 1;
@@ -109,7 +118,7 @@ namespace Mist{
     std::deque<uint16_t> durations;
     uint32_t totalDuration = 0;
     DTSC::Keys keys(M.keys(timingTid));
-    DTSC::Fragments fragments(M.fragments(timingTid));
+    DTSC::Fragments fragments(M.getFragments(timingTid));
     uint32_t firstFragment = fragments.getFirstValid();
     uint32_t endFragment = fragments.getEndValid();
     for (int i = firstFragment; i < endFragment; i++){
@@ -169,6 +178,7 @@ namespace Mist{
     }
     if (!M.getLive() || !totalDuration){result << "#EXT-X-ENDLIST\r\n";}
     HIGH_MSG("Sending this index: %s", result.str().c_str());
+    manifestCache.set(cacheKey, version, result.str());
     return result.str();
   }
 
@@ -176,8 +186,10 @@ namespace Mist{
     uaDelay = 0;
     realTime = 0;
     until = 0xFFFFFFFFFFFFFFFFull;
+    segFilling = false;
     // If this connection is a socket and not already connected to stdio, connect it to stdio.
-    if (myConn.getPureSocket() != -1 && myConn.getSocket() != STDIN_FILENO && myConn.getSocket() != STDOUT_FILENO){
+    // Multiplexed workers handle many connections, so never take over stdio there.
+    if (!isMultiplexed() && myConn.getPureSocket() != -1 && myConn.getSocket() != STDIN_FILENO && myConn.getSocket() != STDOUT_FILENO){
       std::string host = getConnectedHost();
       dup2(myConn.getSocket(), STDIN_FILENO);
       dup2(myConn.getSocket(), STDOUT_FILENO);
@@ -236,6 +248,15 @@ namespace Mist{
         "significantly, but increases compatibility somewhat.";
     capa["optional"]["nonchunked"]["option"] = "--nonchunked";
 
+    cfg->addOption("segmentcache",
+                   JSON::fromString("{\"short\":\"K\",\"long\":\"segmentcache\",\"help\":\"Share "
+                                    "generated live segments with other HLS processes.\"}"));
+    capa["optional"]["segmentcache"]["name"] = "Shared segment cache";
+    capa["optional"]["segmentcache"]["help"] =
+        "Keeps generated segments of live streams in shared memory until they leave the buffer "
+        "window, so every segment is generated only once no matter how many viewers request it.";
+    capa["optional"]["segmentcache"]["option"] = "--segmentcache";
+
     cfg->addOption("chunkpath",
                    JSON::fromString("{\"arg\":\"string\",\"default\":\"\",\"short\":\"e\",\"long\":"
                                     "\"chunkpath\",\"help\":\"Alternate URL path to "
@@ -402,6 +423,29 @@ namespace Mist{
         return;
       }
 
+      segFilling = false;
+      segData.clear();
+      if (config->getBool("segmentcache") && M.getLive()){
+        std::stringstream trks;
+        for (std::map<size_t, Comms::Users>::iterator it = userSelect.begin(); it != userSelect.end(); ++it){
+          trks << it->first << "_";
+        }
+        segCache.reload(streamName);
+        uint64_t key = Util::SegmentCache::segmentKey("ts", trks.str(), from, until);
+        // Multiplexed workers must not block on another process: they generate the segment themselves
+        uint64_t maxWait = isMultiplexed() ? 0 : until - from + 5000;
+        Util::SegmentCache::lookupResult cached = segCache.lookup(key, M, vidTrack, from, maxWait);
+        if (cached == Util::SegmentCache::SEGCACHE_HIT){
+          H.StartResponse(H, myConn, VLCworkaround || config->getBool("nonchunked"));
+          responded = true;
+          H.Chunkify(segCache.data(), segCache.size(), myConn);
+          H.Chunkify("", 0, myConn);
+          H.Clean();
+          return;
+        }
+        segFilling = (cached == Util::SegmentCache::SEGCACHE_FILL);
+      }
+
       H.StartResponse(H, myConn, VLCworkaround || config->getBool("nonchunked"));
       responded = true;
       // we assume whole fragments - but timestamps may be altered at will
@@ -474,6 +518,16 @@ namespace Mist{
           packData.clear();
         }
       }
+      if (tsBuffer.size()){
+        H.Chunkify(tsBuffer, myConn);
+        tsBuffer.clear();
+      }
+
+      if (segFilling){
+        segCache.store(segData);
+        segData.clear();
+        segFilling = false;
+      }
 
       // Signal end of data
       H.Chunkify("", 0, myConn);
@@ -482,9 +536,22 @@ namespace Mist{
     }
     // Invoke the generic TS output sendNext handler
     TSOutput::sendNext();
+    // Send all TS packets of this frame as a single chunk, instead of a chunk per TS packet
+    if (tsBuffer.size()){
+      H.Chunkify(tsBuffer, myConn);
+      tsBuffer.clear();
+    }
   }
 
-  void OutHLS::sendTS(const char *tsData, size_t len){H.Chunkify(tsData, len, myConn);}
+  /// Collects the TS packets of the current frame in tsBuffer, to be sent as a single chunk.
+  /// The packets are copied rather than gathered by pointer for a writev: TSOutput builds every
+  /// packet in the same packData buffer (and the PAT, PMT and SDT in buffers that are reused too),
+  /// so a packet pointer is only valid until the next packet is made. The copy is a memcpy into a
+  /// buffer that keeps its capacity between frames, so it does not allocate once warmed up.
+  void OutHLS::sendTS(const char *tsData, size_t len){
+    tsBuffer.append(tsData, len);
+    if (segFilling){segData.append(tsData, len);}
+  }
 
   void OutHLS::onFail(const std::string &msg, bool critical){
     if (HTTP::URL(H.url).getExt().substr(0, 3) != "m3u"){
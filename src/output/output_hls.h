@@ -1,5 +1,6 @@
 #include "output_http.h"
 #include "output_ts_base.h"
+#include <mist/segcache.h>
 
 namespace Mist{
   class OutHLS : public TSOutput{
@@ -23,6 +24,10 @@ namespace Mist{
     size_t vidTrack;
     size_t audTrack;
     uint64_t until;
+    std::string tsBuffer; ///< Copies of the TS packets of the current frame, sent as a single chunk
+    Util::SegmentCache segCache;
+    bool segFilling;     ///< True if the current segment is generated for the segment cache
+    std::string segData; ///< The current segment so far, if it is generated for the segment cache
   };
 }// namespace Mist
 
@@ -62,6 +62,12 @@ namespace Mist{
     cfg->addOption("prequest", JSON::fromString("{\"arg\":\"string\",\"short\":\"R\",\"long\":"
                                                 "\"prequest\",\"help\":\"Data to pretend arrived "
                                                 "on the socket before parsing the socket.\"}"));
+    capa["optional"]["workers"]["name"] = "Multiplexed workers";
+    capa["optional"]["workers"]["help"] = "If set, serves connections from this many event-driven worker processes, each handling many connections, instead of one process per connection. Zero means one worker per CPU core; -1 disables multiplexed workers.";
+    capa["optional"]["workers"]["type"] = "int";
+    capa["optional"]["workers"]["option"] = "--workers";
+    capa["optional"]["workers"]["short"] = "W";
+    capa["optional"]["workers"]["default"] = -1;
     cfg->addBasicConnectorOptions(capa);
   }
 
@@ -271,12 +277,14 @@ namespace Mist{
         idleLast = Util::bootMS();
         return;
       }
-      if (!isBlocking && !parseData){Util::sleep(100);}
+      if (!isBlocking && !parseData && !stepping){Util::sleep(100);}
       return;
     }
 
     //Attempt to read a HTTP request, regardless of data being available
     bool sawRequest = false;
+    // Multiplexed workers only get here when data is waiting, so read it in first
+    if (stepping){myConn.spool();}
     while (H.Read(myConn)){
       sawRequest = true;
 
@@ -364,7 +372,8 @@ namespace Mist{
 
         if (handler != capa["name"].asStringRef()){
           reConnector(handler);
-          onFail("Server error - could not start connector", true);
+          // A successful handoff to another process or worker pool leaves us without connection
+          if (myConn){onFail("Server error - could not start connector", true);}
           return;
         }
       }
@@ -457,7 +466,7 @@ namespace Mist{
       H.Clean();
     }
     // If we can't read anything more and we're non-blocking, sleep some.
-    if (!sawRequest && !myConn.spool() && !isBlocking && !parseData){Util::sleep(100);}
+    if (!sawRequest && !stepping && !myConn.spool() && !isBlocking && !parseData){Util::sleep(100);}
   }
 
   /// Handles standardized WebSocket commands.
@@ -878,6 +887,8 @@ namespace Mist{
 
   static inline void builPipedPart(JSON::Value &p, char *argarr[], int &argnum, const JSON::Value &argset){
     jsonForEachConst(argset, it){
+      // The started process serves a single connection on stdin, never a worker pool
+      if (it.key() == "workers"){continue;}
       if (it->isMember("option") && p.isMember(it.key())){
         if (!it->isMember("type")){
           if (JSON::Value(p[it.key()]).asBool()){
@@ -970,6 +981,37 @@ namespace Mist{
     std::string tmparg = Util::getMyPath() + std::string("MistOut") + connector;
     std::string tmpPrequest;
     if (H.url.size()){tmpPrequest = H.BuildRequest();}
+
+    // Pass the connection to a multiplexed worker pool for this connector, if one is running
+    std::string muxPath = multiSocketPath(connector);
+    struct stat muxStat;
+    if (!stat(muxPath.c_str(), &muxStat)){
+      Socket::Connection mux(muxPath);
+      if (mux && Socket::sendDescriptor(mux.getSocket(), myConn.getSocket(), Output::getConnectedHost() + "\n" + tmpPrequest)){
+        MEDIUM_MSG("Passed connection to %s worker pool", connector.c_str());
+        Util::logExitReason(ER_CLEAN_INTENDED_STOP, "connection passed to %s worker pool", connector.c_str());
+        wantRequest = false;
+        parseData = false;
+        myConn.drop();
+        return;
+      }
+    }
+    // Multiplexed workers must keep running, so they start the new process as a child instead
+    if (stepping){
+      pid_t pid = fork();
+      if (pid < 0){
+        FAIL_MSG("Could not fork for %s connector: %s", connector.c_str(), strerror(errno));
+        return;
+      }
+      if (pid){
+        wantRequest = false;
+        parseData = false;
+        myConn.drop();
+        return;
+      }
+      dup2(myConn.getSocket(), STDIN_FILENO);
+      dup2(myConn.getSocket(), STDOUT_FILENO);
+    }
     int argnum = 0;
     argarr[argnum++] = (char *)tmparg.c_str();
     std::string debuglevel = JSON::Value(Util::printDebugLevel).asString();
@@ -990,6 +1032,11 @@ namespace Mist{
 
     /// start new/better process
     execv(argarr[0], argarr);
+    // A forked child of a multiplexed worker must never return into the worker's event loop
+    if (stepping){
+      FAIL_MSG("Could not start %s connector: %s", connector.c_str(), strerror(errno));
+      _exit(1);
+    }
   }
 
   std::string HTTPOutput::getConnectedHost(){
@@ -1054,8 +1101,8 @@ namespace Mist{
         // entire file if starting before byte zero
         byteStart = 0;
       }else{
-        // start byteStart bytes before byteEnd
-        byteStart = byteEnd - byteStart;
+        // the last byteStart bytes, up to and including byteEnd
+        byteStart = byteEnd + 1 - byteStart;
       }
       MEDIUM_MSG("Range request: %" PRIu64 "-%" PRIu64 " (%s)", byteStart, byteEnd, header.c_str());
       return true;
@@ -40,7 +40,8 @@ namespace Mist{
     stayConnected = false;
     thisError = "";
     // If this connection is a socket and not already connected to stdio, connect it to stdio.
-    if (myConn.getPureSocket() != -1 && myConn.getSocket() != STDIN_FILENO && myConn.getSocket() != STDOUT_FILENO){
+    // Multiplexed workers handle many connections, so never take over stdio there.
+    if (!isMultiplexed() && myConn.getPureSocket() != -1 && myConn.getSocket() != STDIN_FILENO && myConn.getSocket() != STDOUT_FILENO){
       std::string host = getConnectedHost();
       dup2(myConn.getSocket(), STDIN_FILENO);
       dup2(myConn.getSocket(), STDOUT_FILENO);
@@ -1,5 +1,7 @@
 #include "output_http_minimalserver.h"
-#include <fstream>
+#include <fcntl.h>
+#include <sstream>
+#include <sys/stat.h>
 
 namespace Mist{
   OutHTTPMinimalServer::OutHTTPMinimalServer(Socket::Connection &conn) : HTTPOutput(conn){
@@ -59,24 +61,49 @@ namespace Mist{
       return;
     }
 
-    char buffer[4096];
-    std::ifstream inFile(path.c_str());
-    inFile.seekg(0, std::ios_base::end);
-    unsigned long long filesize = inFile.tellg();
-    inFile.seekg(0, std::ios_base::beg);
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat fileStat;
+    if (fd < 0 || fstat(fd, &fileStat) || !S_ISREG(fileStat.st_mode)){
+      WARN_MSG("URL %s could not be opened as a file: %s", H.url.c_str(), path.c_str());
+      if (fd >= 0){::close(fd);}
+      H.Clean();
+      H.SetHeader("Server", APPIDENT);
+      H.setCORSHeaders();
+      H.SetBody("File not found");
+      H.SendResponse("404", "OK", myConn);
+      return;
+    }
+    uint64_t filesize = fileStat.st_size;
+    uint64_t byteStart = 0;
+    uint64_t byteEnd = filesize ? filesize - 1 : 0;
+    std::string range = H.GetHeader("Range");
     H.Clean();
     H.SetHeader("Server", APPIDENT);
-    H.SetHeader("Content-Length", filesize);
+    H.SetHeader("Accept-Ranges", "bytes");
     H.setCORSHeaders();
+    if (range.size() && filesize){
+      if (!parseRange(range, byteStart, byteEnd) || byteStart > byteEnd){
+        ::close(fd);
+        H.SetBody("Requested Range Not Satisfiable");
+        H.SendResponse("416", "Requested Range Not Satisfiable", myConn);
+        return;
+      }
+      std::stringstream rangeReply;
+      rangeReply << "bytes " << byteStart << "-" << byteEnd << "/" << filesize;
+      H.SetHeader("Content-Range", rangeReply.str());
+    }
+    uint64_t sendLen = filesize ? byteEnd - byteStart + 1 : 0;
+    H.SetHeader("Content-Length", sendLen);
+    bool partial = range.size() && filesize;
     if (method == "OPTIONS" || method == "HEAD"){
-      H.SendResponse("200", "OK", myConn);
+      ::close(fd);
+      H.SendResponse(partial ? "206" : "200", partial ? "Partial content" : "OK", myConn);
       H.Clean();
       return;
     }
-    H.SendResponse("200", "OK", myConn);
-    while (inFile.good()){
-      inFile.read(buffer, 4096);
-      myConn.SendNow(buffer, inFile.gcount());
-    }
+    H.SendResponse(partial ? "206" : "200", partial ? "Partial content" : "OK", myConn);
+    // The file is served unmodified, so let the kernel send it straight from the page cache
+    myConn.sendFile(fd, byteStart, sendLen);
+    ::close(fd);
   }
 }// namespace Mist
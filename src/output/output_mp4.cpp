@@ -7,6 +7,7 @@
 #include <mist/mp4_dash.h>
 #include <mist/mp4_encryption.h>
 #include <mist/mp4_generic.h>
+#include <mist/mp4_index.h>
 #include <mist/stream.h> /* for `Util::codecString()` when streaming mp4 over websockets and playback using media source extensions. */
 #include <mist/nal.h>
 #include <inttypes.h>
@@ -16,6 +17,9 @@ std::set<std::string> supportedAudio;
 std::set<std::string> supportedVideo;
 
 namespace Mist{
+  /// Header and byte offset index of the progressive MP4 file last requested from this process
+  static MP4::ProgressiveIndex progressiveIndex;
+
   std::string toUTF16(const std::string &original){
     std::stringstream result;
     result << (char)0xFF << (char)0xFE;
@@ -113,6 +117,7 @@ namespace Mist{
     endTime = 0xffffffffffffffffull;
     realBaseOffset = 1;
     timeOffset = 0;
+    indexed = false;
   }
   OutMP4::~OutMP4(){}
 
@@ -783,6 +788,21 @@ namespace Mist{
     if (byteStart <= headerSize){return;}
     // okay, we're past the header. Substract the headersize from the starting postion.
     byteStart -= headerSize;
+    // skip ahead to the last indexed part before the position, if we can
+    if (indexed){
+      std::deque<MP4::IndexPart> next;
+      uint64_t indexedPos = progressiveIndex.seek(byteStart, next);
+      sortSet.clear();
+      for (std::deque<MP4::IndexPart>::iterator it = next.begin(); it != next.end(); ++it){
+        keyPart temp;
+        temp.trackID = it->trackID;
+        temp.time = it->time;
+        temp.index = it->index;
+        sortSet.insert(temp);
+      }
+      byteStart -= indexedPos;
+      currPos += indexedPos;
+    }
     // forward through the file by headers, until we reach the point where we need to be
     while (!sortSet.empty()){
       // find the next part and erase it
@@ -821,6 +841,47 @@ namespace Mist{
     // That's technically legal, of course.
   }
 
+  /// Makes sure progressiveIndex holds the header and byte offset index of the progressive MP4
+  /// file for the selected tracks, loading it from the temporary folder if another process stored
+  /// it there, or building and storing it otherwise. Sets and returns indexed.
+  bool OutMP4::loadProgressiveIndex(){
+    indexed = false;
+    std::set<size_t> tracks;
+    for (std::map<size_t, Comms::Users>::const_iterator it = userSelect.begin(); it != userSelect.end(); it++){
+      if (prevVidTrack != INVALID_TRACK_ID && it->first == prevVidTrack){continue;}
+      tracks.insert(it->first);
+    }
+    if (!tracks.size()){return false;}
+    std::stringstream select;
+    select << streamName << (sending3GP ? "/3gp" : "/mp4");
+    for (std::set<size_t>::iterator it = tracks.begin(); it != tracks.end(); ++it){select << "/" << *it;}
+    std::string key = select.str() + "/" + MP4::ProgressiveIndex::fingerprint(M, tracks);
+    if (progressiveIndex.key == key){return (indexed = true);}
+
+    // One file per stream and track selection, overwritten whenever the metadata changes
+    char fileName[64];
+    snprintf(fileName, 64, "MstMP4_%08x", checksum::crc32(0, select.str().data(), select.str().size()));
+    std::string indexFile = Util::getTmpFolder() + fileName;
+    if (progressiveIndex.read(indexFile, key)){
+      HIGH_MSG("Loaded MP4 index %s", indexFile.c_str());
+      return (indexed = true);
+    }
+
+    uint64_t start = Util::bootMS();
+    progressiveIndex.clear();
+    Util::ResizeablePointer headerData;
+    uint64_t size = 0;
+    if (!mp4Header(headerData, size, 0)){return false;}
+    progressiveIndex.build(M, tracks);
+    progressiveIndex.key = key;
+    progressiveIndex.header.assign((const char *)headerData, headerData.size());
+    progressiveIndex.fileSize = size;
+    progressiveIndex.write(indexFile);
+    MEDIUM_MSG("Built MP4 index %s with %zu checkpoints in %" PRIu64 "ms", indexFile.c_str(),
+               progressiveIndex.getCheckpoints(), Util::bootMS() - start);
+    return (indexed = true);
+  }
+
   // ------------------------------------------------------------
 
   size_t OutMP4::fragmentHeaderSize(std::deque<size_t>& sortedTracks, std::set<keyPart>& trunOrder, uint64_t startFragmentTime, uint64_t endFragmentTime) {
@@ -1116,7 +1177,13 @@ namespace Mist{
     sending3GP = (req.url.find(".3gp") != std::string::npos);
 
     fileSize = 0;
-    headerSize = mp4HeaderSize(fileSize, M.getLive());
+    indexed = false;
+    if (!M.getLive() && loadProgressiveIndex()){
+      fileSize = progressiveIndex.fileSize;
+      headerSize = progressiveIndex.header.size();
+    }else{
+      headerSize = mp4HeaderSize(fileSize, M.getLive());
+    }
 
     seekPoint = Output::startTime();
     // for live we use fragmented mode
@@ -1176,7 +1243,10 @@ namespace Mist{
     byteEnd++;
     if (byteStart < headerSize){
       // For storing the header.
-      if ((!startTime && endTime == 0xffffffffffffffffull) || (endTime == 0)){
+      if (indexed){
+        H.Chunkify(progressiveIndex.header.data() + byteStart, std::min(headerSize, byteEnd) - byteStart, myConn);
+        leftOver -= std::min(headerSize, byteEnd) - byteStart;
+      }else if ((!startTime && endTime == 0xffffffffffffffffull) || (endTime == 0)){
         Util::ResizeablePointer headerData;
         if (!mp4Header(headerData, fileSize, M.getLive())){
           FAIL_MSG("Could not generate MP4 header!");
@@ -92,6 +92,7 @@ namespace Mist{
                                         uint64_t endFragmentTime); // this builds the moof box for fragmented MP4
 
     void findSeekPoint(uint64_t byteStart, uint64_t &seekPoint, uint64_t headerSize);
+    bool loadProgressiveIndex();
     void appendSinglePacketMoof(Util::ResizeablePointer& moofOut, size_t extraBytes = 0); 
     size_t fragmentHeaderSize(std::deque<size_t>& sortedTracks, std::set<keyPart>& trunOrder, uint64_t startFragmentTime, uint64_t endFragmentTime);
     void respondHTTP(const HTTP::Parser & req, bool headersOnly);
@@ -119,6 +120,7 @@ namespace Mist{
 
     // variables for standard MP4
     std::set<keyPart> sortSet; // needed for unfragmented MP4, remembers the order of keyparts
+    bool indexed;              // true if the progressive index matches the current request
 
     // variables for fragmented
     size_t fragSeqNum;       // the sequence number of the next keyframe/fragment when producing
@@ -61,8 +61,9 @@ namespace Mist{
   ///\param data The RTP Packet that needs to be sent
   ///\param len The size of data
   ///\param channel Not used here, but is kept for compatibility with sendTCP
+  /// Packets are queued on the socket, to be sent in a batch by flushQueue.
   void sendUDP(void *socket, const char *data, size_t len, uint8_t){
-    ((Socket::UDPConnection *)socket)->SendNow(data, len);
+    ((Socket::UDPConnection *)socket)->sendPaced(data, len);
     if (mainConn){mainConn->addUp(len);}
   }
 
@@ -167,6 +168,11 @@ namespace Mist{
       }
       sdpState.tracks[thisIdx].rtcpSent = Util::bootSecs();
     }
+    // Send all RTP and RTCP packets of this frame at once
+    if (sdpState.tracks[thisIdx].channel == -1){
+      sdpState.tracks[thisIdx].data.flushQueue();
+      sdpState.tracks[thisIdx].rtcp.flushQueue();
+    }
 
     static uint64_t lastAnnounce = Util::bootSecs();
     if (reqUrl.size() && lastAnnounce + 5 < Util::bootSecs()){
@@ -500,6 +506,7 @@ namespace Mist{
       if (userSelect.count(it->first) && Util::bootSecs() / 5 != it->second.rtcpSent){
         it->second.rtcpSent = Util::bootSecs() / 5;
         it->second.pack.sendRTCP_RR(it->second, sendUDP);
+        it->second.rtcp.flushQueue();
       }
     }
   }
@@ -222,6 +222,18 @@ namespace Mist{
     Output::initialSeek(dryRun);
   }
 
+  /// Sends the datagrams of each frame in a batch, after the whole frame was queued by sendTS.
+  void OutTS::sendNext(){
+    TSOutput::sendNext();
+    if (pushOut){
+      pushSock.flushQueue();
+      if (sendFEC){
+        fecColumnSock.flushQueue();
+        fecRowSock.flushQueue();
+      }
+    }
+  }
+
   void OutTS::sendTS(const char *tsData, size_t len){
     if (pushOut){
       static size_t curFilled = 0;
@@ -243,7 +255,7 @@ namespace Mist{
             myConn.addUp(bytesSent);
           }
         }else{
-          pushSock.SendNow(packetBuffer);
+          pushSock.sendPaced(packetBuffer.data(), packetBuffer.size());
           myConn.addUp(packetBuffer.size());
         }
         packetBuffer.clear();
@@ -8,6 +8,7 @@ namespace Mist{
     ~OutTS();
     static void init(Util::Config *cfg);
     void sendTS(const char *tsData, size_t len = 188);
+    void sendNext();
     static bool listenMode();
     virtual void initialSeek(bool dryRun = false);
     bool isReadyForPlay();
@@ -10,54 +10,26 @@ namespace Mist{
     lastHeaderTime = 0;
   }
 
-  void TSOutput::fillPacket(char const *data, size_t dataLen, bool &firstPack, bool video,
-                            bool keyframe, size_t pkgPid, uint16_t &contPkg){
-    do{
-      if (!packData.getBytesFree()){
-        if ((sendRepeatingHeaders && thisPacket.getTime() - lastHeaderTime > sendRepeatingHeaders) || !packCounter){
+  /// Sends the full packet in packData, preceded by a PAT, PMT and SDT when those are due.
+  void TSOutput::sendPacket(){
+    if ((sendRepeatingHeaders && thisPacket.getTime() - lastHeaderTime > sendRepeatingHeaders) || !packCounter){
 
-          std::set<size_t> selectedTracks;
-          for (std::map<size_t, Comms::Users>::iterator it = userSelect.begin(); it != userSelect.end(); it++){
-            selectedTracks.insert(it->first);
-          }
-
-          lastHeaderTime = thisPacket.getTime();
-          TS::Packet tmpPack;
-          tmpPack.FromPointer(TS::PAT);
-          tmpPack.setContinuityCounter(++contPAT);
-          sendTS(tmpPack.checkAndGetBuffer());
-          sendTS(TS::createPMT(selectedTracks, M, ++contPMT));
-          sendTS(TS::createSDT(streamName, ++contSDT));
-          packCounter += 3;
-        }
-        sendTS(packData.checkAndGetBuffer());
-        packCounter++;
-        packData.clear();
-      }
-
-      if (!dataLen){return;}
-
-      if (packData.getBytesFree() == 184){
-        packData.clear();
-        packData.setPID(pkgPid);
-        packData.setContinuityCounter(++contPkg);
-        if (firstPack){
-          packData.setUnitStart(1);
-          if (video){
-            if (keyframe){
-              packData.setRandomAccess(true);
-              packData.setESPriority(true);
-            }
-            packData.setPCR(thisPacket.getTime() * 27000);
-          }
-          firstPack = false;
-        }
+      std::set<size_t> selectedTracks;
+      for (std::map<size_t, Comms::Users>::iterator it = userSelect.begin(); it != userSelect.end(); it++){
+        selectedTracks.insert(it->first);
       }
 
-      size_t tmp = packData.fillFree(data, dataLen);
-      data += tmp;
-      dataLen -= tmp;
-    }while (dataLen);
+      lastHeaderTime = thisPacket.getTime();
+      TS::Packet tmpPack;
+      tmpPack.FromPointer(TS::PAT);
+      tmpPack.setContinuityCounter(++contPAT);
+      sendTS(tmpPack.checkAndGetBuffer());
+      sendTS(TS::createPMT(selectedTracks, M, ++contPMT));
+      sendTS(TS::createSDT(streamName, ++contSDT));
+      packCounter += 3;
+    }
+    sendTS(packData.checkAndGetBuffer());
+    packCounter++;
   }
 
   void TSOutput::sendNext(){
@@ -141,11 +113,11 @@ namespace Mist{
         TS::Packet::getPESVideoLeadIn(bs,
             (((dataLen + extraSize) > MAX_PES_SIZE) ? 0 : dataLen + extraSize),
             packTime, offset, true, M.getBps(thisIdx));
-        fillPacket(bs.data(), bs.size(), firstPack, video, keyframe, pkgPid, contPkg);
+        fillPacket(bs.data(), bs.size(), firstPack, video, keyframe, pkgPid, contPkg, thisPacket.getTime());
 
         // End of previous nal unit, if not already present
         if (addEndNal && codec == "H264"){
-          fillPacket("\000\000\000\001\011\360", 6, firstPack, video, keyframe, pkgPid, contPkg);
+          fillPacket("\000\000\000\001\011\360", 6, firstPack, video, keyframe, pkgPid, contPkg, thisPacket.getTime());
         }
         // Init data, if keyframe and not already present
         if (addInit){
@@ -153,14 +125,14 @@ namespace Mist{
             MP4::AVCC avccbox;
             avccbox.setPayload(M.getInit(thisIdx));
             bs = avccbox.asAnnexB();
-            fillPacket(bs.data(), bs.size(), firstPack, video, keyframe, pkgPid, contPkg);
+            fillPacket(bs.data(), bs.size(), firstPack, video, keyframe, pkgPid, contPkg, thisPacket.getTime());
           }
           /*LTS-START*/
           if (codec == "HEVC"){
             MP4::HVCC hvccbox;
             hvccbox.setPayload(M.getInit(thisIdx));
             bs = hvccbox.asAnnexB();
-            fillPacket(bs.data(), bs.size(), firstPack, video, keyframe, pkgPid, contPkg);
+            fillPacket(bs.data(), bs.size(), firstPack, video, keyframe, pkgPid, contPkg, thisPacket.getTime());
           }
           /*LTS-END*/
         }
@@ -179,17 +151,17 @@ namespace Mist{
                      ThisNaluSize + i + 4, dataLen);
             break;
           }
-          fillPacket("\000\000\000\001", 4, firstPack, video, keyframe, pkgPid, contPkg);
-          fillPacket(dataPointer + i + lenSize, ThisNaluSize, firstPack, video, keyframe, pkgPid, contPkg);
+          fillPacket("\000\000\000\001", 4, firstPack, video, keyframe, pkgPid, contPkg, thisPacket.getTime());
+          fillPacket(dataPointer + i + lenSize, ThisNaluSize, firstPack, video, keyframe, pkgPid, contPkg, thisPacket.getTime());
           i += ThisNaluSize + lenSize;
         }
       }else{
         uint64_t offset = thisPacket.getInt("offset") * 90;
         bs.clear();
         TS::Packet::getPESVideoLeadIn(bs, 0, packTime, offset, true, M.getBps(thisIdx));
-        fillPacket(bs.data(), bs.size(), firstPack, video, keyframe, pkgPid, contPkg);
+        fillPacket(bs.data(), bs.size(), firstPack, video, keyframe, pkgPid, contPkg, thisPacket.getTime());
 
-        fillPacket(dataPointer, dataLen, firstPack, video, keyframe, pkgPid, contPkg);
+        fillPacket(dataPointer, dataLen, firstPack, video, keyframe, pkgPid, contPkg, thisPacket.getTime());
       }
     }else if (type == "audio"){
       size_t tempLen = dataLen;
@@ -209,36 +181,36 @@ namespace Mist{
       if (codec == "opus"){
         tempLen += 3 + (dataLen/255);
         bs = TS::Packet::getPESPS1LeadIn(tempLen, packTime, M.getBps(thisIdx));
-        fillPacket(bs.data(), bs.size(), firstPack, video, keyframe, pkgPid, contPkg);
+        fillPacket(bs.data(), bs.size(), firstPack, video, keyframe, pkgPid, contPkg, thisPacket.getTime());
         bs = "\177\340";
         bs.append(dataLen/255, (char)255);
         bs.append(1, (char)(dataLen-255*(dataLen/255)));
-        fillPacket(bs.data(), bs.size(), firstPack, video, keyframe, pkgPid, contPkg);
+        fillPacket(bs.data(), bs.size(), firstPack, video, keyframe, pkgPid, contPkg, thisPacket.getTime());
       }else{
         bs.clear();
         TS::Packet::getPESAudioLeadIn(bs, tempLen, packTime, M.getBps(thisIdx));
-        fillPacket(bs.data(), bs.size(), firstPack, video, keyframe, pkgPid, contPkg);
+        fillPacket(bs.data(), bs.size(), firstPack, video, keyframe, pkgPid, contPkg, thisPacket.getTime());
         if (codec == "AAC"){
           bs = TS::getAudioHeader(dataLen, M.getInit(thisIdx));
-          fillPacket(bs.data(), bs.size(), firstPack, video, keyframe, pkgPid, contPkg);
+          fillPacket(bs.data(), bs.size(), firstPack, video, keyframe, pkgPid, contPkg, thisPacket.getTime());
         }
       }
-      fillPacket(dataPointer, dataLen, firstPack, video, keyframe, pkgPid, contPkg);
+      fillPacket(dataPointer, dataLen, firstPack, video, keyframe, pkgPid, contPkg, thisPacket.getTime());
     }else if (type == "meta"){
       long unsigned int tempLen = dataLen;
       if (codec == "JSON"){tempLen += 2;}
       bs = TS::Packet::getPESMetaLeadIn(tempLen, packTime, M.getBps(thisIdx));
-      fillPacket(bs.data(), bs.size(), firstPack, video, keyframe, pkgPid, contPkg);
+      fillPacket(bs.data(), bs.size(), firstPack, video, keyframe, pkgPid, contPkg, thisPacket.getTime());
       if (codec == "JSON"){
         char dLen[2];
         Bit::htobs(dLen, dataLen);
-        fillPacket(dLen, 2, firstPack, video, keyframe, pkgPid, contPkg);
+        fillPacket(dLen, 2, firstPack, video, keyframe, pkgPid, contPkg, thisPacket.getTime());
       }
-      fillPacket(dataPointer, dataLen, firstPack, video, keyframe, pkgPid, contPkg);
+      fillPacket(dataPointer, dataLen, firstPack, video, keyframe, pkgPid, contPkg, thisPacket.getTime());
     }
     if (packData.getBytesFree() < 184){
       packData.addStuffing();
-      fillPacket(0, 0, firstPack, video, keyframe, pkgPid, contPkg);
+      fillPacket(0, 0, firstPack, video, keyframe, pkgPid, contPkg, thisPacket.getTime());
     }
   }
 }// namespace Mist
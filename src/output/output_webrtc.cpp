@@ -1646,6 +1646,8 @@ namespace Mist{
           nextPace = it->second.udpSock->timeToNextPace(uTime);
         }
         if (sleepTime > nextPace){sleepTime = nextPace;}
+        // Datagrams the socket already read do not make it readable
+        if (it->second.udpSock->hasQueued()){return;}
 
         int s = it->second.udpSock->getSock();
         FD_SET(s, &rfds);
@@ -4,37 +4,15 @@
 #include <mist/config.h>
 #include <mist/auth.h>
 #include <mist/comms.h>
+#include <mist/timing.h>
+#include <mist/tinythread.h>
 #include <mist/triggers.h>
 #include <signal.h>
 #include <stdio.h>
 #include <sstream>
 
-// Global counters
-uint64_t thisType = 0;
-uint64_t now = Util::bootSecs();
-uint64_t currentConnections = 0;
-uint64_t lastSecond = 0;
-uint64_t globalTime = 0;
-uint64_t globalDown = 0;
-uint64_t globalUp = 0;
-uint64_t globalPktcount = 0;
-uint64_t globalPktloss = 0;
-uint64_t globalPktretrans = 0;
-// Stores last values of each connection
-std::map<size_t, uint64_t> connTime;
-std::map<size_t, uint64_t> connDown;
-std::map<size_t, uint64_t> connUp;
-std::map<size_t, uint64_t> connPktcount;
-std::map<size_t, uint64_t> connPktloss;
-std::map<size_t, uint64_t> connPktretrans;
-// Counts the duration a connector has been active
-std::map<std::string, uint64_t> connectorCount;
-std::map<std::string, uint64_t> connectorLastActive;
-std::map<std::string, uint64_t> hostCount;
-std::map<std::string, uint64_t> hostLastActive;
-std::map<std::string, uint64_t> streamCount;
-std::map<std::string, uint64_t> streamLastActive;
 // Set to True when a session gets invalidated, so that we know to run a new USER_NEW trigger
+// Only used when running a single session; the session tracker gets this from the session status
 bool forceTrigger = false;
 void handleSignal(int signum){
   if (signum == SIGUSR1){
@@ -44,15 +22,210 @@ void handleSignal(int signum){
 
 const char nullAddress[16] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
 
-void userOnActive(Comms::Connections &connections, size_t idx){
-  uint64_t lastUpdate = connections.getNow(idx);
+/// Statistics and triggers of a single session, kept on a record of the statistics page.
+/// A MistSession process keeps either a single one of these, or as session tracker all sessions
+/// that inputs and outputs request from it.
+class trackedSession{
+public:
+  trackedSession(Comms::Sessions &_statComm, const std::string &_sessId, const std::string &_streamName,
+                 const std::string &_ip, const std::string &_tkn, const std::string &_protocol,
+                 const std::string &_reqUrl);
+  ~trackedSession();
+  bool start();
+  bool tick();
+  void finish();
+  void invalidate(){forceTrigger = true;}
+  bool sleeping() const{return !thisType && shouldSleep;}
+  bool sleepDone();
+  const std::string sessionId;
+  const char *exitCode;
+  std::string exitReason;
+
+private:
+  void setExitReason(const char *code, const std::string &reason);
+  void userOnActive(size_t idx);
+  void userOnDisconnect(size_t idx);
+  bool runUserNew(const std::string &host);
+
+  Comms::Sessions &statComm;
+  size_t statIdx;
+  Comms::Connections *connections;
+  IPC::semaphore sessionLock;
+  const std::string thisStreamName;
+  const std::string thisIp;
+  const std::string thisToken;
+  const std::string thisProtocol;
+  const std::string thisReqUrl;
+  std::string thisHost;
+  uint64_t thisType;
+  bool forceTrigger;
+  bool shouldSleep;
+  uint64_t sleepStart;
+  // Counters
+  uint64_t now;
+  uint64_t lastSeen;
+  uint64_t currentConnections;
+  uint64_t lastSecond;
+  uint64_t globalTime;
+  uint64_t globalDown;
+  uint64_t globalUp;
+  uint64_t globalPktcount;
+  uint64_t globalPktloss;
+  uint64_t globalPktretrans;
+  // Stores last values of each connection
+  std::map<size_t, uint64_t> connTime;
+  std::map<size_t, uint64_t> connDown;
+  std::map<size_t, uint64_t> connUp;
+  std::map<size_t, uint64_t> connPktcount;
+  std::map<size_t, uint64_t> connPktloss;
+  std::map<size_t, uint64_t> connPktretrans;
+  // Counts the duration a connector has been active
+  std::map<std::string, uint64_t> connectorCount;
+  std::map<std::string, uint64_t> connectorLastActive;
+  std::map<std::string, uint64_t> hostCount;
+  std::map<std::string, uint64_t> hostLastActive;
+  std::map<std::string, uint64_t> streamCount;
+  std::map<std::string, uint64_t> streamLastActive;
+};
+
+trackedSession::trackedSession(Comms::Sessions &_statComm, const std::string &_sessId,
+                               const std::string &_streamName, const std::string &_ip, const std::string &_tkn,
+                               const std::string &_protocol, const std::string &_reqUrl)
+    : sessionId(_sessId), statComm(_statComm), thisStreamName(_streamName), thisIp(_ip), thisToken(_tkn),
+      thisProtocol(_protocol), thisReqUrl(_reqUrl){
+  exitCode = 0;
+  statIdx = INVALID_RECORD_INDEX;
+  connections = 0;
+  forceTrigger = false;
+  shouldSleep = false;
+  sleepStart = 0;
+  now = Util::bootSecs();
+  lastSeen = now;
+  currentConnections = 0;
+  lastSecond = 0;
+  globalTime = 0;
+  globalDown = 0;
+  globalUp = 0;
+  globalPktcount = 0;
+  globalPktloss = 0;
+  globalPktretrans = 0;
+  thisHost = Socket::getBinForms(thisIp);
+  if (thisHost.size() > 16){thisHost = thisHost.substr(0, 16);}
+  // Determine session type, since triggers only get run for viewer type sessions
+  thisType = 0;
+  if (sessionId[0] == 'I'){
+    thisType = 1;
+  }else if (sessionId[0] == 'O'){
+    thisType = 2;
+  }else if (sessionId[0] == 'U'){
+    thisType = 3;
+  }
+}
+
+/// Closes the connections page if still open and frees the record on the statistics page.
+trackedSession::~trackedSession(){
+  delete connections;
+  if (statIdx != INVALID_RECORD_INDEX){
+    statComm.setStatus(COMM_STATUS_DISCONNECT | statComm.getStatus(statIdx), statIdx);
+  }
+}
+
+/// Keeps the first reason given for the session ending, like Util::logExitReason does for processes.
+void trackedSession::setExitReason(const char *code, const std::string &reason){
+  if (exitCode){return;}
+  exitCode = code;
+  exitReason = reason;
+}
+
+/// Claims the session: locks it, registers it on the statistics page, opens the page with its
+/// connections and runs the USER_NEW trigger. Returns false if the session could not be started,
+/// or already has a running process.
+bool trackedSession::start(){
+  const uint64_t bootTime = Util::getMicros();
+  std::string ipHex;
+  Socket::hostBytesToStr(thisHost.c_str(), thisHost.size(), ipHex);
+  VERYHIGH_MSG("Starting a new session. Passed variables are stream name '%s', session token '%s', protocol '%s', requested URL '%s', IP '%s' and session id '%s'",
+  thisStreamName.c_str(), thisToken.c_str(), thisProtocol.c_str(), thisReqUrl.c_str(), ipHex.c_str(), sessionId.c_str());
+
+  // Try to lock to ensure we are the only process initialising this session
+  char semName[NAME_BUFFER_SIZE];
+  snprintf(semName, NAME_BUFFER_SIZE, SEM_SESSION, sessionId.c_str());
+  sessionLock.open(semName, O_CREAT | O_RDWR, ACCESSPERMS, 1);
+  // If the lock fails, the previous Session process must've failed in spectacular fashion
+  // It's the Controller's task to clean everything up. When the lock fails, this cleanup hasn't happened yet
+  if (!sessionLock.tryWaitOneSecond()){
+    FAIL_MSG("Session '%s' already locked", sessionId.c_str());
+    return false;
+  }
+
+  // Check if a page already exists for this session ID. If so, quit
+  {
+    IPC::sharedPage dataPage;
+    char userPageName[NAME_BUFFER_SIZE];
+    snprintf(userPageName, NAME_BUFFER_SIZE, COMMS_SESSIONS, sessionId.c_str());
+    dataPage.init(userPageName, 0, false, false);
+    if (dataPage){
+      INFO_MSG("Session '%s' already has a running process", sessionId.c_str());
+      sessionLock.post();
+      return false;
+    }
+  }
+
+  // Claim a spot in shared memory for this session on the global statistics page
+  statIdx = statComm.claimRecord();
+  if (statIdx == INVALID_RECORD_INDEX){
+    FAIL_MSG("Unable to register entry for session '%s' on the stats page", sessionId.c_str());
+    sessionLock.post();
+    return false;
+  }
+
+  // Initialise global session data
+  statComm.setHost(thisHost, statIdx);
+  statComm.setSessId(sessionId, statIdx);
+  statComm.setStream(thisStreamName, statIdx);
+  if (thisProtocol.size() && thisProtocol != "HTTP"){connectorLastActive[thisProtocol] = now;}
+  if (thisStreamName.size()){streamLastActive[thisStreamName] = now;}
+  if (memcmp(thisHost.data(), nullAddress, 16)){hostLastActive[thisHost] = now;}
+
+  // Open the shared memory page containing statistics for each individual connection in this session
+  connections = new Comms::Connections;
+  connections->reload(sessionId, true);
+
+  // Do a USER_NEW trigger if it is defined for this stream
+  if (!thisType && !runUserNew(thisIp)){
+    // Mark all connections of this session as finished, since this viewer is not allowed to view this stream
+    setExitReason(ER_TRIGGER, "Session rejected by USER_NEW");
+    connections->setExit();
+    connections->finishAll();
+  }
+
+  //start allowing viewers
+  sessionLock.post();
+
+  INFO_MSG("Started new session %s in %.3f ms", sessionId.c_str(), (double)Util::getMicros(bootTime)/1000.0);
+  return true;
+}
+
+/// Runs the USER_NEW trigger for this session, if it is defined for the stream.
+/// Returns false if the trigger rejected the session.
+bool trackedSession::runUserNew(const std::string &host){
+  if (!Triggers::shouldTrigger("USER_NEW", thisStreamName)){return true;}
+  std::string payload = thisStreamName + "\n" + host + "\n" +
+                        thisToken + "\n" + thisProtocol +
+                        "\n" + thisReqUrl + "\n" + sessionId;
+  return Triggers::doTrigger("USER_NEW", payload, thisStreamName);
+}
+
+void trackedSession::userOnActive(size_t idx){
+  Comms::Connections &conns = *connections;
+  uint64_t lastUpdate = conns.getNow(idx);
   if (lastUpdate < now - 10 && thisType != 1){return;}
   ++currentConnections;
-  std::string thisConnector = connections.getConnector(idx);
-  std::string thisStreamName = connections.getStream(idx);
-  const std::string& thisHost = connections.getHost(idx);
+  std::string thisConnector = conns.getConnector(idx);
+  std::string thisStreamName = conns.getStream(idx);
+  const std::string& thisHost = conns.getHost(idx);
 
-  if (connections.getLastSecond(idx) > lastSecond){lastSecond = connections.getLastSecond(idx);}
+  if (conns.getLastSecond(idx) > lastSecond){lastSecond = conns.getLastSecond(idx);}
   // Save info on the latest active stream, protocol and host separately
   if (thisConnector.size() && thisConnector != "HTTP"){
     connectorCount[thisConnector]++;
@@ -67,43 +240,43 @@ void userOnActive(Comms::Connections &connections, size_t idx){
     if (!hostLastActive.count(thisHost) || hostLastActive[thisHost] < lastUpdate){hostLastActive[thisHost] = lastUpdate;}
   }
   // Sanity checks
-  if (connections.getDown(idx) < connDown[idx]){
+  if (conns.getDown(idx) < connDown[idx]){
     MEDIUM_MSG("Connection downloaded bytes should be a counter, but has decreased in value");
-    connDown[idx] = connections.getDown(idx);
+    connDown[idx] = conns.getDown(idx);
   }
-  if (connections.getUp(idx) < connUp[idx]){
+  if (conns.getUp(idx) < connUp[idx]){
     MEDIUM_MSG("Connection uploaded bytes should be a counter, but has decreased in value");
-    connUp[idx] = connections.getUp(idx);
+    connUp[idx] = conns.getUp(idx);
   }
-  if (connections.getPacketCount(idx) < connPktcount[idx]){
+  if (conns.getPacketCount(idx) < connPktcount[idx]){
     MEDIUM_MSG("Connection packet count should be a counter, but has decreased in value");
-    connPktcount[idx] = connections.getPacketCount(idx);
+    connPktcount[idx] = conns.getPacketCount(idx);
   }
-  if (connections.getPacketLostCount(idx) < connPktloss[idx]){
+  if (conns.getPacketLostCount(idx) < connPktloss[idx]){
     MEDIUM_MSG("Connection packet loss count should be a counter, but has decreased in value");
-    connPktloss[idx] = connections.getPacketLostCount(idx);
+    connPktloss[idx] = conns.getPacketLostCount(idx);
   }
-  if (connections.getPacketRetransmitCount(idx) < connPktretrans[idx]){
+  if (conns.getPacketRetransmitCount(idx) < connPktretrans[idx]){
     MEDIUM_MSG("Connection packets retransmitted should be a counter, but has decreased in value");
-    connPktretrans[idx] = connections.getPacketRetransmitCount(idx);
+    connPktretrans[idx] = conns.getPacketRetransmitCount(idx);
   }
   // Add increase in stats to global stats
-  globalDown += connections.getDown(idx) - connDown[idx];
-  globalUp += connections.getUp(idx) - connUp[idx];
-  globalPktcount += connections.getPacketCount(idx) - connPktcount[idx];
-  globalPktloss += connections.getPacketLostCount(idx) - connPktloss[idx];
-  globalPktretrans += connections.getPacketRetransmitCount(idx) - connPktretrans[idx];
+  globalDown += conns.getDown(idx) - connDown[idx];
+  globalUp += conns.getUp(idx) - connUp[idx];
+  globalPktcount += conns.getPacketCount(idx) - connPktcount[idx];
+  globalPktloss += conns.getPacketLostCount(idx) - connPktloss[idx];
+  globalPktretrans += conns.getPacketRetransmitCount(idx) - connPktretrans[idx];
   // Set last values of this connection
   connTime[idx]++;
-  connDown[idx] = connections.getDown(idx);
-  connUp[idx] = connections.getUp(idx);
-  connPktcount[idx] = connections.getPacketCount(idx);
-  connPktloss[idx] = connections.getPacketLostCount(idx);
-  connPktretrans[idx] = connections.getPacketRetransmitCount(idx);
+  connDown[idx] = conns.getDown(idx);
+  connUp[idx] = conns.getUp(idx);
+  connPktcount[idx] = conns.getPacketCount(idx);
+  connPktloss[idx] = conns.getPacketLostCount(idx);
+  connPktretrans[idx] = conns.getPacketRetransmitCount(idx);
 }
 
 /// \brief Remove mappings of inactive connections
-void userOnDisconnect(Comms::Connections & connections, size_t idx){
+void trackedSession::userOnDisconnect(size_t idx){
   connTime.erase(idx);
   connDown.erase(idx);
   connUp.erase(idx);
@@ -112,9 +285,400 @@ void userOnDisconnect(Comms::Connections & connections, size_t idx){
   connPktretrans.erase(idx);
 }
 
+/// Summarizes the statistics of all connections onto the statistics page, and re-runs USER_NEW if
+/// the session was invalidated. Meant to be called once per second.
+/// Returns false once the session has ended: when it no longer has active connections, was
+/// rejected, or the controller asked for it to be shut down.
+bool trackedSession::tick(){
+  // Stay active until we no longer have an active connection
+  if ((!currentConnections && now - lastSeen > STATS_DELAY) || connections->getExit()){return false;}
+  // Sessions kept by the session tracker receive requests from the controller through their status
+  uint8_t status = statComm.getStatus(statIdx);
+  if (status & COMM_STATUS_REQDISCONNECT){
+    setExitReason(ER_CLEAN_CONTROLLER_REQ, "Session shut down by controller");
+    return false;
+  }
+  if (status & COMM_STATUS_REQINVALIDATE){
+    statComm.setStatus(status & ~COMM_STATUS_REQINVALIDATE, statIdx);
+    forceTrigger = true;
+  }
+
+  currentConnections = 0;
+  lastSecond = 0;
+  now = Util::bootSecs();
+
+  // Loop through all connection entries to get a summary of statistics
+  COMM_LOOP((*connections), userOnActive(id), userOnDisconnect(id));
+  if (currentConnections){
+    globalTime++;
+    lastSeen = now;
+  }
+
+  statComm.setTime(globalTime, statIdx);
+  statComm.setDown(globalDown, statIdx);
+  statComm.setUp(globalUp, statIdx);
+  statComm.setPacketCount(globalPktcount, statIdx);
+  statComm.setPacketLostCount(globalPktloss, statIdx);
+  statComm.setPacketRetransmitCount(globalPktretrans, statIdx);
+  statComm.setLastSecond(lastSecond, statIdx);
+  statComm.setNow(now, statIdx);
+
+  if (currentConnections){
+    {
+      // Convert active protocols to string
+      std::stringstream connectorSummary;
+      for (std::map<std::string, uint64_t>::iterator it = connectorLastActive.begin();
+            it != connectorLastActive.end(); ++it){
+        if (now - it->second < STATS_DELAY){
+          connectorSummary << (connectorSummary.str().size() ? "," : "") << it->first;
+        }
+      }
+      statComm.setConnector(connectorSummary.str(), statIdx);
+    }
+
+    {
+      // Set active host to last active or 0 if there were various hosts active recently
+      std::string thisHost;
+      for (std::map<std::string, uint64_t>::iterator it = hostLastActive.begin();
+            it != hostLastActive.end(); ++it){
+        if (now - it->second < STATS_DELAY){
+          if (!thisHost.size()){
+            thisHost = it->first;
+          }else if (thisHost != it->first){
+            thisHost = nullAddress;
+            break;
+          }
+        }
+      }
+      if (!thisHost.size()){
+        thisHost = nullAddress;
+      }
+      statComm.setHost(thisHost, statIdx);
+    }
+
+    {
+      // Set active stream name to last active or "" if there were multiple streams active recently
+      std::string thisStream = "";
+      for (std::map<std::string, uint64_t>::iterator it = streamLastActive.begin();
+            it != streamLastActive.end(); ++it){
+        if (now - it->second < STATS_DELAY){
+          if (!thisStream.size()){
+            thisStream = it->first;
+          }else if (thisStream != it->first){
+            thisStream = "";
+            break;
+          }
+        }
+      }
+      statComm.setStream(thisStream, statIdx);
+    }
+  }
+
+  // Retrigger USER_NEW if a re-sync was requested
+  if (!thisType && forceTrigger){
+    forceTrigger = false;
+    std::string host;
+    Socket::hostBytesToStr(thisHost.data(), 16, host);
+    if (Triggers::shouldTrigger("USER_NEW", thisStreamName)){
+      INFO_MSG("Triggering USER_NEW for stream %s", thisStreamName.c_str());
+      if (!runUserNew(host)){
+        INFO_MSG("USER_NEW rejected stream %s", thisStreamName.c_str());
+        setExitReason(ER_TRIGGER, "Session rejected by USER_NEW");
+        connections->setExit();
+        connections->finishAll();
+        return false;
+      }else{
+        INFO_MSG("USER_NEW accepted stream %s", thisStreamName.c_str());
+      }
+    }
+  }
+  return true;
+}
+
+/// Ends the session: closes the page with its connections and runs the USER_END trigger.
+/// Sessions rejected by USER_NEW are kept invalidated afterwards, see sleeping() and sleepDone().
+void trackedSession::finish(){
+  //Close the connections page before other cleanup happens
+  if (connections){
+    shouldSleep = connections->getExit();
+    delete connections;
+    connections = 0;
+  }
+  if (Util::bootSecs() - lastSeen > STATS_DELAY){
+    std::stringstream reason;
+    reason << "Session inactive for " << STATS_DELAY << " seconds";
+    setExitReason(ER_CLEAN_INACTIVE, reason.str());
+  }
+
+  // Trigger USER_END
+  if (!thisType && Triggers::shouldTrigger("USER_END", thisStreamName)){
+
+    // Convert connector, host and stream into lists and counts
+    std::stringstream connectorSummary;
+    std::stringstream connectorTimes;
+    for (std::map<std::string, uint64_t>::iterator it = connectorCount.begin(); it != connectorCount.end(); ++it){
+      connectorSummary << (connectorSummary.str().size() ? "," : "") << it->first;
+      connectorTimes << (connectorTimes.str().size() ? "," : "") << it->second;
+    }
+    std::stringstream hostSummary;
+    std::stringstream hostTimes;
+    for (std::map<std::string, uint64_t>::iterator it = hostCount.begin(); it != hostCount.end(); ++it){
+      std::string host;
+      Socket::hostBytesToStr(it->first.data(), 16, host);
+      hostSummary << (hostSummary.str().size() ? "," : "") << host;
+      hostTimes << (hostTimes.str().size() ? "," : "") << it->second;
+    }
+    std::stringstream streamSummary;
+    std::stringstream streamTimes;
+    for (std::map<std::string, uint64_t>::iterator it = streamCount.begin(); it != streamCount.end(); ++it){
+      streamSummary << (streamSummary.str().size() ? "," : "") << it->first;
+      streamTimes << (streamTimes.str().size() ? "," : "") << it->second;
+    }
+
+    std::stringstream summary;
+    summary << thisToken << "\n"
+          << streamSummary.str() << "\n"
+          << connectorSummary.str() << "\n"
+          << hostSummary.str() << "\n"
+          << globalTime << "\n"
+          << globalUp << "\n"
+          << globalDown << "\n"
+          << statComm.getTags(statIdx) << "\n"
+          << hostTimes.str() << "\n"
+          << connectorTimes.str() << "\n"
+          << streamTimes.str() << "\n"
+          << sessionId;
+    Triggers::doTrigger("USER_END", summary.str(), thisStreamName);
+  }
+  sleepStart = Util::bootSecs();
+}
+
+/// For sessions that are kept invalidated after being rejected: returns true once this should
+/// stop, after 10 minutes or when the session is invalidated or shut down again.
+bool trackedSession::sleepDone(){
+  if (forceTrigger || Util::bootSecs() - sleepStart >= SESS_TIMEOUT){return true;}
+  return statComm.getStatus(statIdx) & (COMM_STATUS_REQINVALIDATE | COMM_STATUS_REQDISCONNECT);
+}
+
+/// Opens the statistics page the way masters do, so that records can be claimed for any number of
+/// sessions. Fails instead of creating the page if the controller has not done so.
+/// Call setMaster(false) before the page is closed again, so that it and other records are left alone.
+static bool openStatistics(Comms::Sessions &statComm){
+  {
+    IPC::sharedPage check(COMMS_STATISTICS, 0, false, false);
+    if (!check.mapped || Util::RelAccX(check.mapped, false).isExit()){return false;}
+  }
+  statComm.reload(true);
+  return statComm;
+}
+
+/// A session started on request of an input or output
+struct sessionRequest{
+  std::string sessId;
+  std::string streamName;
+  std::string ip;
+  std::string tkn;
+  std::string protocol;
+  std::string reqUrl;
+};
+
+/// Part of the sessions of the session tracker, kept by a single thread
+struct trackerShard{
+  trackerShard(){
+    sessions = 0;
+    statComm = 0;
+    thread = 0;
+  }
+  tthread::mutex inboxMutex;
+  std::deque<sessionRequest> inbox;
+  size_t sessions; ///< Sessions kept by this shard, including invalidated ones. Guarded by inboxMutex.
+  Comms::Sessions *statComm;
+  tthread::thread *thread;
+};
+
+bool trackerActive = true;
+
+/// Ends a session of the session tracker, keeping it around if it needs to stay invalidated
+static void endSession(trackedSession *S, std::deque<trackedSession *> &asleep){
+  S->finish();
+  INFO_MSG("Shutting down session %s: %s", S->sessionId.c_str(), S->exitReason.c_str());
+  if (S->sleeping()){
+    asleep.push_back(S);
+  }else{
+    delete S;
+  }
+}
+
+/// Runs all sessions of a single shard of the session tracker. Blocking triggers of a session only
+/// hold up the other sessions of the same shard.
+void trackerShardThread(void *arg){
+  trackerShard &shard = *(trackerShard *)arg;
+  std::map<std::string, trackedSession *> active;
+  std::deque<trackedSession *> asleep;
+  uint64_t nextTick = Util::bootMS();
+  while (trackerActive){
+    std::deque<sessionRequest> requests;
+    {
+      tthread::lock_guard<tthread::mutex> guard(shard.inboxMutex);
+      requests.swap(shard.inbox);
+    }
+    for (std::deque<sessionRequest>::iterator it = requests.begin(); it != requests.end(); ++it){
+      if (active.count(it->sessId)){continue;}
+      trackedSession *S = new trackedSession(*shard.statComm, it->sessId, it->streamName, it->ip, it->tkn,
+                                             it->protocol, it->reqUrl);
+      if (!S->start()){
+        delete S;
+        continue;
+      }
+      // New sessions get their first update right away, the same as in their own process
+      if (S->tick()){
+        active[S->sessionId] = S;
+      }else{
+        endSession(S, asleep);
+      }
+    }
+
+    if (Util::bootMS() >= nextTick){
+      nextTick = Util::bootMS() + 1000;
+      std::map<std::string, trackedSession *>::iterator it = active.begin();
+      while (it != active.end()){
+        if (it->second->tick()){
+          ++it;
+          continue;
+        }
+        endSession(it->second, asleep);
+        active.erase(it++);
+      }
+      for (std::deque<trackedSession *>::iterator jt = asleep.begin(); jt != asleep.end();){
+        if (!(*jt)->sleepDone()){
+          ++jt;
+          continue;
+        }
+        delete *jt;
+        jt = asleep.erase(jt);
+      }
+    }
+    {
+      tthread::lock_guard<tthread::mutex> guard(shard.inboxMutex);
+      shard.sessions = active.size() + asleep.size() + shard.inbox.size();
+    }
+    Util::sleep(10);
+  }
+  // Shutting down: end all sessions right away
+  for (std::map<std::string, trackedSession *>::iterator it = active.begin(); it != active.end(); ++it){
+    it->second->finish();
+    INFO_MSG("Shutting down session %s: %s", it->first.c_str(), it->second->exitReason.c_str());
+    delete it->second;
+  }
+  for (std::deque<trackedSession *>::iterator jt = asleep.begin(); jt != asleep.end(); ++jt){delete *jt;}
+  tthread::lock_guard<tthread::mutex> guard(shard.inboxMutex);
+  shard.sessions = 0;
+}
+
+/// Runs the session tracker: a single process that keeps all sessions that inputs and outputs
+/// request from it, spread over a number of threads, instead of a MistSession process per session.
+/// Retires once asked to through the exit flag on its page and all its sessions have ended.
+int runTracker(Util::Config &config){
+  Util::sysSetNrOpenFiles(config.getInteger("filelimit"));
+  // The controller asks sessions of the tracker to shut down through their status, instead of killing us
+  Comms::defaultCommFlags = COMM_STATUS_NOKILL;
+
+  {
+    Comms::SessionRequests running;
+    if (running.open()){
+      INFO_MSG("A session tracker is already running");
+      return 0;
+    }
+    // Remove any page left behind by a session tracker that did not exit cleanly
+    IPC::sharedPage stale(COMMS_SESSTRACKER, 0, false, false);
+    if (stale){stale.master = true;}
+  }
+  Comms::SessionRequests requests;
+  requests.reload(true);
+  if (!requests || !requests.lock()){
+    INFO_MSG("A session tracker is already running");
+    requests.setMaster(false);
+    return 0;
+  }
+
+  Comms::Sessions statComm;
+  if (!openStatistics(statComm)){
+    FAIL_MSG("Unable to open the statistics page, cannot start session tracker");
+    statComm.setMaster(false);
+    requests.setExit();
+    requests.setMaster(false);
+    return 1;
+  }
+
+  size_t shardCount = config.getInteger("threads");
+  if (shardCount < 1){shardCount = 1;}
+  trackerShard *shards = new trackerShard[shardCount];
+  for (size_t i = 0; i < shardCount; ++i){
+    shards[i].statComm = &statComm;
+    shards[i].thread = new tthread::thread(trackerShardThread, &shards[i]);
+  }
+  INFO_MSG("Session tracker started with %zu threads", shardCount);
+
+  while (config.is_active){
+    // Requests are complete once the input or output marks them as disconnected
+    size_t pending = 0;
+    for (size_t i = 0; i < requests.recordCount(); ++i){
+      uint8_t status = requests.getStatus(i);
+      if (status == COMM_STATUS_INVALID){continue;}
+      if (!(status & COMM_STATUS_DISCONNECT)){
+        // Free records of inputs and outputs that went away without finishing their request
+        if (requests.getPid(i) && !Util::Procs::isRunning(requests.getPid(i))){
+          requests.setStatus(COMM_STATUS_INVALID, i);
+        }else{
+          ++pending;
+        }
+        continue;
+      }
+      sessionRequest R;
+      R.sessId = requests.getSessId(i);
+      R.streamName = requests.getStream(i);
+      R.ip = requests.getHost(i);
+      R.tkn = requests.getTkn(i);
+      R.protocol = requests.getConnector(i);
+      R.reqUrl = requests.getReqUrl(i);
+      requests.setStatus(COMM_STATUS_INVALID, i);
+      if (!R.sessId.size()){continue;}
+      // Requests for the same session always go to the same shard
+      uint64_t hash = 0;
+      for (size_t c = 0; c < R.sessId.size(); ++c){hash = hash * 31 + (uint8_t)R.sessId[c];}
+      trackerShard &shard = shards[hash % shardCount];
+      tthread::lock_guard<tthread::mutex> guard(shard.inboxMutex);
+      shard.inbox.push_back(R);
+      ++shard.sessions;
+    }
+    if (requests.getExit() && !pending){
+      size_t sessions = 0;
+      for (size_t i = 0; i < shardCount; ++i){
+        tthread::lock_guard<tthread::mutex> guard(shards[i].inboxMutex);
+        sessions += shards[i].sessions;
+      }
+      if (!sessions){
+        INFO_MSG("Session tracker retired and no sessions left, shutting down");
+        break;
+      }
+    }
+    Util::sleep(10);
+  }
+
+  trackerActive = false;
+  for (size_t i = 0; i < shardCount; ++i){
+    shards[i].thread->join();
+    delete shards[i].thread;
+  }
+  delete[] shards;
+  statComm.setMaster(false);
+  // Leave the page to be removed by the next session tracker, instead of acting on left over requests
+  requests.setExit();
+  requests.setMaster(false);
+  return 0;
+}
+
 int main(int argc, char **argv){
-  Comms::Sessions sessions;
-  uint64_t lastSeen = Util::bootSecs();
   Util::redirectLogsIfNeeded();
   signal(SIGUSR1, handleSignal);
   // Init config and parse arguments
@@ -125,9 +689,33 @@ int main(int argc, char **argv){
   option.null();
   option["arg_num"] = 1;
   option["arg"] = "string";
+  option["default"] = "";
   option["help"] = "Session identifier of the entire session";
   config.addOption("sessionid", option);
 
+  option.null();
+  option["long"] = "tracker";
+  option["short"] = "T";
+  option["help"] = "Run as session tracker, keeping all sessions that inputs and outputs request instead of a single one";
+  option["value"].append(0);
+  config.addOption("tracker", option);
+
+  option.null();
+  option["long"] = "threads";
+  option["short"] = "w";
+  option["arg"] = "integer";
+  option["help"] = "Amount of threads the session tracker spreads sessions over";
+  option["value"].append(4);
+  config.addOption("threads", option);
+
+  option.null();
+  option["long"] = "filelimit";
+  option["short"] = "l";
+  option["arg"] = "integer";
+  option["help"] = "Increase open file descriptor limit to this value if it is lower, for the session tracker";
+  option["value"].append(65536);
+  config.addOption("filelimit", option);
+
   option.null();
   option["long"] = "streamname";
   option["short"] = "s";
@@ -174,258 +762,51 @@ int main(int argc, char **argv){
   config.addOption("requrl", option);
 
   config.activate();
-  if (!(config.parseArgs(argc, argv))){
+  if (!(config.parseArgs(argc, argv)) || (!config.getBool("tracker") && !config.getString("sessionid").size())){
     config.printHelp(std::cout);
     FAIL_MSG("Cannot start a new session due to invalid arguments");
     return 1;
   }
 
-  const uint64_t bootTime = Util::getMicros();
-  // Get session ID, session mode and other variables used as payload for the USER_NEW and USER_END triggers
-  const std::string thisStreamName = config.getString("streamname");
-  const std::string thisToken = config.getString("tkn");
-  const std::string thisProtocol = config.getString("protocol");
-  const std::string thisReqUrl = config.getString("requrl");
-  const std::string thisSessionId = config.getString("sessionid");
-  std::string thisHost = Socket::getBinForms(config.getString("ip"));
-  if (thisHost.size() > 16){thisHost = thisHost.substr(0, 16);}
-
-  std::string ipHex;
-  Socket::hostBytesToStr(thisHost.c_str(), thisHost.size(), ipHex);
-  VERYHIGH_MSG("Starting a new session. Passed variables are stream name '%s', session token '%s', protocol '%s', requested URL '%s', IP '%s' and session id '%s'",
-  thisStreamName.c_str(), thisToken.c_str(), thisProtocol.c_str(), thisReqUrl.c_str(), ipHex.c_str(), thisSessionId.c_str());
-
-  // Try to lock to ensure we are the only process initialising this session
-  IPC::semaphore sessionLock;
-  char semName[NAME_BUFFER_SIZE];
-  snprintf(semName, NAME_BUFFER_SIZE, SEM_SESSION, thisSessionId.c_str());
-  sessionLock.open(semName, O_CREAT | O_RDWR, ACCESSPERMS, 1);
-  // If the lock fails, the previous Session process must've failed in spectacular fashion
-  // It's the Controller's task to clean everything up. When the lock fails, this cleanup hasn't happened yet
-  if (!sessionLock.tryWaitOneSecond()){
-    FAIL_MSG("Session '%s' already locked", thisSessionId.c_str());
-    return 1;
-  }
-
-  // Check if a page already exists for this session ID. If so, quit
-  {
-    IPC::sharedPage dataPage;
-    char userPageName[NAME_BUFFER_SIZE];
-    snprintf(userPageName, NAME_BUFFER_SIZE, COMMS_SESSIONS, thisSessionId.c_str());
-    dataPage.init(userPageName, 0, false, false);
-    if (dataPage){
-      INFO_MSG("Session '%s' already has a running process", thisSessionId.c_str());
-      sessionLock.post();
-      return 0;
-    }
-  }
+  if (config.getBool("tracker")){return runTracker(config);}
 
   // Claim a spot in shared memory for this session on the global statistics page
-  sessions.reload();
-  if (!sessions){
-    FAIL_MSG("Unable to register entry for session '%s' on the stats page", thisSessionId.c_str());
-    sessionLock.post();
+  Comms::Sessions statComm;
+  if (!openStatistics(statComm)){
+    FAIL_MSG("Unable to register entry for session '%s' on the stats page", config.getString("sessionid").c_str());
+    statComm.setMaster(false);
     return 1;
   }
 
-  // Initialise global session data
-  sessions.setHost(thisHost);
-  sessions.setSessId(thisSessionId);
-  sessions.setStream(thisStreamName);
-  if (thisProtocol.size() && thisProtocol != "HTTP"){connectorLastActive[thisProtocol] = now;}
-  if (thisStreamName.size()){streamLastActive[thisStreamName] = now;}
-  if (memcmp(thisHost.data(), nullAddress, 16)){hostLastActive[thisHost] = now;}
-
-  // Determine session type, since triggers only get run for viewer type sessions
-  if (thisSessionId[0] == 'I'){
-    thisType = 1;
-  } else if (thisSessionId[0] == 'O'){
-    thisType = 2;
-  } else if (thisSessionId[0] == 'U'){
-    thisType = 3;
+  // Get session ID, session mode and other variables used as payload for the USER_NEW and USER_END triggers
+  trackedSession session(statComm, config.getString("sessionid"), config.getString("streamname"),
+                         config.getString("ip"), config.getString("tkn"), config.getString("protocol"),
+                         config.getString("requrl"));
+  if (!session.start()){
+    statComm.setMaster(false);
+    return 1;
   }
-  bool shouldSleep = false;
 
-  //Scope to ensure the connections page is deleted before other cleanup happens
-  {
-    // Open the shared memory page containing statistics for each individual connection in this session
-    Comms::Connections connections;
-    connections.reload(thisSessionId, true);
-
-    // Do a USER_NEW trigger if it is defined for this stream
-    if (!thisType && Triggers::shouldTrigger("USER_NEW", thisStreamName)){
-      std::string payload = thisStreamName + "\n" + config.getString("ip") + "\n" +
-                            thisToken + "\n" + thisProtocol +
-                            "\n" + thisReqUrl + "\n" + thisSessionId;
-      if (!Triggers::doTrigger("USER_NEW", payload, thisStreamName)){
-        // Mark all connections of this session as finished, since this viewer is not allowed to view this stream
-        Util::logExitReason(ER_TRIGGER, "Session rejected by USER_NEW");
-        connections.setExit();
-        connections.finishAll();
-      }
+  // Stay active until Mist exits or the session ends
+  while (config.is_active){
+    if (forceTrigger){
+      forceTrigger = false;
+      session.invalidate();
     }
-
-    //start allowing viewers
-    sessionLock.post();
-
-    INFO_MSG("Started new session %s in %.3f ms", thisSessionId.c_str(), (double)Util::getMicros(bootTime)/1000.0);
-
-    // Stay active until Mist exits or we no longer have an active connection
-    while (config.is_active && (currentConnections || now - lastSeen <= STATS_DELAY) && !connections.getExit()){
-      currentConnections = 0;
-      lastSecond = 0;
-      now = Util::bootSecs();
-
-      // Loop through all connection entries to get a summary of statistics
-      COMM_LOOP(connections, userOnActive(connections, id), userOnDisconnect(connections, id));
-      if (currentConnections){
-        globalTime++;
-        lastSeen = now;
-      }
-
-
-      sessions.setTime(globalTime);
-      sessions.setDown(globalDown);
-      sessions.setUp(globalUp);
-      sessions.setPacketCount(globalPktcount);
-      sessions.setPacketLostCount(globalPktloss);
-      sessions.setPacketRetransmitCount(globalPktretrans);
-      sessions.setLastSecond(lastSecond);
-      sessions.setNow(now);
-
-      if (currentConnections){
-        {
-          // Convert active protocols to string
-          std::stringstream connectorSummary;
-          for (std::map<std::string, uint64_t>::iterator it = connectorLastActive.begin();
-                it != connectorLastActive.end(); ++it){
-            if (now - it->second < STATS_DELAY){
-              connectorSummary << (connectorSummary.str().size() ? "," : "") << it->first;
-            }
-          }
-          sessions.setConnector(connectorSummary.str());
-        }
-
-        {
-          // Set active host to last active or 0 if there were various hosts active recently
-          std::string thisHost;
-          for (std::map<std::string, uint64_t>::iterator it = hostLastActive.begin();
-                it != hostLastActive.end(); ++it){
-            if (now - it->second < STATS_DELAY){
-              if (!thisHost.size()){
-                thisHost = it->first;
-              }else if (thisHost != it->first){
-                thisHost = nullAddress;
-                break;
-              }
-            }
-          }
-          if (!thisHost.size()){
-            thisHost = nullAddress;
-          }
-          sessions.setHost(thisHost);
-        }
-
-        {
-          // Set active stream name to last active or "" if there were multiple streams active recently
-          std::string thisStream = "";
-          for (std::map<std::string, uint64_t>::iterator it = streamLastActive.begin();
-                it != streamLastActive.end(); ++it){
-            if (now - it->second < STATS_DELAY){
-              if (!thisStream.size()){
-                thisStream = it->first;
-              }else if (thisStream != it->first){
-                thisStream = "";
-                break;
-              }
-            }
-          }
-          sessions.setStream(thisStream);
-        }
-      }
-
-      // Retrigger USER_NEW if a re-sync was requested
-      if (!thisType && forceTrigger){
-        forceTrigger = false;
-        std::string host;
-        Socket::hostBytesToStr(thisHost.data(), 16, host);
-        if (Triggers::shouldTrigger("USER_NEW", thisStreamName)){
-          INFO_MSG("Triggering USER_NEW for stream %s", thisStreamName.c_str());
-          std::string payload = thisStreamName + "\n" + host + "\n" +
-                                thisToken + "\n" + thisProtocol +
-                                "\n" + thisReqUrl + "\n" + thisSessionId;
-          if (!Triggers::doTrigger("USER_NEW", payload, thisStreamName)){
-            INFO_MSG("USER_NEW rejected stream %s", thisStreamName.c_str());
-            Util::logExitReason(ER_TRIGGER, "Session rejected by USER_NEW");
-            connections.setExit();
-            connections.finishAll();
-            break;
-          }else{
-            INFO_MSG("USER_NEW accepted stream %s", thisStreamName.c_str());
-          }
-        }
-      }
-
-      // Remember latest activity so we know when this session ends
-      if (currentConnections){
-      }
-      Util::wait(1000);
-    }
-    shouldSleep = connections.getExit();
-  }//connections scope end
-  if (Util::bootSecs() - lastSeen > STATS_DELAY){
-    Util::logExitReason(ER_CLEAN_INACTIVE, "Session inactive for %d seconds", STATS_DELAY);
-  }
-
-  // Trigger USER_END
-  if (!thisType && Triggers::shouldTrigger("USER_END", thisStreamName)){
-
-    // Convert connector, host and stream into lists and counts
-    std::stringstream connectorSummary;
-    std::stringstream connectorTimes;
-    for (std::map<std::string, uint64_t>::iterator it = connectorCount.begin(); it != connectorCount.end(); ++it){
-      connectorSummary << (connectorSummary.str().size() ? "," : "") << it->first;
-      connectorTimes << (connectorTimes.str().size() ? "," : "") << it->second;
-    }
-    std::stringstream hostSummary;
-    std::stringstream hostTimes;
-    for (std::map<std::string, uint64_t>::iterator it = hostCount.begin(); it != hostCount.end(); ++it){
-      std::string host;
-      Socket::hostBytesToStr(it->first.data(), 16, host);
-      hostSummary << (hostSummary.str().size() ? "," : "") << host;
-      hostTimes << (hostTimes.str().size() ? "," : "") << it->second;
-    }
-    std::stringstream streamSummary;
-    std::stringstream streamTimes;
-    for (std::map<std::string, uint64_t>::iterator it = streamCount.begin(); it != streamCount.end(); ++it){
-      streamSummary << (streamSummary.str().size() ? "," : "") << it->first;
-      streamTimes << (streamTimes.str().size() ? "," : "") << it->second;
-    }
-
-    std::stringstream summary;
-    summary << thisToken << "\n"
-          << streamSummary.str() << "\n"
-          << connectorSummary.str() << "\n"
-          << hostSummary.str() << "\n"
-          << globalTime << "\n"
-          << globalUp << "\n"
-          << globalDown << "\n"
-          << sessions.getTags() << "\n"
-          << hostTimes.str() << "\n"
-          << connectorTimes.str() << "\n"
-          << streamTimes.str() << "\n"
-          << thisSessionId;
-    Triggers::doTrigger("USER_END", summary.str(), thisStreamName);
+    if (!session.tick()){break;}
+    Util::wait(1000);
   }
+  session.finish();
+  if (session.exitCode){Util::logExitReason(session.exitCode, "%s", session.exitReason.c_str());}
 
-  if (!thisType && shouldSleep){
-    uint64_t sleepStart = Util::bootSecs();
+  if (session.sleeping()){
     // Keep session invalidated for 10 minutes, or until the session stops
-    while (config.is_active && Util::bootSecs() - sleepStart < SESS_TIMEOUT){
+    while (config.is_active && !session.sleepDone()){
       Util::sleep(1000);
       if (forceTrigger){break;}
     }
   }
-  INFO_MSG("Shutting down session %s: %s", thisSessionId.c_str(), Util::exitReason);
+  INFO_MSG("Shutting down session %s: %s", session.sessionId.c_str(), Util::exitReason);
+  statComm.setMaster(false);
   return 0;
 }
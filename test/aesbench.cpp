@@ -0,0 +1,101 @@
+/// \file aesbench.cpp
+/// Measures AES-128 throughput of the paths used for CENC (CTR), HLS encryption (CBC) and HLS input
+/// decryption (CBC), once through mbedtls directly and once through Encryption::AES, which uses
+/// the hardware accelerated backend when the CPU supports it. Fails if their output differs.
+/// Usage: mistbench aes [megabytes]
+#include "bench.h"
+#include <mist/bitfields.h>
+#include <mist/encryption.h>
+#include <mist/timing.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+int Bench::aesBench(int argc, char **argv){
+  size_t megabytes = argc > 1 ? atoll(argv[1]) : 256;
+  const size_t bufSize = 1024 * 1024;
+  const char key[] = "0123456789abcdef";
+  const uint64_t nonce = 0x0102030405060708ull;
+  std::string src(bufSize, 0);
+  for (size_t i = 0; i < bufSize; ++i){src[i] = rand();}
+  std::string soft(bufSize, 0), accel(bufSize, 0);
+  bool ok = true;
+
+  mbedtls_aes_context ctx;
+  mbedtls_aes_init(&ctx);
+  Encryption::AES aes;
+  Bench::Report("aes").add("accelerated", Encryption::Accel::name()).print();
+
+  // CTR, as used for CENC
+  mbedtls_aes_setkey_enc(&ctx, (const unsigned char *)key, 128);
+  aes.setEncryptKey(key);
+  uint64_t start = Util::getMicros();
+  for (size_t i = 0; i < megabytes; ++i){
+    size_t ncOff = 0;
+    unsigned char streamBlock[16], nonceCtr[16];
+    memset(nonceCtr, 0, 16);
+    Bit::htobll((char *)nonceCtr, nonce);
+    mbedtls_aes_crypt_ctr(&ctx, bufSize, &ncOff, nonceCtr, streamBlock, (const unsigned char *)src.data(),
+                          (unsigned char *)&soft[0]);
+  }
+  Bench::Report("aes").add("test", "ctr").add("impl", "mbedtls").throughput(Util::getMicros(start), megabytes * bufSize).print();
+  start = Util::getMicros();
+  for (size_t i = 0; i < megabytes; ++i){aes.encryptBlockCTR(nonce, src.data(), &accel[0], bufSize);}
+  Bench::Report("aes").add("test", "ctr").add("impl", "Encryption::AES").throughput(Util::getMicros(start), megabytes * bufSize).print();
+  if (soft != accel){
+    fprintf(stderr, "CTR output differs\n");
+    ok = false;
+  }
+
+  // CBC encryption, as used for HLS
+  char ivec[16];
+  start = Util::getMicros();
+  for (size_t i = 0; i < megabytes; ++i){
+    memset(ivec, 0, 16);
+    mbedtls_aes_crypt_cbc(&ctx, MBEDTLS_AES_ENCRYPT, bufSize, (unsigned char *)ivec,
+                          (const unsigned char *)src.data(), (unsigned char *)&soft[0]);
+  }
+  Bench::Report("aes").add("test", "cbc_encrypt").add("impl", "mbedtls").throughput(Util::getMicros(start), megabytes * bufSize).print();
+  start = Util::getMicros();
+  for (size_t i = 0; i < megabytes; ++i){
+    memset(ivec, 0, 16);
+    aes.encryptBlockCBC(ivec, src.data(), &accel[0], bufSize);
+  }
+  Bench::Report("aes").add("test", "cbc_encrypt").add("impl", "Encryption::AES").throughput(Util::getMicros(start), megabytes * bufSize).print();
+  if (soft != accel){
+    fprintf(stderr, "CBC encryption output differs\n");
+    ok = false;
+  }
+
+  // CBC decryption of the above, as used for HLS input, in 192 byte reads like InputHLS does
+  std::string cipher = soft;
+  mbedtls_aes_setkey_dec(&ctx, (const unsigned char *)key, 128);
+  aes.setDecryptKey(key);
+  start = Util::getMicros();
+  for (size_t i = 0; i < megabytes; ++i){
+    memset(ivec, 0, 16);
+    for (size_t j = 0; j < bufSize; j += 192){
+      size_t len = bufSize - j < 192 ? bufSize - j : 192;
+      mbedtls_aes_crypt_cbc(&ctx, MBEDTLS_AES_DECRYPT, len, (unsigned char *)ivec,
+                            (const unsigned char *)cipher.data() + j, (unsigned char *)&soft[j]);
+    }
+  }
+  Bench::Report("aes").add("test", "cbc_decrypt").add("impl", "mbedtls").throughput(Util::getMicros(start), megabytes * bufSize).print();
+  start = Util::getMicros();
+  for (size_t i = 0; i < megabytes; ++i){
+    memset(ivec, 0, 16);
+    for (size_t j = 0; j < bufSize; j += 192){
+      size_t len = bufSize - j < 192 ? bufSize - j : 192;
+      aes.decryptBlockCBC(ivec, cipher.data() + j, &accel[j], len);
+    }
+  }
+  Bench::Report("aes").add("test", "cbc_decrypt").add("impl", "Encryption::AES").throughput(Util::getMicros(start), megabytes * bufSize).print();
+  if (soft != accel || accel != src){
+    fprintf(stderr, "CBC decryption output differs\n");
+    ok = false;
+  }
+
+  mbedtls_aes_free(&ctx);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,112 @@
+/// \file bench.cpp
+/// Helpers shared by the benchmarks in this directory.
+/// Replaces the global operator new and delete to keep track of how much heap is in use, and
+/// counts every heap allocation.
+#include "bench.h"
+#include <cstdio>
+#include <cstdlib>
+#include <malloc.h>
+#include <new>
+
+static uint64_t allocs = 0;
+static size_t heapNow = 0;
+static size_t heapPeak = 0;
+static size_t heapBase = 0;
+
+#ifdef __GLIBC__
+// Counts every heap allocation, including those of Util::ResizeablePointer and friends
+extern "C"{
+  void *__libc_malloc(size_t size);
+  void *__libc_calloc(size_t nmemb, size_t size);
+  void *__libc_realloc(void *ptr, size_t size);
+  void *malloc(size_t size){
+    ++allocs;
+    return __libc_malloc(size);
+  }
+  void *calloc(size_t nmemb, size_t size){
+    ++allocs;
+    return __libc_calloc(nmemb, size);
+  }
+  void *realloc(void *ptr, size_t size){
+    ++allocs;
+    return __libc_realloc(ptr, size);
+  }
+}
+#endif
+
+void *operator new(size_t size){
+#ifndef __GLIBC__
+  // Counts allocations through new only
+  ++allocs;
+#endif
+  void *p = malloc(size);
+  if (!p){throw std::bad_alloc();}
+  heapNow += malloc_usable_size(p);
+  if (heapNow > heapPeak){heapPeak = heapNow;}
+  return p;
+}
+
+void operator delete(void *p) throw(){
+  if (!p){return;}
+  heapNow -= malloc_usable_size(p);
+  free(p);
+}
+
+namespace Bench{
+  /// Starts a result line for the given benchmark.
+  Report::Report(const std::string &bench){line = "{\"bench\":\"" + bench + "\"";}
+
+  /// Adds a string field. Values are not escaped: they are names, not data.
+  Report &Report::add(const char *key, const std::string &val){
+    line += std::string(",\"") + key + "\":\"" + val + "\"";
+    return *this;
+  }
+
+  /// Adds an integer field.
+  Report &Report::add(const char *key, uint64_t val){
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%llu", (unsigned long long)val);
+    line += std::string(",\"") + key + "\":" + buf;
+    return *this;
+  }
+
+  /// Adds a floating point field, with the given amount of decimals.
+  Report &Report::add(const char *key, double val, int decimals){
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%.*f", decimals, val);
+    line += std::string(",\"") + key + "\":" + buf;
+    return *this;
+  }
+
+  /// Adds the time taken to process the given amount of bytes, in ms, and the resulting MB/s.
+  Report &Report::throughput(uint64_t micros, uint64_t bytes){
+    add("bytes", bytes);
+    add("ms", micros / 1000.0, 2);
+    return add("MB_per_s", micros ? bytes / (double)micros : 0, 1);
+  }
+
+  /// Adds the amount of operations done in the given time, and the time each took in ns.
+  Report &Report::opTime(uint64_t micros, uint64_t ops){
+    add("ops", ops);
+    return add("ns_per_op", ops ? micros * 1000.0 / ops : 0, 2);
+  }
+
+  /// Prints the result, and flushes it right away so it shows up while the next benchmark runs.
+  void Report::print(){
+    printf("%s}\n", line.c_str());
+    fflush(stdout);
+  }
+
+  /// Returns the amount of heap allocations made so far.
+  uint64_t allocCount(){return allocs;}
+
+  /// Starts a new peak heap use measurement, relative to what is allocated right now.
+  void heapMark(){
+    heapBase = heapNow;
+    heapPeak = heapNow;
+  }
+
+  /// Returns the most bytes that were allocated through operator new at once since the last call
+  /// to heapMark, on top of what was allocated at that time.
+  size_t heapGrowth(){return heapPeak - heapBase;}
+}// namespace Bench
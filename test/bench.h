@@ -0,0 +1,43 @@
+/// \file bench.h
+/// Helpers shared by the benchmarks in this directory, and the benchmarks mistbench runs next to
+/// its own.
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+namespace Bench{
+  /// A single benchmark result, printed as one JSON object per line.
+  /// Every line starts with the name of the benchmark, so the results of different builds can be
+  /// compared line by line.
+  class Report{
+  public:
+    Report(const std::string &bench);
+    Report &add(const char *key, const std::string &val);
+    Report &add(const char *key, uint64_t val);
+    Report &add(const char *key, double val, int decimals);
+    Report &throughput(uint64_t micros, uint64_t bytes);
+    Report &opTime(uint64_t micros, uint64_t ops);
+    void print();
+
+  private:
+    std::string line;
+  };
+
+  uint64_t allocCount();
+  void heapMark();
+  size_t heapGrowth();
+
+  int aesBench(int argc, char **argv);
+  int bufferBench(int argc, char **argv);
+  int connBench(int argc, char **argv);
+  int dtscPacketBench(int argc, char **argv);
+  int headerBench(int argc, char **argv);
+  int jsonFlatBench(int argc, char **argv);
+  int jsonWriterBench(int argc, char **argv);
+  int keySearchBench(int argc, char **argv);
+  int mp4IndexBench(int argc, char **argv);
+  int raxBench(int argc, char **argv);
+  int sendFileBench(int argc, char **argv);
+  int sessionBench(int argc, char **argv);
+}// namespace Bench
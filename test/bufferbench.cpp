@@ -0,0 +1,55 @@
+/// \file bufferbench.cpp
+/// Measures Socket::Buffer throughput for reads of 1 KiB, 64 KiB and 1 MiB, comparing parsing in
+/// place (reserve/commit and peek/consume) with the copying interface (append and remove).
+/// Usage: mistbench buffer [megabytes per run]
+#include "bench.h"
+#include <mist/socket.h>
+#include <mist/timing.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+/// Feeds total bytes into a buffer in blocks of readSize and takes them out again in records of
+/// recSize bytes, the way a parser consumes a network stream.
+static void runOnce(uint64_t total, size_t readSize, size_t recSize, bool inPlace){
+  std::string block(readSize, 'x');
+  Socket::Buffer B;
+  uint64_t checksum = 0;
+  uint64_t start = Util::getMicros();
+  for (uint64_t fed = 0; fed < total; fed += readSize){
+    if (inPlace){
+      memcpy(B.reserve(readSize), block.data(), readSize);
+      B.commit(readSize);
+      const char *rec;
+      while ((rec = B.peek(recSize))){
+        checksum += rec[recSize - 1];
+        B.consume(recSize);
+      }
+    }else{
+      B.append(block);
+      while (B.available(recSize)){checksum += B.remove(recSize)[recSize - 1];}
+    }
+  }
+  uint64_t micros = Util::getMicros(start);
+  Bench::Report("buffer")
+      .add("mode", inPlace ? "in_place" : "copy")
+      .add("read_size", readSize)
+      .add("record_size", recSize)
+      .throughput(micros, total)
+      .add("checksum", checksum)
+      .print();
+}
+
+int Bench::bufferBench(int argc, char **argv){
+  uint64_t total = (argc > 1 ? atoll(argv[1]) : 1024) * 1024 * 1024;
+  size_t sizes[] = {1024, 64 * 1024, 1024 * 1024};
+  for (size_t i = 0; i < 3; ++i){
+    // 188-byte records resemble MPEG-TS, 1316 resembles the UDP payloads carrying them
+    runOnce(total, sizes[i], 188, false);
+    runOnce(total, sizes[i], 188, true);
+    runOnce(total, sizes[i], 1316, false);
+    runOnce(total, sizes[i], 1316, true);
+  }
+  return 0;
+}
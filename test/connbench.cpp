@@ -0,0 +1,157 @@
+/// \file connbench.cpp
+/// Opens many concurrent keep-alive HTTP connections to a server and repeatedly requests the same
+/// URL over all of them, reporting request rate and latency.
+/// Used to compare forked and multiplexed (--workers) output modes, e.g. at 1000, 5000 and 20000
+/// connections: mistbench conn localhost 8080 /hls/live/index.m3u8 20000 30
+#include "bench.h"
+#include <mist/timing.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <netdb.h>
+#include <poll.h>
+#include <string>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+struct benchConn{
+  int fd;
+  bool connected;
+  uint64_t reqStart;
+  std::string in;
+};
+
+static std::string request;
+static std::vector<uint64_t> latencies;
+static uint64_t failures = 0;
+static uint64_t bytesIn = 0;
+
+static int openConn(const addrinfo *ai){
+  int fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+  if (fd < 0){return -1;}
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+  if (connect(fd, ai->ai_addr, ai->ai_addrlen) && errno != EINPROGRESS){
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/// Returns true if in holds a complete response, which is then removed from it.
+static bool fullResponse(std::string &in){
+  size_t hEnd = in.find("\r\n\r\n");
+  if (hEnd == std::string::npos){return false;}
+  size_t len = 0;
+  size_t cl = in.find("Content-Length: ");
+  if (cl == std::string::npos || cl > hEnd){cl = in.find("content-length: ");}
+  if (cl != std::string::npos && cl < hEnd){len = atoll(in.c_str() + cl + 16);}
+  if (in.size() < hEnd + 4 + len){return false;}
+  in.erase(0, hEnd + 4 + len);
+  return true;
+}
+
+int Bench::connBench(int argc, char **argv){
+  if (argc < 5){
+    fprintf(stderr, "Usage: mistbench %s host port path connections [seconds]\n", argv[0]);
+    return 1;
+  }
+  size_t count = atoll(argv[4]);
+  uint64_t duration = (argc > 5 ? atoll(argv[5]) : 10) * 1000;
+  request = std::string("GET ") + argv[3] + " HTTP/1.1\r\nHost: " + argv[1] + "\r\nConnection: keep-alive\r\n\r\n";
+
+  struct rlimit lim;
+  getrlimit(RLIMIT_NOFILE, &lim);
+  lim.rlim_cur = lim.rlim_max;
+  setrlimit(RLIMIT_NOFILE, &lim);
+
+  addrinfo hints, *ai;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo(argv[1], argv[2], &hints, &ai)){
+    fprintf(stderr, "Could not resolve %s\n", argv[1]);
+    return 1;
+  }
+
+  std::vector<benchConn> conns(count);
+  std::vector<pollfd> pfds(count);
+  uint64_t setupStart = Util::bootMS();
+  for (size_t i = 0; i < count; ++i){
+    conns[i].fd = openConn(ai);
+    conns[i].connected = false;
+    conns[i].reqStart = 0;
+    if (conns[i].fd < 0){++failures;}
+    pfds[i].fd = conns[i].fd;
+    pfds[i].events = POLLOUT;
+  }
+
+  char buf[65536];
+  uint64_t start = Util::bootMS();
+  while (Util::bootMS() - start < duration){
+    if (poll(&pfds[0], count, 100) < 1){continue;}
+    for (size_t i = 0; i < count; ++i){
+      benchConn &C = conns[i];
+      if (C.fd < 0 || !pfds[i].revents){continue;}
+      if (pfds[i].revents & (POLLERR | POLLHUP)){
+        close(C.fd);
+        C.fd = pfds[i].fd = -1;
+        ++failures;
+        continue;
+      }
+      if (!C.connected && (pfds[i].revents & POLLOUT)){C.connected = true;}
+      if (pfds[i].revents & POLLIN){
+        ssize_t r = recv(C.fd, buf, sizeof(buf), 0);
+        if (r <= 0){
+          close(C.fd);
+          C.fd = pfds[i].fd = -1;
+          ++failures;
+          continue;
+        }
+        bytesIn += r;
+        C.in.append(buf, r);
+        if (fullResponse(C.in)){
+          latencies.push_back(Util::getMicros(C.reqStart));
+          C.reqStart = 0;
+        }
+      }
+      if (C.connected && !C.reqStart){
+        C.reqStart = Util::getMicros();
+        if (send(C.fd, request.data(), request.size(), MSG_NOSIGNAL) != (ssize_t)request.size()){
+          close(C.fd);
+          C.fd = pfds[i].fd = -1;
+          ++failures;
+          continue;
+        }
+      }
+      pfds[i].events = POLLIN;
+    }
+  }
+  uint64_t elapsed = Util::bootMS() - start;
+  for (size_t i = 0; i < count; ++i){
+    if (conns[i].fd >= 0){close(conns[i].fd);}
+  }
+  freeaddrinfo(ai);
+
+  std::sort(latencies.begin(), latencies.end());
+  uint64_t total = 0;
+  for (size_t i = 0; i < latencies.size(); ++i){total += latencies[i];}
+  size_t n = latencies.size();
+  Bench::Report("conn")
+      .add("connections", count)
+      .add("setup_ms", start - setupStart)
+      .add("requests", n)
+      .add("req_per_sec", n * 1000.0 / elapsed, 1)
+      .add("bytes_in", bytesIn)
+      .add("lat_avg_us", n ? total / n : 0)
+      .add("lat_p50_us", n ? latencies[n / 2] : 0)
+      .add("lat_p99_us", n ? latencies[n * 99 / 100] : 0)
+      .add("failures", failures)
+      .print();
+  return 0;
+}
@@ -0,0 +1,71 @@
+/// \file dtsc_pages.cpp
+/// Checks DTSC::Meta page lookups by time and by key against a linear scan, on a track with pages
+/// that are not available in the middle of it. Pages that are not available are ignored by the
+/// lookups, so their first time and key may be anything: this test gives them values that are out
+/// of order with the available pages around them.
+#include <mist/dtsc.h>
+#include <cstdio>
+#include <inttypes.h>
+
+static size_t linearPage(const DTSC::Meta &M, size_t idx, const char *field, uint64_t val){
+  const Util::RelAccX &pages = M.pages(idx);
+  size_t res = pages.getStartPos();
+  for (size_t i = res; i < pages.getEndPos(); ++i){
+    if (pages.getInt("avail", i) == 0){continue;}
+    if (pages.getInt(field, i) > val){break;}
+    res = i;
+  }
+  return pages.getInt("firstkey", res);
+}
+
+int main(int argc, char **argv){
+  // One key per second, with a page every 10 keys
+  const size_t keyCount = 200;
+  DTSC::Meta M;
+  M.setMaster(true);
+  M.reInit("", true);
+  size_t idx = M.addTrack(keyCount + 1, keyCount + 1, keyCount + 2, keyCount / 10 + 2);
+  M.setType(idx, "video");
+  M.setCodec(idx, "H264");
+  for (uint64_t t = 0; t < keyCount * 1000; t += 1000){M.update(t, 0, idx, 5000, 0, true);}
+
+  Util::RelAccX &tPages = M.pages(idx);
+  DTSC::Pages pages = M.getPages(idx);
+  for (size_t k = 0; k < keyCount; k += 10){
+    size_t p = tPages.getEndPos();
+    tPages.addRecords(1);
+    pages.setFirstKey(p, k);
+    pages.setKeycount(p, 10);
+    pages.setFirstTime(p, k * 1000);
+    pages.setAvail(p, 1024);
+  }
+
+  size_t failures = 0;
+  // A single page that is not available, runs of them, and the first and last page
+  const size_t gaps[][2] = {{7, 8}, {12, 15}, {0, 1}, {19, 20}, {3, 4}};
+  for (size_t g = 0; g < sizeof(gaps) / sizeof(gaps[0]); ++g){
+    for (size_t p = gaps[g][0]; p < gaps[g][1]; ++p){
+      pages.setAvail(p, 0);
+      // Out of order values, alternating between too low and too high
+      pages.setFirstKey(p, (p % 2) ? 0 : keyCount * 10);
+      pages.setFirstTime(p, (p % 2) ? 0 : keyCount * 10000);
+    }
+    for (uint64_t t = 0; t < keyCount * 1000 + 2000; t += 250){
+      size_t got = M.getPageNumberForTime(idx, t);
+      size_t want = linearPage(M, idx, "firsttime", t);
+      if (got != want){
+        fprintf(stderr, "Gap %zu: page %zu for time %" PRIu64 " instead of %zu\n", g, got, t, want);
+        ++failures;
+      }
+    }
+    for (uint64_t k = 0; k < keyCount + 2; ++k){
+      size_t got = M.getPageNumberForKey(idx, k);
+      size_t want = linearPage(M, idx, "firstkey", k);
+      if (got != want){
+        fprintf(stderr, "Gap %zu: page %zu for key %" PRIu64 " instead of %zu\n", g, got, k, want);
+        ++failures;
+      }
+    }
+  }
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,82 @@
+/// \file dtscpacketbench.cpp
+/// Measures how many DTSC packets per second can have their media fields (data, offset, bpos and
+/// keyframe) read, once by scanning for every member with DTSC::Scan::getMember and once through
+/// the indexed DTSC::Packet accessors. Then measures how many packets per second pass through
+/// Mist::InOutBase::bufferLivePacket into the pages of a live stream.
+/// Usage: mistbench dtsc_packet [packets]
+#include "../src/io.h"
+#include "bench.h"
+#include <mist/bitfields.h>
+#include <mist/timing.h>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include <vector>
+
+/// Buffers packets into a live stream of its own, the way an input or push target does.
+class BenchBuffer : public Mist::InOutBase{
+public:
+  BenchBuffer(const std::string &name){
+    streamName = name;
+    meta.reInit(streamName, true);
+    size_t idx = meta.addTrack();
+    meta.setType(idx, "video");
+    meta.setCodec(idx, "H264");
+    meta.setID(idx, 1);
+  }
+};
+
+/// Fills P with the next frame of a 30 FPS H264 video track, with a keyframe every second.
+static void fillPacket(DTSC::Packet &P, size_t i, std::string &frame){
+  bool key = !(i % 30);
+  Bit::htobl((char *)frame.data(), frame.size() - 4);
+  frame[4] = key ? 0x65 : 0x41;
+  P.genericFill(i * 33, 66, 1, frame.data(), frame.size(), i * frame.size(), key);
+}
+
+int Bench::dtscPacketBench(int argc, char **argv){
+  size_t count = argc > 1 ? atoll(argv[1]) : 200000;
+
+  // Packets are read through a fresh reference to their data, the way outputs read them from pages
+  std::string frame(1200, 'x');
+  std::vector<DTSC::Packet> window(256);
+  for (size_t i = 0; i < window.size(); ++i){fillPacket(window[i], i, frame);}
+
+  uint64_t checksum = 0;
+  uint64_t start = Util::getMicros();
+  for (size_t i = 0; i < count; ++i){
+    const DTSC::Packet &src = window[i % window.size()];
+    DTSC::Packet P(src.getData(), src.getDataLen(), true);
+    DTSC::Scan S = P.getScan();
+    char *data;
+    size_t dataLen;
+    S.getMember("data").getString(data, dataLen);
+    checksum += dataLen + S.getMember("offset").asInt() + S.getMember("bpos").asInt() +
+                S.getMember("keyframe").asBool();
+  }
+  Bench::Report("dtsc_packet").add("test", "scan_fields").opTime(Util::getMicros(start), count).add("checksum", checksum).print();
+
+  checksum = 0;
+  start = Util::getMicros();
+  for (size_t i = 0; i < count; ++i){
+    const DTSC::Packet &src = window[i % window.size()];
+    DTSC::Packet P(src.getData(), src.getDataLen(), true);
+    char *data;
+    size_t dataLen;
+    P.getString("data", data, dataLen);
+    checksum += dataLen + P.getInt("offset") + P.getInt("bpos") + P.getFlag("keyframe");
+  }
+  Bench::Report("dtsc_packet").add("test", "indexed_fields").opTime(Util::getMicros(start), count).add("checksum", checksum).print();
+
+  char name[32];
+  snprintf(name, 32, "dtscpacketbench%d", (int)getpid());
+  BenchBuffer B(name);
+  DTSC::Packet P;
+  start = Util::getMicros();
+  for (size_t i = 0; i < count; ++i){
+    fillPacket(P, i, frame);
+    B.bufferLivePacket(P);
+  }
+  Bench::Report("dtsc_packet").add("test", "buffer_live").opTime(Util::getMicros(start), count).print();
+  return 0;
+}
@@ -0,0 +1,92 @@
+/// \file headerbench.cpp
+/// Measures header generation of a large TS or FLV file, such as a 10GB recording, by reading it
+/// as a single byte range and as one byte range per thread. Fails if the resulting tracks differ
+/// in codec, key count, part count or duration.
+/// Usage: mistbench header file.(ts|flv) [threads]
+#include "bench.h"
+#include <mist/dtsc.h>
+#include <mist/flv_tag.h>
+#include <mist/timing.h>
+#include <mist/ts_stream.h>
+#include <cstdio>
+#include <cstdlib>
+#include <inttypes.h>
+#include <set>
+#include <string>
+#include <unistd.h>
+
+static bool scan(const std::string &file, DTSC::Meta &M, size_t chunks){
+  M.setMaster(true);
+  M.reInit("", true);
+  if (file.size() > 4 && file.substr(file.size() - 4) == ".flv"){
+    return FLV::scanHeader(file, M, chunks);
+  }
+  return TS::scanHeader(HTTP::URL(file), M, chunks);
+}
+
+/// Reports how long scanning took, and how many tracks, keys and parts it found.
+static void reportScan(const std::string &file, size_t chunks, uint64_t micros, const DTSC::Meta &M){
+  uint64_t keys = 0, parts = 0;
+  std::set<size_t> tracks = M.getValidTracks();
+  for (std::set<size_t>::iterator it = tracks.begin(); it != tracks.end(); ++it){
+    DTSC::Keys K(M.keys(*it));
+    keys += K.getValidCount();
+    parts += DTSC::Parts(M.parts(*it)).getValidCount();
+  }
+  Bench::Report("header")
+      .add("file", file)
+      .add("threads", chunks)
+      .add("ms", micros / 1000.0, 1)
+      .add("tracks", tracks.size())
+      .add("keys", keys)
+      .add("parts", parts)
+      .print();
+}
+
+int Bench::headerBench(int argc, char **argv){
+  if (argc < 2){
+    fprintf(stderr, "Usage: mistbench %s file.(ts|flv) [threads]\n", argv[0]);
+    return 1;
+  }
+  std::string file = argv[1];
+  size_t threads = argc > 2 ? atoll(argv[2]) : sysconf(_SC_NPROCESSORS_ONLN);
+  if (threads < 2){threads = 2;}
+
+  DTSC::Meta single, multi;
+  uint64_t start = Util::getMicros();
+  if (!scan(file, single, 1)){
+    fprintf(stderr, "Could not read %s\n", file.c_str());
+    return 1;
+  }
+  reportScan(file, 1, Util::getMicros(start), single);
+  start = Util::getMicros();
+  if (!scan(file, multi, threads)){
+    fprintf(stderr, "Could not read %s in %zu ranges\n", file.c_str(), threads);
+    return 1;
+  }
+  reportScan(file, threads, Util::getMicros(start), multi);
+
+  std::set<size_t> tracks = single.getValidTracks();
+  if (tracks != multi.getValidTracks()){
+    fprintf(stderr, "Track lists differ\n");
+    return 1;
+  }
+  bool ok = true;
+  for (std::set<size_t>::iterator it = tracks.begin(); it != tracks.end(); ++it){
+    size_t sKeys = DTSC::Keys(single.keys(*it)).getValidCount();
+    size_t mKeys = DTSC::Keys(multi.keys(*it)).getValidCount();
+    size_t sParts = DTSC::Parts(single.parts(*it)).getValidCount();
+    size_t mParts = DTSC::Parts(multi.parts(*it)).getValidCount();
+    if (single.getCodec(*it) != multi.getCodec(*it) || sKeys != mKeys || sParts != mParts ||
+        single.getFirstms(*it) != multi.getFirstms(*it) || single.getLastms(*it) != multi.getLastms(*it)){
+      fprintf(stderr,
+              "Track %zu differs: %s/%s, %zu/%zu keys, %zu/%zu parts, %" PRIu64 "-%" PRIu64
+              "/%" PRIu64 "-%" PRIu64 "ms\n",
+              *it, single.getCodec(*it).c_str(), multi.getCodec(*it).c_str(), sKeys, mKeys, sParts,
+              mParts, single.getFirstms(*it), single.getLastms(*it), multi.getFirstms(*it),
+              multi.getLastms(*it));
+      ok = false;
+    }
+  }
+  return ok ? 0 : 1;
+}
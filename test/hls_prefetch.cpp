@@ -0,0 +1,160 @@
+#include <mist/http_parser.h>
+#include <mist/prefetch.h>
+#include <mist/socket.h>
+#include <mist/timing.h>
+#include <mist/tinythread.h>
+#include <mist/urireader.h>
+#include <arpa/inet.h>
+#include <cstdio>
+#include <inttypes.h>
+#include <sstream>
+#include <sys/socket.h>
+#include <vector>
+
+/// Mock origin serving a recorded live playlist, delaying every segment like a slow origin does.
+static const size_t segCount = 12;
+static const size_t segSize = 188 * 1000;
+static const uint64_t segDelay = 150;
+
+static std::string playlist(){
+  std::stringstream pls;
+  pls << "#EXTM3U\n#EXT-X-VERSION:3\n#EXT-X-TARGETDURATION:2\n#EXT-X-MEDIA-SEQUENCE:0\n";
+  for (size_t i = 0; i < segCount; ++i){pls << "#EXTINF:2.000,\nseg" << i << ".ts\n";}
+  return pls.str();
+}
+
+static std::string segment(size_t num){
+  std::string seg(segSize, 0);
+  for (size_t i = 0; i < segSize; ++i){seg[i] = (i % 188) ? (char)(num * 31 + i) : 0x47;}
+  return seg;
+}
+
+static void handleConn(void *c){
+  Socket::Connection *conn = (Socket::Connection *)c;
+  HTTP::Parser H;
+  while (*conn){
+    if (!conn->spool() && !conn->Received().size()){
+      Util::sleep(1);
+      continue;
+    }
+    while (H.Read(*conn)){
+      std::string url = H.url;
+      bool head = (H.method == "HEAD");
+      size_t num;
+      H.Clean();
+      if (url == "/live.m3u8"){
+        H.SetBody(playlist());
+      }else if (sscanf(url.c_str(), "/seg%zu.ts", &num) == 1 && num < segCount){
+        if (!head){Util::sleep(segDelay);}
+        H.SetBody(segment(num));
+      }else{
+        H.SendResponse("404", "Not found", *conn);
+        H.Clean();
+        continue;
+      }
+      // Answers HEAD requests with the length of the body, but without the body itself
+      if (head){H.body.clear();}
+      H.SendResponse("200", "OK", *conn);
+      H.Clean();
+    }
+  }
+  conn->close();
+  delete conn;
+}
+
+static void mockServer(void *s){
+  Socket::Server *srv = (Socket::Server *)s;
+  while (srv->connected()){
+    Socket::Connection C = srv->accept(true);
+    if (!C){
+      Util::sleep(5);
+      continue;
+    }
+    tthread::thread T(handleConn, new Socket::Connection(C));
+    T.detach();
+  }
+}
+
+/// Reads every segment of a playlist from a slow local origin, once one after the other and once
+/// through a prefetcher, and checks the prefetched segments are complete and arrive faster.
+int main(int argc, char **argv){
+  Socket::Server *srv = new Socket::Server(0, "127.0.0.1", true);
+  if (!srv->connected()){return 1;}
+  struct sockaddr_storage addr;
+  socklen_t len = sizeof(addr);
+  getsockname(srv->getSocket(), (struct sockaddr *)&addr, &len);
+  int port = ntohs(addr.ss_family == AF_INET6 ? ((struct sockaddr_in6 *)&addr)->sin6_port
+                                              : ((struct sockaddr_in *)&addr)->sin_port);
+  tthread::thread server(mockServer, srv);
+  server.detach();
+
+  char plsUrl[64];
+  snprintf(plsUrl, 64, "http://127.0.0.1:%d/live.m3u8", port);
+  HTTP::URIReader plsDL;
+  if (!plsDL.open(HTTP::URL(plsUrl))){return 1;}
+  char *plsData;
+  size_t plsLen;
+  plsDL.readAll(plsData, plsLen);
+  std::vector<std::string> segments;
+  std::istringstream lines(std::string(plsData, plsLen));
+  std::string line;
+  while (std::getline(lines, line)){
+    if (line.size() && line[0] != '#'){segments.push_back(HTTP::URL(plsUrl).link(line).getUrl());}
+  }
+  if (segments.size() != segCount){
+    fprintf(stderr, "Playlist has %zu segments instead of %zu\n", segments.size(), segCount);
+    return 1;
+  }
+
+  uint64_t start = Util::bootMS();
+  for (size_t i = 0; i < segments.size(); ++i){
+    HTTP::URIReader dl;
+    char *data;
+    size_t dataLen;
+    dl.open(HTTP::URL(segments[i]));
+    dl.readAll(data, dataLen);
+    if (std::string(data, dataLen) != segment(i)){
+      fprintf(stderr, "Segment %zu differs when downloaded directly\n", i);
+      return 1;
+    }
+  }
+  uint64_t sequential = Util::bootMS() - start;
+
+  // Memory for a handful of segments, so the bound is reached
+  HTTP::Prefetcher P;
+  P.start(4, segSize * 3);
+  start = Util::bootMS();
+  for (size_t i = 0; i < segments.size(); ++i){
+    for (size_t j = i + 1; j < segments.size() && j <= i + 4; ++j){P.want(segments[j]);}
+    Util::ResizeablePointer data;
+    HTTP::Prefetcher::takeResult res;
+    while ((res = P.take(segments[i], data, 100)) == HTTP::Prefetcher::PREFETCH_BUSY){}
+    if (res == HTTP::Prefetcher::PREFETCH_MISS){
+      HTTP::URIReader dl;
+      char *ptr;
+      size_t ptrLen;
+      dl.open(HTTP::URL(segments[i]));
+      dl.readAll(ptr, ptrLen);
+      data.assign(ptr, ptrLen);
+    }
+    if (std::string(data, data.size()) != segment(i)){
+      fprintf(stderr, "Segment %zu differs when prefetched\n", i);
+      return 1;
+    }
+  }
+  uint64_t prefetched = Util::bootMS() - start;
+  HTTP::Prefetcher::Stats S = P.getStats();
+  P.stop();
+
+  fprintf(stderr,
+          "%zu segments: %" PRIu64 "ms one after the other, %" PRIu64 "ms prefetched (%" PRIu64
+          " downloads taking %" PRIu64 "ms, %" PRIu64 " ready, %" PRIu64 " waited %" PRIu64
+          "ms, %" PRIu64 " missed, %" PRIu64 " failed)\n",
+          segments.size(), sequential, prefetched, S.downloads, S.downloadMs, S.ready, S.waited,
+          S.waitMs, S.missed, S.failures);
+  // Every segment is either prefetched, or downloaded directly because it was not wanted ahead of
+  // time (the first one) or did not start downloading before it was needed.
+  if (S.failures || !S.missed || S.downloads + S.missed != segCount){return 1;}
+  if (prefetched * 2 > sequential){return 1;}
+  return 0;
+}
@@ -0,0 +1,164 @@
+/// \file jsonflatbench.cpp
+/// Measures parsing and serializing speed and peak heap use of JSON::Value versus JSON::Flat, on a
+/// large configuration document and a large "clients" statistics response.
+/// Both parsers must agree on the contents of every document.
+/// Usage: mistbench json_flat [streams] [sessions]
+#include "bench.h"
+#include <mist/json.h>
+#include <mist/timing.h>
+#include <cstdio>
+#include <cstdlib>
+#include <inttypes.h>
+
+static uint64_t sink = 0;
+
+static std::string makeConfig(size_t streams){
+  JSON::Writer W;
+  W.objectBegin();
+  W.key("config");
+  W.objectBegin();
+  W.key("controller");
+  W.objectBegin();
+  W.key("interface");
+  W.value("0.0.0.0");
+  W.key("port");
+  W.value(4242);
+  W.objectEnd();
+  W.key("protocols");
+  W.arrayBegin();
+  const char *protos[] = {"HTTP", "HLS", "CMAF", "RTMP", "WebRTC", "TSSRT", "RTSP", "DTSC"};
+  for (size_t i = 0; i < 8; ++i){
+    W.objectBegin();
+    W.key("connector");
+    W.value(protos[i]);
+    W.key("pubaddr");
+    W.arrayBegin();
+    W.arrayEnd();
+    W.objectEnd();
+  }
+  W.arrayEnd();
+  W.objectEnd();
+  W.key("streams");
+  W.objectBegin();
+  for (size_t i = 0; i < streams; ++i){
+    char name[32];
+    snprintf(name, 32, "stream%zu", i);
+    W.key(name);
+    W.objectBegin();
+    W.key("DVR");
+    W.value(50000);
+    W.key("name");
+    W.value(name);
+    W.key("source");
+    W.value(std::string("push://\"") + name + "\"\tfrom:é");
+    W.key("stop_sessions");
+    W.value(i % 2 == 0);
+    W.key("maxkeepaway");
+    W.value(1.25 * i);
+    W.key("processes");
+    W.arrayBegin();
+    W.objectBegin();
+    W.key("process");
+    W.value("Livepeer");
+    W.key("target_profiles");
+    W.arrayBegin();
+    for (size_t p = 0; p < 3; ++p){
+      W.objectBegin();
+      W.key("bitrate");
+      W.value((uint64_t)(p + 1) * 1000000);
+      W.key("height");
+      W.value((uint64_t)(p + 1) * 240);
+      W.key("name");
+      W.value("P" + JSON::Value((uint64_t)p).asString());
+      W.objectEnd();
+    }
+    W.arrayEnd();
+    W.objectEnd();
+    W.arrayEnd();
+    W.key("tags");
+    W.arrayBegin();
+    W.value("live");
+    W.value("region-eu");
+    W.arrayEnd();
+    W.objectEnd();
+  }
+  W.objectEnd();
+  W.objectEnd();
+  return W.str();
+}
+
+static std::string makeStats(size_t sessions){
+  JSON::Writer W;
+  W.objectBegin();
+  W.key("data");
+  W.arrayBegin();
+  for (size_t i = 0; i < sessions; ++i){
+    W.arrayBegin();
+    W.value("2001:db8::" + JSON::Value((uint64_t)i % 9999).asString());
+    W.value(i % 3 ? "live" : "vod");
+    W.value(i % 2 ? "HLS" : "WebRTC");
+    W.value((uint64_t)i);
+    W.value((uint64_t)i * 1000);
+    W.value((uint64_t)i * 123456);
+    W.value((uint64_t)i * 789);
+    W.value((uint64_t)i * 1000 + 5);
+    W.value((uint64_t)i * 10 + 5);
+    W.value("sess" + JSON::Value((uint64_t)i * 2654435761u).asString());
+    W.value((uint64_t)i);
+    W.value((uint64_t)0);
+    W.value((uint64_t)i / 7);
+    W.arrayEnd();
+  }
+  W.arrayEnd();
+  W.key("time");
+  W.value((uint64_t)1700000000);
+  W.objectEnd();
+  return W.str();
+}
+
+static bool runOnce(const char *name, const std::string &doc){
+  Bench::heapMark();
+  uint64_t start = Util::getMicros();
+  JSON::Value V = JSON::fromString(doc);
+  uint64_t micros = Util::getMicros(start);
+  size_t peak = Bench::heapGrowth();
+  Bench::Report("json_flat").add("doc", name).add("test", "value_parse").throughput(micros, doc.size()).add("peak_heap_kb", peak / 1024).print();
+
+  start = Util::getMicros();
+  sink += V.toString().size();
+  Bench::Report("json_flat").add("doc", name).add("test", "value_tostring").throughput(Util::getMicros(start), doc.size()).print();
+
+  Bench::heapMark();
+  start = Util::getMicros();
+  JSON::Flat F(doc);
+  micros = Util::getMicros(start);
+  peak = Bench::heapGrowth();
+  Bench::Report("json_flat").add("doc", name).add("test", "flat_parse").throughput(micros, doc.size()).add("peak_heap_kb", peak / 1024).print();
+
+  start = Util::getMicros();
+  sink += F.root().toString().size();
+  Bench::Report("json_flat").add("doc", name).add("test", "flat_tostring").throughput(Util::getMicros(start), doc.size()).print();
+
+  start = Util::getMicros();
+  sink += F.root().toValue().size();
+  Bench::Report("json_flat").add("doc", name).add("test", "flat_tovalue").throughput(Util::getMicros(start), doc.size()).print();
+
+  if (F.root().toValue() != V){
+    fprintf(stderr, "%s: JSON::Flat does not match JSON::Value\n", name);
+    return false;
+  }
+  if (JSON::fromString(F.root().toString()) != V){
+    fprintf(stderr, "%s: JSON::Flat output does not parse back into the same document\n", name);
+    return false;
+  }
+  return true;
+}
+
+int Bench::jsonFlatBench(int argc, char **argv){
+  size_t streams = argc > 1 ? atoll(argv[1]) : 10000;
+  size_t sessions = argc > 2 ? atoll(argv[2]) : 50000;
+  bool ok = runOnce("config", makeConfig(streams));
+  ok &= runOnce("stats", makeStats(sessions));
+  fprintf(stderr, "(%" PRIu64 ")\n", sink);
+  return ok ? 0 : 1;
+}
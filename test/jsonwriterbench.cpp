@@ -0,0 +1,102 @@
+/// \file jsonwriterbench.cpp
+/// Measures the time and peak heap use of generating a "clients" API response for many sessions,
+/// once by building a JSON::Value tree and serializing it, and once with JSON::Writer.
+/// Both outputs are compared, and must be identical.
+/// Usage: mistbench json_writer [sessions]
+#include "bench.h"
+#include <mist/json.h>
+#include <mist/timing.h>
+#include <cstdio>
+#include <cstdlib>
+
+static const char *fieldNames[] = {"host", "stream", "protocol", "conntime", "position", "down", "up",
+                                   "downbps", "upbps", "sessid", "pktcount", "pktlost", "pktretransmit"};
+
+static std::string sessId(size_t i){
+  char buf[20];
+  snprintf(buf, 20, "%016zx", i * 2654435761u);
+  return buf;
+}
+
+static std::string viaTree(size_t sessions){
+  JSON::Value rep;
+  rep["time"] = (uint64_t)1700000000;
+  for (size_t f = 0; f < 13; ++f){rep["fields"].append(fieldNames[f]);}
+  rep["data"].null();
+  for (size_t i = 0; i < sessions; ++i){
+    JSON::Value d;
+    d.append("2001:db8::1:" + sessId(i).substr(0, 4));
+    d.append(i % 3 ? "live" : "vod+\"quoted\"");
+    d.append(i % 2 ? "HLS" : "WebRTC");
+    d.append((uint64_t)i);
+    d.append((uint64_t)i * 1000);
+    d.append((uint64_t)i * 123456);
+    d.append((uint64_t)i * 789);
+    d.append((uint64_t)i * 1000 + 5);
+    d.append((uint64_t)i * 10 + 5);
+    d.append(sessId(i));
+    d.append((uint64_t)i);
+    d.append((uint64_t)0);
+    d.append((uint64_t)i / 7);
+    rep["data"].append(d);
+  }
+  return rep.toString() + "\n\n";
+}
+
+static std::string viaWriter(size_t sessions){
+  JSON::Writer W;
+  W.objectBegin();
+  W.key("data");
+  W.arrayBegin();
+  for (size_t i = 0; i < sessions; ++i){
+    W.arrayBegin();
+    W.value("2001:db8::1:" + sessId(i).substr(0, 4));
+    W.value(i % 3 ? "live" : "vod+\"quoted\"");
+    W.value(i % 2 ? "HLS" : "WebRTC");
+    W.value((uint64_t)i);
+    W.value((uint64_t)i * 1000);
+    W.value((uint64_t)i * 123456);
+    W.value((uint64_t)i * 789);
+    W.value((uint64_t)i * 1000 + 5);
+    W.value((uint64_t)i * 10 + 5);
+    W.value(sessId(i));
+    W.value((uint64_t)i);
+    W.value((uint64_t)0);
+    W.value((uint64_t)i / 7);
+    W.arrayEnd();
+  }
+  W.arrayEnd();
+  W.key("fields");
+  W.arrayBegin();
+  for (size_t f = 0; f < 13; ++f){W.value(fieldNames[f]);}
+  W.arrayEnd();
+  W.key("time");
+  W.value((uint64_t)1700000000);
+  W.objectEnd();
+  W.str() += "\n\n";
+  return W.str();
+}
+
+int Bench::jsonWriterBench(int argc, char **argv){
+  size_t sessions = argc > 1 ? atoll(argv[1]) : 50000;
+
+  Bench::heapMark();
+  uint64_t start = Util::getMicros();
+  std::string written = viaWriter(sessions);
+  uint64_t micros = Util::getMicros(start);
+  size_t peak = Bench::heapGrowth();
+  Bench::Report("json_writer").add("sessions", sessions).add("test", "writer").throughput(micros, written.size()).add("peak_heap_kb", peak / 1024).print();
+
+  Bench::heapMark();
+  start = Util::getMicros();
+  std::string tree = viaTree(sessions);
+  micros = Util::getMicros(start);
+  peak = Bench::heapGrowth();
+  Bench::Report("json_writer").add("sessions", sessions).add("test", "tree").throughput(micros, tree.size()).add("peak_heap_kb", peak / 1024).print();
+
+  if (written != tree){
+    fprintf(stderr, "JSON::Writer output differs from JSON::Value::toString output\n");
+    return 1;
+  }
+  return 0;
+}
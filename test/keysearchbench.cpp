@@ -0,0 +1,166 @@
+/// \file keysearchbench.cpp
+/// Measures DTSC::Meta key, fragment and page lookups by time on tracks of 10k and 100k keys,
+/// for random seeks and for steadily increasing times as used by playback, comparing them with a
+/// linear scan. The results of every lookup are checked against the linear scan as well.
+/// Usage: mistbench keysearch [lookups]
+#include "bench.h"
+#include <mist/dtsc.h>
+#include <mist/timing.h>
+#include <cstdio>
+#include <cstdlib>
+#include <inttypes.h>
+#include <vector>
+
+static uint64_t sink = 0;
+static uint64_t mismatches = 0;
+
+static size_t linearKeyIndex(const DTSC::Meta &M, size_t idx, uint64_t time){
+  DTSC::Keys keys(M.getKeys(idx));
+  size_t i = keys.getFirstValid();
+  while (i < keys.getEndValid() && keys.getTime(i) + keys.getDuration(i) <= time){++i;}
+  return i;
+}
+
+static size_t linearFragmentIndex(const DTSC::Meta &M, size_t idx, uint64_t time){
+  DTSC::Fragments fragments(M.fragments(idx));
+  DTSC::Keys keys(M.getKeys(idx));
+  for (size_t i = fragments.getFirstValid(); i < fragments.getEndValid(); ++i){
+    if (time < keys.getTime(fragments.getFirstKey(i)) + fragments.getDuration(i)){return i;}
+  }
+  if (fragments.getEndValid() > fragments.getFirstValid() && time < M.getLastms(idx)){
+    return fragments.getEndValid() - 1;
+  }
+  return fragments.getEndValid();
+}
+
+static size_t linearKeyNum(const DTSC::Meta &M, size_t idx, uint64_t time){
+  const Util::RelAccX &keys = M.keys(idx);
+  const Util::RelAccX &parts = M.parts(idx);
+  Util::RelAccXFieldData timeField = keys.getFieldData("time");
+  Util::RelAccXFieldData firstPartField = keys.getFieldData("firstpart");
+  Util::RelAccXFieldData durationField = parts.getFieldData("duration");
+  size_t res = keys.getDeleted();
+  for (size_t i = res; i < keys.getEndPos(); i++){
+    if (keys.getInt(timeField, i) > time){
+      if (keys.getInt(firstPartField, i) > parts.getStartPos()){
+        uint64_t dur = parts.getInt(durationField, keys.getInt(firstPartField, i) - 1);
+        if (keys.getInt(timeField, i) - dur < time){res = i;}
+      }
+      continue;
+    }
+    res = i;
+  }
+  return res;
+}
+
+static size_t linearPage(const DTSC::Meta &M, size_t idx, uint64_t time){
+  const Util::RelAccX &pages = M.pages(idx);
+  size_t res = pages.getStartPos();
+  for (size_t i = res; i < pages.getEndPos(); ++i){
+    if (pages.getInt("avail", i) == 0){continue;}
+    if (pages.getInt("firsttime", i) > time){break;}
+    res = i;
+  }
+  return pages.getInt("firstkey", res);
+}
+
+static void check(const char *name, uint64_t time, size_t got, size_t expected){
+  if (got == expected){return;}
+  if (++mismatches < 10){
+    fprintf(stderr, "%s mismatch at time %" PRIu64 ": %zu instead of %zu\n", name, time, got, expected);
+  }
+}
+
+static void runOnce(size_t keyCount, uint64_t lookups){
+  // One key per second, two parts per key, with a page every 100 keys
+  DTSC::Meta M;
+  M.setMaster(true);
+  M.reInit("", true);
+  size_t idx = M.addTrack(keyCount + 1, keyCount + 1, keyCount * 2 + 2, keyCount / 100 + 2);
+  M.setType(idx, "video");
+  M.setCodec(idx, "H264");
+  for (uint64_t t = 0; t < keyCount * 1000; t += 500){M.update(t, 0, idx, 5000, 0, !(t % 1000));}
+
+  Util::RelAccX &tPages = M.pages(idx);
+  DTSC::Pages pages = M.getPages(idx);
+  for (size_t k = 0; k < keyCount; k += 100){
+    size_t p = tPages.getEndPos();
+    tPages.addRecords(1);
+    pages.setFirstKey(p, k);
+    pages.setKeycount(p, 100);
+    pages.setFirstTime(p, k * 1000);
+  }
+  // Drop the first tenth, as a live DVR window would, and leave some pages unavailable
+  for (size_t i = 0; i < keyCount / 10; ++i){M.removeFirstKey(idx);}
+  for (size_t p = tPages.getStartPos(); p < tPages.getEndPos(); ++p){pages.setAvail(p, (p % 7) ? 1024 : 0);}
+  DTSC::Keys keys(M.getKeys(idx));
+
+  uint64_t firstms = M.getFirstms(idx);
+  uint64_t range = M.getLastms(idx) + 2000 - firstms;
+  std::vector<uint64_t> randTimes(lookups), seqTimes(lookups);
+  srand(keyCount);
+  for (size_t i = 0; i < lookups; ++i){
+    randTimes[i] = firstms + ((uint64_t)rand() * RAND_MAX + rand()) % range;
+    // Playback, looking up roughly every key in turn
+    seqTimes[i] = firstms + (i * 1000 + 250) % range;
+  }
+
+  // The linear scans are slow on large tracks, so only check part of the lookups
+  uint64_t linearOps = lookups / 100 + 1;
+  for (size_t i = 0; i < linearOps; ++i){
+    uint64_t t = randTimes[i];
+    check("getKeyIndexForTime", t, M.getKeyIndexForTime(idx, t), linearKeyIndex(M, idx, t));
+    check("getFragmentIndexForTime", t, M.getFragmentIndexForTime(idx, t), linearFragmentIndex(M, idx, t));
+    check("getKeyNumForTime", t, M.getKeyNumForTime(idx, t), linearKeyNum(M, idx, t));
+    check("getPageNumberForTime", t, M.getPageNumberForTime(idx, t), linearPage(M, idx, t));
+    check("Keys::getIndexForTime", t, keys.getIndexForTime(t), linearKeyIndex(M, idx, t));
+  }
+
+  uint64_t start = Util::getMicros();
+  for (uint64_t i = 0; i < linearOps; ++i){sink += linearKeyIndex(M, idx, randTimes[i]);}
+  Bench::Report("keysearch").add("keys", keyCount).add("test", "key_index_linear_random").opTime(Util::getMicros(start), linearOps).print();
+
+  start = Util::getMicros();
+  for (uint64_t i = 0; i < lookups; ++i){sink += M.getKeyIndexForTime(idx, randTimes[i]);}
+  Bench::Report("keysearch").add("keys", keyCount).add("test", "key_index_random").opTime(Util::getMicros(start), lookups).print();
+
+  start = Util::getMicros();
+  for (uint64_t i = 0; i < lookups; ++i){sink += M.getKeyIndexForTime(idx, seqTimes[i]);}
+  Bench::Report("keysearch").add("keys", keyCount).add("test", "key_index_sequential").opTime(Util::getMicros(start), lookups).print();
+
+  start = Util::getMicros();
+  for (uint64_t i = 0; i < lookups; ++i){sink += M.getKeyNumForTime(idx, randTimes[i]);}
+  Bench::Report("keysearch").add("keys", keyCount).add("test", "key_num_random").opTime(Util::getMicros(start), lookups).print();
+
+  start = Util::getMicros();
+  for (uint64_t i = 0; i < lookups; ++i){sink += M.getKeyNumForTime(idx, seqTimes[i]);}
+  Bench::Report("keysearch").add("keys", keyCount).add("test", "key_num_sequential").opTime(Util::getMicros(start), lookups).print();
+
+  start = Util::getMicros();
+  for (uint64_t i = 0; i < lookups; ++i){sink += M.getFragmentIndexForTime(idx, randTimes[i]);}
+  Bench::Report("keysearch").add("keys", keyCount).add("test", "fragment_index_random").opTime(Util::getMicros(start), lookups).print();
+
+  start = Util::getMicros();
+  for (uint64_t i = 0; i < lookups; ++i){sink += M.getFragmentIndexForTime(idx, seqTimes[i]);}
+  Bench::Report("keysearch").add("keys", keyCount).add("test", "fragment_index_sequential").opTime(Util::getMicros(start), lookups).print();
+
+  start = Util::getMicros();
+  for (uint64_t i = 0; i < lookups; ++i){sink += M.getPageNumberForTime(idx, randTimes[i]);}
+  Bench::Report("keysearch").add("keys", keyCount).add("test", "page_random").opTime(Util::getMicros(start), lookups).print();
+
+  start = Util::getMicros();
+  for (uint64_t i = 0; i < lookups; ++i){sink += keys.getIndexForTime(randTimes[i]);}
+  Bench::Report("keysearch").add("keys", keyCount).add("test", "keys_index_random").opTime(Util::getMicros(start), lookups).print();
+}
+
+int Bench::keySearchBench(int argc, char **argv){
+  uint64_t lookups = argc > 1 ? atoll(argv[1]) : 10000;
+  runOnce(10000, lookups);
+  runOnce(100000, lookups);
+  fprintf(stderr, "(%" PRIu64 ")\n", sink);
+  if (mismatches){
+    fprintf(stderr, "%" PRIu64 " lookups did not match a linear scan\n", mismatches);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,524 @@
+/// \file mistbench.cpp
+/// Benchmark suite for the muxers, demuxers and data structures every stream passes through, run
+/// by `meson test --benchmark` or by hand. Feeds synthetic 30 FPS H264 video through:
+/// - ts_mux: PES lead-ins and TS packets, filled by TS::PacketFiller as TSOutput does
+/// - ts_demux: TS::Stream::parse, reading back the output of ts_mux
+/// - ts_ingest: TS::Assembler, reading back the output of ts_mux padded with null packets, in
+///   datagrams of 7 TS packets like SRT and UDP inputs receive them
+/// - meta_update: DTSC::Meta::update
+/// - flv_mux: FLV::Tag::DTSCLoader
+/// - mp4_mux: a moof box per fragment, the way fragmented MP4 outputs build them
+/// - http_parse: HTTP::Parser::Read, on pipelined requests
+/// - json_parse: JSON::fromString, on viewer statistics
+/// - udp_loopback: Socket::UDPConnection, sending RTP-sized datagrams through the pace queue
+///   over loopback and receiving them again
+/// - rtp_reorder: RTP::Sorter, on packets that arrive up to 8 places out of order
+/// - rtp_loss: RTP::Sorter, on the same packets with 2% of them lost
+/// Prints one JSON object per benchmark with packets/s, bytes/s and heap allocations per packet,
+/// so results of different builds can be compared line by line.
+/// Also runs the benchmarks of single components listed in bench.h, which take their own
+/// arguments: `mistbench keysearch 100000` runs Bench::keySearchBench with 100000 lookups.
+/// Usage: mistbench [benchmark|all] [packets]
+#include "bench.h"
+#include <mist/bitfields.h>
+#include <mist/dtsc.h>
+#include <mist/flv_tag.h>
+#include <mist/http_parser.h>
+#include <mist/json.h>
+#include <mist/mp4_dash.h>
+#include <mist/mp4_generic.h>
+#include <mist/rtp.h>
+#include <mist/socket.h>
+#include <mist/timing.h>
+#include <mist/ts_packet.h>
+#include <mist/ts_stream.h>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <cstring>
+#include <inttypes.h>
+#include <string>
+#include <vector>
+
+/// Counts packets, bytes and allocations between its construction and report.
+class BenchRun{
+public:
+  BenchRun(const char *_name) : name(_name){
+    packets = 0;
+    bytes = 0;
+    startAllocs = Bench::allocCount();
+    start = Util::getMicros();
+  }
+  void report(){
+    uint64_t micros = Util::getMicros(start);
+    uint64_t allocated = Bench::allocCount() - startAllocs;
+    Bench::Report(name)
+        .add("packets", packets)
+        .add("bytes", bytes)
+        .add("ms", micros / 1000.0, 2)
+        .add("packets_per_s", micros ? packets * 1000000.0 / micros : 0, 0)
+        .add("MB_per_s", micros ? bytes / (double)micros : 0, 2)
+        .add("allocs_per_packet", packets ? allocated / (double)packets : 0, 3)
+        .print();
+  }
+  uint64_t packets;
+  uint64_t bytes;
+
+private:
+  const char *name;
+  uint64_t start;
+  uint64_t startAllocs;
+};
+
+// 1280x720 High profile parameter sets
+static const char sps[] = "\147\144\000\037\254\331\100\120\005\273\001\020\000\000\003\000\020\000\000\003\003\300\361\203\031\140";
+static const char pps[] = "\150\353\343\313\042\300";
+
+/// Returns the avcC box payload of the synthetic video track.
+static std::string avcInit(){
+  std::string init("\001\144\000\037\377\341", 6);
+  char len[2];
+  Bit::htobs(len, sizeof(sps) - 1);
+  init.append(len, 2);
+  init.append(sps, sizeof(sps) - 1);
+  init.append("\001", 1);
+  Bit::htobs(len, sizeof(pps) - 1);
+  init.append(len, 2);
+  init.append(pps, sizeof(pps) - 1);
+  return init;
+}
+
+/// Size of frame i, with a key frame every second
+static size_t frameSize(size_t i){return (i % 30) ? 1500 + (i * 7919) % 4000 : 40000;}
+
+/// Returns the slice of frame i as a single NAL unit, without start code or length.
+static std::string frameNal(size_t i){
+  std::string nal(frameSize(i), 0);
+  nal[0] = (i % 30) ? 0x41 : 0x65;
+  // Never contains two zero bytes in a row, so it cannot contain a start code
+  for (size_t j = 1; j < nal.size(); ++j){nal[j] = (char)(0x80 | ((i + j * 13) & 0x7F));}
+  return nal;
+}
+
+/// Sets up meta with a single H264 track, returning its index.
+static size_t videoMeta(DTSC::Meta &M){
+  M.setMaster(true);
+  M.reInit("", true);
+  M.setVod(true);
+  size_t idx = M.addTrack();
+  M.setType(idx, "video");
+  M.setCodec(idx, "H264");
+  M.setID(idx, 1);
+  M.setInit(idx, avcInit());
+  M.setWidth(idx, 1280);
+  M.setHeight(idx, 720);
+  return idx;
+}
+
+/// Fills TS packets the way TSOutput does, appending them to a string.
+class TSWriter : public TS::PacketFiller{
+public:
+  TSWriter(std::string &_out) : out(_out){
+    cont = 0;
+    first = false;
+    key = false;
+    time = 0;
+  }
+  void fill(const char *data, size_t dataLen){fillPacket(data, dataLen, first, true, key, pid, cont, time);}
+  void finish(){
+    if (packData.getBytesFree() < 184){
+      packData.addStuffing();
+      fill(0, 0);
+    }
+  }
+  std::string &out;
+  size_t pid;
+  uint16_t cont;
+  bool first;
+  bool key;
+  uint64_t time;
+
+protected:
+  void sendPacket(){out.append(packData.checkAndGetBuffer(), 188);}
+};
+
+/// Muxes count frames into TS, with a PAT and PMT every second.
+static void tsMux(size_t count, std::string &ts, bool doReport){
+  DTSC::Meta M;
+  size_t idx = videoMeta(M);
+  std::set<size_t> tracks;
+  tracks.insert(idx);
+  std::string aud("\000\000\000\001\011\360", 6);
+  std::string init;
+  init.append("\000\000\000\001", 4);
+  init.append(sps, sizeof(sps) - 1);
+  init.append("\000\000\000\001", 4);
+  init.append(pps, sizeof(pps) - 1);
+  std::string frames[30];
+  for (size_t i = 0; i < 30; ++i){frames[i] = frameNal(i);}
+
+  ts.clear();
+  ts.reserve(count * 3000);
+  TSWriter W(ts);
+  W.pid = TS::getUniqTrackID(M, idx);
+  uint16_t contPAT = 0, contPMT = 0;
+  std::string bs;
+  BenchRun R("ts_mux");
+  for (size_t i = 0; i < count; ++i){
+    const std::string &nal = frames[i % 30];
+    W.time = i * 33;
+    W.key = !(i % 30);
+    W.first = true;
+    if (W.key){
+      TS::Packet tmpPack;
+      tmpPack.FromPointer(TS::PAT);
+      tmpPack.setContinuityCounter(++contPAT);
+      ts.append(tmpPack.checkAndGetBuffer(), 188);
+      ts.append(TS::createPMT(tracks, M, ++contPMT), 188);
+    }
+    bs.clear();
+    TS::Packet::getPESVideoLeadIn(bs, 0, W.time * 90, 0, true, 0);
+    W.fill(bs.data(), bs.size());
+    W.fill(aud.data(), aud.size());
+    if (W.key){W.fill(init.data(), init.size());}
+    W.fill("\000\000\000\001", 4);
+    W.fill(nal.data(), nal.size());
+    W.finish();
+    ++R.packets;
+    R.bytes += nal.size();
+  }
+  if (doReport){R.report();}
+}
+
+/// Demuxes the output of tsMux back into DTSC packets.
+static void tsDemux(const std::string &ts){
+  TS::Stream S;
+  DTSC::Packet P;
+  BenchRun R("ts_demux");
+  for (size_t i = 0; i + 188 <= ts.size(); i += 188){
+    S.parse((char *)ts.data() + i, i);
+    while (S.hasPacket()){
+      S.getEarliestPacket(P);
+      ++R.packets;
+      R.bytes += P.getDataStringLen();
+    }
+  }
+  R.report();
+}
+
+/// Assembles the output of tsMux, with a null packet after every two packets as constant bitrate
+/// streams have, from datagrams of 1316 bytes.
+static void tsIngest(const std::string &ts){
+  std::string padded;
+  padded.reserve(ts.size() * 3 / 2 + 188);
+  char nullPacket[188];
+  memset(nullPacket, 0xFF, 188);
+  memcpy(nullPacket, "\107\037\377\020", 4);
+  for (size_t i = 0; i + 188 <= ts.size(); i += 188){
+    padded.append(ts.data() + i, 188);
+    if (i % 376){padded.append(nullPacket, 188);}
+  }
+  TS::Stream S;
+  TS::Assembler A;
+  A.setLive();
+  DTSC::Packet P;
+  BenchRun R("ts_ingest");
+  for (size_t i = 0; i < padded.size(); i += 1316){
+    A.assemble(S, padded.data() + i, std::min((size_t)1316, padded.size() - i), true);
+    while (S.hasPacket()){
+      S.getEarliestPacket(P);
+      ++R.packets;
+      R.bytes += P.getDataStringLen();
+    }
+  }
+  R.report();
+}
+
+static void metaUpdate(size_t count){
+  DTSC::Meta M;
+  size_t idx = videoMeta(M);
+  uint64_t bpos = 0;
+  BenchRun R("meta_update");
+  for (size_t i = 0; i < count; ++i){
+    size_t size = frameSize(i);
+    M.update(i * 33, 0, idx, size, bpos, !(i % 30));
+    bpos += size;
+    ++R.packets;
+    R.bytes += size;
+  }
+  R.report();
+}
+
+static void flvMux(size_t count){
+  DTSC::Meta M;
+  size_t idx = videoMeta(M);
+  std::string frames[30];
+  for (size_t i = 0; i < 30; ++i){
+    std::string nal = frameNal(i);
+    frames[i].resize(4);
+    Bit::htobl((char *)frames[i].data(), nal.size());
+    frames[i].append(nal);
+  }
+  DTSC::Packet P;
+  FLV::Tag tag;
+  BenchRun R("flv_mux");
+  for (size_t i = 0; i < count; ++i){
+    const std::string &frame = frames[i % 30];
+    P.genericFill(i * 33, 0, 1, frame.data(), frame.size(), 0, !(i % 30));
+    tag.DTSCLoader(P, M, idx);
+    ++R.packets;
+    R.bytes += tag.len;
+  }
+  R.report();
+}
+
+/// Builds a moof for every fragment of 30 frames, with a trun entry per frame.
+static void mp4Mux(size_t count){
+  BenchRun R("mp4_mux");
+  uint32_t seq = 0;
+  for (size_t i = 0; i < count; i += 30){
+    MP4::MOOF moofBox;
+    MP4::MFHD mfhdBox(seq++);
+    moofBox.setContent(mfhdBox, 0);
+    MP4::TRAF trafBox;
+    MP4::TFHD tfhdBox;
+    tfhdBox.setFlags(MP4::tfhdSampleFlag | MP4::tfhdBaseIsMoof);
+    tfhdBox.setTrackID(1);
+    tfhdBox.setDefaultSampleDuration(444);
+    tfhdBox.setDefaultSampleSize(444);
+    tfhdBox.setDefaultSampleFlags(MP4::noIPicture | MP4::noKeySample);
+    trafBox.setContent(tfhdBox, 0);
+    MP4::TFDT tfdtBox;
+    tfdtBox.setBaseMediaDecodeTime(i * 33);
+    trafBox.setContent(tfdtBox, 1);
+    uint32_t offset = 0;
+    for (size_t j = i; j < i + 30 && j < count; ++j){
+      MP4::TRUN trunBox;
+      trunBox.setFlags(MP4::trundataOffset | MP4::trunfirstSampleFlags | MP4::trunsampleSize |
+                       MP4::trunsampleDuration | MP4::trunsampleOffsets);
+      trunBox.setDataOffset(offset);
+      trunBox.setFirstSampleFlags((j % 30) ? (MP4::noIPicture | MP4::noKeySample)
+                                           : (MP4::isIPicture | MP4::isKeySample));
+      MP4::trunSampleInformation sampleInfo;
+      sampleInfo.sampleSize = frameSize(j);
+      sampleInfo.sampleDuration = 33;
+      sampleInfo.sampleOffset = 0;
+      trunBox.setSampleInformation(sampleInfo, 0);
+      trafBox.setContent(trunBox, 2 + j - i);
+      offset += sampleInfo.sampleSize;
+      ++R.packets;
+    }
+    moofBox.setContent(trafBox, 1);
+    R.bytes += moofBox.boxedSize();
+  }
+  R.report();
+}
+
+static void httpParse(size_t count){
+  std::string request = "GET /hls/stream/index.m3u8?tkn=1234567890 HTTP/1.1\r\n"
+                        "Host: example.com:8080\r\n"
+                        "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36\r\n"
+                        "Accept: */*\r\n"
+                        "Accept-Encoding: gzip, deflate\r\n"
+                        "Range: bytes=0-1023\r\n"
+                        "Connection: keep-alive\r\n\r\n";
+  // Pipelined requests, parsed in batches
+  std::string batch;
+  for (size_t i = 0; i < 64; ++i){batch += request;}
+  HTTP::Parser H;
+  std::string buf;
+  BenchRun R("http_parse");
+  while (R.packets < count){
+    buf = batch;
+    while (H.Read(buf)){
+      R.bytes += request.size();
+      ++R.packets;
+      H.Clean();
+    }
+  }
+  R.report();
+}
+
+static void jsonParse(size_t count){
+  std::string doc = "{\"fields\":[\"host\",\"stream\",\"protocol\",\"conntime\",\"down\",\"up\"],\"data\":[";
+  for (size_t i = 0; i < 100; ++i){
+    char entry[160];
+    snprintf(entry, 160, "%s[\"192.168.%zu.%zu\",\"stream%zu\",\"HLS\",%zu,%zu,%zu]", i ? "," : "",
+             i / 250, i % 250, i % 7, 1700000000 + i, i * 123456, i * 789);
+    doc += entry;
+  }
+  doc += "]}";
+  BenchRun R("json_parse");
+  // Every document holds 100 viewers, counted as a packet each
+  while (R.packets < count){
+    JSON::Value V = JSON::fromString(doc);
+    if (V["data"].size() != 100){
+      fprintf(stderr, "Could not parse statistics document\n");
+      exit(1);
+    }
+    R.packets += 100;
+    R.bytes += doc.size();
+  }
+  R.report();
+}
+
+static void udpLoopback(size_t count){
+  Socket::UDPConnection rx, tx;
+  uint16_t port = rx.bind(0, "127.0.0.1");
+  if (!port){
+    fprintf(stderr, "Could not bind UDP socket\n");
+    exit(1);
+  }
+  tx.SetDestination("127.0.0.1", port);
+  // Video frames fragmented into full-size RTP packets, the last one of every frame smaller
+  char pkt[1200];
+  memset(pkt, 0xAB, sizeof(pkt));
+  size_t sent = 0;
+  BenchRun R("udp_loopback");
+  while (sent < count){
+    // Enough packets that the queue is behind its pace, the way a busy output's queue gets
+    for (size_t i = 0; i < 30000 && sent < count; ++i, ++sent){
+      tx.sendPaced(pkt, (i % 8 == 7) ? 700 : 1200);
+    }
+    // Flush the pace queue as fast as it allows, draining the receiving end in between
+    while (tx.timeToNextPace() != std::string::npos){
+      tx.sendPaced(0);
+      while (rx.Receive()){
+        ++R.packets;
+        R.bytes += rx.data.size();
+      }
+    }
+  }
+  uint64_t start = Util::bootMS();
+  while (R.packets < count && Util::bootMS() - start < 100){
+    while (rx.Receive()){
+      ++R.packets;
+      R.bytes += rx.data.size();
+    }
+  }
+  R.report();
+}
+
+/// Counts sorted packets, and fails if they come out of order.
+class BenchSorter : public RTP::Sorter{
+public:
+  BenchSorter(BenchRun &r) : R(r){}
+  void outPacket(const uint64_t track, const RTP::Packet &p){
+    if (R.packets && (int16_t)(p.getSequence() - lastSeq) <= 0){
+      fprintf(stderr, "Sorter output packet #%u after #%u\n", p.getSequence(), lastSeq);
+      exit(1);
+    }
+    lastSeq = p.getSequence();
+    ++R.packets;
+    R.bytes += p.getDataLen();
+  }
+  uint16_t lastSeq;
+
+private:
+  BenchRun &R;
+};
+
+static void rtpSort(size_t count, const char *name, size_t lossPercent){
+  // Every packet arrives at its own position plus a jitter of 0-7 places; a lost one never does
+  std::vector<std::pair<uint64_t, uint32_t> > order;
+  order.reserve(count);
+  uint32_t rnd = 12345;
+  for (size_t i = 0; i < count; ++i){
+    rnd = rnd * 1103515245 + 12345;
+    if ((rnd >> 8) % 100 < lossPercent){continue;}
+    order.push_back(std::make_pair(i + ((rnd >> 16) & 7), (uint32_t)i));
+  }
+  std::stable_sort(order.begin(), order.end());
+  char pkt[1200];
+  memset(pkt, 0, sizeof(pkt));
+  pkt[0] = (char)0x80;
+  pkt[1] = 96;
+  BenchRun R(name);
+  BenchSorter S(R);
+  for (size_t i = 0; i < order.size(); ++i){
+    Bit::htobs(pkt + 2, (uint16_t)(order[i].second + 60000));
+    Bit::htobl(pkt + 4, order[i].second * 3000);
+    S.addPacket(pkt, (order[i].second % 8 == 7) ? 700 : 1200);
+    // Sent out as NACKs by WebRTC
+    if (S.wantedSeqs.size()){S.wantedSeqs.clear();}
+  }
+  R.report();
+}
+
+/// Benchmarks of single components, run by name with the arguments that follow it
+static const struct{
+  const char *name;
+  int (*run)(int argc, char **argv);
+}benches[] ={
+#ifdef SSL
+    {"aes", Bench::aesBench},
+#endif
+    {"buffer", Bench::bufferBench},
+    {"conn", Bench::connBench},
+    {"dtsc_packet", Bench::dtscPacketBench},
+    {"header", Bench::headerBench},
+    {"json_flat", Bench::jsonFlatBench},
+    {"json_writer", Bench::jsonWriterBench},
+    {"keysearch", Bench::keySearchBench},
+    {"mp4_index", Bench::mp4IndexBench},
+    {"rax", Bench::raxBench},
+    {"sendfile", Bench::sendFileBench},
+    {"session", Bench::sessionBench},
+};
+
+int main(int argc, char **argv){
+  std::string which = argc > 1 ? argv[1] : "all";
+  for (size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); ++i){
+    if (which == benches[i].name){return benches[i].run(argc - 1, argv + 1);}
+  }
+  size_t count = argc > 2 ? atoll(argv[2]) : 20000;
+  bool all = (which == "all");
+  bool found = false;
+  if (all || which == "ts_mux" || which == "ts_demux" || which == "ts_ingest"){
+    std::string ts;
+    tsMux(count, ts, all || which == "ts_mux");
+    if (all || which == "ts_demux"){tsDemux(ts);}
+    if (all || which == "ts_ingest"){tsIngest(ts);}
+    found = true;
+  }
+  if (all || which == "meta_update"){
+    metaUpdate(count);
+    found = true;
+  }
+  if (all || which == "flv_mux"){
+    flvMux(count);
+    found = true;
+  }
+  if (all || which == "mp4_mux"){
+    mp4Mux(count);
+    found = true;
+  }
+  if (all || which == "http_parse"){
+    httpParse(count * 10);
+    found = true;
+  }
+  if (all || which == "json_parse"){
+    jsonParse(count * 10);
+    found = true;
+  }
+  if (all || which == "rtp_reorder"){
+    rtpSort(count * 10, "rtp_reorder", 0);
+    found = true;
+  }
+  if (all || which == "rtp_loss"){
+    rtpSort(count * 10, "rtp_loss", 2);
+    found = true;
+  }
+  if (all || which == "udp_loopback"){
+    udpLoopback(count * 10);
+    found = true;
+  }
+  if (!found){
+    fprintf(stderr, "Usage: %s [ts_mux|ts_demux|ts_ingest|meta_update|flv_mux|mp4_mux|http_parse|json_parse|rtp_reorder|rtp_loss|udp_loopback|all] [packets]\n", argv[0]);
+    fprintf(stderr, "   or: %s <component> [arguments], with component one of:", argv[0]);
+    for (size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); ++i){fprintf(stderr, " %s", benches[i].name);}
+    fprintf(stderr, "\n");
+    return 1;
+  }
+  return 0;
+}
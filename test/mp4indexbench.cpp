@@ -0,0 +1,134 @@
+/// \file mp4indexbench.cpp
+/// Measures how long it takes to map a Range: byte offset of a progressive MP4 file to a position
+/// in its media data, for a synthetic recording of video and audio. Compares a walk over all parts
+/// before the offset, as done without an index, to a lookup in an MP4::ProgressiveIndex, and fails
+/// if they disagree. Also checks the index survives being stored and loaded.
+/// Usage: mistbench mp4_index [minutes] [lookups]
+#include "bench.h"
+#include <mist/dtsc.h>
+#include <mist/mp4_index.h>
+#include <mist/timing.h>
+#include <cstdio>
+#include <cstdlib>
+#include <inttypes.h>
+#include <unistd.h>
+
+struct PartOrder{
+  bool operator()(const MP4::IndexPart &a, const MP4::IndexPart &b) const{
+    if (a.time != b.time){return a.time < b.time;}
+    if (a.trackID != b.trackID){return a.trackID < b.trackID;}
+    return a.index < b.index;
+  }
+};
+
+/// Walks the interleaved parts from the given state, starting at byte pos of the media data,
+/// until reaching the part that contains offset. Returns that part, and the amount of parts walked.
+static MP4::IndexPart walk(const DTSC::Meta &M, const std::deque<MP4::IndexPart> &start, uint64_t pos,
+                           uint64_t offset, uint64_t &walked){
+  std::set<MP4::IndexPart, PartOrder> order(start.begin(), start.end());
+  walked = 0;
+  MP4::IndexPart P = *order.begin();
+  while (!order.empty()){
+    P = *order.begin();
+    order.erase(order.begin());
+    DTSC::Parts parts(M.parts(P.trackID));
+    uint64_t size = parts.getSize(P.index);
+    if (pos + size > offset){break;}
+    pos += size;
+    ++walked;
+    if (P.time + parts.getDuration(P.index) < M.getLastms(P.trackID)){
+      P.time += parts.getDuration(P.index);
+      ++P.index;
+      order.insert(P);
+    }
+  }
+  return P;
+}
+
+int Bench::mp4IndexBench(int argc, char **argv){
+  uint64_t minutes = argc > 1 ? atoll(argv[1]) : 180;
+  size_t lookups = argc > 2 ? atoll(argv[2]) : 50;
+
+  // 25 fps video with a key frame every 2 seconds, and 1024-sample AAC at 48 kHz
+  DTSC::Meta M;
+  M.setMaster(true);
+  M.reInit("", true);
+  M.setVod(true);
+  size_t vid = M.addTrack();
+  M.setType(vid, "video");
+  M.setCodec(vid, "H264");
+  size_t aud = M.addTrack();
+  M.setType(aud, "audio");
+  M.setCodec(aud, "AAC");
+  uint64_t start = Util::getMicros();
+  uint64_t duration = minutes * 60000;
+  uint64_t bpos = 0;
+  for (uint64_t f = 0; f * 40 < duration; ++f){
+    size_t size = (f % 50) ? 2000 + (f * 7919) % 6000 : 60000;
+    M.update(f * 40, 0, vid, size, bpos, !(f % 50));
+    bpos += size;
+  }
+  for (uint64_t f = 0; f * 64 / 3 < duration; ++f){
+    size_t size = 300 + (f * 131) % 100;
+    M.update(f * 64 / 3, 0, aud, size, bpos, !(f % 94));
+    bpos += size;
+  }
+  uint64_t partCount = DTSC::Parts(M.parts(vid)).getValidCount() + DTSC::Parts(M.parts(aud)).getValidCount();
+  fprintf(stderr, "Generated %" PRIu64 " minutes with %" PRIu64 " parts in %.1fms\n", minutes,
+          partCount, Util::getMicros(start) / 1000.0);
+
+  std::set<size_t> tracks;
+  tracks.insert(vid);
+  tracks.insert(aud);
+  MP4::ProgressiveIndex I;
+  start = Util::getMicros();
+  I.build(M, tracks);
+  I.key = MP4::ProgressiveIndex::fingerprint(M, tracks);
+  fprintf(stderr, "Built index of %" PRIu64 " bytes of media data with %zu checkpoints in %.1fms\n",
+          I.dataSize, I.getCheckpoints(), Util::getMicros(start) / 1000.0);
+
+  char fileName[64];
+  snprintf(fileName, 64, "/tmp/mp4indexbench.%d", getpid());
+  MP4::ProgressiveIndex L;
+  bool loaded = I.write(fileName) && L.read(fileName, I.key) && L.getCheckpoints() == I.getCheckpoints();
+  unlink(fileName);
+  if (!loaded){
+    fprintf(stderr, "Could not store and load the index\n");
+    return 1;
+  }
+
+  std::deque<MP4::IndexPart> first;
+  L.seek(0, first);
+  uint64_t walkMicros = 0, indexMicros = 0, walked = 0, indexWalked = 0;
+  for (size_t i = 0; i < lookups; ++i){
+    uint64_t offset = (I.dataSize / lookups) * i + (i * 104729) % (I.dataSize / lookups);
+    uint64_t w;
+    start = Util::getMicros();
+    MP4::IndexPart a = walk(M, first, 0, offset, w);
+    walkMicros += Util::getMicros(start);
+    walked += w;
+
+    start = Util::getMicros();
+    std::deque<MP4::IndexPart> next;
+    uint64_t pos = L.seek(offset, next);
+    MP4::IndexPart b = walk(M, next, pos, offset, w);
+    indexMicros += Util::getMicros(start);
+    indexWalked += w;
+
+    if (a.trackID != b.trackID || a.index != b.index || a.time != b.time){
+      fprintf(stderr, "Offset %" PRIu64 ": walk found %zu:%" PRIu64 "@%" PRIu64 ", index %zu:%" PRIu64 "@%" PRIu64 "\n",
+              offset, a.trackID, a.index, a.time, b.trackID, b.index, b.time);
+      return 1;
+    }
+  }
+  Bench::Report("mp4_index")
+      .add("minutes", minutes)
+      .add("parts", partCount)
+      .add("lookups", lookups)
+      .add("walk_us", (double)walkMicros / lookups, 1)
+      .add("walk_parts", (double)walked / lookups, 1)
+      .add("index_us", (double)indexMicros / lookups, 1)
+      .add("index_parts", (double)indexWalked / lookups, 1)
+      .print();
+  return 0;
+}
@@ -0,0 +1,76 @@
+/// \file raxbench.cpp
+/// Measures the cost of Util::RelAccX field access by name versus by precomputed field handle, on
+/// the page and key tables of an in-memory DTSC::Meta, as used for every buffered or sent packet.
+/// Usage: mistbench rax [iterations]
+#include "bench.h"
+#include <mist/dtsc.h>
+#include <mist/timing.h>
+#include <cstdio>
+#include <cstdlib>
+#include <inttypes.h>
+
+static uint64_t sink = 0;
+
+int Bench::raxBench(int argc, char **argv){
+  uint64_t iterations = argc > 1 ? atoll(argv[1]) : 10000000;
+  DTSC::Meta M;
+  M.setMaster(true);
+  M.reInit("", true);
+  size_t idx = M.addTrack();
+  M.setType(idx, "video");
+  M.setCodec(idx, "H264");
+  // Two seconds per key, 25 fps
+  for (uint64_t t = 0; t < 600000; t += 40){M.update(t, 0, idx, 5000, 0, !(t % 2000));}
+
+  // Fill the page table the way the live buffer does, spreading the keys evenly over all pages
+  Util::RelAccX &tPages = M.pages(idx);
+  DTSC::Pages pages = M.getPages(idx);
+  size_t keysPerPage = 300 / tPages.getRCount() + 1;
+  for (size_t i = 0; i < tPages.getRCount(); ++i){
+    tPages.addRecords(1);
+    pages.setFirstKey(i, i * keysPerPage);
+    pages.setKeycount(i, keysPerPage);
+    pages.setFirstTime(i, i * keysPerPage * 2000);
+    pages.setAvail(i, 1024 * 1024);
+  }
+  size_t pageCount = tPages.getEndPos();
+
+  uint64_t start = Util::getMicros();
+  for (uint64_t i = 0; i < iterations; ++i){sink += tPages.getInt("avail", i % pageCount);}
+  Bench::Report("rax").add("test", "page_avail_by_name").opTime(Util::getMicros(start), iterations).print();
+
+  start = Util::getMicros();
+  for (uint64_t i = 0; i < iterations; ++i){sink += pages.getAvail(i % pageCount);}
+  Bench::Report("rax").add("test", "page_avail_by_handle").opTime(Util::getMicros(start), iterations).print();
+
+  start = Util::getMicros();
+  for (uint64_t i = 0; i < iterations; ++i){tPages.setInt("avail", i, i % pageCount);}
+  Bench::Report("rax").add("test", "page_set_avail_by_name").opTime(Util::getMicros(start), iterations).print();
+
+  start = Util::getMicros();
+  for (uint64_t i = 0; i < iterations; ++i){pages.setAvail(i % pageCount, i);}
+  Bench::Report("rax").add("test", "page_set_avail_by_handle").opTime(Util::getMicros(start), iterations).print();
+
+  // Opening the keys of a track, which outputs do for nearly every packet they send
+  uint64_t keyOps = iterations / 10;
+  start = Util::getMicros();
+  for (uint64_t i = 0; i < keyOps; ++i){
+    DTSC::Keys keys(M.keys(idx));
+    sink += keys.getTime(i % keys.getEndValid());
+  }
+  Bench::Report("rax").add("test", "keys_open_by_name").opTime(Util::getMicros(start), keyOps).print();
+
+  start = Util::getMicros();
+  for (uint64_t i = 0; i < keyOps; ++i){
+    DTSC::Keys keys(M.getKeys(idx));
+    sink += keys.getTime(i % keys.getEndValid());
+  }
+  Bench::Report("rax").add("test", "keys_open_by_handle").opTime(Util::getMicros(start), keyOps).print();
+
+  start = Util::getMicros();
+  for (uint64_t i = 0; i < keyOps; ++i){sink += M.getPageNumberForKey(idx, i % 300);}
+  Bench::Report("rax").add("test", "page_for_key").opTime(Util::getMicros(start), keyOps).print();
+
+  fprintf(stderr, "(%" PRIu64 ")\n", sink);
+  return 0;
+}
@@ -0,0 +1,92 @@
+/// \file sendfilebench.cpp
+/// Measures loopback TCP throughput of sending a file through user space (pread + SendNow)
+/// versus Socket::Connection::sendFile, which lets the kernel send it straight from the page cache.
+/// Usage: mistbench sendfile [megabytes] [file]
+/// Without a file, a temporary file of the given size (default 1024 MiB) is created and removed.
+#include "bench.h"
+#include <mist/socket.h>
+#include <mist/timing.h>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <signal.h>
+#include <string>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/// Accepts a single connection and reads everything from it, then exits.
+static void drain(Socket::Server &srv){
+  Socket::Connection C = srv.accept();
+  char buf[65536];
+  while (read(C.getSocket(), buf, sizeof(buf)) > 0){}
+  _exit(0);
+}
+
+static void runOnce(const char *name, int fd, uint64_t size, bool kernel){
+  Socket::Server srv(0, std::string("127.0.0.1"));
+  std::string host;
+  uint32_t port;
+  Socket::getSocketName(srv.getSocket(), host, port);
+  pid_t pid = fork();
+  if (!pid){drain(srv);}
+  srv.drop();
+  Socket::Connection C("127.0.0.1", port, false);
+  uint64_t start = Util::getMicros();
+  if (kernel){
+    C.sendFile(fd, 0, size);
+  }else{
+    char buf[65536];
+    uint64_t offset = 0;
+    while (offset < size && C){
+      ssize_t r = pread(fd, buf, sizeof(buf), offset);
+      if (r <= 0){break;}
+      C.SendNow(buf, r);
+      offset += r;
+    }
+  }
+  uint64_t sent = C.dataUp();
+  C.close();
+  waitpid(pid, 0, 0);
+  uint64_t micros = Util::getMicros(start);
+  Bench::Report("sendfile").add("mode", name).throughput(micros, sent).print();
+}
+
+int Bench::sendFileBench(int argc, char **argv){
+  signal(SIGPIPE, SIG_IGN);
+  uint64_t size = (argc > 1 ? atoll(argv[1]) : 1024) * 1024 * 1024;
+  std::string path = argc > 2 ? argv[2] : "";
+  bool temporary = !path.size();
+  if (temporary){
+    char tmpName[] = "/tmp/sendfilebenchXXXXXX";
+    int tmpFd = mkstemp(tmpName);
+    if (tmpFd < 0){
+      fprintf(stderr, "Could not create temporary file\n");
+      return 1;
+    }
+    path = tmpName;
+    std::string block(1024 * 1024, 'x');
+    for (uint64_t i = 0; i < size; i += block.size()){
+      if (write(tmpFd, block.data(), block.size()) != (ssize_t)block.size()){
+        fprintf(stderr, "Could not fill temporary file\n");
+        unlink(tmpName);
+        return 1;
+      }
+    }
+    close(tmpFd);
+  }
+  int fd = open(path.c_str(), O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st)){
+    fprintf(stderr, "Could not open %s\n", path.c_str());
+    return 1;
+  }
+  size = st.st_size;
+  // Read the file once first, so both runs are served from the page cache
+  runOnce("warmup", fd, size, false);
+  runOnce("copy", fd, size, false);
+  runOnce("sendfile", fd, size, true);
+  close(fd);
+  if (temporary){unlink(path.c_str());}
+  return 0;
+}
@@ -0,0 +1,169 @@
+/// \file sessionbench.cpp
+/// Measures how fast new sessions are started, once with a MistSession process per session and once
+/// with a shared session tracker (MistSession --tracker). For every session, the time from asking
+/// for it until its connections page can be claimed is measured, the same way outputs wait for it.
+/// Also reports the total proportional memory use of all MistSession processes afterwards.
+/// Usage: mistbench session <path/to/MistSession> [sessions]
+#include "bench.h"
+#include <mist/comms.h>
+#include <mist/procs.h>
+#include <mist/shared_memory.h>
+#include <mist/timing.h>
+#include <mist/util.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <inttypes.h>
+#include <vector>
+
+/// Returns the proportional set size of the given process in kilobytes, or 0 if unknown.
+static uint64_t pssKb(pid_t pid){
+  char path[64];
+  snprintf(path, 64, "/proc/%d/smaps_rollup", (int)pid);
+  std::ifstream in(path);
+  std::string line;
+  while (std::getline(in, line)){
+    if (line.compare(0, 4, "Pss:") == 0){return strtoull(line.c_str() + 4, 0, 10);}
+  }
+  return 0;
+}
+
+static std::string sessId(const char *mode, size_t i){
+  char buf[40];
+  snprintf(buf, 40, "bench%s%zu", mode, i);
+  return buf;
+}
+
+/// Reports how many sessions started per second, and the mean and 99th percentile of their latency.
+static void reportLatency(const char *mode, size_t sessions, uint64_t micros, std::vector<uint64_t> &latency, uint64_t pss){
+  std::sort(latency.begin(), latency.end());
+  uint64_t sum = 0;
+  for (size_t i = 0; i < latency.size(); ++i){sum += latency[i];}
+  double mean = latency.size() ? sum / (double)latency.size() : 0;
+  uint64_t p99 = latency.size() ? latency[(latency.size() * 99) / 100 - (latency.size() >= 100 ? 1 : 0)] : 0;
+  Bench::Report("session")
+      .add("mode", mode)
+      .add("sessions", sessions)
+      .add("started", latency.size())
+      .add("sessions_per_s", micros ? latency.size() * 1000000.0 / micros : 0, 1)
+      .add("mean_ms", mean / 1000.0, 2)
+      .add("p99_ms", p99 / 1000.0, 2)
+      .add("pss_kb", pss)
+      .print();
+}
+
+/// Waits for the connections page of every session to be claimable, recording how long each took
+/// since it was requested. Sessions that do not start within 10 seconds are left out.
+static void waitForAll(const char *mode, size_t sessions, const std::vector<uint64_t> &asked,
+                       std::vector<Comms::Connections *> &conns, std::vector<uint64_t> &latency){
+  size_t done = 0;
+  uint64_t deadline = Util::getMicros() + 10000000;
+  while (done < sessions && Util::getMicros() < deadline){
+    for (size_t i = 0; i < sessions; ++i){
+      if (*conns[i]){continue;}
+      // Opening a page that does not exist yet backs off for a while, so check for it first
+      char pageName[NAME_BUFFER_SIZE];
+      snprintf(pageName, NAME_BUFFER_SIZE, COMMS_SESSIONS, sessId(mode, i).c_str());
+      IPC::sharedPage probe(pageName, 0, false, false);
+      if (!probe){continue;}
+      conns[i]->reload(sessId(mode, i), false, false);
+      if (*conns[i]){
+        latency.push_back(Util::getMicros() - asked[i]);
+        ++done;
+      }
+    }
+    if (done < sessions){Util::usleep(1000);}
+  }
+}
+
+static void runLegacy(const std::string &binary, size_t sessions){
+  std::vector<pid_t> pids;
+  std::vector<uint64_t> asked(sessions), latency;
+  std::vector<Comms::Connections *> conns;
+  uint64_t start = Util::getMicros();
+  for (size_t i = 0; i < sessions; ++i){
+    std::deque<std::string> args;
+    args.push_back(binary);
+    args.push_back(sessId("L", i));
+    args.push_back("--streamname");
+    args.push_back("bench");
+    args.push_back("--ip");
+    args.push_back("127.0.0.1");
+    args.push_back("--protocol");
+    args.push_back("HLS");
+    asked[i] = Util::getMicros();
+    pid_t pid = Util::Procs::StartPiped(args, 0, 0, 0);
+    if (pid){pids.push_back(pid);}
+    conns.push_back(new Comms::Connections());
+  }
+  waitForAll("L", sessions, asked, conns, latency);
+  uint64_t micros = Util::getMicros(start);
+  uint64_t pss = 0;
+  for (size_t i = 0; i < pids.size(); ++i){pss += pssKb(pids[i]);}
+  reportLatency("process", sessions, micros, latency, pss);
+
+  for (size_t i = 0; i < sessions; ++i){
+    conns[i]->unload();
+    delete conns[i];
+  }
+  for (size_t i = 0; i < pids.size(); ++i){Util::Procs::Stop(pids[i]);}
+  for (size_t i = 0; i < pids.size(); ++i){
+    while (Util::Procs::isActive(pids[i])){Util::sleep(10);}
+  }
+}
+
+static void runTracker(const std::string &binary, size_t sessions){
+  std::deque<std::string> args;
+  args.push_back(binary);
+  args.push_back("--tracker");
+  pid_t tracker = Util::Procs::StartPiped(args, 0, 0, 0);
+  Comms::SessionRequests req;
+  for (size_t i = 0; i < 500 && !req.open(); ++i){Util::sleep(10);}
+  if (!req.open()){
+    fprintf(stderr, "Session tracker did not start\n");
+    Util::Procs::Stop(tracker);
+    return;
+  }
+
+  std::vector<uint64_t> asked(sessions), latency;
+  std::vector<Comms::Connections *> conns;
+  uint64_t start = Util::getMicros();
+  for (size_t i = 0; i < sessions; ++i){
+    asked[i] = Util::getMicros();
+    req.submit(sessId("T", i), "bench", "127.0.0.1", "", "HLS", "");
+    conns.push_back(new Comms::Connections());
+  }
+  waitForAll("T", sessions, asked, conns, latency);
+  uint64_t micros = Util::getMicros(start);
+  reportLatency("tracker", sessions, micros, latency, pssKb(tracker));
+
+  for (size_t i = 0; i < sessions; ++i){
+    conns[i]->unload();
+    delete conns[i];
+  }
+  Util::Procs::Stop(tracker);
+  while (Util::Procs::isActive(tracker)){Util::sleep(10);}
+}
+
+int Bench::sessionBench(int argc, char **argv){
+  if (argc < 2){
+    fprintf(stderr, "Usage: mistbench %s <path/to/MistSession> [sessions]\n", argv[0]);
+    return 1;
+  }
+  std::string binary = argv[1];
+  size_t sessions = argc > 2 ? atoll(argv[2]) : 1000;
+  Util::sysSetNrOpenFiles(4 * sessions + 1024);
+  Util::Procs::setHandler();
+
+  // Sessions keep their statistics on the page the controller normally creates
+  Comms::Sessions statComm;
+  statComm.reload(true);
+  if (!statComm){
+    fprintf(stderr, "Could not create the statistics page\n");
+    return 1;
+  }
+  runLegacy(binary, sessions);
+  runTracker(binary, sessions);
+  return 0;
+}
@@ -0,0 +1,112 @@
+#include "../src/controller/controller_totals.cpp"
+#include <cstdio>
+#include <cstdlib>
+#include <inttypes.h>
+#include <mist/timing.h>
+#include <vector>
+
+/// A simulated session: its statistics, and what it added to the running totals
+struct session{
+  Controller::statStorage data;
+  Controller::sessionTotals totals;
+  Controller::sessType type;
+  uint64_t counters[Controller::STAT_COUNTERS];
+  bool done;
+};
+
+/// Feeds random sessions into the running totals the same way statSession does: every update
+/// adds the newest statistics, every stats pass forward-fills the active sessions up to now, and
+/// ending a session stops counting it. Sessions report irregularly, sometimes several times in the
+/// same second, and sometimes not at all for a while.
+/// The totals are then checked against the full recompute that totals requests used to do: every
+/// session counted for every second from its first statistics on, with the statistics it had at
+/// that second. Unlike the old recompute, a session that ended is only counted up to its last
+/// statistics, and packet counters are the ones of that second rather than the newest ones.
+int main(int argc, char **argv){
+  const char *streams[] = {"live", "vod", "live+one", "live+two"};
+  const char *protos[] = {"HLS", "WebRTC", "HTTP", "HLS,DASH"};
+  const size_t sessCount = 300;
+  const uint64_t duration = 300;
+  // Use times from now on, so nothing is older than the statistics cutoff
+  const uint64_t base = Util::bootSecs();
+  srand(1);
+
+  Controller::statTotals T;
+  std::vector<session> sessions(sessCount);
+  std::vector<uint64_t> startAt(sessCount), endAt(sessCount);
+  for (size_t s = 0; s < sessCount; ++s){
+    sessions[s].type = (Controller::sessType)(s % 5);
+    memset(sessions[s].counters, 0, sizeof(sessions[s].counters));
+    sessions[s].done = false;
+    startAt[s] = base + rand() % duration;
+    endAt[s] = (rand() % 3) ? startAt[s] + rand() % (base + duration - startAt[s]) : 0;
+  }
+  for (uint64_t now = base; now < base + duration; ++now){
+    for (size_t s = 0; s < sessCount; ++s){
+      session &S = sessions[s];
+      if (S.done || now < startAt[s]){continue;}
+      if (endAt[s] && now > endAt[s] && S.data.size()){
+        S.data.finish();
+        S.totals.update(T, S.data, S.type, S.data.getEnd());
+        S.done = true;
+        continue;
+      }
+      // Sessions go quiet for a while now and then
+      if (S.data.size() && rand() % 3 == 0){continue;}
+      size_t reports = (rand() % 10 == 0) ? 2 : 1;
+      for (size_t r = 0; r < reports; ++r){
+        S.counters[Controller::STAT_DOWN] += rand() % 100000;
+        S.counters[Controller::STAT_UP] += rand() % 1000;
+        S.counters[Controller::STAT_PKTCOUNT] += rand() % 50;
+        S.counters[Controller::STAT_PKTLOST] += rand() % 5;
+        S.counters[Controller::STAT_PKTRETRANSMIT] += rand() % 3;
+        S.data.update(now, now - startAt[s], 0, S.counters, streams[s % 4], "127.0.0.1", protos[(s / 4) % 4]);
+        S.totals.update(T, S.data, S.type, S.data.getEnd());
+      }
+    }
+    // The stats pass
+    for (size_t s = 0; s < sessCount; ++s){
+      if (sessions[s].data.getFirstActive()){sessions[s].totals.update(T, sessions[s].data, sessions[s].type, now);}
+    }
+  }
+  const uint64_t last = base + duration - 1;
+
+  size_t failures = 0;
+  for (size_t f = 0; f < 20; ++f){
+    std::set<std::string> wantStreams, wantProtos;
+    if (f & 1){wantStreams.insert(streams[f % 4]);}
+    if (f & 2){wantProtos.insert(protos[(f / 4) % 4]);}
+    uint64_t reqStart = base + rand() % duration;
+    uint64_t reqEnd = reqStart + rand() % (last - reqStart + 1);
+
+    std::map<uint64_t, Controller::totalsData> incremental, full;
+    T.fill(reqStart, reqEnd, wantStreams, wantProtos, incremental);
+    for (size_t s = 0; s < sessCount; ++s){
+      const Controller::statStorage &D = sessions[s].data;
+      if (!D.size()){continue;}
+      const Controller::statLabels &L = D.getLabels(0);
+      if (wantStreams.size() && !wantStreams.count(L.streamName)){continue;}
+      if (wantProtos.size() && !wantProtos.count(L.connectors)){continue;}
+      uint64_t lastReal = sessions[s].done ? D.getEnd() - 1 : last;
+      for (uint64_t i = reqStart; i <= reqEnd && i <= lastReal; ++i){
+        if (!D.hasDataFor(i)){continue;}
+        size_t pos = D.getPos(i);
+        full[i].add(D.getBps(i, Controller::STAT_DOWN), D.getBps(i, Controller::STAT_UP), sessions[s].type,
+                    D.getCounter(pos, Controller::STAT_PKTCOUNT), D.getCounter(pos, Controller::STAT_PKTLOST),
+                    D.getCounter(pos, Controller::STAT_PKTRETRANSMIT));
+      }
+    }
+    if (incremental.size() != full.size()){
+      fprintf(stderr, "Filter %zu: %zu seconds instead of %zu\n", f, incremental.size(), full.size());
+      ++failures;
+      continue;
+    }
+    for (std::map<uint64_t, Controller::totalsData>::iterator it = full.begin(); it != full.end(); ++it){
+      if (!incremental.count(it->first) || !(incremental[it->first] == it->second)){
+        fprintf(stderr, "Filter %zu: totals for second %" PRIu64 " differ\n", f, it->first - base);
+        ++failures;
+      }
+    }
+  }
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,134 @@
+#include <mist/defines.h>
+#include <mist/http_parser.h>
+#include <mist/shared_memory.h>
+#include <mist/socket.h>
+#include <mist/timing.h>
+#include <mist/tinythread.h>
+#include <mist/triggers.h>
+#include <arpa/inet.h>
+#include <cstdio>
+#include <cstdlib>
+#include <inttypes.h>
+#include <set>
+#include <signal.h>
+#include <sys/socket.h>
+
+/// Mock trigger handler: answers every POST with "true" over keep-alive connections, except for
+/// the first few, which fail so the dispatcher has to retry them.
+/// With closeAfterOne set it behaves like handlers that close the connection after every response.
+static tthread::mutex mockMutex;
+static bool closeAfterOne = false;
+static std::set<std::string> received;
+static size_t requests = 0;
+static size_t connections = 0;
+static const size_t failFirst = 5;
+/// Kept until after queued triggers are sent on exit
+static IPC::sharedPage globCfg;
+
+static void handleConn(void *c){
+  Socket::Connection *conn = (Socket::Connection *)c;
+  HTTP::Parser H;
+  while (*conn){
+    if (!conn->spool() && !conn->Received().size()){
+      Util::sleep(1);
+      continue;
+    }
+    while (H.Read(*conn)){
+      bool fail;
+      {
+        tthread::lock_guard<tthread::mutex> guard(mockMutex);
+        fail = (++requests <= failFirst);
+        if (!fail && H.GetHeader("X-Trigger") == "TEST_TRIGGER"){received.insert(H.body);}
+      }
+      H.Clean();
+      H.SetBody(fail ? "busy" : "true");
+      H.SendResponse(fail ? "503" : "200", fail ? "Service Unavailable" : "OK", *conn);
+      H.Clean();
+      if (closeAfterOne){break;}
+    }
+    if (closeAfterOne){break;}
+  }
+  conn->close();
+  delete conn;
+}
+
+static void mockServer(void *s){
+  Socket::Server *srv = (Socket::Server *)s;
+  while (srv->connected()){
+    Socket::Connection C = srv->accept(true);
+    if (!C){
+      Util::sleep(5);
+      continue;
+    }
+    {
+      tthread::lock_guard<tthread::mutex> guard(mockMutex);
+      ++connections;
+    }
+    tthread::thread T(handleConn, new Socket::Connection(C));
+    T.detach();
+  }
+}
+
+/// Fires asynchronous HTTP triggers at a local mock handler, and checks that every one of them is
+/// delivered exactly once, without opening a connection per trigger.
+/// Given "close" as argument, the handler closes every connection after one response instead, and
+/// the triggers must still all be delivered.
+int main(int argc, char **argv){
+  const size_t count = 500;
+  closeAfterOne = (argc > 1 && std::string(argv[1]) == "close");
+  // Writes to connections the handler just closed must fail instead of killing us, as in the controller
+  signal(SIGPIPE, SIG_IGN);
+  // Triggers read the instance name from the global configuration a controller normally provides
+  globCfg.init(SHM_GLOBAL_CONF, 0, false, false);
+  if (!globCfg){
+    globCfg.init(SHM_GLOBAL_CONF, 4096, true, false);
+    Util::RelAccX globAccX(globCfg.mapped, false);
+    globAccX.addField("udpApi", RAX_128STRING);
+    globAccX.addField("iid", RAX_64STRING);
+    globAccX.addField("hrn", RAX_128STRING);
+    globAccX.setRCount(1);
+    globAccX.setEndPos(1);
+    globAccX.setReady();
+    globAccX.setString("udpApi", "udp://127.0.0.1:9");
+  }
+  // The mock handler keeps running until the process exits
+  Socket::Server *srv = new Socket::Server(0, "127.0.0.1", true);
+  if (!srv->connected()){return 1;}
+  struct sockaddr_storage addr;
+  socklen_t len = sizeof(addr);
+  getsockname(srv->getSocket(), (struct sockaddr *)&addr, &len);
+  int port = ntohs(addr.ss_family == AF_INET6 ? ((struct sockaddr_in6 *)&addr)->sin6_port
+                                              : ((struct sockaddr_in *)&addr)->sin_port);
+  tthread::thread server(mockServer, srv);
+  server.detach();
+
+  char url[64];
+  snprintf(url, 64, "http://127.0.0.1:%d/trigger", port);
+  uint64_t start = Util::bootMS();
+  for (size_t i = 0; i < count; ++i){
+    char payload[32];
+    snprintf(payload, 32, "stream\n%zu", i);
+    Triggers::handleTrigger("TEST_TRIGGER", url, payload, 0, "true");
+  }
+  uint64_t queued = Util::bootMS() - start;
+
+  size_t got = 0;
+  while (Util::bootMS() < start + 20000){
+    {
+      tthread::lock_guard<tthread::mutex> guard(mockMutex);
+      got = received.size();
+    }
+    if (got == count){break;}
+    Util::sleep(10);
+  }
+  tthread::lock_guard<tthread::mutex> guard(mockMutex);
+  fprintf(stderr, "Queued %zu triggers in %" PRIu64 "ms, %zu delivered over %zu connections in %zu requests\n",
+          count, queued, got, connections, requests);
+  if (got != count){return 1;}
+  // Each connection only gets to answer its first request, so nothing else is worth checking
+  if (closeAfterOne){return 0;}
+  if (requests != count + failFirst){return 1;}
+  // One connection, plus one for every retry after a failure
+  if (connections > failFirst + 1){return 1;}
+  return 0;
+}